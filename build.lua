@@ -24,6 +24,7 @@ local options = {
 	tb            = false,
 	tb_unittests  = false,
 	driver        = false,
+	client        = false,
 	shared        = false,
 	test          = false,
 	forth         = false,
@@ -46,6 +47,8 @@ local modules = {
 	-- executables:
 	--   Cuik command line
 	driver       = { is_exe=true, srcs={"main/main_driver.c"}, deps={"common", "cuik", "tb"} },
+	--   thin client for `cuik -server`
+	client       = { is_exe=true, srcs={"main/client.c"}, deps={"common"} },
 	--   forth
 	forth        = { is_exe=true, srcs={"forth/forth.c"}, deps={"common", "tb"}, flags="-I libCuik/include" },
 	--   TB unittests
@@ -126,7 +129,7 @@ if is_windows then
 else
 	ld = cc
 	cflags = cflags.." -D_GNU_SOURCE"
-	ldflags = ldflags.." -g -lc -lm "
+	ldflags = ldflags.." -g -lc -lm -ldl "
 
 	if options.lld then
 		ldflags = ldflags.." -fuse-ld=lld"
@@ -276,6 +279,7 @@ local exe_name = "cuik"
 if options.tb           then exe_name = "tb" end
 if options.tb_unittests then exe_name = "tb_unittests" end
 if options.forth        then exe_name = "forth" end
+if options.client       then exe_name = "cuik_client" end
 
 -- placing executables into bin/
 exe_name = "bin/"..exe_name
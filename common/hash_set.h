@@ -111,7 +111,9 @@ bool nl_hashset_put(NL_HashSet* restrict hs, void* ptr) {
         assert(hs->allocator == NULL && "arena hashsets can't be resized!");
         NL_HashSet new_hs = nl_hashset_alloc(nl_hashset_capacity(hs));
         nl_hashset_for(p, hs) {
-            nl_hashset_put(&new_hs, *p);
+            if (*p != NL_HASHSET_TOMB) {
+                nl_hashset_put(&new_hs, *p);
+            }
         }
         nl_hashset_free(*hs);
         *hs = new_hs;
@@ -182,7 +184,10 @@ void* nl_hashset_put2(NL_HashSet* restrict hs, void* ptr, NL_HashFunc hash, NL_C
 
     NL_HashSet new_hs = nl_hashset_alloc(nl_hashset_capacity(hs));
     nl_hashset_for(p, hs) {
-        nl_hashset_put2(&new_hs, *p, hash, cmp);
+        // tombstones don't need to survive the rehash (and can't be hashed anyways)
+        if (*p != NL_HASHSET_TOMB) {
+            nl_hashset_put2(&new_hs, *p, hash, cmp);
+        }
     }
     nl_hashset_free(*hs);
     *hs = new_hs;
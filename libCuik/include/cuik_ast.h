@@ -515,6 +515,8 @@ struct Stmt {
         } expr;
         struct StmtReturn {
             Cuik_Expr* expr;
+            // [[clang::musttail]], expr must be a call and it'll become a tail call
+            bool musttail;
         } return_;
         struct StmtContinue {
             Stmt* target; // loop
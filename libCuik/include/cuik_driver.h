@@ -30,9 +30,25 @@ struct Cuik_DriverArgs {
     Cuik_Toolchain toolchain;
 
     int threads, opt_level;
+
+    // if non-zero, every group of shard_size TUs gets its own TB_Module
+    int shard_size;
     const char* output_name;
     const char* entrypoint;
 
+    // profile file paths (-fprofile-generate, -fprofile-use)
+    const char* profile_generate;
+    const char* profile_use;
+
+    // size in MiB of the module's code reservation (-fcode-reserve), 0 means none
+    size_t code_reserve;
+
+    // scheduling model name (-mtune), NULL is generic
+    const char* tune;
+
+    // what main() returned under -r
+    int run_status;
+
     void* diag_userdata;
     Cuik_DiagCallback diag_callback;
 
@@ -153,6 +169,10 @@ CUIK_API Cuik_BuildStep* cuik_driver_cc(Cuik_DriverArgs* args, const char* sourc
 CUIK_API Cuik_BuildStep* cuik_driver_ld(Cuik_DriverArgs* args, int dep_count, Cuik_BuildStep** deps);
 
 CUIK_API TranslationUnit* cuik_driver_cc_get_tu(Cuik_BuildStep* s);
+
+// only filled in when args->live is set, these are all the files
+// the preprocessor opened (main file & headers).
+CUIK_API const char** cuik_driver_cc_get_files(Cuik_BuildStep* s, size_t* out_count);
 CUIK_API CompilationUnit* cuik_driver_ld_get_cu(Cuik_BuildStep* s);
 
 // returns true on success
@@ -163,6 +183,9 @@ CUIK_API void cuik_step_free(Cuik_BuildStep* s);
 
 CUIK_API bool cuik_driver_does_codegen(const Cuik_DriverArgs* args);
 
+// whether -r can jump into the code for args->target, prints why not
+CUIK_API bool cuik_driver_can_run(const Cuik_DriverArgs* args);
+
 ////////////////////////////////
 // Scheduling
 ////////////////////////////////
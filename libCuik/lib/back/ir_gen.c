@@ -10,6 +10,9 @@ static thread_local const char* function_name;
 
 static thread_local TB_PassingRule func_return_rule;
 
+// the call in a musttail return, it emits the return on its own
+static thread_local Subexpr* tail_call_expr;
+
 static _Thread_local TB_Node* current_scope;
 
 static void emit_location(TranslationUnit* tu, TB_Function* func, SourceLoc loc);
@@ -42,6 +45,22 @@ static TB_Symbol* get_external(CompilationUnit* restrict cu, const char* name) {
     return result;
 }
 
+// declarations get an external the first time anything points at them, get_external
+// hands back the real thing if another TU already defined it.
+static TB_Symbol* get_decl_symbol(TranslationUnit* tu, Stmt* stmt) {
+    if (stmt->backing.s == NULL) {
+        const char* name = (const char*) stmt->decl.name;
+
+        if (tu->parent != NULL) {
+            stmt->backing.s = get_external(tu->parent, name);
+        } else {
+            stmt->backing.e = tb_extern_create(tu->ir_mod, -1, name, TB_EXTERNAL_SO_LOCAL);
+        }
+    }
+
+    return stmt->backing.s;
+}
+
 static TB_Global* place_external(CompilationUnit* restrict cu, TranslationUnit* tu, Stmt* stmt, TB_DebugType* dbg_type, TB_Linkage linkage) {
     const char* name = stmt->decl.name;
     if (stmt->flags & STMT_FLAGS_IS_EXPORTED) {
@@ -310,6 +329,9 @@ static TB_Node* cvt2rval(TranslationUnit* tu, TB_Function* func, IRVal* v) {
                 reg = v->reg;
             } else {
                 reg = tb_inst_load(func, ctype_to_tbtype(src), v->reg, src->align, is_volatile);
+                if (!is_volatile) {
+                    tb_function_attrib_type_class(func, reg, ctype_to_alias_class(v, src));
+                }
             }
             break;
         }
@@ -421,16 +443,6 @@ static int pass_parameter(TranslationUnit* tu, TB_Function* func, TB_PassingRule
     }
 }
 
-int count_max_tb_init_objects(InitNode* root_node) {
-    int sum = root_node->kids_count;
-    for (InitNode* k = root_node->kid; k != NULL; k = k->next) {
-        sum += count_max_tb_init_objects(k);
-        if (k->expr && get_root_subexpr(k->expr)->op == EXPR_ADDR) sum += 1;
-    }
-
-    return sum;
-}
-
 static void eval_local_initializer(TranslationUnit* tu, TB_Function* func, TB_Node* addr, InitNode* n) {
     if (n->kid != NULL) {
         for (InitNode* k = n->kid; k != NULL; k = k->next) {
@@ -480,8 +492,56 @@ TB_ModuleSectionHandle get_variable_storage(TB_Module* m, const Attribs* attrs,
     }
 }
 
-static void eval_global_initializer(TranslationUnit* tu, TB_Global* g, InitNode* n, int offset);
-static void gen_global_initializer(TranslationUnit* tu, TB_Global* g, Cuik_Type* type, Cuik_Expr* e, size_t offset) {
+// global initializers are written into one contiguous region (allocated on
+// first non-zero write) rather than a region per element, big tables would
+// otherwise turn into thousands of tiny heap allocations. only relocations
+// end up as separate init objects.
+typedef struct {
+    TB_Global* g;
+    size_t size;
+    uint8_t* data;
+} GlobalBulk;
+
+static uint8_t* bulk_region(TranslationUnit* tu, GlobalBulk* b, size_t offset) {
+    if (b->data == NULL) {
+        b->data = tb_global_add_region(tu->ir_mod, b->g, 0, b->size);
+        memset(b->data, 0, b->size);
+    }
+
+    return &b->data[offset];
+}
+
+// upper bound on the number of relocations, plain literals never produce one
+static int count_global_init_relocs(InitNode* n) {
+    if (n->kid == NULL) {
+        Subexpr* s = n->expr ? get_root_subexpr(n->expr) : NULL;
+        if (s == NULL) return 0;
+
+        switch (s->op) {
+            case EXPR_INT: case EXPR_CHAR: case EXPR_WCHAR: case EXPR_ENUM:
+            case EXPR_FLOAT32: case EXPR_FLOAT64:
+            return 0;
+
+            case EXPR_STR: case EXPR_WSTR:
+            return cuik_canonical_type(n->type)->kind == KIND_PTR;
+
+            case EXPR_INITIALIZER:
+            return count_global_init_relocs(s->init.root);
+
+            default:
+            return 1;
+        }
+    }
+
+    int sum = 0;
+    for (InitNode* k = n->kid; k != NULL; k = k->next) {
+        sum += count_global_init_relocs(k);
+    }
+    return sum;
+}
+
+static void eval_global_initializer(TranslationUnit* tu, GlobalBulk* b, InitNode* n, int offset);
+static void gen_global_initializer(TranslationUnit* tu, GlobalBulk* b, Cuik_Type* type, Cuik_Expr* e, size_t offset) {
     assert(type != NULL);
     size_t type_size = type->size;
 
@@ -505,10 +565,10 @@ static void gen_global_initializer(TranslationUnit* tu, TB_Global* g, Cuik_Type*
             char* dst = tb_global_add_region(tu->ir_mod, dummy, 0, len);
             memcpy(dst, s->str.start, len);
 
-            tb_global_add_symbol_reloc(tu->ir_mod, g, offset, (TB_Symbol*) dummy);
+            tb_global_add_symbol_reloc(tu->ir_mod, b->g, offset, (TB_Symbol*) dummy);
         } else {
-            char* dst = tb_global_add_region(tu->ir_mod, g, offset, type->size);
-            memcpy(dst, s->str.start, len);
+            // char arrays can be bigger than the literal, the rest stays zeroed
+            memcpy(bulk_region(tu, b, offset), s->str.start, len < type_size ? len : type_size);
         }
         return;
     }
@@ -516,7 +576,7 @@ static void gen_global_initializer(TranslationUnit* tu, TB_Global* g, Cuik_Type*
     // try to emit global initializer
     if (s->op == EXPR_INITIALIZER) {
         Subexpr* s = get_root_subexpr(e);
-        eval_global_initializer(tu, g, s->init.root, offset);
+        eval_global_initializer(tu, b, s->init.root, offset);
         return;
     }
 
@@ -528,7 +588,7 @@ static void gen_global_initializer(TranslationUnit* tu, TB_Global* g, Cuik_Type*
             Stmt* stmt = e->exprs[value.s.base].sym.stmt;
             assert((stmt->op == STMT_GLOBAL_DECL || stmt->op == STMT_FUNC_DECL) && "could not resolve as constant initializer");
 
-            tb_global_add_symbol_reloc(tu->ir_mod, g, offset, stmt->backing.s);
+            tb_global_add_symbol_reloc(tu->ir_mod, b->g, offset, get_decl_symbol(tu, stmt));
             int_form = value.s.offset;
         } else if (value.tag == CUIK_CONST_INT) {
             int_form = value.i;
@@ -548,7 +608,7 @@ static void gen_global_initializer(TranslationUnit* tu, TB_Global* g, Cuik_Type*
         }
 
         if (int_form != 0) {
-            uint8_t* region = tb_global_add_region(tu->ir_mod, g, offset, type_size);
+            uint8_t* region = bulk_region(tu, b, offset);
 
             if (TARGET_NEEDS_BYTESWAP(tu->target)) {
                 // reverse copy
@@ -569,15 +629,35 @@ static void gen_global_initializer(TranslationUnit* tu, TB_Global* g, Cuik_Type*
     abort();
 }
 
-static void eval_global_initializer(TranslationUnit* tu, TB_Global* g, InitNode* n, int offset) {
+static void eval_global_initializer(TranslationUnit* tu, GlobalBulk* b, InitNode* n, int offset) {
     if (n->kid != NULL) {
         for (InitNode* k = n->kid; k != NULL; k = k->next) {
-            eval_global_initializer(tu, g, k, offset);
+            eval_global_initializer(tu, b, k, offset);
         }
     } else {
         Cuik_Type* child_type = cuik_canonical_type(n->type);
-        gen_global_initializer(tu, g, child_type, n->expr, offset + n->offset);
+        gen_global_initializer(tu, b, child_type, n->expr, offset + n->offset);
+    }
+}
+
+// sets up the storage for g and fills in its initializer
+static void gen_global(TranslationUnit* tu, TB_Global* g, TB_ModuleSectionHandle section, Cuik_Type* type, Cuik_Expr* initial) {
+    Subexpr* root = initial ? get_root_subexpr(initial) : NULL;
+
+    // one object for the bulk region and the rest are relocations
+    int max_tb_objects = 0;
+    if (root == NULL) {
+        max_tb_objects = 0;
+    } else if (root->op == EXPR_INITIALIZER) {
+        max_tb_objects = 1 + count_global_init_relocs(root->init.root);
+    } else {
+        max_tb_objects = 2;
     }
+
+    tb_global_set_storage(tu->ir_mod, section, g, type->size, type->align, max_tb_objects);
+
+    GlobalBulk b = { g, type->size };
+    gen_global_initializer(tu, &b, type, initial, 0);
 }
 
 static void insert_label(TB_Function* func) {
@@ -729,22 +809,10 @@ static IRVal irgen_subexpr(TranslationUnit* tu, TB_Function* func, Cuik_Expr* _,
                     .reg = tb_inst_get_symbol_address(func, stmt->backing.s),
                 };
             } else if (type->kind == KIND_FUNC || stmt->op == STMT_GLOBAL_DECL || (stmt->op == STMT_DECL && stmt->decl.attrs.is_static)) {
-                if (stmt->backing.s == NULL) {
-                    // check if it's defined by another TU
-                    // functions are external by default
-                    const char* name = (const char*) stmt->decl.name;
-
-                    if (tu->parent != NULL) {
-                        stmt->backing.s = get_external(tu->parent, name);
-                    } else {
-                        stmt->backing.e = tb_extern_create(tu->ir_mod, -1, name, TB_EXTERNAL_SO_LOCAL);
-                    }
-                }
-
-                assert(stmt->backing.s != NULL);
+                // functions are external by default
                 return (IRVal){
                     .value_type = LVALUE,
-                    .reg = tb_inst_get_symbol_address(func, stmt->backing.s),
+                    .reg = tb_inst_get_symbol_address(func, get_decl_symbol(tu, stmt)),
                 };
             } else {
                 return (IRVal){
@@ -784,12 +852,14 @@ static IRVal irgen_subexpr(TranslationUnit* tu, TB_Function* func, Cuik_Expr* _,
             } else {
                 return (IRVal){
                     .value_type = LVALUE,
+                    .may_pun = lhs.may_pun || cuik_canonical_type(lhs.type)->kind == KIND_UNION,
                     .reg = tb_inst_member_access(func, lhs.reg, e->dot_arrow.offset),
                 };
             }
         }
         case EXPR_ARROW_R: {
             TB_Node* src = RVAL(0);
+            Cuik_Type* record = cuik_canonical_type(cuik_canonical_type(GET_ARG(0).type)->ptr_to);
 
             Member* member = e->dot_arrow.member;
             assert(member != NULL);
@@ -806,6 +876,7 @@ static IRVal irgen_subexpr(TranslationUnit* tu, TB_Function* func, Cuik_Expr* _,
             } else {
                 return (IRVal){
                     .value_type = LVALUE,
+                    .may_pun = record->kind == KIND_UNION,
                     .reg = tb_inst_member_access(func, src, e->dot_arrow.offset),
                 };
             }
@@ -903,6 +974,17 @@ static IRVal irgen_subexpr(TranslationUnit* tu, TB_Function* func, Cuik_Expr* _,
             }
             assert(ir_arg_count == real_arg_count);
 
+            if (e == tail_call_expr && return_rule != TB_PASSING_INDIRECT) {
+                tb_inst_tailcall(func, call_prototype, target_node, real_arg_count, ir_args);
+                tls_restore(ir_args);
+
+                tail_call_expr = NULL;
+                return (IRVal){
+                    .value_type = RVALUE,
+                    .reg = NULL,
+                };
+            }
+
             TB_MultiOutput out = tb_inst_call(func, call_prototype, target_node, real_arg_count, ir_args);
             tls_restore(ir_args);
 
@@ -1246,7 +1328,10 @@ static IRVal irgen_subexpr(TranslationUnit* tu, TB_Function* func, Cuik_Expr* _,
             // writeback (the atomic form does this all in one go... as atomics do)
             if (!CUIK_QUAL_TYPE_HAS(GET_TYPE(), CUIK_QUAL_ATOMIC)) {
                 assert(address.value_type == LVALUE);
-                tb_inst_store(func, dt, address.reg, operation, type->align, is_volatile);
+                TB_Node* st = tb_inst_store(func, dt, address.reg, operation, type->align, is_volatile);
+                if (!is_volatile) {
+                    tb_function_attrib_type_class(func, st, ctype_to_alias_class(&address, type));
+                }
             }
 
             return (IRVal){
@@ -1386,7 +1471,10 @@ static IRVal irgen_subexpr(TranslationUnit* tu, TB_Function* func, Cuik_Expr* _,
                     }
 
                     assert(lhs.value_type == LVALUE);
-                    tb_inst_store(func, dt, lhs.reg, data, type->align, is_volatile);
+                    TB_Node* st = tb_inst_store(func, dt, lhs.reg, data, type->align, is_volatile);
+                    if (!is_volatile) {
+                        tb_function_attrib_type_class(func, st, ctype_to_alias_class(&lhs, type));
+                    }
                 } else {
                     TB_Node* r = cvt2rval(tu, func, &rhs);
                     TB_ArithmeticBehavior ab = type->is_unsigned ? 0 : TB_ARITHMATIC_NSW;
@@ -1429,7 +1517,10 @@ static IRVal irgen_subexpr(TranslationUnit* tu, TB_Function* func, Cuik_Expr* _,
                         assert(lhs.value_type == LVALUE);
                     }
 
-                    tb_inst_store(func, dt, lhs.reg, data, type->align, is_volatile);
+                    TB_Node* st = tb_inst_store(func, dt, lhs.reg, data, type->align, is_volatile);
+                    if (!is_volatile) {
+                        tb_function_attrib_type_class(func, st, ctype_to_alias_class(&lhs, type));
+                    }
 
                     if (e->op == EXPR_ASSIGN) {
                         assert(data);
@@ -1607,22 +1698,7 @@ static void irgen_stmt(TranslationUnit* tu, TB_Function* func, Stmt* restrict s)
                 tls_restore(name);
 
                 TB_ModuleSectionHandle section = get_variable_storage(tu->ir_mod, &attrs, s->decl.type.raw & CUIK_QUAL_CONST);
-
-                int max_tb_objects = 0;
-                if (s->decl.initial != NULL) {
-                    Subexpr* initial = get_root_subexpr(s->decl.initial);
-
-                    if (initial->op == EXPR_ADDR) {
-                        max_tb_objects = 2;
-                    } else if (initial->op == EXPR_INITIALIZER) {
-                        max_tb_objects = count_max_tb_init_objects(initial->init.root);
-                    } else {
-                        max_tb_objects = 1;
-                    }
-                }
-
-                tb_global_set_storage(tu->ir_mod, section, g, type->size, type->align, max_tb_objects);
-                gen_global_initializer(tu, g, type, s->decl.initial, 0);
+                gen_global(tu, g, section, type, s->decl.initial);
 
                 if (attrs.is_tls) {
                     tb_module_set_tls_index(tu->ir_mod, -1, "_tls_index");
@@ -1679,7 +1755,15 @@ static void irgen_stmt(TranslationUnit* tu, TB_Function* func, Stmt* restrict s)
                 break;
             }
 
+            if (s->return_.musttail) {
+                tail_call_expr = get_root_subexpr(s->return_.expr);
+            }
+
             IRVal v = irgen_expr(tu, func, s->return_.expr);
+            if (s->return_.musttail && tail_call_expr == NULL) {
+                break;
+            }
+            tail_call_expr = NULL;
 
             Cuik_Type* type = cuik_canonical_type(get_root_cast(s->return_.expr));
             if (func_return_rule == TB_PASSING_INDIRECT) {
@@ -1888,8 +1972,6 @@ static void irgen_stmt(TranslationUnit* tu, TB_Function* func, Stmt* restrict s)
                 head->backing.r = label;
 
                 if (head->op == STMT_CASE) {
-                    assert(head->case_.key_max < UINT32_MAX);
-
                     intmax_t end = head->case_.key_max;
                     for (intmax_t i = head->case_.key; i <= end; i++) {
                         tls_push(sizeof(TB_SwitchEntry));
@@ -1965,6 +2047,15 @@ TB_Symbol* cuikcg_top_level(TranslationUnit* restrict tu, TB_Module* m, TB_Arena
             func_return_rule = TB_PASSING_DIRECT;
         }
 
+        // restrict pointers get to promise the optimizer they're the only way to
+        // reach their pointee.
+        for (size_t i = 0; i < param_count; i++) {
+            Cuik_QualType param_type = type->func.param_list[i].type;
+            if (CUIK_QUAL_TYPE_HAS(param_type, CUIK_QUAL_RESTRICT) && cuik_canonical_type(param_type)->kind == KIND_PTR) {
+                tb_function_attrib_restrict(func, tb_inst_param(func, i + (func_return_rule == TB_PASSING_INDIRECT)));
+            }
+        }
+
         // mark where the return site is
         if (tu->has_tb_debug_info) {
             SourceLoc loc = s->decl.initial_as_stmt->loc.end;
@@ -2000,23 +2091,9 @@ TB_Symbol* cuikcg_top_level(TranslationUnit* restrict tu, TB_Module* m, TB_Arena
         return (TB_Symbol*) func;
     } else if (s->flags & STMT_FLAGS_HAS_IR_BACKING) {
         Cuik_Type* type = cuik_canonical_type(s->decl.type);
-        Subexpr* initial = get_root_subexpr(s->decl.initial);
 
         TB_ModuleSectionHandle section = get_variable_storage(tu->ir_mod, &s->decl.attrs, s->decl.type.raw & CUIK_QUAL_CONST);
-        int max_tb_objects;
-        if (initial == NULL) {
-            tb_global_set_storage(tu->ir_mod, section, (TB_Global*) s->backing.s, type->size, type->align, 0);
-            return s->backing.s;
-        } else if (initial->op == EXPR_ADDR) {
-            max_tb_objects = 2;
-        } else if (initial->op == EXPR_INITIALIZER) {
-            max_tb_objects = count_max_tb_init_objects(initial->init.root);
-        } else {
-            max_tb_objects = 1;
-        }
-
-        tb_global_set_storage(tu->ir_mod, section, (TB_Global*) s->backing.s, type->size, type->align, max_tb_objects);
-        gen_global_initializer(tu, (TB_Global*) s->backing.s, type, s->decl.initial, 0);
+        gen_global(tu, (TB_Global*) s->backing.s, section, type, s->decl.initial);
         return s->backing.s;
     }
 
@@ -22,6 +22,10 @@ typedef struct IRVal {
     IRValType value_type;
     Cuik_QualType type, cast_type;
 
+    // lvalue is reached through a union member, those are allowed to
+    // type pun so they can't take part in strict aliasing.
+    bool may_pun;
+
     union {
         TB_Node* reg;
         TB_Symbol* sym;
@@ -75,7 +79,32 @@ static TB_DataType ctype_to_tbtype(const Cuik_Type* t) {
     }
 }
 
-int count_max_tb_init_objects(InitNode* root_node);
+// strict aliasing buckets for tb_function_attrib_type_class, 0 is the "aliases
+// anything" class which covers the character types, union members and anything
+// we're not sure about. signedness doesn't matter and enums alias their underlying
+// integer.
+static int ctype_to_alias_class(const IRVal* v, const Cuik_Type* t) {
+    if (v->may_pun) {
+        return 0;
+    }
+
+    switch (t->kind) {
+        case KIND_SHORT:
+        case KIND_INT:
+        case KIND_ENUM:
+        case KIND_LONG:
+        case KIND_LLONG:
+        return t->size == 2 ? 1 : t->size == 4 ? 2 : t->size == 8 ? 3 : 0;
+
+        case KIND_FLOAT:  return 4;
+        case KIND_DOUBLE: return 5;
+        case KIND_PTR:    return 6;
+
+        default:
+        return 0;
+    }
+}
+
 TB_DebugType* cuik__as_tb_debug_type(TB_Module* mod, Cuik_Type* t);
 
 static void irgen_stmt(TranslationUnit* tu, TB_Function* func, Stmt* restrict s);
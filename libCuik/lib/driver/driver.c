@@ -15,6 +15,10 @@
 #include <stdatomic.h>
 #endif
 
+// callees at most this many IR nodes get inlined, it's roughly
+// what a few field accesses or a small helper turn into.
+#define CUIK_INLINE_BUDGET 40
+
 // this is used by the worker routines
 typedef struct {
     Cuik_BuildStep* step;
@@ -57,11 +61,21 @@ struct Cuik_BuildStep {
             TB_Arena arena;
             Cuik_CPP* cpp;
             TranslationUnit* tu;
+
+            // every file the preprocessor touched, only
+            // filled in for -live so we know what to watch.
+            DynArray(char*) files;
         } cc;
 
         struct {
             Cuik_DriverArgs* args;
             CompilationUnit* cu;
+
+            // with -shard, each group of TUs lives in its own compilation
+            // unit (and thus TB_Module), cu only holds onto shared state.
+            size_t shard_count;
+            CompilationUnit** shards;
+            TB_Module** shard_mods;
         } ld;
 
         struct {
@@ -92,6 +106,17 @@ static void step_done(Cuik_BuildStep* s) {
     }
 }
 
+// which compilation unit the N'th dependency of a link step should go into
+static CompilationUnit* ld_get_cu(Cuik_BuildStep* ld, size_t ordinal) {
+    if (ld->ld.shard_count == 0) {
+        return ld->ld.cu;
+    }
+
+    size_t i = ordinal / ld->ld.args->shard_size;
+    assert(i < ld->ld.shard_count);
+    return ld->ld.shards[i];
+}
+
 static bool has_file_ext(const char* path) {
     for (; *path; path++) {
         if (*path == '/')  return false;
@@ -143,7 +168,7 @@ static void sys_invoke(BuildStepInfo* info) {
 }
 
 #ifdef CUIK_USE_TB
-static void irgen(Cuik_IThreadpool* restrict thread_pool, Cuik_DriverArgs* restrict args, CompilationUnit* restrict cu, TB_Module* mod);
+static void irgen(Cuik_IThreadpool* restrict thread_pool, Cuik_DriverArgs* restrict args, TranslationUnit* restrict tu, TB_Module* mod);
 
 // ctx is non-NULL when we print asm
 static void apply_func(TB_Function* f, void* arg) {
@@ -157,6 +182,15 @@ static void apply_func(TB_Function* f, void* arg) {
             tb_pass_optimize(p);
         }
 
+        // graph coloring is worth the compile time once we're optimizing hard
+        if (args->opt_level >= 2) {
+            tb_pass_regalloc(p, TB_REGALLOC_GRAPH_COLOR);
+        }
+
+        if (args->opt_level >= 1) {
+            tb_pass_local_schedule(p, TB_LOCAL_SCHED_LIST);
+        }
+
         // print IR
         if (args->emit_ir) {
             // tb_function_print(f, tb_default_print_callback, stdout);
@@ -195,6 +229,19 @@ static void cc_invoke(BuildStepInfo* restrict info) {
     }
 
     TokenStream* tokens = cuikpp_get_token_stream(cpp);
+    if (args->live) {
+        // big files are split into chunks which share a filename, skip those
+        const char* last = NULL;
+        Cuik_FileEntry* files = cuikpp_get_files(tokens);
+        size_t file_count = cuikpp_get_file_count(tokens);
+        for (size_t i = 0; i < file_count; i++) {
+            if (files[i].filename != last) {
+                dyn_array_put(s->cc.files, cuik_strdup(files[i].filename));
+                last = files[i].filename;
+            }
+        }
+    }
+
     if (args->preprocess) {
         cuikpp_dump_tokens(tokens);
         goto done;
@@ -217,7 +264,8 @@ static void cc_invoke(BuildStepInfo* restrict info) {
 
     log_debug("BuildStep %p: parsed file", s);
 
-    CompilationUnit* cu = (s->anti_dep != NULL && s->anti_dep->tag == BUILD_STEP_LD) ? s->anti_dep->ld.cu : NULL;
+    Cuik_BuildStep* ld = (s->anti_dep != NULL && s->anti_dep->tag == BUILD_STEP_LD) ? s->anti_dep : NULL;
+    CompilationUnit* cu = ld ? ld_get_cu(ld, s->local_ordinal) : NULL;
     TranslationUnit* tu = result.tu;
 
     cuik_set_tu_ordinal(tu, s->local_ordinal);
@@ -226,13 +274,14 @@ static void cc_invoke(BuildStepInfo* restrict info) {
     Cuik_ImportRequest* imports = result.imports;
     if (cu != NULL) {
         if (imports != NULL) {
-            cuik_lock_compilation_unit(cu);
+            // the library list is shared between shards so we lock the main CU
+            cuik_lock_compilation_unit(ld->ld.cu);
             for (; imports != NULL; imports = imports->next) {
                 Cuik_Path* p = cuik_malloc(sizeof(Cuik_Path));
                 cuik_path_set(p, imports->lib_name);
                 dyn_array_put(args->libraries, p);
             }
-            cuik_unlock_compilation_unit(cu);
+            cuik_unlock_compilation_unit(ld->ld.cu);
         }
 
         cuik_add_to_compilation_unit(cu, tu);
@@ -269,18 +318,13 @@ static void cc_invoke(BuildStepInfo* restrict info) {
     }
 
     CUIK_TIMED_BLOCK("Backend") {
-        irgen(s->tp, args, cu, mod);
+        irgen(s->tp, args, tu, mod);
 
         // once we've complete debug info and diagnostics we don't need line info
         CUIK_TIMED_BLOCK("Free CPP") {
             cuiklex_free_tokens(tokens);
             cuikpp_free(cpp);
         }
-
-        if (args->opt_level > 0 || args->assembly || args->emit_ir) {
-            // do parallel function passes
-            cuiksched_per_function(s->tp, args->threads, mod, args, apply_func);
-        }
     }
     #endif
 
@@ -301,6 +345,97 @@ static void cc_invoke(BuildStepInfo* restrict info) {
     done_no_cpp: step_done(s);
 }
 
+#ifdef CUIK_USE_TB
+typedef struct {
+    TB_Module* mod;
+    TB_DebugFormat debug_fmt;
+    const char* path;
+
+    bool* failed;
+    Futex* remaining;
+} ShardExportTask;
+
+static void shard_export_job(void* arg) {
+    ShardExportTask task = *((ShardExportTask*) arg);
+
+    CUIK_TIMED_BLOCK("shard export") {
+        TB_ExportBuffer buffer = tb_module_object_export(task.mod, task.debug_fmt);
+        tb_module_destroy(task.mod);
+
+        if (!tb_export_buffer_to_file(buffer, task.path)) {
+            *task.failed = true;
+        }
+        tb_export_buffer_free(buffer);
+    }
+
+    if (task.remaining) {
+        futex_dec(task.remaining);
+    }
+}
+
+// emits one object file per shard, these don't share any state so
+// we can throw them all on the threadpool.
+static bool export_shards(Cuik_BuildStep* s, TB_DebugFormat debug_fmt, Cuik_Path* base, Cuik_Path* obj_paths) {
+    size_t n = s->ld.shard_count;
+    bool* failed = cuik_calloc(n, sizeof(bool));
+    Futex remaining = n;
+
+    for (size_t i = 0; i < n; i++) {
+        char ext[32];
+        int ext_len = snprintf(ext, sizeof(ext), "_%zu.o", i);
+        cuik_path_set_ext(&obj_paths[i], base, ext_len, ext);
+
+        ShardExportTask task = {
+            .mod = s->ld.shard_mods[i],
+            .debug_fmt = debug_fmt,
+            .path = obj_paths[i].data,
+            .failed = &failed[i],
+        };
+
+        #if CUIK_ALLOW_THREADS
+        if (s->tp != NULL) {
+            task.remaining = &remaining;
+            CUIK_CALL(s->tp, submit, shard_export_job, sizeof(task), &task);
+            continue;
+        }
+        #endif
+
+        shard_export_job(&task);
+        remaining -= 1;
+    }
+
+    futex_wait_eq(&remaining, 0);
+
+    bool ok = true;
+    for (size_t i = 0; i < n; i++) {
+        if (failed[i]) {
+            fprintf(stderr, "could not write object file: %s\n", obj_paths[i].data);
+            ok = false;
+        }
+    }
+
+    cuik_free(failed);
+    return ok;
+}
+
+// the module is shared by every TU going into it, the whole program passes
+// run once all the CC steps are done (and then the functions get compiled).
+static void optimize_module(Cuik_BuildStep* s, Cuik_DriverArgs* args, TB_Module* mod) {
+    if (args->opt_level > 0) CUIK_TIMED_BLOCK("Inline") {
+        tb_module_inline(mod, get_ir_arena(), CUIK_INLINE_BUDGET);
+    }
+
+    if (args->opt_level > 0) CUIK_TIMED_BLOCK("IPO") {
+        tb_module_ipo(mod, get_ir_arena());
+    }
+
+    if (args->opt_level > 0 || args->assembly || args->emit_ir) {
+        // do parallel function passes
+        cuiksched_per_function(s->tp, args->threads, mod, args, apply_func);
+    }
+}
+#endif
+
 static void ld_invoke(BuildStepInfo* info) {
     Cuik_BuildStep* s = info->step;
     Cuik_DriverArgs* args = s->ld.args;
@@ -319,12 +454,34 @@ static void ld_invoke(BuildStepInfo* info) {
     // Once the frontend is complete we don't need this... unless we wanna keep it
     if (!args->preserve_ast) {
         cuik_destroy_compilation_unit(s->ld.cu);
+        for (size_t i = 0; i < s->ld.shard_count; i++) {
+            // the module isn't owned by the CU so it'll survive this
+            cuik_destroy_compilation_unit(s->ld.shards[i]);
+        }
+    }
+
+    if (s->ld.shard_count > 0) {
+        for (size_t i = 0; i < s->ld.shard_count; i++) {
+            optimize_module(s, args, s->ld.shard_mods[i]);
+        }
+    } else {
+        optimize_module(s, args, mod);
     }
 
     if (!cuik_driver_does_codegen(args)) {
         goto done;
     }
 
+    if (args->profile_generate) {
+        if (s->ld.shard_count > 0) {
+            for (size_t i = 0; i < s->ld.shard_count; i++) {
+                tb_module_profile_finish(s->ld.shard_mods[i], get_ir_arena());
+            }
+        } else {
+            tb_module_profile_finish(mod, get_ir_arena());
+        }
+    }
+
     // TODO(NeGate): do a smarter system (just default to whatever the different platforms like)
     TB_DebugFormat debug_fmt = (args->debug_info ? TB_DEBUGFMT_CODEVIEW : TB_DEBUGFMT_NONE);
     Cuik_System sys = cuik_get_target_system(args->target);
@@ -339,31 +496,58 @@ static void ld_invoke(BuildStepInfo* info) {
     }
 
     if (args->run) {
-        #if 0
+        // main() follows Win64 even on a SysV host, the compiler lowers our
+        // side of the call (calls out of the JIT'd code get thunked by TB).
+        #if !defined(_WIN32) && defined(__GNUC__) && defined(__x86_64__)
+        typedef int (__attribute__((ms_abi)) *JITEntry)(int, char**);
+        #else
+        typedef int (*JITEntry)(int, char**);
+        #endif
+
         TB_JIT* jit = tb_jit_begin(mod, 0);
 
-        // put every function into the heap
-        int(*entry)(int, char**) = NULL;
-        TB_FOR_FUNCTIONS(f, mod) {
-            void* ptr = tb_jit_place_function(jit, f);
-            if (strcmp(tb_symbol_get_name((TB_Symbol*) f), "main") == 0) {
-                entry = ptr;
+        // put every function & global into the heap, anything
+        // external gets resolved against the host process.
+        JITEntry entry = NULL;
+        CUIK_TIMED_BLOCK("JIT") {
+            TB_SymbolIter it = tb_symbol_iter(mod);
+            TB_Symbol* sym;
+            while (sym = tb_symbol_iter_next(&it), sym != NULL) {
+                if (sym->tag == TB_SYMBOL_FUNCTION) {
+                    void* ptr = tb_jit_place_function(jit, (TB_Function*) sym);
+                    if (ptr != NULL && sym->name && strcmp(sym->name, "main") == 0) {
+                        entry = ptr;
+                    }
+                } else if (sym->tag == TB_SYMBOL_GLOBAL) {
+                    tb_jit_place_global(jit, (TB_Global*) sym);
+                }
             }
         }
 
-        assert(entry != NULL);
+        if (entry == NULL) {
+            fprintf(stderr, "error: could not find main() to JIT\n");
+            step_error(s);
+        } else {
+            // run main()
+            char* argv[] = { args->sources[0]->data, NULL };
+            int code = entry(1, argv);
+            fflush(stdout);
 
-        // run main()
-        char* argv = (char[]){ "jit" };
-        int code = entry(1, &argv);
-        tb_jit_end(jit);
+            if (args->verbose) {
+                fprintf(stderr, "C JIT exit with %d\n", code);
+            }
 
-        fprintf(stderr, "C JIT exit with %d\n", code);
-        goto done;
-        #endif
+            // the driver exits with it, the build itself went fine
+            args->run_status = code;
+
+            if (!tb_jit_profile_write(mod)) {
+                fprintf(stderr, "error: could not write profile: %s\n", args->profile_generate);
+            }
+        }
 
-        fprintf(stderr, "C JIT not ready :(\n");
-        exit(1);
+        tb_jit_end(jit);
+        tb_module_destroy(mod);
+        goto done;
     }
 
     ////////////////////////////////
@@ -416,7 +600,13 @@ static void ld_invoke(BuildStepInfo* info) {
         }
 
         CUIK_TIMED_BLOCK("tb_linker_append_module") {
-            tb_linker_append_module(l, mod);
+            if (s->ld.shard_count > 0) {
+                for (size_t i = 0; i < s->ld.shard_count; i++) {
+                    tb_linker_append_module(l, s->ld.shard_mods[i]);
+                }
+            } else {
+                tb_linker_append_module(l, mod);
+            }
         }
 
         if (args->entrypoint) {
@@ -436,14 +626,45 @@ static void ld_invoke(BuildStepInfo* info) {
 
         TB_ExportBuffer buffer = tb_linker_export(l);
         if (!tb_export_buffer_to_file(buffer, output_path.data)) {
-            goto error;
+            step_error(s);
         }
 
         tb_export_buffer_free(buffer);
+        goto cleanup;
 
         error:
         step_error(s);
-        tb_module_destroy(mod);
+
+        cleanup:
+        if (s->ld.shard_count > 0) {
+            for (size_t i = 0; i < s->ld.shard_count; i++) {
+                tb_module_destroy(s->ld.shard_mods[i]);
+            }
+        } else {
+            tb_module_destroy(mod);
+        }
+        goto done;
+    } else if (s->ld.shard_count > 0) {
+        Cuik_Path* obj_paths = cuik_malloc(s->ld.shard_count * sizeof(Cuik_Path));
+        bool ok;
+        CUIK_TIMED_BLOCK("export shards") {
+            ok = export_shards(s, debug_fmt, args->output_name ? &output_path : args->sources[0], obj_paths);
+        }
+
+        if (!ok) {
+            step_error(s);
+        } else if (args->flavor != TB_FLAVOR_OBJECT) {
+            CUIK_TIMED_BLOCK("linker") {
+                Cuik_Linker l = gimme_linker(args);
+                for (size_t i = 0; i < s->ld.shard_count; i++) {
+                    cuiklink_add_input_file(&l, obj_paths[i].data);
+                }
+                cuiklink_invoke(&l, args, output_path.data, args->output_name);
+                cuiklink_deinit(&l);
+            }
+        }
+
+        cuik_free(obj_paths);
         goto done;
     } else {
         Cuik_Path obj_path;
@@ -499,6 +720,23 @@ Cuik_BuildStep* cuik_driver_cc(Cuik_DriverArgs* args, const char* source) {
     return s;
 }
 
+#ifdef CUIK_USE_TB
+// has to happen before any functions get built
+static void setup_module(Cuik_DriverArgs* args, TB_Module* mod) {
+    if (args->profile_generate) {
+        tb_module_profile_generate(mod, args->profile_generate);
+    }
+
+    if (args->profile_use && !tb_module_profile_use(mod, args->profile_use)) {
+        fprintf(stderr, "warning: could not load profile: %s\n", args->profile_use);
+    }
+
+    if (args->code_reserve && !tb_module_reserve_code(mod, args->code_reserve << 20)) {
+        fprintf(stderr, "warning: could not reserve %zu MiB for code\n", args->code_reserve);
+    }
+}
+#endif
+
 Cuik_BuildStep* cuik_driver_ld(Cuik_DriverArgs* args, int dep_count, Cuik_BuildStep** deps) {
     Cuik_BuildStep* s = cuik_calloc(1, sizeof(Cuik_BuildStep));
     s->tag = BUILD_STEP_LD;
@@ -511,9 +749,33 @@ Cuik_BuildStep* cuik_driver_ld(Cuik_DriverArgs* args, int dep_count, Cuik_BuildS
 
     #ifdef CUIK_USE_TB
     TB_FeatureSet features = { 0 };
-    s->ld.cu->ir_mod = tb_module_create(
-        args->target->arch, (TB_System) cuik_get_target_system(args->target), &features, args->run
-    );
+    if (args->tune == NULL || strcmp(args->tune, "generic") == 0) {
+        features.x64_tune = TB_X64_TUNE_GENERIC;
+    } else if (strcmp(args->tune, "skylake") == 0) {
+        features.x64_tune = TB_X64_TUNE_SKYLAKE;
+    } else if (strcmp(args->tune, "zen") == 0) {
+        features.x64_tune = TB_X64_TUNE_ZEN;
+    } else {
+        fprintf(stderr, "warning: unknown -mtune '%s', using generic\n", args->tune);
+    }
+
+    TB_System sys = (TB_System) cuik_get_target_system(args->target);
+    if (args->shard_size > 0 && !args->run && dep_count > 0) {
+        // every shard gets a separate module so they don't fight over the
+        // same symbol tables and can be exported in parallel.
+        size_t n = (dep_count + args->shard_size - 1) / args->shard_size;
+        s->ld.shard_count = n;
+        s->ld.shards = cuik_malloc(n * sizeof(CompilationUnit*));
+        s->ld.shard_mods = cuik_malloc(n * sizeof(TB_Module*));
+        for (size_t i = 0; i < n; i++) {
+            s->ld.shards[i] = cuik_create_compilation_unit();
+            s->ld.shard_mods[i] = s->ld.shards[i]->ir_mod = tb_module_create(args->target->arch, sys, &features, false);
+            setup_module(args, s->ld.shard_mods[i]);
+        }
+    } else {
+        s->ld.cu->ir_mod = tb_module_create(args->target->arch, sys, &features, args->run);
+        setup_module(args, s->ld.cu->ir_mod);
+    }
     #endif
 
     for (size_t i = 0; i < dep_count; i++) {
@@ -527,6 +789,12 @@ TranslationUnit* cuik_driver_cc_get_tu(Cuik_BuildStep* s) {
     return s->cc.tu;
 }
 
+const char** cuik_driver_cc_get_files(Cuik_BuildStep* s, size_t* out_count) {
+    assert(s->tag == BUILD_STEP_CC);
+    *out_count = dyn_array_length(s->cc.files);
+    return (const char**) s->cc.files;
+}
+
 CompilationUnit* cuik_driver_ld_get_cu(Cuik_BuildStep* s) {
     assert(s->tag == BUILD_STEP_LD);
     return s->ld.cu;
@@ -574,7 +842,7 @@ bool cuik_step_run(Cuik_BuildStep* s, Cuik_IThreadpool* tp) {
     step_submit(s, tp, &m, false);
     mtx_destroy(&m);
 
-    return s->errors == 0;
+    return s->errors == 0 && !s->error_root;
 }
 
 void cuik_step_free(Cuik_BuildStep* s) {
@@ -584,6 +852,14 @@ void cuik_step_free(Cuik_BuildStep* s) {
 
     if (s->tag == BUILD_STEP_SYS) {
         cuik_free(s->sys.data);
+    } else if (s->tag == BUILD_STEP_CC) {
+        dyn_array_for(i, s->cc.files) {
+            cuik_free(s->cc.files[i]);
+        }
+        dyn_array_destroy(s->cc.files);
+    } else if (s->tag == BUILD_STEP_LD) {
+        cuik_free(s->ld.shards);
+        cuik_free(s->ld.shard_mods);
     }
 
     cuik_free(s);
@@ -593,6 +869,27 @@ bool cuik_driver_does_codegen(const Cuik_DriverArgs* args) {
     return !args->emit_ir && !args->test_preproc && !args->preprocess && !args->syntax_only && !args->ast;
 }
 
+bool cuik_driver_can_run(const Cuik_DriverArgs* args) {
+    // TB can't lower the SysV calling convention yet, there's nothing sane to jump into
+    if (cuik_get_target_system(args->target) != CUIK_SYSTEM_WINDOWS) {
+        fprintf(stderr, "error: -r isn't supported on SysV targets yet, try -target x64_windows_msvc\n");
+        return false;
+    }
+
+    // the JIT places x64 code and jumps into it, the host has to be able to run that
+    #if !defined(__x86_64__) && !defined(_M_X64)
+    fprintf(stderr, "error: -r needs an x64 host\n");
+    return false;
+    #else
+    if (args->target->arch != TB_ARCH_X86_64) {
+        fprintf(stderr, "error: -r can only run x64 code\n");
+        return false;
+    }
+    #endif
+
+    return true;
+}
+
 void cuikpp_dump_tokens(TokenStream* s) {
     const char* last_file = NULL;
     int last_line = 0;
@@ -793,44 +1090,35 @@ static void irgen_job(void* arg) {
     }
 }
 
-static void irgen(Cuik_IThreadpool* restrict thread_pool, Cuik_DriverArgs* restrict args, CompilationUnit* restrict cu, TB_Module* mod) {
+static void irgen(Cuik_IThreadpool* restrict thread_pool, Cuik_DriverArgs* restrict args, TranslationUnit* restrict tu, TB_Module* mod) {
+    // each CC step only generates IR for its own TU, the rest of the
+    // compilation unit is handled by the sibling steps.
+    if (cuik_get_entrypoint_status(tu) == CUIK_ENTRYPOINT_WINMAIN && args->subsystem == TB_WIN_SUBSYSTEM_UNKNOWN) {
+        args->subsystem = TB_WIN_SUBSYSTEM_WINDOWS;
+    }
+
+    size_t top_level_count = cuik_num_of_top_level_stmts(tu);
+    Stmt** top_level = cuik_get_top_level_stmts(tu);
+
     if (thread_pool != NULL) {
         #if CUIK_ALLOW_THREADS
-        size_t stmt_count = 0;
-        CUIK_FOR_EACH_TU(tu, cu) {
-            if (cuik_get_entrypoint_status(tu) == CUIK_ENTRYPOINT_WINMAIN && args->subsystem == TB_WIN_SUBSYSTEM_UNKNOWN) {
-                args->subsystem = TB_WIN_SUBSYSTEM_WINDOWS;
-            }
+        size_t batch_size = good_batch_size(args->threads, top_level_count);
+        Futex remaining = (top_level_count + batch_size - 1) / batch_size;
 
-            stmt_count += cuik_num_of_top_level_stmts(tu);
-        }
-
-        size_t batch_size = good_batch_size(args->threads, stmt_count);
-        size_t task_capacity = (stmt_count + batch_size - 1) / batch_size;
+        for (size_t i = 0; i < top_level_count; i += batch_size) {
+            size_t end = i + batch_size;
+            if (end >= top_level_count) end = top_level_count;
 
-        IRGenTask* tasks = cuik_malloc(task_capacity * sizeof(IRGenTask));
-        Futex remaining = task_capacity;
+            IRGenTask task = {
+                .mod = mod,
+                .tu = tu,
+                .args = args,
+                .stmts = &top_level[i],
+                .count = end - i,
+                .remaining = &remaining
+            };
 
-        size_t task_count = 0;
-        CUIK_FOR_EACH_TU(tu, cu) {
-            size_t top_level_count = cuik_num_of_top_level_stmts(tu);
-            Stmt** top_level = cuik_get_top_level_stmts(tu);
-            for (size_t i = 0; i < top_level_count; i += batch_size) {
-                size_t end = i + batch_size;
-                if (end >= top_level_count) end = top_level_count;
-
-                assert(task_count < task_capacity);
-                IRGenTask task = {
-                    .mod = mod,
-                    .tu = tu,
-                    .args = args,
-                    .stmts = &top_level[i],
-                    .count = end - i,
-                    .remaining = &remaining
-                };
-
-                CUIK_CALL(thread_pool, submit, irgen_job, sizeof(task), &task);
-            }
+            CUIK_CALL(thread_pool, submit, irgen_job, sizeof(task), &task);
         }
 
         // wait for the threads to finish
@@ -840,22 +1128,15 @@ static void irgen(Cuik_IThreadpool* restrict thread_pool, Cuik_DriverArgs* restr
         abort();
         #endif
     } else {
-        CUIK_FOR_EACH_TU(tu, cu) {
-            if (cuik_get_entrypoint_status(tu) == CUIK_ENTRYPOINT_WINMAIN && args->subsystem == TB_WIN_SUBSYSTEM_UNKNOWN) {
-                args->subsystem = TB_WIN_SUBSYSTEM_WINDOWS;
-            }
-
-            size_t c = cuik_num_of_top_level_stmts(tu);
-            IRGenTask task = {
-                .mod = mod,
-                .tu = tu,
-                .args = args,
-                .stmts = cuik_get_top_level_stmts(tu),
-                .count = c
-            };
-
-            irgen_job(&task);
-        }
+        IRGenTask task = {
+            .mod = mod,
+            .tu = tu,
+            .args = args,
+            .stmts = top_level,
+            .count = top_level_count
+        };
+
+        irgen_job(&task);
     }
 }
 #endif
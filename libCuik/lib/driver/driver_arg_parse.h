@@ -189,8 +189,10 @@ CUIK_API bool cuik_args_to_driver(Cuik_DriverArgs* comp_args, Cuik_Arguments* re
         }
     }
 
-    // initialize toolchain
-    comp_args->toolchain.ctx = comp_args->toolchain.init();
+    // initialize toolchain (unless the caller kept one warm for us)
+    if (comp_args->toolchain.ctx == NULL) {
+        comp_args->toolchain.ctx = comp_args->toolchain.init();
+    }
 
     if (args->_[ARG_OUTPUT]) {
         comp_args->output_name = cuik_strdup(args->_[ARG_OUTPUT]->value);
@@ -299,6 +301,34 @@ CUIK_API bool cuik_args_to_driver(Cuik_DriverArgs* comp_args, Cuik_Arguments* re
         comp_args->opt_level = atoi(args->_[ARG_OPTLVL]->value);
     }
 
+    // -fprofile-generate=path works too
+    Cuik_Arg* profgen = args->_[ARG_PROFGEN];
+    if (profgen && profgen->value != arg_is_set) {
+        comp_args->profile_generate = cuik_strdup(profgen->value + (profgen->value[0] == '='));
+    }
+
+    Cuik_Arg* profuse = args->_[ARG_PROFUSE];
+    if (profuse && profuse->value != arg_is_set) {
+        comp_args->profile_use = cuik_strdup(profuse->value + (profuse->value[0] == '='));
+    }
+
+    Cuik_Arg* code_res = args->_[ARG_CODERES];
+    if (code_res) {
+        int n = code_res->value != arg_is_set ? atoi(code_res->value + (code_res->value[0] == '=')) : 4096;
+        comp_args->code_reserve = (n < 0 ? 0 : n);
+    }
+
+    Cuik_Arg* tune = args->_[ARG_TUNE];
+    if (tune && tune->value != arg_is_set) {
+        comp_args->tune = cuik_strdup(tune->value + (tune->value[0] == '='));
+    }
+
+    Cuik_Arg* shard = args->_[ARG_SHARD];
+    if (shard) {
+        int n = shard->value != arg_is_set ? atoi(shard->value) : 1;
+        comp_args->shard_size = (n < 1 ? 1 : n);
+    }
+
     TOGGLE(ARG_PP, preprocess);
     TOGGLE(ARG_PPTEST, test_preproc);
     TOGGLE(ARG_RUN, run);
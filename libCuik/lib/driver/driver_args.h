@@ -13,7 +13,11 @@ X(AST,         "ast",      false, "print AST into stdout")
 X(SYNTAX,      "xe",       false, "type check only")
 // optimizer
 X(OPTLVL,      "O",        true,  "no optimizations")
+X(PROFGEN,     "fprofile-generate", true, "instrument the program, it appends branch counts to the given file when it exits")
+X(PROFUSE,     "fprofile-use", true, "optimize using the branch counts from the given profile")
 // backend
+X(CODERES,     "fcode-reserve", true, "reserve a contiguous block of address space (in MiB) for the generated code")
+X(TUNE,        "mtune",    true,  "pick the scheduling model (generic, skylake, zen)")
 X(EMITIR,      "emit-ir",  false, "print IR into stdout")
 X(OUTPUT,      "o",        true,  "set the output filepath")
 X(OBJECT,      "c",        false, "output object file")
@@ -24,6 +28,7 @@ X(NOLIBC,      "nostdlib", false, "don't include and link against the default CR
 X(LIB,         "l",        true,  "add library name to the linking")
 X(LIBDIR,      "L",        true,  "add library directory to search paths")
 X(BASED,       "based",    false, "use the TB linker (EXPERIMENTAL)")
+X(SHARD,       "shard",    true,  "give every N translation units their own module, emitted in parallel")
 X(SUBSYSTEM,   "subsystem",true,  "set windows subsystem (windows only... of course)")
 X(ENTRY,       "e",        true,  "set entrypoint")
 // misc
@@ -32,5 +37,5 @@ X(THREADS,     "j",        true,  "enabled multithreaded compilation")
 X(TIME,        "T",        false, "profile the compile times")
 X(THINK,       "think",    false, "aids in thinking about serious problems")
 // run
-X(RUN,         "r",        false, "JIT the executable (NOT READY)")
+X(RUN,         "r",        false, "JIT the executable and run main() (Win64 targets only for now)")
 #undef X
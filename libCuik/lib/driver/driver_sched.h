@@ -1,6 +1,6 @@
 #ifdef CUIK_USE_TB
 typedef struct {
-    Futex* remaining;
+    Futex* done;
 
     TB_Function* f;
     void* arg;
@@ -12,8 +12,9 @@ static void per_func_task(void* arg) {
     PerFunction task = *((PerFunction*) arg);
     task.func(task.f, task.arg);
 
-    atomic_fetch_sub(task.remaining, 1);
-    futex_signal(task.remaining);
+    // counts up since we don't know how many tasks there are until they're all submitted
+    atomic_fetch_add(task.done, 1);
+    futex_signal(task.done);
 }
 
 static size_t good_batch_size(size_t n, size_t jobs) {
@@ -34,10 +35,10 @@ static size_t good_batch_size(size_t n, size_t jobs) {
 void cuiksched_per_function(Cuik_IThreadpool* restrict thread_pool, int num_threads, TB_Module* mod, void* arg, CuikSched_PerFunction func) {
     TB_SymbolIter it = tb_symbol_iter(mod);
     if (thread_pool != NULL) {
-        Futex remaining = 0;
+        Futex done = 0;
         size_t count = 0;
 
-        PerFunction task = { .remaining = &remaining, .arg = arg, .func = func };
+        PerFunction task = { .done = &done, .arg = arg, .func = func };
 
         TB_Symbol* sym;
         while (sym = tb_symbol_iter_next(&it), sym) if (sym->tag == TB_SYMBOL_FUNCTION) {
@@ -46,7 +47,7 @@ void cuiksched_per_function(Cuik_IThreadpool* restrict thread_pool, int num_thre
             count++;
         }
 
-        futex_wait_eq(&remaining, count);
+        futex_wait_eq(&done, count);
     } else {
         TB_Symbol* sym;
         while (sym = tb_symbol_iter_next(&it), sym) if (sym->tag == TB_SYMBOL_FUNCTION) {
@@ -15,14 +15,21 @@ static Cuik_Attribute* parse_attributes(Cuik_Parser* restrict parser, TokenStrea
             a->prev = last;
             a->loc.start = tokens_get_location(s);
 
-            // TODO(NeGate): we'll only handle the identifier case with no :: for now
+            // TODO(NeGate): we don't keep the namespace around, [[clang::musttail]] is
+            // just musttail for now.
             tokens_next(s), tokens_next(s);
-            if (tokens_get(s)->type != TOKEN_IDENTIFIER) {
-                diag_err(s, tokens_get_range(s), "expected an identifier");
-            } else {
+            for (;;) {
+                if (tokens_get(s)->type != TOKEN_IDENTIFIER) {
+                    diag_err(s, tokens_get_range(s), "expected an identifier");
+                    break;
+                }
+
                 Token* t = tokens_get(s);
                 a->name = atoms_put(t->content.length, t->content.data);
                 tokens_next(s);
+
+                if (!tokens_peek_double_token(s, ':')) break;
+                tokens_next(s), tokens_next(s);
             }
             a->loc.end = tokens_get_location(s);
 
@@ -34,16 +41,24 @@ static Cuik_Attribute* parse_attributes(Cuik_Parser* restrict parser, TokenStrea
             last = a;
         } else if (tokens_get(s)->type == TOKEN_KW_attribute) {
             // TODO(NeGate): Correctly parse attributes instead of
-            // ignoring them.
+            // ignoring them, we only keep the names of the ones
+            // without arguments.
             tokens_next(s);
             expect_char(s, '(');
 
             int depth = 1;
             while (depth) {
-                if (tokens_get(s)->type == '(') {
+                Token* t = tokens_get(s);
+                if (t->type == '(') {
                     depth++;
-                } else if (tokens_get(s)->type == ')') {
+                } else if (t->type == ')') {
                     depth--;
+                } else if (t->type == TOKEN_IDENTIFIER && depth == 2) {
+                    Cuik_Attribute* a = TB_ARENA_ALLOC(parser->arena, Cuik_Attribute);
+                    a->prev = last;
+                    a->loc = get_token_range(t);
+                    a->name = atoms_put(t->content.length, t->content.data);
+                    last = a;
                 }
 
                 tokens_next(s);
@@ -1890,9 +1890,21 @@ void sema_stmt(TranslationUnit* tu, Stmt* restrict s) {
                 }
 
                 Cuik_QualType return_type = cuik_canonical_type(cuik__sema_function_stmt->decl.type)->func.return_type;
+                Subexpr* root = get_root_subexpr(s->return_.expr);
+
+                // the callee hands back the result directly to our caller, no room for conversions
+                if (s->return_.musttail) {
+                    if (root->op != EXPR_CALL) {
+                        diag_err(&tu->tokens, root->loc, "musttail return must be a call");
+                    } else if (!type_equal(cuik_canonical_type(expr_type), cuik_canonical_type(return_type))) {
+                        diag_err(&tu->tokens, root->loc, "musttail call returns %!T but the function returns %!T", cuik_canonical_type(expr_type), cuik_canonical_type(return_type));
+                    }
+                }
 
-                implicit_conversion(tu, expr_type, return_type, get_root_subexpr(s->return_.expr));
+                implicit_conversion(tu, expr_type, return_type, root);
                 set_root_cast(s->return_.expr, return_type);
+            } else if (s->return_.musttail) {
+                diag_err(&tu->tokens, s->loc, "musttail return must be a call");
             }
             break;
         }
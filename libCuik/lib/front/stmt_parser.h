@@ -241,6 +241,21 @@ static Stmt* parse_stmt2(Cuik_Parser* parser, TokenStream* restrict s) {
         expect_char(s, ';');
     }
 
+    // statement attributes, the only one we care about is musttail on returns
+    // so if it's not a return we back up and let the decl/expr parser see them.
+    bool musttail = false;
+    if (tokens_peek_double_token(s, '[') || tokens_get(s)->type == TOKEN_KW_attribute) {
+        size_t attr_start = s->list.current;
+        Cuik_Attribute* attrs = parse_attributes(parser, s, NULL);
+        if (tokens_get(s)->type != TOKEN_KW_return) {
+            s->list.current = attr_start;
+        } else {
+            for (Cuik_Attribute* a = attrs; a; a = a->prev) {
+                if (a->name && strcmp(a->name, "musttail") == 0) musttail = true;
+            }
+        }
+    }
+
     Stmt* n = NULL;
     SourceLoc loc_start = tokens_get_location(s);
     TknType peek = tokens_get(s)->type;
@@ -259,7 +274,7 @@ static Stmt* parse_stmt2(Cuik_Parser* parser, TokenStream* restrict s) {
         }
 
         n->op = STMT_RETURN;
-        n->return_ = (struct StmtReturn){ .expr = e };
+        n->return_ = (struct StmtReturn){ .expr = e, .musttail = musttail };
 
         expect_with_reason(s, ';', "return");
     } else if (peek == TOKEN_KW_if) {
@@ -29,7 +29,7 @@ void target_generic_fill_builtin_table(BuiltinTable* builtins) {
     #define X(name, format) nl_map_put_cstr(*builtins, #name, format);
 
     // gcc/clang
-    X(__builtin_expect, "b b");
+    X(__builtin_expect, "TC T");
     X(__builtin_trap, "v v");
     X(__builtin_clz, "i i");
     X(__builtin_mul_overflow, ". v");
@@ -229,6 +229,10 @@ BuiltinResult target_generic_compile_builtin(TranslationUnit* tu, TB_Function* f
         return ZZZ(NULL);
     } else if (strcmp(name, "__builtin_expect") == 0) {
         TB_Node* dst = RVAL(1);
+        TB_Node* expected = RVAL(2);
+        if (expected->type == TB_INTEGER_CONST) {
+            tb_function_attrib_expect(func, dst, TB_NODE_GET_EXTRA_T(expected, TB_NodeInt)->value);
+        }
         return ZZZ(dst);
     } else if (strcmp(name, "__builtin_trap") == 0) {
         tb_inst_trap(func);
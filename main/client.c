@@ -0,0 +1,78 @@
+// thin client for `cuik -server`, forwards the arguments and the
+// working directory then replays whatever the server spits out.
+//
+// usage: cuik_client [-socket <path>] <normal cuik arguments...>
+#include "remote.h"
+#include <limits.h>
+
+int main(int argc, const char** argv) {
+    char path[FILENAME_MAX];
+    int first = 1;
+    if (argc >= 3 && strcmp(argv[1], "-socket") == 0) {
+        snprintf(path, sizeof(path), "%s", argv[2]);
+        first = 3;
+    } else {
+        remote_default_path(path, sizeof(path));
+    }
+
+    struct sockaddr_un addr;
+    if (!remote_fill_addr(&addr, path)) {
+        return EXIT_FAILURE;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0 || connect(sock, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "error: could not connect to %s (is `cuik -server` running?)\n", path);
+        return EXIT_FAILURE;
+    }
+
+    char cwd[PATH_MAX];
+    if (getcwd(cwd, sizeof(cwd)) == NULL) {
+        perror("getcwd");
+        return EXIT_FAILURE;
+    }
+
+    bool ok = remote_write_u32(sock, REMOTE_MAGIC) && remote_write_str(sock, cwd) && remote_write_u32(sock, argc - first);
+    for (int i = first; ok && i < argc; i++) {
+        ok = remote_write_str(sock, argv[i]);
+    }
+
+    if (!ok) {
+        fprintf(stderr, "error: failed to send request\n");
+        return EXIT_FAILURE;
+    }
+
+    // replay output until we get the exit code
+    char buffer[4096];
+    for (;;) {
+        uint8_t tag;
+        uint32_t len;
+        if (!remote_read_all(sock, &tag, 1) || !remote_read_u32(sock, &len)) {
+            break;
+        }
+
+        if (tag == REMOTE_EXIT && len == sizeof(uint32_t)) {
+            uint32_t code;
+            if (!remote_read_u32(sock, &code)) break;
+
+            close(sock);
+            return code;
+        }
+
+        while (len > 0) {
+            uint32_t chunk = len < sizeof(buffer) ? len : sizeof(buffer);
+            if (!remote_read_all(sock, buffer, chunk)) goto lost;
+
+            if (tag == REMOTE_OUTPUT) {
+                fwrite(buffer, 1, chunk, stdout);
+                fflush(stdout);
+            }
+            len -= chunk;
+        }
+    }
+
+    lost:
+    fprintf(stderr, "error: lost connection to the server\n");
+    close(sock);
+    return EXIT_FAILURE;
+}
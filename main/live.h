@@ -1,14 +1,42 @@
-typedef struct {
-    uint64_t og_last_write;
-} LiveCompiler;
+// Watches the source files & every header they pulled in, -live uses
+// this to block until something changes and then recompiles in the same
+// process (threadpool, atoms and toolchain stay warm).
+//
+// usage:
+//   live_compile_init(&l);
+//   for (;;) {
+//     live_compile_begin(&l);
+//     ... compile ...
+//     live_compile_reset(&l);
+//     live_compile_add_file(&l, path); // for each dependency
+//     if (!live_compile_wait(&l)) break;
+//   }
+//   live_compile_deinit(&l);
+
+// the dependencies are only known once the compile is done so the watches
+// go up after it, anything saved in the meantime is caught by comparing its
+// modification time against when the compile started.
+//
+// editors tend to save in several steps (truncate, write, rename) so we
+// wait until the events stop coming for this long before recompiling.
+#define LIVE_DEBOUNCE_MS 50
 
 #if _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <windows.h>
 
+typedef struct {
+    uint64_t compile_start;
+    DynArray(char*) files;
+    DynArray(uint64_t) last_writes;
+} LiveCompiler;
+
 static uint64_t get_last_write_time(const char* filepath) {
     WIN32_FIND_DATA data;
     HANDLE handle = FindFirstFile(filepath, &data);
+    if (handle == INVALID_HANDLE_VALUE) {
+        return 0;
+    }
 
     ULARGE_INTEGER i;
     i.LowPart = data.ftLastWriteTime.dwLowDateTime;
@@ -18,36 +46,274 @@ static uint64_t get_last_write_time(const char* filepath) {
     return i.QuadPart;
 }
 
-// returns false if no changes are made, true if the file is ready to be reloaded
-static bool live_compile_watch(LiveCompiler* l, const char* source_file) {
+static bool live_compile_init(LiveCompiler* l) {
+    *l = (LiveCompiler){ 0 };
+    return true;
+}
+
+static void live_compile_begin(LiveCompiler* l) {
+    FILETIME ft;
+    GetSystemTimeAsFileTime(&ft);
+
+    ULARGE_INTEGER i;
+    i.LowPart = ft.dwLowDateTime;
+    i.HighPart = ft.dwHighDateTime;
+    l->compile_start = i.QuadPart;
+}
+
+static void live_compile_reset(LiveCompiler* l) {
+    dyn_array_for(i, l->files) {
+        cuik_free(l->files[i]);
+    }
+    dyn_array_clear(l->files);
+    dyn_array_clear(l->last_writes);
+}
+
+static void live_compile_add_file(LiveCompiler* l, const char* path) {
+    dyn_array_for(i, l->files) {
+        if (strcmp(l->files[i], path) == 0) return;
+    }
+
+    // written during the compile, pretend we never saw it so the first poll fires
+    uint64_t t = get_last_write_time(path);
+    dyn_array_put(l->files, cuik_strdup(path));
+    dyn_array_put(l->last_writes, t >= l->compile_start ? 0 : t);
+}
+
+static bool live_compile_changed(LiveCompiler* l) {
+    bool changed = false;
+    dyn_array_for(i, l->files) {
+        uint64_t t = get_last_write_time(l->files[i]);
+        if (t != l->last_writes[i]) {
+            l->last_writes[i] = t;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+// blocks until one of the files is modified, returns false if we can't watch anything
+static bool live_compile_wait(LiveCompiler* l) {
+    if (dyn_array_length(l->files) == 0) {
+        return false;
+    }
+
     // Wait for the user to save again
-    uint64_t current_last_write;
-    if (current_last_write = get_last_write_time(source_file), l->og_last_write == current_last_write) {
+    while (!live_compile_changed(l)) {
+        SleepEx(LIVE_DEBOUNCE_MS, FALSE);
+    }
+
+    // debounce, then wait for it to finish writing before trying to compile
+    do {
+        SleepEx(LIVE_DEBOUNCE_MS, FALSE);
+    } while (live_compile_changed(l));
+
+    dyn_array_for(i, l->files) {
+        int ticks = 0;
+        while (GetFileAttributesA(l->files[i]) == INVALID_FILE_ATTRIBUTES) {
+            SleepEx(1, FALSE);
+
+            if (ticks++ > 100) {
+                printf("live-compiler error: file locked (tried multiple times)\n");
+                break;
+            }
+        }
+    }
+
+    return true;
+}
+
+static void live_compile_deinit(LiveCompiler* l) {
+    live_compile_reset(l);
+    dyn_array_destroy(l->files);
+    dyn_array_destroy(l->last_writes);
+}
+#elif __linux__
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+// we watch directories rather than the files themselves, most editors save
+// by writing a temporary and renaming it over the original which would
+// silently kill a watch on the old inode.
+typedef struct {
+    char* path;
+    int wd;
+} LiveDir;
+
+typedef struct {
+    int dir;
+    char* name;
+} LiveFile;
+
+typedef struct {
+    int fd;
+    DynArray(LiveDir) dirs;
+    DynArray(LiveFile) files;
+
+    // set when one of the files was saved after compile_start
+    bool stale;
+    struct timespec compile_start;
+} LiveCompiler;
+
+static bool live_compile_init(LiveCompiler* l) {
+    *l = (LiveCompiler){ .fd = inotify_init1(IN_CLOEXEC) };
+    if (l->fd < 0) {
+        perror("live-compiler error: inotify_init1");
         return false;
     }
 
-    l->og_last_write = current_last_write;
+    return true;
+}
+
+static void live_compile_begin(LiveCompiler* l) {
+    // file timestamps come off the coarse clock, a finer start time could
+    // land after a write that happened later.
+    clock_gettime(CLOCK_REALTIME_COARSE, &l->compile_start);
+}
+
+static void live_compile_reset(LiveCompiler* l) {
+    dyn_array_for(i, l->dirs) {
+        inotify_rm_watch(l->fd, l->dirs[i].wd);
+        cuik_free(l->dirs[i].path);
+    }
+
+    dyn_array_for(i, l->files) {
+        cuik_free(l->files[i].name);
+    }
+
+    dyn_array_clear(l->dirs);
+    dyn_array_clear(l->files);
+    l->stale = false;
+}
+
+static void live_compile_add_file(LiveCompiler* l, const char* path) {
+    // split into directory & filename
+    const char* slash = strrchr(path, '/');
+    const char* name = slash ? slash + 1 : path;
+    size_t dir_len = slash ? (slash - path) : 0;
+
+    char dir[FILENAME_MAX];
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else if (dir_len == 0) {
+        strcpy(dir, "/");
+    } else {
+        if (dir_len >= FILENAME_MAX) return;
+        memcpy(dir, path, dir_len);
+        dir[dir_len] = 0;
+    }
+
+    // find or add the directory watch
+    int dir_i = -1;
+    dyn_array_for(i, l->dirs) {
+        if (strcmp(l->dirs[i].path, dir) == 0) {
+            dir_i = i;
+            break;
+        }
+    }
+
+    if (dir_i < 0) {
+        int wd = inotify_add_watch(l->fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE);
+        if (wd < 0) {
+            fprintf(stderr, "live-compiler warning: could not watch %s\n", dir);
+            return;
+        }
+
+        dir_i = dyn_array_length(l->dirs);
+        dyn_array_put(l->dirs, (LiveDir){ cuik_strdup(dir), wd });
+    }
+
+    dyn_array_for(i, l->files) {
+        if (l->files[i].dir == dir_i && strcmp(l->files[i].name, name) == 0) return;
+    }
+
+    // the watch wasn't up yet if it got saved during the compile
+    struct stat st;
+    if (stat(path, &st) == 0) {
+        struct timespec t = st.st_mtim, start = l->compile_start;
+        if (t.tv_sec > start.tv_sec || (t.tv_sec == start.tv_sec && t.tv_nsec >= start.tv_nsec)) {
+            l->stale = true;
+        }
+    }
 
-    // wait for it to finish writing before trying to compile
-    int ticks = 0;
-    while (GetFileAttributesA(source_file) == INVALID_FILE_ATTRIBUTES) {
-        SleepEx(1, FALSE);
+    dyn_array_put(l->files, (LiveFile){ dir_i, cuik_strdup(name) });
+}
+
+// drains whatever events are pending, returns true if any of them hit a watched file
+static bool live_compile_drain(LiveCompiler* l) {
+    _Alignas(struct inotify_event) char buffer[4096];
+    bool hit = false;
+
+    ssize_t len = read(l->fd, buffer, sizeof(buffer));
+    for (char* ptr = buffer; ptr < buffer + len;) {
+        struct inotify_event* e = (struct inotify_event*) ptr;
+        ptr += sizeof(struct inotify_event) + e->len;
+
+        if (e->len == 0 || hit) continue;
+        dyn_array_for(i, l->files) {
+            LiveFile* f = &l->files[i];
+            if (l->dirs[f->dir].wd == e->wd && strcmp(f->name, e->name) == 0) {
+                hit = true;
+                break;
+            }
+        }
+    }
+
+    return hit;
+}
+
+// blocks until one of the files is modified, returns false if we can't watch anything
+static bool live_compile_wait(LiveCompiler* l) {
+    if (dyn_array_length(l->files) == 0) {
+        return false;
+    }
+
+    struct pollfd pfd = { .fd = l->fd, .events = POLLIN };
+    for (;;) {
+        if (l->stale) {
+            break;
+        }
 
-        if (ticks++ > 100) {
-            printf("live-compiler error: file locked (tried multiple times)\n");
+        if (poll(&pfd, 1, -1) < 0) {
+            perror("live-compiler error: poll");
             return false;
         }
+
+        if (live_compile_drain(l)) {
+            break;
+        }
+    }
+
+    // debounce: keep eating events until things are quiet
+    while (poll(&pfd, 1, LIVE_DEBOUNCE_MS) > 0) {
+        live_compile_drain(l);
     }
 
     return true;
 }
-#else
-static uint64_t get_last_write_time(const char* filepath) {
-    return 0;
+
+static void live_compile_deinit(LiveCompiler* l) {
+    live_compile_reset(l);
+    dyn_array_destroy(l->dirs);
+    dyn_array_destroy(l->files);
+    close(l->fd);
 }
+#else
+typedef struct {
+    int dummy;
+} LiveCompiler;
 
-static bool live_compile_watch(LiveCompiler* l, const char* source_file) {
-    l->og_last_write = get_last_write_time(source_file);
+static bool live_compile_init(LiveCompiler* l) {
+    fprintf(stderr, "live-compiler error: not supported on this platform\n");
     return false;
 }
+
+static void live_compile_begin(LiveCompiler* l) {}
+static void live_compile_reset(LiveCompiler* l) {}
+static void live_compile_add_file(LiveCompiler* l, const char* path) {}
+static bool live_compile_wait(LiveCompiler* l) { return false; }
+static void live_compile_deinit(LiveCompiler* l) {}
 #endif
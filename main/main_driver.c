@@ -14,6 +14,7 @@
 #endif
 
 #include "bindgen.h"
+#include "server.h"
 
 #if CUIK_ALLOW_THREADS
 #include <threads.h>
@@ -112,6 +113,7 @@ int main(int argc, const char** argv) {
         #endif
 
         if (strcmp(argv[1], "-bindgen") == 0) return run_bindgen(argc - 2, argv + 2);
+        if (strcmp(argv[1], "-server")  == 0) return run_server(argc - 2, argv + 2);
     }
 
     log_set_level(LOG_DEBUG);
@@ -135,6 +137,11 @@ int main(int argc, const char** argv) {
         args.target = cuik_target_host();
     }
 
+    if (args.run && !cuik_driver_can_run(&args)) {
+        status = EXIT_FAILURE;
+        goto done;
+    }
+
     if (dyn_array_length(args.sources) == 0) {
         fprintf(stderr, "error: no input files!\n");
         status = EXIT_FAILURE;
@@ -196,21 +203,70 @@ int main(int argc, const char** argv) {
     }
     #endif
 
-    // compile source files
-    size_t obj_count = dyn_array_length(args.sources);
-    Cuik_BuildStep** objs = cuik_malloc(obj_count * sizeof(Cuik_BuildStep*));
-    dyn_array_for(i, args.sources) {
-        objs[i] = cuik_driver_cc(&args, args.sources[i]->data);
+    LiveCompiler live;
+    if (args.live && !live_compile_init(&live)) {
+        args.live = false;
     }
 
-    // link (if no codegen is performed this doesn't *really* do much)
-    Cuik_BuildStep* linked = cuik_driver_ld(&args, obj_count, objs);
-    if (!cuik_step_run(linked, tp)) {
-        status = 1;
+    // #pragma comment(lib, ...) appends to this, we don't want those
+    // piling up between live compiles.
+    size_t og_lib_count = dyn_array_length(args.libraries);
+
+    for (;;) {
+        if (args.live) {
+            live_compile_begin(&live);
+        }
+
+        // compile source files
+        size_t obj_count = dyn_array_length(args.sources);
+        Cuik_BuildStep** objs = cuik_malloc(obj_count * sizeof(Cuik_BuildStep*));
+        dyn_array_for(i, args.sources) {
+            objs[i] = cuik_driver_cc(&args, args.sources[i]->data);
+        }
+
+        // link (if no codegen is performed this doesn't *really* do much)
+        Cuik_BuildStep* linked = cuik_driver_ld(&args, obj_count, objs);
+        status = cuik_step_run(linked, tp) ? args.run_status : 1;
+
+        if (args.live) {
+            // the main files are always watched, even if preprocessing failed
+            live_compile_reset(&live);
+            dyn_array_for(i, args.sources) {
+                live_compile_add_file(&live, args.sources[i]->data);
+
+                size_t file_count;
+                const char** files = cuik_driver_cc_get_files(objs[i], &file_count);
+                for (size_t j = 0; j < file_count; j++) {
+                    if (files[j][0] != '<') live_compile_add_file(&live, files[j]);
+                }
+            }
+        }
+
+        cuik_step_free(linked);
+        cuik_free(objs);
+
+        if (!args.live) {
+            break;
+        }
+
+        for (size_t i = og_lib_count; i < dyn_array_length(args.libraries); i++) {
+            cuik_free(args.libraries[i]);
+        }
+        if (args.libraries) {
+            dyn_array_set_length(args.libraries, og_lib_count);
+        }
+
+        printf("live: waiting for changes...\n");
+        fflush(stdout);
+        if (!live_compile_wait(&live)) {
+            break;
+        }
+        printf("live: recompiling...\n");
     }
 
-    cuik_step_free(linked);
-    cuik_free(objs);
+    if (args.live) {
+        live_compile_deinit(&live);
+    }
 
     #if CUIK_ALLOW_THREADS
     cuik_threadpool_destroy(tp);
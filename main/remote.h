@@ -0,0 +1,102 @@
+// Wire format shared by `cuik -server` and the thin client (main/client.c),
+// everything goes over a local Unix socket.
+//
+// request (client -> server):
+//   u32 magic
+//   u32 cwd length, cwd bytes
+//   u32 argc, then for each arg: u32 length, bytes
+//
+// response (server -> client) is a series of frames:
+//   u8 tag, u32 length, bytes
+//
+// REMOTE_OUTPUT carries whatever the compile printed (diagnostics, asm,
+// IR dumps), REMOTE_EXIT is always the last frame and holds the exit
+// status as a u32.
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define REMOTE_MAGIC 0x4B495543 // 'CUIK'
+
+enum {
+    REMOTE_OUTPUT = 1,
+    REMOTE_EXIT   = 2,
+};
+
+// $XDG_RUNTIME_DIR/cuik.sock or /tmp/cuik-<uid>.sock if that's missing
+static void remote_default_path(char* out, size_t cap) {
+    const char* dir = getenv("XDG_RUNTIME_DIR");
+    if (dir != NULL && dir[0] != 0) {
+        snprintf(out, cap, "%s/cuik.sock", dir);
+    } else {
+        snprintf(out, cap, "/tmp/cuik-%u.sock", (unsigned) getuid());
+    }
+}
+
+static bool remote_fill_addr(struct sockaddr_un* addr, const char* path) {
+    *addr = (struct sockaddr_un){ .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        fprintf(stderr, "error: socket path too long: %s\n", path);
+        return false;
+    }
+
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+static bool remote_write_all(int fd, const void* data, size_t len) {
+    const char* ptr = data;
+    while (len > 0) {
+        ssize_t n = write(fd, ptr, len);
+        if (n <= 0) return false;
+        ptr += n, len -= n;
+    }
+    return true;
+}
+
+static bool remote_read_all(int fd, void* data, size_t len) {
+    char* ptr = data;
+    while (len > 0) {
+        ssize_t n = read(fd, ptr, len);
+        if (n <= 0) return false;
+        ptr += n, len -= n;
+    }
+    return true;
+}
+
+static bool remote_write_u32(int fd, uint32_t x) {
+    return remote_write_all(fd, &x, sizeof(x));
+}
+
+static bool remote_read_u32(int fd, uint32_t* x) {
+    return remote_read_all(fd, x, sizeof(*x));
+}
+
+static bool remote_write_str(int fd, const char* str) {
+    uint32_t len = strlen(str);
+    return remote_write_u32(fd, len) && remote_write_all(fd, str, len);
+}
+
+// returns a malloc'd null terminated string
+static char* remote_read_str(int fd) {
+    uint32_t len;
+    if (!remote_read_u32(fd, &len) || len > (1u << 20u)) return NULL;
+
+    char* str = malloc(len + 1);
+    if (!remote_read_all(fd, str, len)) {
+        free(str);
+        return NULL;
+    }
+
+    str[len] = 0;
+    return str;
+}
+
+static bool remote_write_frame(int fd, uint8_t tag, const void* data, uint32_t len) {
+    return remote_write_all(fd, &tag, 1) && remote_write_u32(fd, len) && remote_write_all(fd, data, len);
+}
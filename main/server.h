@@ -0,0 +1,269 @@
+// cuik -server [socket path]
+//
+// keeps a compiler process around so the build system doesn't pay for
+// process startup, toolchain discovery, threadpool spin-up and atom table
+// reservation on every invocation. requests come in over a local Unix
+// socket (see remote.h) and are handled one at a time, the output of each
+// compile is streamed back to the client as it's produced. -r builds run in
+// a forked child so the program can't crash (or exit) the server.
+#ifndef _WIN32
+#include "remote.h"
+#include <errno.h>
+#include <signal.h>
+#include <threads.h>
+#include <sys/wait.h>
+
+typedef struct {
+    int client;
+    int pipe_read;
+} ServerForward;
+
+// shuffles everything written to stdout/stderr during a compile over to the client
+static int server_forward(void* arg) {
+    ServerForward* f = arg;
+
+    char buffer[4096];
+    ssize_t n;
+    while (n = read(f->pipe_read, buffer, sizeof(buffer)), n > 0) {
+        if (!remote_write_frame(f->client, REMOTE_OUTPUT, buffer, n)) {
+            // client left, keep draining so the compile doesn't block
+            f->client = -1;
+        }
+    }
+
+    return 0;
+}
+
+static int server_build(Cuik_DriverArgs* args, Cuik_IThreadpool* tp) {
+    size_t obj_count = dyn_array_length(args->sources);
+    Cuik_BuildStep** objs = cuik_malloc(obj_count * sizeof(Cuik_BuildStep*));
+    dyn_array_for(i, args->sources) {
+        objs[i] = cuik_driver_cc(args, args->sources[i]->data);
+    }
+
+    Cuik_BuildStep* linked = cuik_driver_ld(args, obj_count, objs);
+    int status = cuik_step_run(linked, tp) ? args->run_status : 1;
+
+    cuik_step_free(linked);
+    cuik_free(objs);
+    return status;
+}
+
+// the JIT'd program shares our address space, it gets a process of its own
+// to crash in. the threadpool's workers don't survive the fork so the child
+// builds on one thread.
+static int server_build_forked(Cuik_DriverArgs* args) {
+    fflush(stdout), fflush(stderr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("server: fork");
+        return EXIT_FAILURE;
+    } else if (pid == 0) {
+        int status = server_build(args, NULL);
+        fflush(stdout), fflush(stderr);
+        _exit(status);
+    }
+
+    int wstatus;
+    while (waitpid(pid, &wstatus, 0) < 0) {
+        if (errno != EINTR) {
+            perror("server: waitpid");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (WIFSIGNALED(wstatus)) {
+        fprintf(stderr, "error: program died: %s\n", strsignal(WTERMSIG(wstatus)));
+        return EXIT_FAILURE;
+    }
+
+    return WEXITSTATUS(wstatus);
+}
+
+static int server_compile(int argc, const char** argv, Cuik_Toolchain* warm, Cuik_IThreadpool* tp) {
+    Cuik_DriverArgs args = {
+        .version   = CUIK_VERSION_C23,
+        .toolchain = *warm,
+
+        #ifdef CUIK_USE_TB
+        .flavor    = TB_FLAVOR_EXECUTABLE,
+        #endif
+    };
+
+    int status = EXIT_SUCCESS;
+    if (!cuik_parse_driver_args(&args, argc, argv)) {
+        goto done;
+    }
+
+    if (args.target == NULL) {
+        args.target = cuik_target_host();
+    }
+
+    if (args.live) {
+        fprintf(stderr, "warning: -live is ignored by the server\n");
+        args.live = false;
+    }
+
+    if (args.run && !cuik_driver_can_run(&args)) {
+        status = EXIT_FAILURE;
+        goto done;
+    }
+
+    if (dyn_array_length(args.sources) == 0) {
+        fprintf(stderr, "error: no input files!\n");
+        status = EXIT_FAILURE;
+        goto done;
+    }
+
+    if (args.run) {
+        status = server_build_forked(&args);
+    } else {
+        status = server_build(&args, args.threads > 1 ? tp : NULL);
+    }
+
+    done:
+    // -target gives us a fresh toolchain, the warm one sticks around
+    if (args.toolchain.ctx != warm->ctx) {
+        cuik_toolchain_free(&args.toolchain);
+    }
+    cuik_free_target(args.target);
+    cuik_free_driver_args(&args);
+    return status;
+}
+
+static void server_handle(int client, Cuik_Toolchain* warm, Cuik_IThreadpool* tp) {
+    uint32_t magic, argc;
+    if (!remote_read_u32(client, &magic) || magic != REMOTE_MAGIC) {
+        fprintf(stderr, "server: bad request\n");
+        return;
+    }
+
+    char* cwd = remote_read_str(client);
+    if (cwd == NULL || !remote_read_u32(client, &argc) || argc > 4096) {
+        fprintf(stderr, "server: bad request\n");
+        free(cwd);
+        return;
+    }
+
+    const char** argv = cuik_malloc(argc * sizeof(char*));
+    for (size_t i = 0; i < argc; i++) {
+        if ((argv[i] = remote_read_str(client)) == NULL) {
+            fprintf(stderr, "server: bad request\n");
+            argc = i;
+            goto done;
+        }
+    }
+
+    int status = EXIT_FAILURE;
+    int fds[2];
+    if (pipe(fds) < 0) {
+        perror("server: pipe");
+        goto done;
+    }
+
+    // route stdout/stderr into the pipe for the duration of the compile
+    fflush(stdout), fflush(stderr);
+    int old_out = dup(STDOUT_FILENO), old_err = dup(STDERR_FILENO);
+    dup2(fds[1], STDOUT_FILENO);
+    dup2(fds[1], STDERR_FILENO);
+    close(fds[1]);
+
+    ServerForward f = { client, fds[0] };
+    thrd_t forward;
+    thrd_create(&forward, server_forward, &f);
+
+    if (chdir(cwd) < 0) {
+        fprintf(stderr, "error: could not enter %s\n", cwd);
+    } else {
+        status = server_compile(argc, argv, warm, tp);
+    }
+
+    // restoring the fds closes the last write end, the forwarder sees EOF
+    fflush(stdout), fflush(stderr);
+    dup2(old_out, STDOUT_FILENO);
+    dup2(old_err, STDERR_FILENO);
+    close(old_out), close(old_err);
+
+    thrd_join(forward, NULL);
+    close(fds[0]);
+
+    uint32_t code = status;
+    remote_write_frame(client, REMOTE_EXIT, &code, sizeof(code));
+
+    done:
+    for (size_t i = 0; i < argc; i++) {
+        free((char*) argv[i]);
+    }
+    cuik_free(argv);
+    free(cwd);
+}
+
+static int run_server(int argc, const char** argv) {
+    char path[FILENAME_MAX];
+    if (argc > 0) {
+        snprintf(path, sizeof(path), "%s", argv[0]);
+    } else {
+        remote_default_path(path, sizeof(path));
+    }
+
+    struct sockaddr_un addr;
+    if (!remote_fill_addr(&addr, path)) {
+        return EXIT_FAILURE;
+    }
+
+    int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock < 0) {
+        perror("server: socket");
+        return EXIT_FAILURE;
+    }
+
+    // a client hanging up early shouldn't take the server down with it
+    signal(SIGPIPE, SIG_IGN);
+
+    // a stale socket from a dead server would make bind fail
+    unlink(path);
+    if (bind(sock, (struct sockaddr*) &addr, sizeof(addr)) < 0 || listen(sock, 16) < 0) {
+        perror("server: bind");
+        close(sock);
+        return EXIT_FAILURE;
+    }
+
+    // the warm state, this is what every request gets to skip
+    Cuik_Toolchain toolchain = cuik_toolchain_host();
+    toolchain.ctx = toolchain.init();
+
+    Cuik_IThreadpool* tp = NULL;
+    #if CUIK_ALLOW_THREADS
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    tp = cuik_threadpool_create(cores > 1 ? cores : 1);
+    #endif
+
+    printf("server: listening on %s\n", path);
+    fflush(stdout);
+
+    for (;;) {
+        int client = accept(sock, NULL, NULL);
+        if (client < 0) {
+            perror("server: accept");
+            continue;
+        }
+
+        server_handle(client, &toolchain, tp);
+        close(client);
+    }
+
+    #if CUIK_ALLOW_THREADS
+    cuik_threadpool_destroy(tp);
+    #endif
+    cuik_toolchain_free(&toolchain);
+    close(sock);
+    unlink(path);
+    return EXIT_SUCCESS;
+}
+#else
+static int run_server(int argc, const char** argv) {
+    fprintf(stderr, "error: -server is only supported on POSIX systems for now\n");
+    return EXIT_FAILURE;
+}
+#endif
@@ -121,8 +121,16 @@ typedef enum TB_FeatureSet_X64 {
     TB_FEATURE_X64_AVX2   = (1u << 10u),
 } TB_FeatureSet_X64;
 
+// which microarchitecture the list scheduler models (latencies and ports)
+typedef enum TB_X64_Tune {
+    TB_X64_TUNE_GENERIC,
+    TB_X64_TUNE_SKYLAKE,
+    TB_X64_TUNE_ZEN,
+} TB_X64_Tune;
+
 typedef struct TB_FeatureSet {
     TB_FeatureSet_X64 x64;
+    TB_X64_Tune x64_tune;
 } TB_FeatureSet;
 
 typedef enum TB_Linkage {
@@ -187,11 +195,13 @@ static_assert(sizeof(TB_DataType) == 4, "im expecting this to be a uint32_t");
 #define TB_IS_INTEGER_TYPE(x)  ((x).type == TB_INT)
 #define TB_IS_FLOAT_TYPE(x)    ((x).type == TB_FLOAT)
 #define TB_IS_POINTER_TYPE(x)  ((x).type == TB_PTR)
+#define TB_IS_VECTOR_TYPE(x)   ((x).width != 0)
 
 // accessors
 #define TB_GET_INT_BITWIDTH(x) ((x).data)
 #define TB_GET_FLOAT_FORMAT(x) ((x).data)
 #define TB_GET_PTR_ADDRSPACE(x) ((x).data)
+#define TB_GET_VECTOR_LANES(x)  (1u << (x).width)
 
 ////////////////////////////////
 // ANNOTATIONS
@@ -268,6 +278,9 @@ typedef enum TB_NodeTypeEnum {
     //   target pointer (or syscall number) and the rest are just data args.
     TB_CALL,           // (Control, Memory, Data, Data...) -> (Control, Memory, Data)
     TB_SYSCALL,        // (Control, Memory, Data, Data...) -> (Control, Memory, Data)
+    //   tail calls only show up during codegen, it's a CALL in tail position which
+    //   ends the function (the callee returns to our caller).
+    TB_TAILCALL,       // (Control, Memory, Data, Data...) -> ()
     //   safepoint polls are the same except they only trigger if the poll site
     //   says to (platform specific but almost always just the page being made
     //   unmapped/guard), 3rd argument is the poll site.
@@ -335,6 +348,11 @@ typedef enum TB_NodeTypeEnum {
     // Select
     TB_SELECT,
 
+    // Vectors
+    //   copies the scalar into every lane, the element type of the
+    //   output vector matches the input.
+    TB_VBROADCAST, // Data -> Vector
+
     // Bitmagic
     TB_BSWAP,
     TB_CLZ,
@@ -489,7 +507,6 @@ typedef struct TB_Symbol {
 typedef struct TB_Node TB_Node;
 typedef struct User User;
 struct User {
-    User* next;
     TB_Node* n;
     int slot;
 };
@@ -500,15 +517,20 @@ struct TB_Node {
     TB_DataType dt;
 
     // makes it easier to track in graph walks
-    size_t gvn;
+    uint32_t gvn;
 
-    // only value while inside of a TB_Passes,
+    // only valid while inside of a TB_Passes,
     // these are unordered and usually just
     // help perform certain transformations or
-    // analysis (not necessarily semantics)
+    // analysis (not necessarily semantics).
+    //
+    // the capacity isn't stored, it's the user_count
+    // rounded up to a power of two.
+    uint32_t user_count;
     User* users;
 
-    // ordered def-use edges, jolly ol' semantics
+    // ordered def-use edges, jolly ol' semantics.
+    // usually these live right after the extra data.
     TB_Node** inputs;
 
     char extra[];
@@ -524,6 +546,9 @@ typedef struct { // TB_BRANCH
     size_t succ_count;
     TB_Node** succ;
 
+    // relative weights for each successor, NULL if we don't know
+    uint32_t* weights;
+
     int64_t keys[];
 } TB_NodeBranch;
 
@@ -595,6 +620,8 @@ typedef struct {
 
 typedef struct {
     TB_FunctionPrototype* proto;
+    // codegen must turn it into a tail call (or die trying)
+    bool tail;
     TB_Node* projs[];
 } TB_NodeCall;
 
@@ -611,6 +638,9 @@ typedef struct {
     // immediate dominator (can be approximate)
     int dom_depth;
     TB_Node* dom;
+    // how many natural loops this block is nested in (0 is straight-line code),
+    // filled in alongside the dominators by the loop analysis.
+    int loop_depth;
 
     // used for IR building only, stale after that.
     TB_Node *mem_in, *mem_out;
@@ -680,6 +710,14 @@ typedef enum {
 #define TB_TYPE_INTN(N) TB_DataType{ { TB_INT,   0, (N) } }
 #define TB_TYPE_PTRN(N) TB_DataType{ { TB_PTR,   0, (N) } }
 
+// 128bit vectors, the width is log2 of the lane count
+#define TB_TYPE_I8x16   TB_DataType{ { TB_INT,   4, 8 } }
+#define TB_TYPE_I16x8   TB_DataType{ { TB_INT,   3, 16 } }
+#define TB_TYPE_I32x4   TB_DataType{ { TB_INT,   2, 32 } }
+#define TB_TYPE_I64x2   TB_DataType{ { TB_INT,   1, 64 } }
+#define TB_TYPE_F32x4   TB_DataType{ { TB_FLOAT, 2, TB_FLT_32 } }
+#define TB_TYPE_F64x2   TB_DataType{ { TB_FLOAT, 1, TB_FLT_64 } }
+
 #else
 
 #define TB_TYPE_TUPLE   (TB_DataType){ { TB_TUPLE } }
@@ -698,6 +736,14 @@ typedef enum {
 #define TB_TYPE_INTN(N) (TB_DataType){ { TB_INT,   0, (N) } }
 #define TB_TYPE_PTRN(N) (TB_DataType){ { TB_PTR,   0, (N) } }
 
+// 128bit vectors, the width is log2 of the lane count
+#define TB_TYPE_I8x16   (TB_DataType){ { TB_INT,   4, 8 } }
+#define TB_TYPE_I16x8   (TB_DataType){ { TB_INT,   3, 16 } }
+#define TB_TYPE_I32x4   (TB_DataType){ { TB_INT,   2, 32 } }
+#define TB_TYPE_I64x2   (TB_DataType){ { TB_INT,   1, 64 } }
+#define TB_TYPE_F32x4   (TB_DataType){ { TB_FLOAT, 2, TB_FLT_32 } }
+#define TB_TYPE_F64x2   (TB_DataType){ { TB_FLOAT, 1, TB_FLT_64 } }
+
 #endif
 
 typedef void (*TB_PrintCallback)(void* user_data, const char* fmt, ...);
@@ -729,6 +775,12 @@ TB_API void tb_module_destroy(TB_Module* m);
 // dont and the tls_index is used, it'll crash
 TB_API void tb_module_set_tls_index(TB_Module* m, ptrdiff_t len, const char* name);
 
+// Reserves one contiguous (huge page aligned where possible) block of address space
+// which every thread carves its code regions out of, this keeps the module's text
+// together. Must be called before any function is compiled, returns false if the
+// reservation failed (compilation still works, it just falls back to small mappings).
+TB_API bool tb_module_reserve_code(TB_Module* m, size_t size);
+
 TB_API TB_ModuleSectionHandle tb_module_create_section(TB_Module* m, ptrdiff_t len, const char* name, TB_ModuleSectionFlags flags, TB_ComdatType comdat);
 
 typedef struct {
@@ -786,6 +838,26 @@ TB_API void* tb_jit_get_code_ptr(TB_Function* f);
 // Generates a 2MiB stack
 TB_API void* tb_jit_stack_create(size_t* out_size);
 
+////////////////////////////////
+// Profile guided optimizations
+////////////////////////////////
+// both of these have to be called before any function in the module is built.
+//
+// profile_generate counts every function entry and every edge out of tb_inst_if &
+// tb_inst_branch, when the program exits the counts get appended to the file at
+// path (delete it to start over). profile_use reads that back and the same edges
+// get their counts as branch weights.
+TB_API void tb_module_profile_generate(TB_Module* m, const char* path);
+TB_API bool tb_module_profile_use(TB_Module* m, const char* path);
+
+// call once the module is done being built (before exporting or placing it into
+// a JIT), compiles the dump code into the module if it hasn't been yet.
+TB_API void tb_module_profile_finish(TB_Module* m, TB_Arena* arena);
+
+// the JIT doesn't get an atexit handler so this appends the counts to the
+// profile file, call it after the program has run but before tb_jit_end.
+TB_API bool tb_jit_profile_write(TB_Module* m);
+
 ////////////////////////////////
 // Exporter
 ////////////////////////////////
@@ -945,6 +1017,14 @@ TB_API TB_ModuleSectionHandle tb_module_get_tls(TB_Module* m);
 TB_API void tb_function_attrib_variable(TB_Function* f, TB_Node* n, TB_Node* parent, ptrdiff_t len, const char* name, TB_DebugType* type);
 TB_API void tb_function_attrib_scope(TB_Function* f, TB_Node* n, TB_Node* parent);
 TB_API void tb_function_attrib_location(TB_Function* f, TB_Node* n, TB_SourceFile* file, int line, int column);
+// strict aliasing, loads & stores tagged with different non-zero type classes
+// never touch the same memory. 0 is the "char" class which aliases everything.
+TB_API void tb_function_attrib_type_class(TB_Function* f, TB_Node* n, int type_class);
+// pointer (usually a parameter) which doesn't alias anything not derived from it.
+TB_API void tb_function_attrib_restrict(TB_Function* f, TB_Node* n);
+// __builtin_expect, n is likely to be value. branches (tb_inst_if, tb_inst_branch)
+// built on top of it get their weights from this.
+TB_API void tb_function_attrib_expect(TB_Function* f, TB_Node* n, uint64_t value);
 
 ////////////////////////////////
 // Debug info Generation
@@ -1050,7 +1130,7 @@ TB_API TB_Node* tb_inst_bitcast(TB_Function* f, TB_Node* src, TB_DataType dt);
 TB_API TB_Node* tb_inst_local(TB_Function* f, TB_CharUnits size, TB_CharUnits align);
 
 TB_API TB_Node* tb_inst_load(TB_Function* f, TB_DataType dt, TB_Node* addr, TB_CharUnits align, bool is_volatile);
-TB_API void tb_inst_store(TB_Function* f, TB_DataType dt, TB_Node* addr, TB_Node* val, TB_CharUnits align, bool is_volatile);
+TB_API TB_Node* tb_inst_store(TB_Function* f, TB_DataType dt, TB_Node* addr, TB_Node* val, TB_CharUnits align, bool is_volatile);
 
 TB_API void tb_inst_safepoint_poll(TB_Function* f, TB_Node* addr, int input_count, TB_Node** inputs);
 
@@ -1089,6 +1169,12 @@ TB_API TB_Node* tb_inst_get_symbol_address(TB_Function* f, TB_Symbol* target);
 // a, b must match in type
 TB_API TB_Node* tb_inst_select(TB_Function* f, TB_Node* cond, TB_Node* a, TB_Node* b);
 
+// Vectors
+//   the element-wise arithmatic is just the scalar ops with a vector type,
+//   loads and stores work on vectors as well (they don't need to be aligned).
+//   width is log2 of the lane count, the result is a vector of src's type.
+TB_API TB_Node* tb_inst_vbroadcast(TB_Function* f, TB_Node* src, int width);
+
 // Integer arithmatic
 TB_API TB_Node* tb_inst_add(TB_Function* f, TB_Node* a, TB_Node* b, TB_ArithmeticBehavior arith_behavior);
 TB_API TB_Node* tb_inst_sub(TB_Function* f, TB_Node* a, TB_Node* b, TB_ArithmeticBehavior arith_behavior);
@@ -1168,6 +1254,10 @@ TB_API TB_Node* tb_inst_x86_rsqrt(TB_Function* f, TB_Node* a);
 // Control flow
 TB_API TB_Node* tb_inst_syscall(TB_Function* f, TB_DataType dt, TB_Node* syscall_num, size_t param_count, TB_Node** params);
 TB_API TB_MultiOutput tb_inst_call(TB_Function* f, TB_FunctionPrototype* proto, TB_Node* target, size_t param_count, TB_Node** params);
+// calls and returns the results, unlike tb_inst_call + tb_inst_ret the callee is
+// guaranteed to reuse our stack frame (codegen will panic if it can't do that).
+// the current block is terminated.
+TB_API void tb_inst_tailcall(TB_Function* f, TB_FunctionPrototype* proto, TB_Node* target, size_t param_count, TB_Node** params);
 
 // Managed
 TB_API TB_Node* tb_inst_safepoint(TB_Function* f, TB_Node* poke_site, size_t param_count, TB_Node** params);
@@ -1177,8 +1267,12 @@ TB_API bool tb_inst_add_phi_operand(TB_Function* f, TB_Node* phi, TB_Node* regio
 
 TB_API TB_Node* tb_inst_phi2(TB_Function* f, TB_Node* region, TB_Node* a, TB_Node* b);
 TB_API void tb_inst_goto(TB_Function* f, TB_Node* target);
-TB_API void tb_inst_if(TB_Function* f, TB_Node* cond, TB_Node* true_case, TB_Node* false_case);
-TB_API void tb_inst_branch(TB_Function* f, TB_DataType dt, TB_Node* key, TB_Node* default_case, size_t entry_count, const TB_SwitchEntry* keys);
+TB_API TB_Node* tb_inst_if(TB_Function* f, TB_Node* cond, TB_Node* true_case, TB_Node* false_case);
+TB_API TB_Node* tb_inst_branch(TB_Function* f, TB_DataType dt, TB_Node* key, TB_Node* default_case, size_t entry_count, const TB_SwitchEntry* keys);
+// relative weights for each successor of a branch (the default case goes first, for
+// ifs that's the true case), profile counts can be passed in directly. these only steer
+// the block layout.
+TB_API void tb_inst_set_branch_weights(TB_Function* f, TB_Node* br, const uint32_t* weights);
 
 TB_API void tb_inst_ret(TB_Function* f, size_t count, TB_Node** values);
 
@@ -1217,9 +1311,20 @@ TB_API void tb_pass_exit(TB_Passes* opt);
 //
 //   SROA: splits LOCALs into multiple to allow for more dataflow
 //     analysis later on.
+//
+//   SCCP: optimistic constant propagation, folds values and branches
+//     which are only known to be constant once the unreachable paths
+//     are thrown out. it's best to run after mem2reg.
+//
+//   loop: canonicalizes loops (one preheader, one backedge), rewrites
+//     array indexing off induction variables into pointer increments
+//     and fully unrolls loops with small constant trip counts. the
+//     invariant code motion happens later as part of scheduling.
 TB_API void tb_pass_peephole(TB_Passes* opt, TB_PeepholeFlags flags);
 TB_API void tb_pass_sroa(TB_Passes* opt);
 TB_API bool tb_pass_mem2reg(TB_Passes* opt);
+TB_API void tb_pass_sccp(TB_Passes* opt);
+TB_API void tb_pass_loop(TB_Passes* opt);
 
 // this just runs the optimizer in the default configuration
 TB_API void tb_pass_optimize(TB_Passes* opt);
@@ -1231,12 +1336,43 @@ TB_API void tb_pass_schedule(TB_Passes* opt);
 TB_API bool tb_pass_print(TB_Passes* opt);
 
 // codegen
+//   regalloc: picks the register allocator codegen uses, linear scan is the
+//     default since it's fast. graph coloring takes longer but it coalesces
+//     more of the copies and keeps spill code out of loops.
+typedef enum TB_RegAlloc {
+    TB_REGALLOC_LINEAR_SCAN,
+    TB_REGALLOC_GRAPH_COLOR,
+} TB_RegAlloc;
+
+TB_API void tb_pass_regalloc(TB_Passes* opt, TB_RegAlloc ra);
+
+//   local_schedule: picks how codegen orders the nodes within a block, the default
+//     is a plain topological walk. the list scheduler uses the target's latency model
+//     (TB_FeatureSet picks which one) to get loads and divides going early.
+typedef enum TB_LocalSched {
+    TB_LOCAL_SCHED_TOPO,
+    TB_LOCAL_SCHED_LIST,
+} TB_LocalSched;
+
+TB_API void tb_pass_local_schedule(TB_Passes* opt, TB_LocalSched s);
 TB_API TB_FunctionOutput* tb_pass_codegen(TB_Passes* opt, bool emit_asm);
 
 TB_API void tb_pass_kill_node(TB_Passes* opt, TB_Node* n);
 TB_API void tb_pass_mark(TB_Passes* opt, TB_Node* n);
 TB_API void tb_pass_mark_users(TB_Passes* opt, TB_Node* n);
 
+// module-level passes, these look at every function in the module so they
+// must run before (not concurrently with) the per function passes:
+//   inline: builds a call graph out of the direct calls and inlines callees
+//     bottom up as long as they're at most `budget` nodes, recursive calls are
+//     left alone. the cloned nodes are allocated in `arena`.
+TB_API void tb_module_inline(TB_Module* m, TB_Arena* arena, int budget);
+//   ipo: figures out which functions are readonly, readnone, noreturn or
+//     return non-null pointers so the call sites can use it during peepholes,
+//     private functions which get the same constant argument from every call
+//     site get it substituted in. best run right after inline.
+TB_API void tb_module_ipo(TB_Module* m, TB_Arena* arena);
+
 ////////////////////////////////
 // IR access
 ////////////////////////////////
@@ -29,6 +29,13 @@ typedef struct {
 
     NL_Map(TB_Node*, uint32_t) labels;
     uint32_t return_label;
+
+    // where the rel32 branches to labels start, the target can
+    // shrink them once the whole function is laid out.
+    DynArray(uint32_t) branches;
+    // padding reserved in front of aligned labels, it's sized
+    // alongside the branches.
+    DynArray(uint32_t) aligns;
 } TB_CGEmitter;
 
 // Helper macros
@@ -99,15 +106,13 @@ static void tb_resolve_rel32(TB_CGEmitter* restrict e, uint32_t* head, uint32_t
 static void* tb_cgemit_reserve(TB_CGEmitter* restrict e, size_t count) {
     if (e->count + count >= e->capacity) {
         // make new region
-        TB_CodeRegion* new_region = tb_platform_valloc(CODE_REGION_BUFFER_SIZE);
-        if (new_region == NULL) tb_panic("could not allocate code region!");
-
-        new_region->capacity = CODE_REGION_BUFFER_SIZE - sizeof(TB_CodeRegion);
+        TB_CodeRegion* new_region = tb__alloc_code_region(e->output->parent->super.module, e->count + count);
         e->output->code_region = new_region;
 
         // copy code into new region
         memcpy(new_region->data, e->data, e->count);
         e->data = new_region->data;
+        e->capacity = new_region->capacity;
     }
 
     return &e->data[e->count];
@@ -28,6 +28,9 @@ enum {
     //    XORPS xmm0, xmm0
     // or XOR   eax,  eax
     INST_ZERO,
+
+    // multiway branch, the target expands it when emitting
+    INST_SWITCH,
 };
 
 typedef struct Inst Inst;
@@ -56,6 +59,8 @@ typedef struct MachineReg {
 typedef struct {
     int uses;
     RegIndex vreg;
+    // which stretch between memory effects it's scheduled in
+    int epoch;
 } ValueDesc;
 
 typedef struct LiveInterval LiveInterval;
@@ -78,10 +83,20 @@ typedef struct {
     Worklist worklist; // reusing from TB_Passes.
     ValueDesc* values; // the indices match the GVN.
 
+    // memory effects split the blocks into epochs, a load can only be folded into an
+    // instruction emitted within its own epoch (epoch is wherever phase 4 is at).
+    int epoch, epoch_count;
+
+    // latency model for the list scheduler, NULL means we keep the topological order
+    const SchedModel* sched;
+
     DynArray(PhiVal) phi_vals;
 
     // Regalloc
     DynArray(LiveInterval) intervals;
+    // timeline positions of every INST_EPILOGUE (tail calls get their own),
+    // the callee saved registers are restored at each of them.
+    DynArray(int) epilogues;
 
     // machine output sequences
     Inst *first, *head;
@@ -103,15 +118,18 @@ static bool fits_into_int8(uint64_t x) {
     return (int64_t)y == x;
 }
 
+// imm32 operands get sign extended on 64bit ops, 0x80000000 and up won't survive that
 static bool fits_into_int32(uint64_t x) {
-    uint32_t hi = x >> 32ull;
-    return hi == 0 || hi == 0xFFFFFFFF;
+    return (int64_t) x == (int32_t) x;
 }
 
 static void init_regalloc(Ctx* restrict ctx);
+static int liveness(Ctx* restrict ctx, TB_Function* f);
 
 static TB_X86_DataType legalize(TB_DataType dt);
 static bool is_terminator(int type);
+static bool can_tail_call(TB_Function* f, TB_Node* call);
+static const SchedModel* sched_model(const TB_FeatureSet* features);
 static bool wont_spill_around(int type);
 static int classify_reg_class(TB_DataType dt);
 static void isel(Ctx* restrict ctx, TB_Node* n, int dst);
@@ -234,7 +252,7 @@ static Inst* inst_move(TB_DataType dt, RegIndex dst, RegIndex src) {
     int machine_dt = legalize(dt);
 
     Inst* i = tb_arena_alloc(tmp_arena, sizeof(Inst) + (2 * sizeof(RegIndex)));
-    *i = (Inst){ .type = machine_dt >= TB_X86_TYPE_SSE_SS ? FP_MOV : MOV, .dt = machine_dt, .out_count = 1, 1 };
+    *i = (Inst){ .type = machine_dt >= TB_X86_TYPE_PBYTE ? FP_MOV : MOV, .dt = machine_dt, .out_count = 1, 1 };
     i->operands[0] = dst;
     i->operands[1] = src;
     return i;
@@ -386,6 +404,14 @@ static Inst* inst_op_zero(TB_DataType dt, RegIndex dst) {
 // Register allocation
 ////////////////////////////////
 #include "reg_alloc.h"
+#include "reg_alloc_color.h"
+#include "peephole.h"
+
+typedef int (*RegAllocFn)(Ctx* restrict ctx, TB_Function* f, int stack_usage, int end);
+static const RegAllocFn reg_allocs[] = {
+    [TB_REGALLOC_LINEAR_SCAN] = linear_scan,
+    [TB_REGALLOC_GRAPH_COLOR] = graph_color,
+};
 
 #define DEF(n, dt) alloc_vreg(ctx, n, dt)
 static int alloc_vreg(Ctx* restrict ctx, TB_Node* n, TB_DataType dt) {
@@ -428,6 +454,7 @@ static int liveness(Ctx* restrict ctx, TB_Function* f) {
 
     // generate local live sets
     int timeline = 4, epilogue = -1;
+    dyn_array_clear(ctx->epilogues);
     // CUIK_TIMED_BLOCK("local liveness")
     {
         if (ctx->first) {
@@ -456,6 +483,7 @@ static int liveness(Ctx* restrict ctx, TB_Function* f) {
                     mbb->terminator = timeline;
                 } else if (inst->type == INST_EPILOGUE) {
                     epilogue = timeline;
+                    dyn_array_put(ctx->epilogues, timeline);
                 }
 
                 Set* restrict gen = &mbb->gen;
@@ -482,62 +510,111 @@ static int liveness(Ctx* restrict ctx, TB_Function* f) {
     }
 
     // generate global live sets
-    size_t base = dyn_array_length(ctx->worklist.items);
-    assert(base == ctx->block_count);
-
-    // all nodes go into the worklist
-    FOREACH_N(i, 0, ctx->block_count) {
+    //   the flow graph gets flattened into arrays indexed by worklist position first,
+    //   after that each visit is a few straight word-wide passes over the sets.
+    size_t block_count = ctx->block_count;
+    size_t words = (interval_count + 63) / 64;
+    assert(dyn_array_length(ctx->worklist.items) == block_count);
+
+    MachineBB** mbbs = tb_arena_alloc(arena, block_count * sizeof(MachineBB*));
+    int* index_of    = tb_arena_alloc(arena, block_count * sizeof(int));
+    int* succ_start  = tb_arena_alloc(arena, (block_count + 1) * sizeof(int));
+    int* pred_start  = tb_arena_alloc(arena, (block_count + 2) * sizeof(int));
+    memset(pred_start, 0, (block_count + 2) * sizeof(int));
+
+    FOREACH_N(i, 0, block_count) {
         TB_Node* bb = ctx->worklist.items[i];
         assert(bb->type == TB_START || bb->type == TB_REGION);
 
-        dyn_array_put(ctx->worklist.items, bb);
+        int id = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->postorder_id;
+        assert(id >= 0 && id < block_count);
+        index_of[id] = i;
 
         // in(bb) = use(bb)
-        MachineBB* mbb = &nl_map_get_checked(seq_bb, bb);
-        set_copy(&mbb->live_in, &mbb->gen);
+        mbbs[i] = &nl_map_get_checked(seq_bb, bb);
+        set_copy(&mbbs[i]->live_in, &mbbs[i]->gen);
     }
 
-    while (dyn_array_length(ctx->worklist.items) > base) // CUIK_TIMED_BLOCK("global iter")
-    {
-        TB_Node* bb = dyn_array_pop(ctx->worklist.items);
-        TB_NodeRegion* r = TB_NODE_GET_EXTRA(bb);
-        MachineBB* mbb = &nl_map_get_checked(seq_bb, bb);
+    DynArray(int) succs = dyn_array_create(int, block_count * 2);
+    FOREACH_N(i, 0, block_count) {
+        succ_start[i] = dyn_array_length(succs);
 
-        // walk all successors
-        Set* restrict live_out = &mbb->live_out;
-        set_clear(live_out);
+        TB_Node* end = TB_NODE_GET_EXTRA_T(ctx->worklist.items[i], TB_NodeRegion)->end;
+        if (end->type == TB_BRANCH) {
+            TB_NodeBranch* br = TB_NODE_GET_EXTRA(end);
+            FOREACH_N(j, 0, br->succ_count) {
+                int succ = index_of[TB_NODE_GET_EXTRA_T(br->succ[j], TB_NodeRegion)->postorder_id];
+                assert(ctx->worklist.items[succ] == br->succ[j]);
 
-        if (r->end->type == TB_BRANCH) {
-            TB_NodeBranch* br = TB_NODE_GET_EXTRA(r->end);
-            FOREACH_N(i, 0, br->succ_count) {
-                // union with successor's lives
-                MachineBB* succ = &nl_map_get_checked(seq_bb, br->succ[i]);
-                set_union(live_out, &succ->live_in);
+                dyn_array_put(succs, succ);
+                pred_start[succ + 2] += 1;
             }
         }
+    }
+    succ_start[block_count] = dyn_array_length(succs);
+
+    // invert the edges
+    int* preds = tb_arena_alloc(arena, (dyn_array_length(succs) + 1) * sizeof(int));
+    FOREACH_N(i, 0, block_count) pred_start[i + 2] += pred_start[i + 1];
+    FOREACH_N(i, 0, block_count) {
+        FOREACH_N(j, succ_start[i], succ_start[i + 1]) {
+            preds[pred_start[succs[j] + 1]++] = i;
+        }
+    }
 
-        Set* restrict live_in = &mbb->live_in;
-        Set* restrict kill = &mbb->kill;
-        Set* restrict gen = &mbb->gen;
+    // FIFO over block indices, seeded in postorder so successors tend to settle first.
+    // a block is only ever queued once at a time so it fits in block_count slots.
+    int* queue   = tb_arena_alloc(arena, block_count * sizeof(int));
+    bool* queued = tb_arena_alloc(arena, block_count * sizeof(bool));
+    FOREACH_N(i, 0, block_count) queue[i] = i, queued[i] = true;
 
-        // live_in = (live_out - live_kill) U live_gen
-        bool changes = false;
-        FOREACH_N(i, 0, (interval_count + 63) / 64) {
-            bool changes = false;
-            uint64_t new_in = (live_out->data[i] & ~kill->data[i]) | gen->data[i];
+    size_t head = 0, queue_len = block_count;
+    while (queue_len > 0) // CUIK_TIMED_BLOCK("global iter")
+    {
+        int i = queue[head];
+        head = head + 1 == block_count ? 0 : head + 1;
+        queue_len -= 1;
+        queued[i] = false;
+
+        MachineBB* mbb = mbbs[i];
+        uint64_t* restrict live_out = mbb->live_out.data;
+        uint64_t* restrict live_in  = mbb->live_in.data;
+        uint64_t* restrict kill     = mbb->kill.data;
+        uint64_t* restrict gen      = mbb->gen.data;
+
+        // out(bb) = U in(succ)
+        int first = succ_start[i], last = succ_start[i + 1];
+        if (first == last) {
+            memset(live_out, 0, words * sizeof(uint64_t));
+        } else {
+            memcpy(live_out, mbbs[succs[first]]->live_in.data, words * sizeof(uint64_t));
+            FOREACH_N(j, first + 1, last) {
+                uint64_t* restrict other = mbbs[succs[j]]->live_in.data;
+                FOREACH_N(k, 0, words) live_out[k] |= other[k];
+            }
+        }
 
-            changes |= (live_in->data[i] != new_in);
-            live_in->data[i] = new_in;
+        // live_in = (live_out - live_kill) U live_gen
+        uint64_t changes = 0;
+        FOREACH_N(k, 0, words) {
+            uint64_t new_in = (live_out[k] & ~kill[k]) | gen[k];
+            changes |= live_in[k] ^ new_in;
+            live_in[k] = new_in;
         }
 
-        // if we have changes, mark the predeccesors
+        // if we have changes, requeue the predeccesors
         if (changes) {
-            FOREACH_N(i, 0, bb->input_count) {
-                dyn_array_put(ctx->worklist.items, tb_get_parent_region(bb->inputs[i]));
+            FOREACH_N(j, pred_start[i], pred_start[i + 1]) {
+                int pred = preds[j];
+                if (!queued[pred]) {
+                    queued[pred] = true;
+                    queue[(head + queue_len) % block_count] = pred;
+                    queue_len += 1;
+                }
             }
         }
     }
-    dyn_array_set_length(ctx->worklist.items, ctx->block_count);
+    dyn_array_destroy(succs);
 
     /*FOREACH_REVERSE_N(i, 0, ctx->block_count) {
         MachineBB* mbb = &nl_map_get_checked(seq_bb, ctx->worklist.items[i]);
@@ -570,7 +647,7 @@ static void put_val(Ctx* restrict ctx, TB_Node* n, int src) {
 static RegIndex input_reg(Ctx* restrict ctx, TB_Node* n) {
     ValueDesc* val = lookup_val(ctx, n);
     if (val == NULL) {
-        DO_IF(TB_OPTDEBUG_CODEGEN)(log_debug("%s: materialize on the spot for node %zu", ctx->f->super.name, n->gvn));
+        DO_IF(TB_OPTDEBUG_CODEGEN)(log_debug("%s: materialize on the spot for node %u", ctx->f->super.name, n->gvn));
         int tmp = DEF(n, n->dt);
         isel(ctx, n, tmp);
         return tmp;
@@ -581,7 +658,7 @@ static RegIndex input_reg(Ctx* restrict ctx, TB_Node* n) {
     if (val->vreg >= 0) {
         return val->vreg;
     } else if (should_rematerialize(n)) {
-        DO_IF(TB_OPTDEBUG_CODEGEN)(log_debug("%s: materialize on the spot for node %zu", ctx->f->super.name, n->gvn));
+        DO_IF(TB_OPTDEBUG_CODEGEN)(log_debug("%s: materialize on the spot for node %u", ctx->f->super.name, n->gvn));
         int tmp = DEF(n, n->dt);
         isel(ctx, n, tmp);
         return tmp;
@@ -630,6 +707,23 @@ static void isel_set_location(Ctx* restrict ctx, TB_Node* n) {
     }
 }
 
+// does generating n (rematerializing it on the spot counts) read the PHI's register
+static bool phi_move_reads(Ctx* restrict ctx, TB_Node* n, TB_Node* phi) {
+    if (n == phi) {
+        return true;
+    }
+
+    ValueDesc* val = lookup_val(ctx, n);
+    if ((val != NULL && val->vreg >= 0) || !should_rematerialize(n)) {
+        return false;
+    }
+
+    FOREACH_N(i, 0, n->input_count) {
+        if (n->inputs[i] && phi_move_reads(ctx, n->inputs[i], phi)) return true;
+    }
+    return false;
+}
+
 static void isel_region(Ctx* restrict ctx, TB_Node* bb, TB_Node* end) {
     assert(dyn_array_length(ctx->worklist.items) == ctx->block_count);
 
@@ -639,6 +733,11 @@ static void isel_region(Ctx* restrict ctx, TB_Node* bb, TB_Node* end) {
         sched_walk(ctx->p, &ctx->worklist, &phi_vals, bb, end);
     }
 
+    // phase 1.5: hide latency (the top node stays first)
+    if (ctx->sched != NULL) CUIK_TIMED_BLOCK("list sched") {
+        sched_list(ctx->p, &ctx->worklist, ctx->block_count + 1, end, ctx->sched);
+    }
+
     // phase 2: define all the nodes in this BB
     CUIK_TIMED_BLOCK("phase 2") {
         FOREACH_REVERSE_N(i, ctx->block_count, dyn_array_length(ctx->worklist.items)) {
@@ -646,7 +745,7 @@ static void isel_region(Ctx* restrict ctx, TB_Node* bb, TB_Node* end) {
 
             // track use count
             size_t use_count = 0;
-            for (User* use = find_users(ctx->p, n); use; use = use->next) {
+            FOR_USERS(use, n) {
                 if (use->n->inputs[0] != NULL) use_count++;
             }
 
@@ -654,6 +753,16 @@ static void isel_region(Ctx* restrict ctx, TB_Node* bb, TB_Node* end) {
             ctx->values[n->gvn].uses = use_count;
             ctx->values[n->gvn].vreg = -1;
         }
+
+        FOREACH_N(i, ctx->block_count, dyn_array_length(ctx->worklist.items)) {
+            TB_Node* n = ctx->worklist.items[i];
+            ctx->values[n->gvn].epoch = ctx->epoch_count;
+
+            if (n->dt.type == TB_TUPLE || n->dt.type == TB_CONTROL || n->dt.type == TB_MEMORY) {
+                ctx->epoch_count += 1;
+            }
+        }
+        ctx->epoch_count += 1;
     }
 
     // phase 3: within the BB, the phi nodes should view itself as the previous value
@@ -668,7 +777,7 @@ static void isel_region(Ctx* restrict ctx, TB_Node* bb, TB_Node* end) {
             v->dst = input_reg(ctx, v->phi);
         }
 
-        for (User* use = find_users(ctx->p, top); use; use = use->next) {
+        FOR_USERS(use, top) {
             if (use->n->type == TB_PHI && use->n->dt.type != TB_MEMORY) {
                 ValueDesc* val = &ctx->values[use->n->gvn];
 
@@ -706,7 +815,7 @@ static void isel_region(Ctx* restrict ctx, TB_Node* bb, TB_Node* end) {
             // if the value hasn't been asked for yet and
             if (val->vreg < 0 && should_rematerialize(n)) {
                 DO_IF(TB_OPTDEBUG_CODEGEN)(
-                    printf("  DISCARD %zu: ", n->gvn),
+                    printf("  DISCARD %u: ", n->gvn),
                     print_node_sexpr(n, 0),
                     printf("\n")
                 );
@@ -717,24 +826,64 @@ static void isel_region(Ctx* restrict ctx, TB_Node* bb, TB_Node* end) {
             Inst dummy;
             dummy.next = NULL;
             ctx->head = &dummy;
+            ctx->epoch = val->epoch;
 
             if (n->dt.type == TB_TUPLE || n->dt.type == TB_CONTROL || n->dt.type == TB_MEMORY) {
                 DO_IF(TB_OPTDEBUG_CODEGEN)(
-                    printf("  EFFECT %zu: ", n->gvn),
+                    printf("  EFFECT %u: ", n->gvn),
                     print_node_sexpr(n, 0),
                     printf("\n")
                 );
 
                 if (n->type == TB_BRANCH) {
-                    // writeback PHIs
+                    // writeback PHIs, these are parallel copies so a move can't clobber
+                    // a PHI which another move still reads (a = b, b = t) and a cycle
+                    // of them needs a temporary. the sources are generated right before
+                    // their move like usual, -1 means we haven't yet.
+                    int* srcs = tb_arena_alloc(tmp_arena, our_phis * sizeof(int));
+                    bool* done = tb_arena_alloc(tmp_arena, our_phis * sizeof(bool));
                     FOREACH_N(i, 0, our_phis) {
-                        PhiVal* v = &phi_vals[i];
-                        TB_DataType dt = v->phi->dt;
+                        srcs[i] = -1, done[i] = false;
+                    }
 
-                        int src = input_reg(ctx, v->n);
+                    size_t left = our_phis;
+                    while (left > 0) {
+                        bool progress = false;
+                        FOREACH_N(i, 0, our_phis) {
+                            if (done[i]) continue;
+
+                            bool blocked = false;
+                            FOREACH_N(j, 0, our_phis) {
+                                if (!done[j] && j != i && srcs[j] < 0 && phi_move_reads(ctx, phi_vals[j].n, phi_vals[i].phi)) {
+                                    blocked = true;
+                                    break;
+                                }
+                            }
+
+                            if (!blocked) {
+                                PhiVal* v = &phi_vals[i];
+                                TB_DataType dt = v->phi->dt;
+
+                                if (srcs[i] < 0) srcs[i] = input_reg(ctx, v->n);
+                                hint_reg(ctx, v->dst, srcs[i]);
+                                SUBMIT(inst_move(dt, v->dst, srcs[i]));
+                                done[i] = true, left -= 1, progress = true;
+                            }
+                        }
 
-                        hint_reg(ctx, v->dst, src);
-                        SUBMIT(inst_move(dt, v->dst, src));
+                        if (!progress) {
+                            // everything left is in a cycle, read one of them early
+                            size_t i = 0;
+                            while (done[i] || srcs[i] >= 0) i++;
+
+                            srcs[i] = input_reg(ctx, phi_vals[i].n);
+                            if (phi_vals[i].n->type == TB_PHI) {
+                                TB_DataType dt = phi_vals[i].phi->dt;
+                                int tmp = DEF(NULL, dt);
+                                SUBMIT(inst_move(dt, tmp, srcs[i]));
+                                srcs[i] = tmp;
+                            }
+                        }
                     }
                 }
 
@@ -760,7 +909,7 @@ static void isel_region(Ctx* restrict ctx, TB_Node* bb, TB_Node* end) {
                 }
 
                 DO_IF(TB_OPTDEBUG_CODEGEN)(
-                    printf("  DATA %zu: ", n->gvn),
+                    printf("  DATA %u: ", n->gvn),
                     print_node_sexpr(n, 0),
                     printf("\n")
                 );
@@ -768,7 +917,7 @@ static void isel_region(Ctx* restrict ctx, TB_Node* bb, TB_Node* end) {
                 isel(ctx, n, val->vreg);
             } else {
                 DO_IF(TB_OPTDEBUG_CODEGEN)(
-                    printf("  DEAD %zu: ", n->gvn),
+                    printf("  DEAD %u: ", n->gvn),
                     print_node_sexpr(n, 0),
                     printf("\n")
                 );
@@ -829,6 +978,224 @@ static void isel_region(Ctx* restrict ctx, TB_Node* bb, TB_Node* end) {
     dyn_array_set_length(ctx->worklist.items, ctx->block_count);
 }
 
+////////////////////////////////
+// Block layout
+////////////////////////////////
+// blocks are placed so the likely paths fall through:
+//
+//   * cold blocks (the ones which only lead into an unreachable or trap, or which we
+//     only get into across edges the branch weights say are rarely taken) go after
+//     everything else, past the epilogue.
+//   * the rest get chained from the entry, each block is followed by its heaviest
+//     successor once all of that successor's forward preds are placed. when nothing
+//     qualifies we pick up the first unplaced block in reverse postorder.
+//   * loop headers get aligned so the backedge lands on a fresh fetch block.
+//
+// the order is written back into the worklist (reversed so it still reads like a
+// postorder) since that's what isel, liveness and regalloc walk.
+enum {
+    // an edge with less than 1/32 of the branch's weight is cold
+    LAYOUT_COLD_RATIO = 32,
+    LAYOUT_LOOP_ALIGN = 16,
+};
+
+static bool layout_is_block(Ctx* restrict ctx, TB_Node* bb) {
+    int id = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->postorder_id;
+    return id >= 0 && id < ctx->block_count && ctx->worklist.items[id] == bb;
+}
+
+// how much of pred's branch goes into bb, without weights every edge counts the same
+static uint64_t layout_edge_weight(TB_Node* pred, TB_Node* bb, uint64_t* out_total) {
+    TB_NodeBranch* br = TB_NODE_GET_EXTRA(TB_NODE_GET_EXTRA_T(pred, TB_NodeRegion)->end);
+
+    uint64_t w = 0, total = 0;
+    FOREACH_N(i, 0, br->succ_count) {
+        uint64_t x = br->weights ? br->weights[i] : 1;
+        if (br->succ[i] == bb) w += x;
+        total += x;
+    }
+
+    *out_total = total;
+    return w;
+}
+
+static bool layout_is_cold(Ctx* restrict ctx, bool* cold, TB_Node* bb) {
+    TB_Node* end = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->end;
+    if (end->type == TB_UNREACHABLE || end->type == TB_TRAP) {
+        return true;
+    }
+
+    // everything after us is cold
+    if (end->type == TB_BRANCH) {
+        TB_NodeBranch* br = TB_NODE_GET_EXTRA(end);
+
+        bool all_cold = br->succ_count > 0;
+        FOREACH_N(i, 0, br->succ_count) {
+            TB_Node* succ = br->succ[i];
+            if (!layout_is_block(ctx, succ) || !cold[TB_NODE_GET_EXTRA_T(succ, TB_NodeRegion)->postorder_id]) {
+                all_cold = false;
+                break;
+            }
+        }
+
+        if (all_cold) return true;
+    }
+
+    // every way in is cold or rarely taken, backedges (preds which come earlier in
+    // the postorder) don't count.
+    int id = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->postorder_id;
+    bool has_preds = false;
+    FOREACH_N(i, 0, bb->input_count) {
+        TB_Node* pred = tb_get_parent_region(bb->inputs[i]);
+        if (!layout_is_block(ctx, pred)) continue;
+
+        int pred_id = TB_NODE_GET_EXTRA_T(pred, TB_NodeRegion)->postorder_id;
+        if (pred_id <= id) continue;
+
+        has_preds = true;
+        if (cold[pred_id]) continue;
+
+        uint64_t total, w = layout_edge_weight(pred, bb, &total);
+        if (TB_NODE_GET_EXTRA_T(TB_NODE_GET_EXTRA_T(pred, TB_NodeRegion)->end, TB_NodeBranch)->weights == NULL ||
+            w * LAYOUT_COLD_RATIO >= total) {
+            return false;
+        }
+    }
+
+    return has_preds;
+}
+
+// the forward preds have all been placed (or are cold and will go at the end)
+static bool layout_preds_placed(Ctx* restrict ctx, bool* placed, bool* cold, TB_Node* bb) {
+    int id = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->postorder_id;
+    FOREACH_N(i, 0, bb->input_count) {
+        TB_Node* pred = tb_get_parent_region(bb->inputs[i]);
+        if (!layout_is_block(ctx, pred)) continue;
+
+        int pred_id = TB_NODE_GET_EXTRA_T(pred, TB_NodeRegion)->postorder_id;
+        if (pred_id > id && !placed[pred_id] && !cold[pred_id]) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// reorders the blocks in the worklist, returns which of them (by worklist index) are
+// loop headers we want aligned.
+static bool* layout_blocks(Ctx* restrict ctx, TB_Function* f, TB_Node* stop_bb) {
+    size_t count = ctx->block_count;
+    TB_Node** blocks = ctx->worklist.items;
+    FOREACH_N(i, 0, count) {
+        assert(TB_NODE_GET_EXTRA_T(blocks[i], TB_NodeRegion)->postorder_id == i);
+    }
+
+    bool* cold   = tb_arena_alloc(tmp_arena, count * sizeof(bool));
+    bool* placed = tb_arena_alloc(tmp_arena, count * sizeof(bool));
+    bool* align  = tb_arena_alloc(tmp_arena, count * sizeof(bool));
+    TB_Node** order = tb_arena_alloc(tmp_arena, count * sizeof(TB_Node*));
+    FOREACH_N(i, 0, count) {
+        cold[i] = placed[i] = false;
+    }
+
+    // the cold set only ever grows, keep going until it settles
+    bool changes = true;
+    while (changes) {
+        changes = false;
+        FOREACH_N(i, 0, count) {
+            TB_Node* bb = blocks[i];
+            if (!cold[i] && bb != f->start_node && bb != stop_bb && layout_is_cold(ctx, cold, bb)) {
+                cold[i] = true;
+                changes = true;
+            }
+        }
+    }
+
+    // chain the hot blocks
+    size_t placed_count = 0, cursor = count;
+    TB_Node* bb = f->start_node;
+    while (bb != NULL) {
+        int id = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->postorder_id;
+        placed[id] = true;
+        order[placed_count++] = bb;
+
+        // follow the heaviest edge, ties go to whoever is first in reverse postorder
+        TB_Node* next = NULL;
+        int next_id = -1;
+        uint64_t best = 0;
+
+        TB_Node* end = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->end;
+        if (end->type == TB_BRANCH) {
+            TB_NodeBranch* br = TB_NODE_GET_EXTRA(end);
+            FOREACH_N(i, 0, br->succ_count) {
+                TB_Node* succ = br->succ[i];
+                if (succ == stop_bb || !layout_is_block(ctx, succ)) continue;
+
+                int succ_id = TB_NODE_GET_EXTRA_T(succ, TB_NodeRegion)->postorder_id;
+                if (placed[succ_id] || cold[succ_id] || !layout_preds_placed(ctx, placed, cold, succ)) continue;
+
+                uint64_t total, w = layout_edge_weight(bb, succ, &total);
+                if (next == NULL || w > best || (w == best && succ_id > next_id)) {
+                    next = succ, next_id = succ_id, best = w;
+                }
+            }
+        }
+
+        if (next == NULL) {
+            while (cursor > 0) {
+                cursor -= 1;
+
+                TB_Node* other = blocks[cursor];
+                if (!placed[cursor] && !cold[cursor] && other != stop_bb) {
+                    next = other;
+                    break;
+                }
+            }
+        }
+
+        bb = next;
+    }
+
+    // the epilogue goes after the hot code (unless it's the entry), the cold blocks after that
+    if (layout_is_block(ctx, stop_bb) && !placed[TB_NODE_GET_EXTRA_T(stop_bb, TB_NodeRegion)->postorder_id]) {
+        placed[TB_NODE_GET_EXTRA_T(stop_bb, TB_NodeRegion)->postorder_id] = true;
+        order[placed_count++] = stop_bb;
+    }
+
+    FOREACH_REVERSE_N(i, 0, count) {
+        if (!placed[i]) order[placed_count++] = blocks[i];
+    }
+    assert(placed_count == count);
+
+    // a hot block with a hot backedge into it is a loop header
+    FOREACH_N(i, 0, count) {
+        TB_Node* header = order[i];
+        int id = TB_NODE_GET_EXTRA_T(header, TB_NodeRegion)->postorder_id;
+
+        bool is_loop = false;
+        if (!cold[id]) {
+            FOREACH_N(j, 0, header->input_count) {
+                TB_Node* pred = tb_get_parent_region(header->inputs[j]);
+                if (!layout_is_block(ctx, pred)) continue;
+
+                int pred_id = TB_NODE_GET_EXTRA_T(pred, TB_NodeRegion)->postorder_id;
+                if (pred_id <= id && !cold[pred_id]) {
+                    is_loop = true;
+                    break;
+                }
+            }
+        }
+
+        align[count - 1 - i] = is_loop;
+    }
+
+    FOREACH_N(i, 0, count) {
+        blocks[count - 1 - i] = order[i];
+    }
+
+    return align;
+}
+
 // Codegen through here is done in phases
 static void compile_function(TB_Passes* restrict p, TB_FunctionOutput* restrict func_out, const TB_FeatureSet* features, uint8_t* out, size_t out_capacity, bool emit_asm) {
     verify_tmp_arena(p);
@@ -838,6 +1205,9 @@ static void compile_function(TB_Passes* restrict p, TB_FunctionOutput* restrict
 
     tb_pass_schedule(p);
 
+    // calls in tail position become jumps (with the epilogue in front of them)
+    int tail_calls = tb_pass_tail_calls(p, can_tail_call);
+
     #if 0
     reg_alloc_log = strcmp(f->super.name, "main_wnd_proc") == 0;
     if (reg_alloc_log) {
@@ -853,6 +1223,7 @@ static void compile_function(TB_Passes* restrict p, TB_FunctionOutput* restrict
         .f = f,
         .p = p,
         .target_abi = f->super.module->target_abi,
+        .sched = p->local_sched == TB_LOCAL_SCHED_LIST ? sched_model(features) : NULL,
         .emit = {
             .f = f,
             .emit_asm = emit_asm,
@@ -881,6 +1252,13 @@ static void compile_function(TB_Passes* restrict p, TB_FunctionOutput* restrict
     assert(p->worklist.items[ctx.block_count - 1] == f->start_node && "Codegen must always schedule entry BB first");
 
     worklist_clear_visited(&p->worklist);
+    ctx.worklist = p->worklist;
+
+    TB_Node* stop_bb = tb_get_parent_region(f->stop_node);
+    bool* align;
+    CUIK_TIMED_BLOCK("layout") {
+        align = layout_blocks(&ctx, f, stop_bb);
+    }
 
     // Instruction selection:
     //   we just decide which instructions to emit, which operands are
@@ -894,7 +1272,7 @@ static void compile_function(TB_Passes* restrict p, TB_FunctionOutput* restrict
         FOREACH_REVERSE_N(i, 0, ctx.block_count) {
             TB_Node* bb = ctx.worklist.items[i];
 
-            for (User* use = find_users(p, bb); use; use = use->next) {
+            FOR_USERS(use, bb) {
                 TB_Node* n = use->n;
                 if (n->type == TB_PHI && n->dt.type != TB_MEMORY) {
                     worklist_test_n_set(&ctx.worklist, n);
@@ -904,50 +1282,34 @@ static void compile_function(TB_Passes* restrict p, TB_FunctionOutput* restrict
             }
         }
 
-        // compile all nodes which aren't the STOP node
-        TB_Node* stop_node = f->stop_node;
-        TB_Node* stop_bb = tb_get_parent_region(stop_node);
-
+        // compile all nodes in the order layout picked
         bool has_stop = false;
         FOREACH_REVERSE_N(i, 0, ctx.block_count) {
             TB_Node* bb = ctx.worklist.items[i];
             assert(bb->type == TB_START || bb->type == TB_REGION);
 
             nl_map_put(ctx.emit.labels, bb, 0);
-            if (bb != stop_bb) {
-                // mark fallthrough
-                ctx.fallthrough = i > 0 ? ctx.worklist.items[i - 1] : NULL;
-                if (ctx.fallthrough == stop_bb) ctx.fallthrough = NULL;
-
-                Inst* label = inst_label(bb);
-                if (ctx.first == NULL) {
-                    ctx.first = ctx.head = label;
-                } else {
-                    append_inst(&ctx, label);
-                }
-
-                TB_Node* end = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->end;
-                isel_region(&ctx, bb, end);
-            } else {
-                has_stop = true;
-            }
-        }
+            has_stop |= bb == stop_bb;
 
-        // always schedule the STOP node here
-        if (has_stop) {
             // mark fallthrough
-            ctx.fallthrough = NULL;
+            ctx.fallthrough = i > 0 ? ctx.worklist.items[i - 1] : NULL;
+
+            Inst* label = inst_label(bb);
+            if (align[i]) {
+                label->imm = LAYOUT_LOOP_ALIGN;
+            }
 
-            Inst* label = inst_label(stop_bb);
             if (ctx.first == NULL) {
                 ctx.first = ctx.head = label;
             } else {
                 append_inst(&ctx, label);
             }
 
-            TB_Node* end = TB_NODE_GET_EXTRA_T(stop_bb, TB_NodeRegion)->end;
-            isel_region(&ctx, stop_bb, end);
-        } else {
+            TB_Node* end = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->end;
+            isel_region(&ctx, bb, end);
+        }
+
+        if (!has_stop && tail_calls == 0) {
             // liveness expects one but we don't really have shit to put down there... it's never reached
             append_inst(&ctx, alloc_inst(INST_EPILOGUE, TB_TYPE_VOID, 0, 0, 0));
         }
@@ -961,9 +1323,13 @@ static void compile_function(TB_Passes* restrict p, TB_FunctionOutput* restrict
             end = liveness(&ctx, f);
         }
 
-        // we can in theory have other regalloc solutions and eventually will put
-        // graph coloring here.
-        ctx.stack_usage = linear_scan(&ctx, f, ctx.stack_usage, end);
+        // linear scan unless the user asked for something slower
+        ctx.stack_usage = reg_allocs[p->regalloc](&ctx, f, ctx.stack_usage, end);
+
+        // regalloc leaves copies & reloads behind, clean those up
+        CUIK_TIMED_BLOCK("peephole") {
+            peephole(&ctx);
+        }
 
         // Arch-specific: convert instruction buffer into actual instructions
         CUIK_TIMED_BLOCK("emit code") {
@@ -972,8 +1338,11 @@ static void compile_function(TB_Passes* restrict p, TB_FunctionOutput* restrict
     }
 
     nl_map_free(ctx.emit.labels);
+    dyn_array_destroy(ctx.emit.branches);
+    dyn_array_destroy(ctx.emit.aligns);
     nl_map_free(ctx.machine_bbs);
     dyn_array_destroy(ctx.intervals);
+    dyn_array_destroy(ctx.epilogues);
     dyn_array_destroy(ctx.phi_vals);
 
     if (dyn_array_length(ctx.locations)) {
@@ -0,0 +1,573 @@
+// Post-RA peepholes, regalloc leaves a fair bit of junk behind: copies which nobody reads,
+// reloads of values still sitting in a register, zero tests of values which the ALU op
+// already set the flags for. these run over the Inst list right before emission:
+//
+//   * copies get propagated forward within a block, liveness over the physical registers
+//     removes the ones which end up dead (along with any other dead pure defs).
+//   * reloading a spill slot we just stored into becomes a register copy.
+//   * a copy of a zeroed register becomes a zeroing of its own.
+//   * zero tests after an op which set ZF & SF from the same value go away.
+//   * compares get sunk down to their branch so they macro-fuse.
+//
+// the rules only know about instructions through their PeepFlags, the target fills
+// those in (peep_classify) and tells us when a destination is also read (peep_reads_dst).
+typedef enum {
+    // operands describe every register it touches, anything else is a barrier
+    PEEP_KNOWN        = 1 << 0,
+    // writes the destination without looking at the old value
+    PEEP_DEF          = 1 << 1,
+    // no side effects besides writing the destination (memory operands aside)
+    PEEP_PURE         = 1 << 2,
+    // out = in[0]
+    PEEP_MOVE         = 1 << 3,
+    // has a memory operand but never touches memory (LEA)
+    PEEP_ADDR         = 1 << 4,
+    // operands are pinned by the hardware or the ABI, leave them alone
+    PEEP_FIXED        = 1 << 5,
+
+    PEEP_WRITES_FLAGS = 1 << 6,
+    // ZF & SF come from the result, just like testing it against zero
+    PEEP_FLAGS_ZS     = 1 << 7,
+    // ...and the rest of the flags match a test too
+    PEEP_FLAGS_TEST   = 1 << 8,
+    PEEP_READS_FLAGS  = 1 << 9,
+    // only looks at ZF & SF
+    PEEP_READS_ZS     = 1 << 10,
+    // only writes flags
+    PEEP_COMPARE      = 1 << 11,
+    // `op a, a` compares a against zero
+    PEEP_ZERO_TEST_RR = 1 << 12,
+    // `op a, 0` compares a against zero
+    PEEP_ZERO_TEST_I  = 1 << 13,
+
+    PEEP_JUMP         = 1 << 14,
+    PEEP_BRANCH       = 1 << 15,
+} PeepFlags;
+
+typedef enum {
+    PEEP_NONE,
+    PEEP_CHANGED,
+    // the instruction isn't at prev->next anymore
+    PEEP_REMOVED,
+} PeepResult;
+
+enum {
+    PEEP_MAX_ROUNDS = 4,
+    // how far forward the rules look for users
+    PEEP_WINDOW     = 32,
+    // locations past this are stack slots, the rest are (class * 32) + reg
+    PEEP_SLOT       = 64,
+};
+
+#define PEEP_ALL (~UINT64_C(0))
+
+typedef struct {
+    uint64_t reads, writes, kills;
+} PeepEffects;
+
+typedef struct {
+    Inst* label;
+    int start, count;
+
+    int succ[2], succ_count;
+    // exit is anywhere we lose track of the control flow, ret is a plain return
+    bool exit, ret;
+
+    uint64_t gen, kill, live_in, live_out;
+} PeepBlock;
+
+typedef PeepResult (*PeepRule)(Ctx* restrict ctx, Inst* prev, Inst* inst, uint32_t info);
+
+static uint32_t peep_classify(int type);
+static bool peep_reads_dst(Ctx* restrict ctx, Inst* inst, uint32_t info);
+static uint64_t peep_return_live(Ctx* restrict ctx);
+
+static uint32_t peep_info(Inst* inst) {
+    // the pseudo-ops live past the end of InstType
+    switch ((int) inst->type) {
+        case INST_LINE:
+        case INST_TERMINATOR:
+        case INST_EPILOGUE:
+        case INST_ENTRY:
+        return PEEP_KNOWN;
+
+        case INST_ZERO:
+        return PEEP_KNOWN | PEEP_DEF | PEEP_PURE | PEEP_WRITES_FLAGS;
+
+        case INST_LABEL:
+        case INST_INLINE:
+        case INST_SWITCH:
+        return 0;
+
+        default:
+        return peep_classify(inst->type);
+    }
+}
+
+static int peep_loc(Ctx* restrict ctx, RegIndex r) {
+    LiveInterval* it = &ctx->intervals[r];
+    if (it->spill > 0) {
+        return PEEP_SLOT + it->spill;
+    } else if (it->assigned < 0) {
+        return -1;
+    } else {
+        return it->reg_class*32 + it->assigned;
+    }
+}
+
+static bool peep_is_reg(int loc) { return loc >= 0 && loc < PEEP_SLOT; }
+static bool peep_same_class(int a, int b) { return a / 32 == b / 32; }
+
+static bool peep_is_copy(Inst* inst, uint32_t info) {
+    return (info & PEEP_MOVE) && inst->out_count == 1 && inst->in_count == 1 && inst->tmp_count == 0 && (inst->flags & ~INST_SPILL) == 0;
+}
+
+// plain integer copies, the rest either merge into the destination or change the value
+static bool peep_is_int_copy(Inst* inst, uint32_t info) {
+    return peep_is_copy(inst, info) && (inst->dt == TB_X86_TYPE_DWORD || inst->dt == TB_X86_TYPE_QWORD);
+}
+
+// false if it's a barrier
+static bool peep_effects(Ctx* restrict ctx, Inst* inst, uint32_t info, PeepEffects* e) {
+    *e = (PeepEffects){ 0 };
+    if ((info & PEEP_KNOWN) == 0) {
+        return false;
+    }
+
+    RegIndex* ops = inst->operands;
+    bool merge = inst->out_count > 0 && peep_reads_dst(ctx, inst, info);
+    FOREACH_N(i, 0, inst->out_count + inst->in_count + inst->tmp_count) {
+        int loc = peep_loc(ctx, ops[i]);
+        if (loc < 0) return false;
+        if (loc >= PEEP_SLOT) continue;
+
+        uint64_t bit = UINT64_C(1) << loc;
+        if (i < inst->out_count) {
+            e->writes |= bit;
+            if (merge) e->reads |= bit;
+            else e->kills |= bit;
+        } else if (i < inst->out_count + inst->in_count) {
+            e->reads |= bit;
+        } else {
+            // clobbers
+            e->writes |= bit;
+            e->kills |= bit;
+        }
+    }
+    return true;
+}
+
+static bool peep_has_loc(Ctx* restrict ctx, RegIndex* ops, size_t count, int loc) {
+    FOREACH_N(i, 0, count) {
+        if (peep_loc(ctx, ops[i]) == loc) return true;
+    }
+    return false;
+}
+
+static bool peep_writes(Ctx* restrict ctx, Inst* inst, int loc) {
+    return peep_has_loc(ctx, inst->operands, inst->out_count, loc) ||
+        peep_has_loc(ctx, inst->operands + inst->out_count + inst->in_count, inst->tmp_count, loc);
+}
+
+// the tested location if it's a compare against zero
+static int peep_zero_test(Ctx* restrict ctx, Inst* inst, uint32_t info) {
+    if (inst->out_count != 0) return -1;
+
+    RegIndex* ins = inst->operands;
+    if ((info & PEEP_ZERO_TEST_RR) && inst->in_count == 2 && inst->flags == 0) {
+        int a = peep_loc(ctx, ins[0]);
+        return peep_is_reg(a) && a == peep_loc(ctx, ins[1]) ? a : -1;
+    } else if ((info & PEEP_ZERO_TEST_I) && inst->in_count == 1 && inst->flags == INST_IMM && inst->imm == 0) {
+        int a = peep_loc(ctx, ins[0]);
+        return peep_is_reg(a) ? a : -1;
+    }
+    return -1;
+}
+
+// flags never live across blocks, isel puts the compare next to its user
+static bool peep_flags_dead_after(Inst* inst) {
+    for (Inst* y = inst->next; y && y->type != INST_LABEL; y = y->next) {
+        uint32_t info = peep_info(y);
+        if ((info & PEEP_KNOWN) == 0 || (info & PEEP_READS_FLAGS)) return false;
+        if (info & PEEP_WRITES_FLAGS) return true;
+    }
+    return true;
+}
+
+static bool peep_flags_only_zs_after(Inst* inst) {
+    for (Inst* y = inst->next; y && y->type != INST_LABEL; y = y->next) {
+        uint32_t info = peep_info(y);
+        if ((info & PEEP_KNOWN) == 0) return false;
+        if ((info & PEEP_READS_FLAGS) && (info & PEEP_READS_ZS) == 0) return false;
+        if ((info & PEEP_WRITES_FLAGS) && (info & PEEP_READS_FLAGS) == 0) return true;
+    }
+    return true;
+}
+
+////////////////////////////////
+// Rules
+////////////////////////////////
+// mov a, a
+static PeepResult peep_self_copy(Ctx* restrict ctx, Inst* prev, Inst* inst, uint32_t info) {
+    if (!peep_is_copy(inst, info)) return PEEP_NONE;
+
+    int a = peep_loc(ctx, inst->operands[0]);
+    if (a < 0 || a != peep_loc(ctx, inst->operands[1])) return PEEP_NONE;
+
+    prev->next = inst->next;
+    return PEEP_REMOVED;
+}
+
+// mov [slot], r ... mov r2, [slot] => mov r2, r
+static PeepResult peep_forward_spill(Ctx* restrict ctx, Inst* prev, Inst* inst, uint32_t info) {
+    if (!peep_is_int_copy(inst, info)) return PEEP_NONE;
+
+    int slot = peep_loc(ctx, inst->operands[0]);
+    int r = peep_loc(ctx, inst->operands[1]);
+    if (slot < PEEP_SLOT || !peep_is_reg(r)) return PEEP_NONE;
+
+    PeepResult res = PEEP_NONE;
+    int n = 0;
+    for (Inst* y = inst->next; y && y->type != INST_LABEL && n < PEEP_WINDOW; y = y->next, n++) {
+        uint32_t yi = peep_info(y);
+        if ((yi & PEEP_KNOWN) == 0 || (yi & PEEP_FIXED)) break;
+
+        if (peep_is_copy(y, yi) && y->dt == inst->dt && peep_loc(ctx, y->operands[1]) == slot) {
+            int dst = peep_loc(ctx, y->operands[0]);
+
+            // the reload into the same register still zero extends the 32bit ones
+            if (peep_is_reg(dst) && peep_same_class(dst, r) && (dst != r || inst->dt == TB_X86_TYPE_QWORD)) {
+                y->operands[1] = inst->operands[1];
+                res = PEEP_CHANGED;
+            }
+        }
+
+        if (peep_writes(ctx, y, slot) || peep_writes(ctx, y, r)) break;
+    }
+
+    return res;
+}
+
+// mov a, b followed by reads of a, those read b instead which usually leaves the copy dead.
+static PeepResult peep_copy_prop(Ctx* restrict ctx, Inst* prev, Inst* inst, uint32_t info) {
+    if (!peep_is_int_copy(inst, info)) return PEEP_NONE;
+
+    RegIndex src = inst->operands[1];
+    int a = peep_loc(ctx, inst->operands[0]), b = peep_loc(ctx, src);
+    if (!peep_is_reg(a) || !peep_is_reg(b) || a == b || !peep_same_class(a, b)) return PEEP_NONE;
+
+    PeepResult res = PEEP_NONE;
+    int n = 0;
+    for (Inst* y = inst->next; y && y->type != INST_LABEL && n < PEEP_WINDOW; y = y->next, n++) {
+        uint32_t yi = peep_info(y);
+        if ((yi & PEEP_KNOWN) == 0 || (yi & PEEP_FIXED)) break;
+
+        RegIndex* outs = y->operands;
+        RegIndex* ins  = outs + y->out_count;
+        RegIndex* tmps = ins + y->in_count;
+        FOREACH_N(k, 0, y->in_count) {
+            // physical operands are constraints, not something regalloc picked
+            if (ctx->intervals[ins[k]].reg >= 0 || peep_loc(ctx, ins[k]) != a) continue;
+
+            // 32bit copies zero extend, only the low half is the same
+            int slot = y->out_count + k;
+            bool addr = (y->flags & INST_MEM) && (slot == y->mem_slot || ((y->flags & INST_INDEXED) && slot == y->mem_slot + 1));
+            if (inst->dt != TB_X86_TYPE_QWORD && (addr || y->dt < TB_X86_TYPE_BYTE || y->dt > TB_X86_TYPE_DWORD)) continue;
+
+            // outs & temps get written while the later inputs are still being read
+            if (k > 0 && peep_has_loc(ctx, outs, y->out_count, b)) continue;
+            if (peep_has_loc(ctx, tmps, y->tmp_count, b)) continue;
+
+            ins[k] = src;
+            res = PEEP_CHANGED;
+        }
+
+        if (peep_writes(ctx, y, a) || peep_writes(ctx, y, b)) break;
+    }
+
+    return res;
+}
+
+// xor z, z ... mov a, z => xor a, a
+static PeepResult peep_zero_copy(Ctx* restrict ctx, Inst* prev, Inst* inst, uint32_t info) {
+    if (inst->type != INST_ZERO || (inst->dt != TB_X86_TYPE_DWORD && inst->dt != TB_X86_TYPE_QWORD)) return PEEP_NONE;
+
+    int z = peep_loc(ctx, inst->operands[0]);
+    if (!peep_is_reg(z)) return PEEP_NONE;
+
+    PeepResult res = PEEP_NONE;
+    int n = 0;
+    for (Inst* y = inst->next; y && y->type != INST_LABEL && n < PEEP_WINDOW; y = y->next, n++) {
+        uint32_t yi = peep_info(y);
+        if ((yi & PEEP_KNOWN) == 0 || (yi & PEEP_FIXED)) break;
+
+        if (peep_is_int_copy(y, yi) && peep_loc(ctx, y->operands[1]) == z) {
+            int dst = peep_loc(ctx, y->operands[0]);
+            if (peep_is_reg(dst) && peep_same_class(dst, z) && peep_flags_dead_after(y)) {
+                y->type = INST_ZERO;
+                y->flags = 0;
+                y->in_count = 0;
+                res = PEEP_CHANGED;
+            }
+        }
+
+        if (peep_writes(ctx, y, z)) break;
+    }
+
+    return res;
+}
+
+// and a, b ... test a, a, the flags are already there
+static PeepResult peep_redundant_test(Ctx* restrict ctx, Inst* prev, Inst* inst, uint32_t info) {
+    if ((info & PEEP_FLAGS_ZS) == 0 || inst->out_count != 1 || (inst->flags & INST_LOCK)) return PEEP_NONE;
+
+    int x = peep_loc(ctx, inst->operands[0]);
+    if (!peep_is_reg(x)) return PEEP_NONE;
+
+    Inst* yprev = inst;
+    for (Inst* y = inst->next; y && y->type != INST_LABEL; yprev = y, y = y->next) {
+        uint32_t yi = peep_info(y);
+        if ((yi & PEEP_KNOWN) == 0) break;
+
+        if (peep_zero_test(ctx, y, yi) == x && y->dt == inst->dt) {
+            // CF & OF don't match a test unless it's a logical op
+            if ((info & PEEP_FLAGS_TEST) == 0 && !peep_flags_only_zs_after(y)) break;
+
+            yprev->next = y->next;
+            return PEEP_CHANGED;
+        }
+
+        if ((yi & (PEEP_WRITES_FLAGS | PEEP_READS_FLAGS)) || peep_writes(ctx, y, x)) break;
+    }
+
+    return PEEP_NONE;
+}
+
+// cmp a, b; mov c, d; jcc => mov c, d; cmp a, b; jcc
+static PeepResult peep_sink_compare(Ctx* restrict ctx, Inst* prev, Inst* inst, uint32_t info) {
+    if ((info & PEEP_COMPARE) == 0 || (info & PEEP_FIXED) || (inst->flags & (INST_MEM | INST_GLOBAL))) return PEEP_NONE;
+
+    PeepEffects e;
+    if (!peep_effects(ctx, inst, info, &e)) return PEEP_NONE;
+    FOREACH_N(i, 0, inst->in_count) {
+        if (!peep_is_reg(peep_loc(ctx, inst->operands[i]))) return PEEP_NONE;
+    }
+
+    Inst* last = inst;
+    for (Inst* y = inst->next; y && y->type != INST_LABEL; y = y->next) {
+        uint32_t yi = peep_info(y);
+        if (yi & PEEP_BRANCH) {
+            if (last == inst) return PEEP_NONE;
+
+            prev->next = inst->next;
+            inst->next = last->next;
+            last->next = inst;
+            return PEEP_REMOVED;
+        }
+
+        PeepEffects ye;
+        if (!peep_effects(ctx, y, yi, &ye) || (yi & (PEEP_FIXED | PEEP_READS_FLAGS | PEEP_WRITES_FLAGS))) break;
+        if (ye.writes & e.reads) break;
+        last = y;
+    }
+
+    return PEEP_NONE;
+}
+
+static const PeepRule peep_rules[] = {
+    peep_self_copy,
+    peep_forward_spill,
+    peep_copy_prop,
+    peep_zero_copy,
+    peep_redundant_test,
+    peep_sink_compare,
+};
+
+////////////////////////////////
+// Dead code
+////////////////////////////////
+static bool peep_is_dead_candidate(Ctx* restrict ctx, Inst* inst, uint32_t info) {
+    if ((info & PEEP_PURE) == 0 || inst->out_count != 1 || inst->tmp_count != 0 || (inst->flags & INST_LOCK)) {
+        return false;
+    }
+
+    // loads might be volatile
+    if ((inst->flags & (INST_MEM | INST_GLOBAL)) && (info & PEEP_ADDR) == 0) {
+        return false;
+    }
+
+    return peep_is_reg(peep_loc(ctx, inst->operands[0]));
+}
+
+static int peep_block_of(PeepBlock* blocks, int* block_of, size_t block_count, TB_Node* target) {
+    int id = TB_NODE_GET_EXTRA_T(target, TB_NodeRegion)->postorder_id;
+    return id >= 0 && id < block_count ? block_of[id] : -1;
+}
+
+// liveness over the physical registers, then anything pure writing a dead register goes.
+static bool peep_dead_code(Ctx* restrict ctx) {
+    DynArray(Inst*) insts = dyn_array_create(Inst*, 64);
+    DynArray(PeepBlock) blocks = dyn_array_create(PeepBlock, ctx->block_count);
+
+    int* block_of = tb_arena_alloc(tmp_arena, ctx->block_count * sizeof(int));
+    FOREACH_N(i, 0, ctx->block_count) block_of[i] = -1;
+
+    for (Inst* inst = ctx->first; inst; inst = inst->next) {
+        if (inst->type == INST_LABEL) {
+            int id = TB_NODE_GET_EXTRA_T(inst->n, TB_NodeRegion)->postorder_id;
+            if (id >= 0 && id < ctx->block_count) {
+                block_of[id] = dyn_array_length(blocks);
+            }
+
+            PeepBlock b = { .label = inst, .start = dyn_array_length(insts) };
+            dyn_array_put(blocks, b);
+        } else {
+            assert(dyn_array_length(blocks) > 0);
+            dyn_array_put(insts, inst);
+            blocks[dyn_array_length(blocks) - 1].count++;
+        }
+    }
+
+    // local sets & successors
+    size_t block_count = dyn_array_length(blocks);
+    FOREACH_N(i, 0, block_count) {
+        PeepBlock* b = &blocks[i];
+        bool falls = true;
+
+        FOREACH_REVERSE_N(j, 0, b->count) {
+            Inst* inst = insts[b->start + j];
+            uint32_t info = peep_info(inst);
+
+            PeepEffects e;
+            if (!peep_effects(ctx, inst, info, &e)) {
+                b->gen = PEEP_ALL;
+                b->exit |= inst->type == INST_SWITCH;
+                continue;
+            }
+
+            b->gen = e.reads | (b->gen & ~e.kills);
+            b->kill |= e.kills;
+
+            if (inst->type == INST_EPILOGUE) {
+                // the ret goes down right after the callee saved restores
+                b->ret = true;
+                falls = false;
+            } else if (info & (PEEP_JUMP | PEEP_BRANCH)) {
+                int succ = (inst->flags & INST_NODE) ? peep_block_of(blocks, block_of, ctx->block_count, inst->n) : -1;
+                if (succ < 0 || b->succ_count == 2) {
+                    b->exit = true;
+                } else {
+                    b->succ[b->succ_count++] = succ;
+                }
+
+                // anything after an unconditional jump is never reached
+                if (info & PEEP_JUMP) falls = false;
+            }
+        }
+
+        if (falls) {
+            if (i + 1 < block_count && b->succ_count < 2) {
+                b->succ[b->succ_count++] = i + 1;
+            } else {
+                b->exit = true;
+            }
+        }
+    }
+
+    // global sets
+    uint64_t ret_live = peep_return_live(ctx);
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        FOREACH_REVERSE_N(i, 0, block_count) {
+            PeepBlock* b = &blocks[i];
+
+            uint64_t out = b->exit ? PEEP_ALL : b->ret ? ret_live : 0;
+            FOREACH_N(j, 0, b->succ_count) {
+                out |= blocks[b->succ[j]].live_in;
+            }
+
+            uint64_t in = b->gen | (out & ~b->kill);
+            if (in != b->live_in || out != b->live_out) {
+                b->live_in = in, b->live_out = out;
+                changed = true;
+            }
+        }
+    }
+
+    bool progress = false;
+    FOREACH_N(i, 0, block_count) {
+        PeepBlock* b = &blocks[i];
+
+        uint64_t live = b->live_out;
+        bool flags_live = false;
+        FOREACH_REVERSE_N(j, 0, b->count) {
+            Inst* inst = insts[b->start + j];
+            uint32_t info = peep_info(inst);
+
+            PeepEffects e;
+            if (!peep_effects(ctx, inst, info, &e)) {
+                live = PEEP_ALL;
+                flags_live = true;
+                continue;
+            }
+
+            if (peep_is_dead_candidate(ctx, inst, info) && (live & e.writes) == 0 &&
+                !((info & PEEP_WRITES_FLAGS) && flags_live)) {
+                insts[b->start + j] = NULL;
+                progress = true;
+                continue;
+            }
+
+            live = (live & ~e.kills) | e.reads;
+            if (info & PEEP_WRITES_FLAGS) flags_live = false;
+            if (info & PEEP_READS_FLAGS) flags_live = true;
+        }
+
+        Inst* prev = b->label;
+        FOREACH_N(j, 0, b->count) {
+            if (insts[b->start + j]) {
+                prev->next = insts[b->start + j];
+                prev = prev->next;
+            }
+        }
+        prev->next = i + 1 < block_count ? blocks[i + 1].label : NULL;
+    }
+
+    dyn_array_destroy(blocks);
+    dyn_array_destroy(insts);
+    return progress;
+}
+
+static void peephole(Ctx* restrict ctx) {
+    FOREACH_N(round, 0, PEEP_MAX_ROUNDS) {
+        bool progress = false;
+
+        Inst* prev = ctx->first;
+        for (Inst* inst = prev->next; inst;) {
+            uint32_t info = peep_info(inst);
+
+            bool removed = false;
+            FOREACH_N(i, 0, COUNTOF(peep_rules)) {
+                PeepResult r = peep_rules[i](ctx, prev, inst, info);
+                if (r == PEEP_REMOVED) {
+                    removed = true;
+                    break;
+                }
+
+                progress |= (r == PEEP_CHANGED);
+            }
+
+            if (removed) {
+                progress = true;
+                inst = prev->next;
+            } else {
+                prev = inst;
+                inst = inst->next;
+            }
+        }
+
+        progress |= peep_dead_code(ctx);
+        if (!progress) break;
+    }
+}
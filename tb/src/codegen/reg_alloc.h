@@ -46,6 +46,9 @@ struct LiveInterval {
     // spill point, -1 if there's none
     int spill, split_kid;
 
+    // stack slot shared by all the pieces of this value, 0 until one spills
+    int slot;
+
     // help speed up some of the main allocation loop
     int active_range;
 
@@ -56,6 +59,17 @@ struct LiveInterval {
 
 typedef DynArray(RegIndex) IntervalList;
 
+// pool entries chain back to the interval's older entries
+typedef struct {
+    LiveRange r;
+    int prev;
+} RangeNode;
+
+typedef struct {
+    UsePos u;
+    int prev;
+} UseNode;
+
 typedef struct {
     TB_ABI abi;
 
@@ -70,13 +84,21 @@ typedef struct {
     int* free_pos;
     int* block_pos;
 
-    int endpoint;
+    // where the callee saved registers get restored
+    DynArray(int) epilogues;
     uint64_t callee_saved[CG_REGISTER_CLASSES];
 
     Set active_set[CG_REGISTER_CLASSES];
     RegIndex active[CG_REGISTER_CLASSES][16];
 
     Inst* cache;
+
+    // while building, ranges & uses go into flat pools (see build_intervals)
+    DynArray(RangeNode) range_pool;
+    DynArray(UseNode) use_pool;
+    // newest pool entry per interval, -1 if there's none
+    int* range_top;
+    int* use_top;
 } LSRA;
 
 static LiveRange* last_range(LiveInterval* i) {
@@ -86,35 +108,37 @@ static LiveRange* last_range(LiveInterval* i) {
 ////////////////////////////////
 // Generate intervals
 ////////////////////////////////
-static void add_use_pos(LiveInterval* interval, int t, int kind) {
-    UsePos u = { t, kind };
-    dyn_array_put(interval->uses, u);
+// every interval would otherwise grow its own ranges & uses arrays one entry at a time,
+// instead those go into two flat pools where each interval only knows its newest entry
+// so appending (and coalescing with the newest range) is O(1). once everything's built
+// they get copied out into exactly sized arrays.
+static void add_use_pos(LSRA* restrict ra, RegIndex ri, int t, int kind) {
+    UseNode n = { { t, kind }, ra->use_top[ri] };
+    ra->use_top[ri] = dyn_array_length(ra->use_pool);
+    dyn_array_put(ra->use_pool, n);
 }
 
 // interval->start is filled in by the definition
-static void add_range(LiveInterval* interval, int start, int end) {
+static void add_range(LSRA* restrict ra, RegIndex ri, int start, int end) {
     assert(start <= end);
-    size_t count = dyn_array_length(interval->ranges);
-    if (count > 0 && interval->ranges[count - 1].start <= end) {
-        LiveRange* top = &interval->ranges[count - 1];
+    int top = ra->range_top[ri];
+    if (top >= 0 && ra->range_pool[top].r.start <= end) {
+        LiveRange* r = &ra->range_pool[top].r;
 
         // coalesce
-        top->start = TB_MIN(top->start, start);
-        top->end   = TB_MAX(top->end,   end);
+        r->start = TB_MIN(r->start, start);
+        r->end   = TB_MAX(r->end,   end);
     } else {
-        LiveRange r = { start, end };
-        dyn_array_put(interval->ranges, r);
+        RangeNode n = { { start, end }, top };
+        ra->range_top[ri] = dyn_array_length(ra->range_pool);
+        dyn_array_put(ra->range_pool, n);
     }
 
+    LiveInterval* interval = &ra->intervals[ri];
     if (end > interval->end) interval->end = end;
 }
 
 static void reverse_bb_walk(LSRA* restrict ra, MachineBB* bb, Inst* inst) {
-    Inst* next = inst->next;
-    if (next && next->type != INST_LABEL) {
-        reverse_bb_walk(ra, bb, next);
-    }
-
     // mark outputs, inputs and temps
     //
     // TODO(NeGate): on x86 we can have one memory operand per instruction.
@@ -125,39 +149,132 @@ static void reverse_bb_walk(LSRA* restrict ra, MachineBB* bb, Inst* inst) {
 
     FOREACH_N(i, 0, inst->out_count) {
         assert(*ops >= 0);
-        LiveInterval* interval = &ra->intervals[*ops++];
+        RegIndex ri = *ops++;
 
-        if (interval->ranges == NULL) {
-            add_range(interval, inst->time, inst->time);
+        int top = ra->range_top[ri];
+        if (top < 0) {
+            add_range(ra, ri, inst->time, inst->time);
         } else {
-            interval->ranges[dyn_array_length(interval->ranges) - 1].start = inst->time;
+            ra->range_pool[top].r.start = inst->time;
         }
 
-        interval->start = inst->time;
-        add_use_pos(interval, inst->time, dst_use_reg ? USE_REG : USE_OUT);
+        ra->intervals[ri].start = inst->time;
+        add_use_pos(ra, ri, inst->time, dst_use_reg ? USE_REG : USE_OUT);
     }
 
     FOREACH_N(i, 0, inst->in_count) {
         assert(*ops >= 0);
-        LiveInterval* interval = &ra->intervals[*ops++];
+        RegIndex ri = *ops++;
 
-        add_range(interval, bb->start, inst->time);
-        add_use_pos(interval, inst->time, USE_REG);
+        add_range(ra, ri, bb->start, inst->time);
+        add_use_pos(ra, ri, inst->time, USE_REG);
     }
 
-    // calls use the temporaries for clobbers
+    // calls use the temporaries for clobbers, everything else writes them
+    // while the inputs are still being read so they can't share registers.
     bool is_call = (inst->type == CALL || inst->type == SYSCALL);
+    int tmp_start = is_call ? inst->time : inst->time - 1;
     FOREACH_N(i, 0, inst->tmp_count) {
         assert(*ops >= 0);
-        LiveInterval* interval = &ra->intervals[*ops++];
+        RegIndex ri = *ops++;
+        LiveInterval* interval = &ra->intervals[ri];
+
+        add_range(ra, ri, tmp_start, inst->time + 1);
+        if (interval->start > tmp_start) {
+            interval->start = tmp_start;
+        }
 
-        add_range(interval, inst->time, inst->time + 1);
         if (!is_call) {
-            add_use_pos(interval, inst->time, USE_REG);
+            add_use_pos(ra, ri, inst->time, USE_REG);
         }
     }
 }
 
+static void build_intervals(LSRA* restrict ra, Ctx* restrict ctx) {
+    MachineBBs mbbs = ctx->machine_bbs;
+    size_t interval_count = dyn_array_length(ra->intervals);
+
+    ra->range_top = tb_arena_alloc(tmp_arena, interval_count * sizeof(int));
+    ra->use_top   = tb_arena_alloc(tmp_arena, interval_count * sizeof(int));
+    memset(ra->range_top, 0xFF, interval_count * sizeof(int));
+    memset(ra->use_top,   0xFF, interval_count * sizeof(int));
+
+    ra->range_pool = dyn_array_create(RangeNode, interval_count * 2);
+    ra->use_pool   = dyn_array_create(UseNode, interval_count * 2);
+
+    DynArray(Inst*) stack = dyn_array_create(Inst*, 64);
+    FOREACH_N(i, 0, ctx->block_count) {
+        TB_Node* bb = ctx->worklist.items[i];
+        MachineBB* mbb = &nl_map_get_checked(mbbs, bb);
+
+        int bb_start = mbb->start;
+        int bb_end = mbb->end + 2;
+
+        // for anything that's live out, add the entire range
+        Set* live_out = &mbb->live_out;
+        FOREACH_N(j, 0, (interval_count + 63) / 64) {
+            uint64_t bits = live_out->data[j];
+            while (bits) {
+                int k = tb_ffs64(bits) - 1;
+                bits &= bits - 1;
+
+                add_range(ra, j*64 + k, bb_start, bb_end);
+            }
+        }
+
+        // for all instruction in BB (in reverse), add ranges. the entry block's
+        // first is its own label so we only stop at the next one.
+        dyn_array_clear(stack);
+        for (Inst* inst = mbb->first; inst; inst = inst->next) {
+            dyn_array_put(stack, inst);
+            if (inst->next && inst->next->type == INST_LABEL) break;
+        }
+
+        FOREACH_REVERSE_N(j, 0, dyn_array_length(stack)) {
+            reverse_bb_walk(ra, mbb, stack[j]);
+        }
+    }
+    dyn_array_destroy(stack);
+
+    // we use every fixed interval at the very start to force them into
+    // the inactive set.
+    FOREACH_N(i, 0, 32) if (ra->range_top[i] >= 0) {
+        ra->intervals[i].start = 0;
+        add_range(ra, i, 0, 1);
+    }
+
+    ra->range_top[RBP] = -1;
+    ra->range_top[RSP] = -1;
+
+    // copy the chains out (they're newest first, the arrays are oldest first)
+    FOREACH_N(i, 0, interval_count) {
+        LiveInterval* interval = &ra->intervals[i];
+
+        size_t count = 0;
+        for (int j = ra->range_top[i]; j >= 0; j = ra->range_pool[j].prev) count++;
+        if (count) {
+            interval->ranges = dyn_array_create(LiveRange, count);
+            dyn_array_set_length(interval->ranges, count);
+            for (int j = ra->range_top[i]; j >= 0; j = ra->range_pool[j].prev) {
+                interval->ranges[--count] = ra->range_pool[j].r;
+            }
+        }
+
+        count = 0;
+        for (int j = ra->use_top[i]; j >= 0; j = ra->use_pool[j].prev) count++;
+        if (count) {
+            interval->uses = dyn_array_create(UsePos, count);
+            dyn_array_set_length(interval->uses, count);
+            for (int j = ra->use_top[i]; j >= 0; j = ra->use_pool[j].prev) {
+                interval->uses[--count] = ra->use_pool[j].u;
+            }
+        }
+    }
+
+    dyn_array_destroy(ra->range_pool);
+    dyn_array_destroy(ra->use_pool);
+}
+
 static int range_intersect(int start, int end, LiveRange* b) {
     if (b->start <= end && start <= b->end) {
         return start > b->start ? start : b->start;
@@ -166,6 +283,17 @@ static int range_intersect(int start, int end, LiveRange* b) {
     }
 }
 
+// first point in [start, end] which any of the remaining ranges (the active one
+// and everything after it) of it touches, -1 if none.
+static int remaining_intersect(int start, int end, LiveInterval* it) {
+    FOREACH_REVERSE_N(i, 0, it->active_range + 1) {
+        int p = range_intersect(start, end, &it->ranges[i]);
+        if (p >= 0) return p;
+    }
+
+    return -1;
+}
+
 static int interval_intersect(LiveInterval* a, LiveInterval* b) {
     if (!(b->start <= a->end && a->start <= b->end)) {
         return -1; // don't intersect at all
@@ -195,18 +323,20 @@ static int interval_intersect(LiveInterval* a, LiveInterval* b) {
 FOREACH_N(_i, 0, ((set).capacity + 63) / 64) \
 for (uint64_t bits = (set).data[_i], it = _i*64; bits; bits >>= 1, it++) if (bits & 1)
 
+// uses are newest first, a use right at time still needs the register
 static int next_use(LSRA* restrict ra, LiveInterval* interval, int time) {
     for (;;) {
-        FOREACH_N(i, 0, dyn_array_length(interval->uses)) {
-            if (interval->uses[i].pos > time) {
+        FOREACH_REVERSE_N(i, 0, dyn_array_length(interval->uses)) {
+            if (interval->uses[i].pos >= time) {
                 return interval->uses[i].pos;
             }
         }
 
-        if (interval->split_kid >= 0) {
-            interval = &ra->intervals[interval->split_kid];
-            continue;
+        if (interval->split_kid < 0) {
+            break;
         }
+
+        interval = &ra->intervals[interval->split_kid];
     }
 
     return INT_MAX;
@@ -246,6 +376,11 @@ static void insert_split_move(LSRA* restrict ra, int t, int old_reg, int new_reg
         ra->cache = ra->first;
     }
 
+    // a spill stores what the register held before any of the moves at t, those
+    // might be reloads into the register it's giving up.
+    bool is_store = ra->intervals[new_reg].spill > 0 && ra->intervals[old_reg].spill <= 0;
+    Inst* spot = NULL;
+
     prev = ra->cache, inst = prev->next;
     CUIK_TIMED_BLOCK("walk") {
         while (inst != NULL) {
@@ -254,6 +389,12 @@ static void insert_split_move(LSRA* restrict ra, int t, int old_reg, int new_reg
                 break;
             }
 
+            if (is_store && inst->time == t && (inst->flags & INST_SPILL) && inst->operands[0] != old_reg) {
+                if (spot == NULL) spot = prev;
+            } else {
+                spot = NULL;
+            }
+
             prev = inst, inst = inst->next;
         }
     }
@@ -268,7 +409,9 @@ static void insert_split_move(LSRA* restrict ra, int t, int old_reg, int new_reg
     *new_inst = (Inst){ .type = MOV, .flags = INST_SPILL, .dt = dt, .out_count = 1, 1 };
     new_inst->operands[0] = new_reg;
     new_inst->operands[1] = old_reg;
-    new_inst->time = prev->time + 1;
+    // moves at the same spot run in the order they were inserted (except for spills)
+    if (spot != NULL) prev = spot;
+    new_inst->time = prev->time > t ? prev->time : t;
     new_inst->next = prev->next;
     prev->next = new_inst;
 }
@@ -283,6 +426,100 @@ static LiveInterval* split_interval_at(LSRA* restrict ra, LiveInterval* interval
     return interval;
 }
 
+// every piece of a value spills into the same slot, that way two spilled
+// pieces meeting across an edge don't need a move between them.
+static int spill_slot(LSRA* restrict ra, LiveInterval* interval) {
+    LiveInterval* it = interval;
+    while (it->slot == 0 && it->split_kid >= 0) {
+        it = &ra->intervals[it->split_kid];
+    }
+
+    int slot = it->slot;
+    if (slot == 0) {
+        // packed values (and the callee saved XMMs) need the whole 16 bytes
+        TB_X86_DataType dt = interval->dt;
+        int size = (dt >= TB_X86_TYPE_PBYTE && dt <= TB_X86_TYPE_PQWORD) || dt >= TB_X86_TYPE_SSE_PS ? 16 : 8;
+
+        ra->stack_usage = align_up(ra->stack_usage + size, size);
+        slot = ra->stack_usage;
+    }
+
+    // the pieces after this one get it too, the ones made later copy it
+    for (it = interval;; it = &ra->intervals[it->split_kid]) {
+        it->slot = slot;
+        if (it->split_kid < 0) break;
+    }
+
+    return slot;
+}
+
+// the register a piece lives in, -1 if it's on the stack
+static int move_loc(LSRA* restrict ra, int ri) {
+    LiveInterval* it = &ra->intervals[ri];
+    if (it->spill > 0 || it->assigned < 0) {
+        return -1;
+    }
+
+    return it->reg_class*64 + it->assigned;
+}
+
+// the moves on an edge happen all at once, moves[i*2] goes into moves[i*2 + 1]. none of
+// them may clobber a register another one still reads, cycles go through a stack slot.
+static void resolve_edge_moves(LSRA* restrict ra, int t, DynArray(int) moves) {
+    size_t count = dyn_array_length(moves) / 2;
+    while (count > 0) {
+        bool progress = false;
+        for (size_t i = 0; i < count;) {
+            int dst = move_loc(ra, moves[i*2 + 1]);
+
+            bool blocked = false;
+            if (dst >= 0) {
+                FOREACH_N(j, 0, count) {
+                    if (j != i && move_loc(ra, moves[j*2]) == dst) {
+                        blocked = true;
+                        break;
+                    }
+                }
+            }
+
+            if (blocked) {
+                i++;
+                continue;
+            }
+
+            insert_split_move(ra, t, moves[i*2], moves[i*2 + 1]);
+            progress = true;
+
+            count -= 1;
+            moves[i*2 + 0] = moves[count*2 + 0];
+            moves[i*2 + 1] = moves[count*2 + 1];
+        }
+
+        if (!progress) {
+            // everything left is in a cycle, park one of the sources in its value's slot
+            int src = moves[0];
+            int slot = spill_slot(ra, &ra->intervals[src]);
+
+            LiveInterval it = {
+                .reg_class = ra->intervals[src].reg_class,
+                .dt = ra->intervals[src].dt,
+                .spill = slot,
+                .slot = slot,
+                .assigned = -1,
+                .reg = -1,
+                .hint = -1,
+                .split_kid = -1,
+            };
+
+            int parked = dyn_array_length(ra->intervals);
+            dyn_array_put(ra->intervals, it);
+
+            insert_split_move(ra, t, src, parked);
+            moves[0] = parked;
+        }
+    }
+}
+
 // any uses after `pos` after put into the new interval
 static int split_intersecting(LSRA* restrict ra, int current_time, int pos, LiveInterval* interval, bool is_spill) {
     assert(interval->reg < 0);
@@ -291,11 +528,9 @@ static int split_intersecting(LSRA* restrict ra, int current_time, int pos, Live
     if (interval->spill > 0) {
         REG_ALLOC_LOG printf("  \x1b[33m#   v%d: reload [RBP - %d] at t=%d\x1b[0m\n", ri, interval->spill, pos);
     } else {
-        // allocate stack slot
-        int size = 8;
-        ra->stack_usage = align_up(ra->stack_usage + size, size);
+        spill_slot(ra, interval);
 
-        REG_ALLOC_LOG printf("  \x1b[33m#   v%d: spill %s to [RBP - %d] at t=%d\x1b[0m\n", ri, reg_name(interval->reg_class, interval->assigned), ra->stack_usage, pos);
+        REG_ALLOC_LOG printf("  \x1b[33m#   v%d: spill %s to [RBP - %d] at t=%d\x1b[0m\n", ri, reg_name(interval->reg_class, interval->assigned), interval->slot, pos);
         if (current_time >= pos && interval->assigned >= 0) {
             if (set_get(&ra->active_set[interval->reg_class], interval->assigned) && ra->active[interval->reg_class][interval->assigned] == ri) {
                 REG_ALLOC_LOG printf("  \x1b[33m#   v%d: expired during split\x1b[0m\n", ri);
@@ -307,7 +542,7 @@ static int split_intersecting(LSRA* restrict ra, int current_time, int pos, Live
     // split lifetime
     LiveInterval it = *interval;
     if (is_spill) {
-        it.spill = ra->stack_usage;
+        it.spill = interval->slot;
     } else {
         it.spill = -1;
         it.reg = -1;
@@ -318,7 +553,8 @@ static int split_intersecting(LSRA* restrict ra, int current_time, int pos, Live
     it.uses = NULL;
     it.ranges = NULL;
     it.n = NULL;
-    it.split_kid = -1;
+    // if we've been split before (further down), that piece comes after the new one
+    it.split_kid = interval->split_kid;
     interval->end = pos;
 
     int old_reg = interval - ra->intervals;
@@ -342,21 +578,24 @@ static int split_intersecting(LSRA* restrict ra, int current_time, int pos, Live
         ra->unhandled[i] = new_reg;
     }
 
-    // split uses
+    // split uses (newest first so the ones past pos are a prefix)
     size_t use_count = dyn_array_length(interval->uses);
-    FOREACH_REVERSE_N(i, 0, use_count) {
-        size_t split_count = use_count - (i + 1);
-        if (interval->uses[i].pos > pos && split_count > 0) {
-            // split
-            DynArray(UsePos) uses = dyn_array_create(UsePos, split_count);
-            dyn_array_set_length(uses, split_count);
-            memcpy(uses, &interval->uses[i + 1], split_count * sizeof(UsePos));
-
-            dyn_array_set_length(interval->uses, i + 1);
-            it.uses = interval->uses;
-            interval->uses = uses;
-            break;
-        }
+    size_t after = 0;
+    while (after < use_count && interval->uses[after].pos > pos) after++;
+
+    if (after == use_count) {
+        // nothing's left before pos
+        it.uses = interval->uses;
+        interval->uses = NULL;
+    } else if (after > 0) {
+        size_t split_count = use_count - after;
+        DynArray(UsePos) uses = dyn_array_create(UsePos, split_count);
+        dyn_array_set_length(uses, split_count);
+        memcpy(uses, &interval->uses[after], split_count * sizeof(UsePos));
+
+        dyn_array_set_length(interval->uses, after);
+        it.uses = interval->uses;
+        interval->uses = uses;
     }
 
     // split ranges
@@ -372,6 +611,9 @@ static int split_intersecting(LSRA* restrict ra, int current_time, int pos, Live
                 memmove(range, range + 1, shift * sizeof(LiveRange));
             }
             dyn_array_pop(interval->ranges);
+
+            // the next range shifted into this slot
+            continue;
         } else if (range->end > pos) {
             // intersects pos, we need to split the range
             LiveRange r = { pos, range->end };
@@ -426,7 +668,7 @@ static ptrdiff_t allocate_free_reg(LSRA* restrict ra, LiveInterval* interval) {
         LiveInterval* it = &ra->intervals[ra->inactive[i]];
         int fp = ra->free_pos[it->assigned];
         if (fp > 0) {
-            int p = range_intersect(interval->start, interval->end, &it->ranges[it->active_range]);
+            int p = remaining_intersect(interval->start, interval->end, it);
             if (p >= 0 && p < fp) {
                 ra->free_pos[it->assigned] = p;
             }
@@ -488,8 +730,10 @@ static ptrdiff_t allocate_free_reg(LSRA* restrict ra, LiveInterval* interval) {
             dyn_array_put(ra->intervals, it);
 
             // insert spill and reload
-            insert_split_move(ra, 0,            vreg, spill_slot);
-            insert_split_move(ra, ra->endpoint, spill_slot, vreg);
+            insert_split_move(ra, 0, vreg, spill_slot);
+            dyn_array_for(i, ra->epilogues) {
+                insert_split_move(ra, ra->epilogues[i], spill_slot, vreg);
+            }
 
             // adding to intervals might resized this
             interval = &ra->intervals[old_reg];
@@ -519,7 +763,7 @@ static ptrdiff_t allocate_free_reg(LSRA* restrict ra, LiveInterval* interval) {
 }
 
 static ptrdiff_t allocate_blocked_reg(LSRA* restrict ra, LiveInterval* interval) {
-    int rc = interval->reg_class;
+    int rc = interval->reg_class, ri = interval - ra->intervals;
     int* use_pos = ra->free_pos;
 
     FOREACH_N(i, 0, 16) ra->block_pos[i] = INT_MAX;
@@ -533,10 +777,20 @@ static ptrdiff_t allocate_blocked_reg(LSRA* restrict ra, LiveInterval* interval)
         }
     }
 
+    // inactive intervals are keyed by the register they're holding, they
+    // also block the register once they come back.
     dyn_array_for(i, ra->inactive) {
         LiveInterval* it = &ra->intervals[ra->inactive[i]];
         if (it->reg_class == rc && it->reg < 0) {
-            use_pos[i] = next_use(ra, it, interval->start);
+            int p = next_use(ra, it, interval->start);
+            if (p < use_pos[it->assigned]) {
+                use_pos[it->assigned] = p;
+            }
+
+            int bp = remaining_intersect(interval->start, interval->end, it);
+            if (bp >= 0 && bp < ra->block_pos[it->assigned]) {
+                ra->block_pos[it->assigned] = bp;
+            }
         }
     }
 
@@ -554,7 +808,7 @@ static ptrdiff_t allocate_blocked_reg(LSRA* restrict ra, LiveInterval* interval)
         if (it->reg_class == rc && it->reg >= 0) {
             int bp = ra->block_pos[it->assigned];
             if (bp > 0) {
-                int p = range_intersect(interval->start, interval->end, &it->ranges[it->active_range]);
+                int p = remaining_intersect(interval->start, interval->end, it);
                 if (p >= 0 && p < bp) {
                     ra->block_pos[it->assigned] = p;
                 }
@@ -575,20 +829,19 @@ static ptrdiff_t allocate_blocked_reg(LSRA* restrict ra, LiveInterval* interval)
     }
 
     int pos = use_pos[highest];
-    int first_use = interval->uses[dyn_array_length(interval->uses) - 1].pos;
+    size_t use_count = dyn_array_length(interval->uses);
+    int first_use = use_count ? interval->uses[use_count - 1].pos : INT_MAX;
 
     bool spilled = false;
     if (first_use > pos) {
-        int size = 8;
-
         // spill interval
-        ra->stack_usage = align_up(ra->stack_usage + size, size);
-        interval->spill = ra->stack_usage;
+        interval->spill = spill_slot(ra, interval);
 
         // split at optimal spot before first use that requires a register
         FOREACH_REVERSE_N(i, 0, dyn_array_length(interval->uses)) {
             if (interval->uses[i].pos >= pos && interval->uses[i].kind == USE_REG) {
                 split_intersecting(ra, interval->start, interval->uses[i].pos - 1, interval, false);
+                interval = &ra->intervals[ri]; // might've resized the intervals
                 break;
             }
         }
@@ -601,6 +854,7 @@ static ptrdiff_t allocate_blocked_reg(LSRA* restrict ra, LiveInterval* interval)
         LiveInterval* to_split = get_active(ra, rc, highest);
         if (to_split != NULL) {
             split_intersecting(ra, interval->start, split_pos, to_split, true);
+            interval = &ra->intervals[ri]; // might've resized the intervals
         }
 
         // split any inactive interval for reg at the end of it's lifetime hole
@@ -610,8 +864,17 @@ static ptrdiff_t allocate_blocked_reg(LSRA* restrict ra, LiveInterval* interval)
 
             if (it->reg_class == rc && it->assigned == highest && r->start <= pos+1 && pos <= r->end) {
                 split_intersecting(ra, interval->start, split_pos, it, true);
+                interval = &ra->intervals[ri]; // might've resized the intervals
             }
         }
+
+        // we only get the register until something else comes back for it
+        int bp = ra->block_pos[highest];
+        if (bp < interval->end) {
+            interval->assigned = highest;
+            split_intersecting(ra, interval->start, bp - 1, interval, true);
+            interval = &ra->intervals[ri]; // might've resized the intervals
+        }
     }
 
     // split active reg if it intersects with fixed interval
@@ -642,8 +905,8 @@ static void move_to_active(LSRA* restrict ra, LiveInterval* interval) {
 static bool update_interval(LSRA* restrict ra, LiveInterval* restrict interval, bool is_active, int time, int inactive_index) {
     int ri = interval - ra->intervals;
 
-    // get to the right range first
-    while (interval->ranges[interval->active_range].end <= time) {
+    // get to the right range first (if we walk off the last one, it's expired)
+    while (interval->active_range > 0 && interval->ranges[interval->active_range].end <= time) {
         interval->active_range -= 1;
     }
 
@@ -681,7 +944,7 @@ static bool update_interval(LSRA* restrict ra, LiveInterval* restrict interval,
     return false;
 }
 
-static void cuiksort_defs(LiveInterval* intervals, ptrdiff_t lo, ptrdiff_t hi, RegIndex* arr);
+static void sort_unhandled(LSRA* restrict ra, size_t interval_count);
 static int linear_scan(Ctx* restrict ctx, TB_Function* f, int stack_usage, int end) {
     LSRA ra = { .abi = f->super.module->target_abi, .first = ctx->first, .cache = ctx->first, .intervals = ctx->intervals, .stack_usage = stack_usage };
 
@@ -694,48 +957,15 @@ static int linear_scan(Ctx* restrict ctx, TB_Function* f, int stack_usage, int e
     MachineBBs mbbs = ctx->machine_bbs;
     size_t interval_count = dyn_array_length(ra.intervals);
     CUIK_TIMED_BLOCK("build intervals") {
-        FOREACH_N(i, 0, ctx->block_count) {
-            TB_Node* bb = ctx->worklist.items[i];
-            MachineBB* mbb = &nl_map_get_checked(mbbs, bb);
-
-            int bb_start = mbb->start;
-            int bb_end = mbb->end + 2;
-
-            // for anything that's live out, add the entire range
-            Set* live_out = &mbb->live_out;
-            FOREACH_N(j, 0, (interval_count + 63) / 64) {
-                uint64_t bits = live_out->data[j];
-                if (bits == 0) continue;
-
-                FOREACH_N(k, 0, 64) if (bits & (1ull << k)) {
-                    add_range(&ra.intervals[j*64 + k], bb_start, bb_end);
-                }
-            }
-
-            // for all instruction in BB (in reverse), add ranges
-            if (mbb->first) {
-                reverse_bb_walk(&ra, mbb, mbb->first);
-            }
-        }
-    }
-
-    // we use every fixed interval at the very start to force them into
-    // the inactive set.
-    FOREACH_N(i, 0, 32) if (ra.intervals[i].ranges) {
-        ra.intervals[i].start = 0;
-        add_range(&ra.intervals[i], 0, 1);
+        build_intervals(&ra, ctx);
     }
 
-    dyn_array_destroy(ra.intervals[RBP].ranges);
-    dyn_array_destroy(ra.intervals[RSP].ranges);
-
-    ra.endpoint = end;
+    ra.epilogues = ctx->epilogues;
     mark_callee_saved_constraints(ctx, ra.callee_saved);
 
     // generate unhandled interval list (sorted by starting point)
-    ra.unhandled = dyn_array_create(LiveInterval*, (interval_count * 4) / 3);
-    FOREACH_N(i, 0, interval_count) dyn_array_put(ra.unhandled, i);
-    cuiksort_defs(ctx->intervals, 0, interval_count - 1, ra.unhandled);
+    ra.unhandled = dyn_array_create(RegIndex, (interval_count * 4) / 3);
+    sort_unhandled(&ra, interval_count);
 
     // only need enough to store for the biggest register class
     ra.free_pos  = TB_ARENA_ARR_ALLOC(tmp_arena, 16, int);
@@ -841,8 +1071,21 @@ static int linear_scan(Ctx* restrict ctx, TB_Function* f, int stack_usage, int e
         }
     }
 
+    // a split move reads whichever piece ended where the new one starts, that's not
+    // the piece it was made with if that one got split again before its end.
+    for (Inst* restrict inst = ra.first; inst; inst = inst->next) {
+        if (inst->flags & INST_SPILL) {
+            LiveInterval* src = &ra.intervals[inst->operands[1]];
+            int pos = ra.intervals[inst->operands[0]].start;
+            if (src->reg < 0 && src->split_kid >= 0 && pos > src->end) {
+                inst->operands[1] = split_interval_at(&ra, src, pos) - ra.intervals;
+            }
+        }
+    }
+
     // move resolver
     CUIK_TIMED_BLOCK("move resolver") {
+        DynArray(int) edge_moves = NULL;
         FOREACH_N(i, 0, ctx->block_count) {
             TB_Node* bb = ctx->worklist.items[i];
             assert(bb->type == TB_START || bb->type == TB_REGION);
@@ -860,31 +1103,37 @@ static int linear_scan(Ctx* restrict ctx, TB_Function* f, int stack_usage, int e
                 MachineBB* target = &nl_map_get_checked(mbbs, bb);
 
                 // for all live-ins, we should check if we need to insert a move
+                dyn_array_clear(edge_moves);
                 FOREACH_SET(i, target->live_in) {
                     LiveInterval* interval = &ra.intervals[i];
 
                     // if the value changes across the edge, insert move
-                    LiveInterval* start = split_interval_at(&ra, interval, mbb->end);
-                    LiveInterval* end = split_interval_at(&ra, interval, target->start);
-
-                    if (start != end) {
-                        if (start->spill > 0) {
-                            assert(end->spill <= 0 && "TODO: both can't be spills yet");
-                            insert_split_move(&ra, target->start + 1, start - ra.intervals, end - ra.intervals);
-                        } else {
-                            insert_split_move(&ra, mbb->terminator - 1, start - ra.intervals, end - ra.intervals);
+                    int start = split_interval_at(&ra, interval, mbb->end) - ra.intervals;
+                    int end = split_interval_at(&ra, interval, target->start) - ra.intervals;
+
+                    // spilled on both sides means the same slot, nothing to move
+                    if (start != end && (ra.intervals[start].spill <= 0 || ra.intervals[end].spill <= 0)) {
+                        int loc = move_loc(&ra, start);
+                        if (loc < 0 || loc != move_loc(&ra, end)) {
+                            dyn_array_put(edge_moves, start);
+                            dyn_array_put(edge_moves, end);
                         }
                     }
                 }
 
-                // the moves are inserted either at the end of block from or at the beginning of block to,
-                // depending on the control flow
-                // resolver.find_insert_position(from, to)
-
-                // insert all moves in correct order (without overwriting registers that are used later)
-                // resolver.resolve_mappings()
+                // the moves only belong to this edge, that's the end of our block if it's
+                // the only way out or the start of the target if it's the only way in.
+                // fallthroughs don't get a jump so there might not be a terminator.
+                if (br->succ_count > 1 && bb->type == TB_REGION && bb->input_count == 1) {
+                    resolve_edge_moves(&ra, target->start + 1, edge_moves);
+                } else {
+                    int t = mbb->terminator ? mbb->terminator - 1 : mbb->end;
+                    resolve_edge_moves(&ra, t, edge_moves);
+                }
             }
         }
+
+        dyn_array_destroy(edge_moves);
     }
 
     // resolve all split interval references
@@ -915,34 +1164,35 @@ static int linear_scan(Ctx* restrict ctx, TB_Function* f, int stack_usage, int e
 ////////////////////////////////
 // Sorting unhandled list
 ////////////////////////////////
-static size_t partition(LiveInterval* intervals, ptrdiff_t lo, ptrdiff_t hi, RegIndex* arr) {
-    int pivot = intervals[arr[(hi - lo) / 2 + lo]].start; // middle
-
-    ptrdiff_t i = lo - 1, j = hi + 1;
-    for (;;) {
-        // Move the left index to the right at least once and while the element at
-        // the left index is less than the pivot
-        do { i += 1; } while (intervals[arr[i]].start > pivot);
-
-        // Move the right index to the left at least once and while the element at
-        // the right index is greater than the pivot
-        do { j -= 1; } while (intervals[arr[j]].start < pivot);
+// counting sort on the start points, the list gets popped from the end so the
+// earliest start goes last. unused intervals are left out (nothing to allocate).
+static void sort_unhandled(LSRA* restrict ra, size_t interval_count) {
+    int max_start = 0;
+    FOREACH_N(i, 0, interval_count) {
+        LiveInterval* it = &ra->intervals[i];
+        if (it->ranges && it->start != INT_MAX && it->start > max_start) {
+            max_start = it->start;
+        }
+    }
 
-        // If the indices crossed, return
-        if (i >= j) return j;
+    // bucket 0 holds anything which never got a start, then it's biggest start first
+    size_t bucket_count = max_start + 2;
+    int* offsets = tb_arena_alloc(tmp_arena, (bucket_count + 1) * sizeof(int));
+    memset(offsets, 0, (bucket_count + 1) * sizeof(int));
 
-        // Swap the elements at the left and right indices
-        SWAP(RegIndex, arr[i], arr[j]);
+    #define BUCKET(it) ((it)->start == INT_MAX ? 0 : 1 + (max_start - (it)->start))
+    size_t count = 0;
+    FOREACH_N(i, 0, interval_count) {
+        LiveInterval* it = &ra->intervals[i];
+        if (it->ranges) offsets[BUCKET(it) + 1] += 1, count += 1;
     }
-}
 
-static void cuiksort_defs(LiveInterval* intervals, ptrdiff_t lo, ptrdiff_t hi, RegIndex* arr) {
-    if (lo >= 0 && hi >= 0 && lo < hi) {
-        // get pivot
-        size_t p = partition(intervals, lo, hi, arr);
+    FOREACH_N(i, 0, bucket_count) offsets[i + 1] += offsets[i];
 
-        // sort both sides
-        cuiksort_defs(intervals, lo, p, arr);
-        cuiksort_defs(intervals, p + 1, hi, arr);
+    dyn_array_set_length(ra->unhandled, count);
+    FOREACH_REVERSE_N(i, 0, interval_count) {
+        LiveInterval* it = &ra->intervals[i];
+        if (it->ranges) ra->unhandled[offsets[BUCKET(it)]++] = i;
     }
+    #undef BUCKET
 }
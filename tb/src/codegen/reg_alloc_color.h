@@ -0,0 +1,854 @@
+// Graph coloring register allocator (Chaitin-Briggs), it's slower than linear scan
+// but it gets to see the whole function at once:
+//
+//   * copies are coalesced whenever that can't make the graph harder to color, Briggs'
+//     test between virtual regs and George's against physical ones.
+//   * spill costs are weighted by loop depth so the values which get spilled are the
+//     ones living outside of the loops.
+//   * spilled values are loaded into short lived temporaries before each use and stored
+//     after each def, the ones should_rematerialize likes are recomputed instead.
+//
+// each vreg ends up in one place for the whole function so there's no splitting or move
+// resolution, if the spilling doesn't settle we give up and hand it to linear scan.
+enum {
+    // the interference matrix is quadratic, big functions stay on linear scan
+    COLOR_MAX_INTERVALS = 8192,
+    COLOR_MAX_ROUNDS    = 6,
+};
+
+typedef struct {
+    int dst, src;
+    float weight;
+    bool done;
+} ColorMove;
+
+typedef struct {
+    Ctx* ctx;
+
+    // these survive across rounds, coalescing decisions stick
+    DynArray(int) alias; // union find
+    DynArray(int) fixed; // physical reg a group got coalesced into, -1 if none
+
+    // the rest gets rebuilt each round for this many intervals
+    size_t count;
+    uint64_t* matrix; // lower triangle of the interference matrix
+    DynArray(int)* adj;
+    DynArray(ColorMove) moves;
+
+    uint32_t* forbid; // physical regs of the same class it interferes with
+    float* cost;
+    bool* present;
+    int* color;
+    int* mark;
+
+    // anything made by spilling is past this, those don't get spilled again
+    int first_tmp;
+    int stack_usage;
+    uint64_t callee_saved[CG_REGISTER_CLASSES];
+} ColorRA;
+
+static int color_find(ColorRA* restrict ra, int i) {
+    while (ra->alias[i] != i) {
+        ra->alias[i] = ra->alias[ra->alias[i]];
+        i = ra->alias[i];
+    }
+    return i;
+}
+
+// spilled values live in their stack slot, they're not part of the graph
+static bool color_is_node(ColorRA* restrict ra, int i) {
+    LiveInterval* it = &ra->ctx->intervals[i];
+    return it->reg >= 0 || it->spill <= 0;
+}
+
+static uint32_t color_allocatable(int rc) {
+    return rc == REG_CLASS_GPR ? 0xFFFF & ~((1u << RSP) | (1u << RBP)) : 0xFFFF;
+}
+
+static int color_k(ColorRA* restrict ra, int i) {
+    return tb_popcount(color_allocatable(ra->ctx->intervals[i].reg_class) & ~ra->forbid[i]);
+}
+
+static bool color_interferes(ColorRA* restrict ra, int a, int b) {
+    if (a < b) SWAP(int, a, b);
+    size_t bit = ((size_t) a * (a - 1)) / 2 + b;
+    return ra->matrix[bit / 64] & (1ull << (bit % 64));
+}
+
+static void color_add_edge(ColorRA* restrict ra, int a, int b) {
+    LiveInterval* intervals = ra->ctx->intervals;
+
+    a = color_find(ra, a), b = color_find(ra, b);
+    if (a == b || intervals[a].reg_class != intervals[b].reg_class) {
+        return;
+    }
+
+    // physical regs are precolored, we just remember which ones are off limits
+    bool a_phys = intervals[a].reg >= 0, b_phys = intervals[b].reg >= 0;
+    if (a_phys || b_phys) {
+        if (!a_phys) ra->forbid[a] |= 1u << intervals[b].reg;
+        if (!b_phys) ra->forbid[b] |= 1u << intervals[a].reg;
+        return;
+    }
+
+    if (a < b) SWAP(int, a, b);
+    size_t bit = ((size_t) a * (a - 1)) / 2 + b;
+    if ((ra->matrix[bit / 64] & (1ull << (bit % 64))) == 0) {
+        ra->matrix[bit / 64] |= 1ull << (bit % 64);
+        dyn_array_put(ra->adj[a], b);
+        dyn_array_put(ra->adj[b], a);
+    }
+}
+
+// neighbors which are still group leaders
+static int color_degree(ColorRA* restrict ra, int i) {
+    int d = 0;
+    dyn_array_for(j, ra->adj[i]) {
+        int t = ra->adj[i][j];
+        d += ra->alias[t] == t;
+    }
+    return d;
+}
+
+static bool color_significant(ColorRA* restrict ra, int i) {
+    return ra->fixed[i] >= 0 || color_degree(ra, i) >= color_k(ra, i);
+}
+
+// register to register copy, the only kind we coalesce
+static bool color_is_move(Inst* inst) {
+    return (inst->type == MOV || inst->type == FP_MOV) && (inst->flags & ~INST_SPILL) == 0 &&
+        inst->out_count == 1 && inst->in_count == 1 && inst->tmp_count == 0;
+}
+
+static float color_block_weight(TB_Node* bb) {
+    int depth = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->loop_depth;
+
+    float w = 1.0f;
+    for (int i = 0; i < depth && i < 6; i++) w *= 10.0f;
+    return w;
+}
+
+static void color_build(ColorRA* restrict ra) {
+    Ctx* restrict ctx = ra->ctx;
+    LiveInterval* intervals = ctx->intervals;
+
+    Set live = set_create_in_arena(tmp_arena, ra->count);
+    DynArray(Inst*) insts = dyn_array_create(Inst*, 64);
+
+    FOREACH_N(i, 0, ctx->block_count) {
+        TB_Node* bb = ctx->worklist.items[i];
+        MachineBB* mbb = &nl_map_get_checked(ctx->machine_bbs, bb);
+        float weight = color_block_weight(bb);
+
+        // the entry block starts at its label, the rest start just past it
+        Inst* inst = mbb->first;
+        if (inst && inst->type == INST_LABEL) inst = inst->next;
+
+        dyn_array_clear(insts);
+        for (; inst && inst->type != INST_LABEL; inst = inst->next) {
+            dyn_array_put(insts, inst);
+        }
+
+        set_copy(&live, &mbb->live_out);
+        FOREACH_REVERSE_N(j, 0, dyn_array_length(insts)) {
+            Inst* inst = insts[j];
+            RegIndex* outs = inst->operands;
+            RegIndex* ins  = outs + inst->out_count;
+            RegIndex* tmps = ins + inst->in_count;
+            bool is_move = color_is_move(inst);
+            bool is_call = (inst->type == CALL || inst->type == SYSCALL);
+
+            FOREACH_N(k, 0, inst->out_count + inst->in_count + inst->tmp_count) {
+                int r = outs[k];
+                if (intervals[r].reg < 0 && color_is_node(ra, r)) {
+                    r = color_find(ra, r);
+                    ra->present[r] = true;
+                    ra->cost[r] += weight;
+                }
+            }
+
+            // defs interfere with everything live past them, copies are the exception
+            // since both sides hold the same value.
+            FOREACH_N(k, 0, inst->out_count) {
+                int d = outs[k];
+                if (!color_is_node(ra, d)) continue;
+
+                FOREACH_SET(l, live) {
+                    if (l != d && !(is_move && l == ins[0]) && color_is_node(ra, l)) {
+                        color_add_edge(ra, d, l);
+                    }
+                }
+
+                // the first input is copied into the destination before the rest are
+                // read (mov dst, lhs; op dst, rhs) so those can't share a register.
+                FOREACH_N(m, 1, inst->in_count) {
+                    if (color_is_node(ra, ins[m])) color_add_edge(ra, d, ins[m]);
+                }
+
+                FOREACH_N(m, 0, k) {
+                    if (color_is_node(ra, outs[m])) color_add_edge(ra, d, outs[m]);
+                }
+            }
+
+            // temporaries get written while the inputs are still being read, calls use
+            // them for clobbers which happen after the inputs are done.
+            FOREACH_N(k, 0, inst->tmp_count) {
+                int t = tmps[k];
+                if (!color_is_node(ra, t)) continue;
+
+                FOREACH_SET(l, live) {
+                    if (l != t && color_is_node(ra, l)) color_add_edge(ra, t, l);
+                }
+
+                FOREACH_N(m, 0, inst->out_count) {
+                    if (color_is_node(ra, outs[m])) color_add_edge(ra, t, outs[m]);
+                }
+
+                if (!is_call) {
+                    FOREACH_N(m, 0, inst->in_count) {
+                        if (color_is_node(ra, ins[m])) color_add_edge(ra, t, ins[m]);
+                    }
+                }
+
+                FOREACH_N(m, 0, k) {
+                    if (color_is_node(ra, tmps[m])) color_add_edge(ra, t, tmps[m]);
+                }
+            }
+
+            // the tmps leave out the argument & return registers, the copies into those
+            // don't interfere with their sources so they'd look fine to coalesce into.
+            // the callee trashes every caller saved reg, nothing live across can use one.
+            if (is_call) {
+                FOREACH_SET(l, live) {
+                    if (intervals[l].reg >= 0 || !color_is_node(ra, l)) continue;
+
+                    int rc = intervals[l].reg_class;
+                    ra->forbid[color_find(ra, l)] |= color_allocatable(rc) & ~ra->callee_saved[rc];
+                }
+            }
+
+            // only same sized copies, the others might be doing zero extension.
+            if (is_move) {
+                int d = outs[0], s = ins[0];
+                if (color_is_node(ra, d) && color_is_node(ra, s) &&
+                    intervals[d].reg_class == intervals[s].reg_class &&
+                    (intervals[d].reg >= 0 || intervals[d].dt == inst->dt) &&
+                    (intervals[s].reg >= 0 || intervals[s].dt == inst->dt)) {
+                    ColorMove m = { d, s, weight, false };
+                    dyn_array_put(ra->moves, m);
+                }
+            }
+
+            FOREACH_N(k, 0, inst->out_count) {
+                set_remove(&live, outs[k]);
+            }
+
+            FOREACH_N(k, 0, inst->in_count) {
+                set_put(&live, ins[k]);
+            }
+        }
+    }
+
+    dyn_array_destroy(insts);
+}
+
+static int color_move_cmp(const void* a, const void* b) {
+    float wa = ((const ColorMove*) a)->weight, wb = ((const ColorMove*) b)->weight;
+    return (wa < wb) - (wa > wb);
+}
+
+// Briggs: the merged node has fewer significant neighbors than colors
+static bool color_briggs(ColorRA* restrict ra, int a, int b, int stamp) {
+    int sig = 0;
+    FOREACH_N(k, 0, 2) {
+        int v = k ? b : a;
+        dyn_array_for(j, ra->adj[v]) {
+            int t = ra->adj[v][j];
+            if (ra->alias[t] != t || ra->mark[t] == stamp) continue;
+            ra->mark[t] = stamp;
+
+            // neighbors of both lose one once they're merged
+            int d = color_degree(ra, t);
+            if (color_interferes(ra, t, a) && color_interferes(ra, t, b)) d -= 1;
+
+            if (ra->fixed[t] >= 0 || d >= color_k(ra, t)) sig++;
+        }
+    }
+
+    uint32_t avail = color_allocatable(ra->ctx->intervals[a].reg_class) & ~(ra->forbid[a] | ra->forbid[b]);
+    return sig < tb_popcount(avail);
+}
+
+// George: every neighbor already conflicts with the physical reg or is easy to color
+static bool color_george(ColorRA* restrict ra, int v, int reg) {
+    dyn_array_for(j, ra->adj[v]) {
+        int t = ra->adj[v][j];
+        if (ra->alias[t] != t) continue;
+
+        if (ra->fixed[t] == reg) return false;
+        if (ra->fixed[t] < 0 && (ra->forbid[t] & (1u << reg)) == 0 && color_significant(ra, t)) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void color_coalesce(ColorRA* restrict ra) {
+    LiveInterval* intervals = ra->ctx->intervals;
+
+    // hottest copies first
+    size_t move_count = dyn_array_length(ra->moves);
+    if (move_count == 0) return;
+    qsort(ra->moves, move_count, sizeof(ColorMove), color_move_cmp);
+
+    int stamp = 0;
+    for (bool progress = true; progress;) {
+        progress = false;
+
+        FOREACH_N(i, 0, move_count) {
+            ColorMove* m = &ra->moves[i];
+            if (m->done) continue;
+
+            int a = color_find(ra, m->dst), b = color_find(ra, m->src);
+            if (a == b) {
+                m->done = true;
+                continue;
+            }
+
+            bool a_phys = intervals[a].reg >= 0, b_phys = intervals[b].reg >= 0;
+            if (a_phys && b_phys) {
+                m->done = true;
+                continue;
+            }
+
+            if (a_phys || b_phys) {
+                int v = a_phys ? b : a;
+                int reg = intervals[a_phys ? a : b].reg;
+
+                if (ra->fixed[v] >= 0 || (color_allocatable(intervals[v].reg_class) & (1u << reg)) == 0) {
+                    m->done = true;
+                } else if ((ra->forbid[v] & (1u << reg)) == 0 && color_george(ra, v, reg)) {
+                    REG_ALLOC_LOG printf("  # coalesce v%d into %s\n", v, reg_name(intervals[v].reg_class, reg));
+
+                    ra->fixed[v] = reg;
+                    m->done = true;
+                    progress = true;
+                }
+                continue;
+            }
+
+            // groups stuck to a physical reg are done
+            if (ra->fixed[a] >= 0 || ra->fixed[b] >= 0 || color_interferes(ra, a, b)) {
+                m->done = true;
+                continue;
+            }
+
+            if (color_briggs(ra, a, b, ++stamp)) {
+                REG_ALLOC_LOG printf("  # coalesce v%d into v%d\n", b, a);
+
+                ra->alias[b] = a;
+                ra->forbid[a] |= ra->forbid[b];
+                ra->cost[a] += ra->cost[b];
+                ra->present[a] |= ra->present[b];
+                dyn_array_for(j, ra->adj[b]) {
+                    int t = ra->adj[b][j];
+                    if (ra->alias[t] == t) color_add_edge(ra, a, t);
+                }
+
+                m->done = true;
+                progress = true;
+            }
+        }
+    }
+}
+
+// returns false if anything had to be spilled, those go into the spills set
+static bool color_select(ColorRA* restrict ra, Set* spills) {
+    Ctx* restrict ctx = ra->ctx;
+    LiveInterval* intervals = ctx->intervals;
+    size_t count = ra->count;
+
+    int* deg = tb_arena_alloc(tmp_arena, count * sizeof(int));
+    int* pref = tb_arena_alloc(tmp_arena, count * sizeof(int));
+    bool* removed = tb_arena_alloc(tmp_arena, count * sizeof(bool));
+    int* stack = tb_arena_alloc(tmp_arena, count * sizeof(int));
+    int* low = tb_arena_alloc(tmp_arena, count * sizeof(int));
+
+    FOREACH_N(i, 0, count) {
+        pref[i] = -1;
+        ra->color[i] = intervals[i].reg >= 0 ? intervals[i].reg : -1;
+    }
+
+    // copies which didn't get coalesced can still end up in the same register
+    dyn_array_for(i, ra->moves) {
+        int a = color_find(ra, ra->moves[i].dst), b = color_find(ra, ra->moves[i].src);
+        if (a == b) continue;
+
+        if (pref[a] < 0) pref[a] = b;
+        if (pref[b] < 0) pref[b] = a;
+    }
+
+    // precolored groups constrain their neighbors like physical regs do
+    size_t node_count = 0, low_count = 0;
+    FOREACH_N(i, 0, count) {
+        removed[i] = true;
+        if (intervals[i].reg >= 0 || ra->alias[i] != i || !ra->present[i]) continue;
+
+        if (ra->fixed[i] >= 0) {
+            assert((ra->forbid[i] & (1u << ra->fixed[i])) == 0 && "coalesced into a register it interferes with");
+            ra->color[i] = ra->fixed[i];
+            dyn_array_for(j, ra->adj[i]) {
+                int t = ra->adj[i][j];
+                if (ra->alias[t] == t) ra->forbid[t] |= 1u << ra->fixed[i];
+            }
+        } else {
+            removed[i] = false;
+            node_count++;
+        }
+    }
+
+    FOREACH_N(i, 0, count) {
+        if (removed[i]) continue;
+
+        deg[i] = 0;
+        dyn_array_for(j, ra->adj[i]) {
+            int t = ra->adj[i][j];
+            deg[i] += ra->alias[t] == t && !removed[t];
+        }
+
+        if (deg[i] < color_k(ra, i)) low[low_count++] = i;
+    }
+
+    // simplify, when we're stuck we optimistically push the cheapest thing to spill
+    size_t stack_count = 0;
+    while (stack_count < node_count) {
+        int v = -1;
+        while (low_count > 0) {
+            int t = low[--low_count];
+            if (!removed[t]) { v = t; break; }
+        }
+
+        if (v < 0) {
+            // spill temporaries are a last resort
+            float best = 0.0f;
+            bool best_tmp = false;
+            FOREACH_N(i, 0, count) if (!removed[i]) {
+                float c = ra->cost[i] / (deg[i] + 1);
+                bool is_tmp = i >= ra->first_tmp;
+                if (v < 0 || (best_tmp && !is_tmp) || (best_tmp == is_tmp && c < best)) {
+                    v = i, best = c, best_tmp = is_tmp;
+                }
+            }
+        }
+
+        removed[v] = true;
+        stack[stack_count++] = v;
+
+        dyn_array_for(j, ra->adj[v]) {
+            int t = ra->adj[v][j];
+            if (ra->alias[t] == t && !removed[t]) {
+                if (deg[t]-- == color_k(ra, t)) low[low_count++] = t;
+            }
+        }
+    }
+
+    // select, walking the stack backwards
+    uint64_t used_callee[CG_REGISTER_CLASSES] = { 0 };
+    bool spilled = false;
+    FOREACH_REVERSE_N(i, 0, stack_count) {
+        int v = stack[i];
+        int rc = intervals[v].reg_class;
+
+        uint32_t taken = ra->forbid[v];
+        dyn_array_for(j, ra->adj[v]) {
+            int t = ra->adj[v][j];
+            if (ra->alias[t] == t && ra->color[t] >= 0) taken |= 1u << ra->color[t];
+        }
+
+        uint32_t avail = color_allocatable(rc) & ~taken;
+        if (avail == 0) {
+            REG_ALLOC_LOG printf("  # v%d: spill (cost %f)\n", v, ra->cost[v]);
+
+            set_put(spills, v);
+            spilled = true;
+            continue;
+        }
+
+        // try to land with a copy partner, then caller saved regs since the callee
+        // saved ones cost a save & restore the first time we touch them.
+        int c = -1;
+        int hint = pref[v] >= 0 ? pref[v] : intervals[v].hint;
+        if (hint >= 0) {
+            hint = color_find(ra, hint);
+            if (ra->color[hint] >= 0 && (avail & (1u << ra->color[hint]))) {
+                c = ra->color[hint];
+            }
+        }
+
+        if (c < 0) {
+            uint32_t callee = ra->callee_saved[rc];
+            uint32_t caller = avail & ~callee;
+            uint32_t reused = avail & callee & used_callee[rc];
+
+            c = tb_ffs(caller ? caller : reused ? reused : avail) - 1;
+        }
+
+        ra->color[v] = c;
+        used_callee[rc] |= (1ull << c) & ra->callee_saved[rc];
+    }
+
+    return !spilled;
+}
+
+static int color_new_tmp(Ctx* restrict ctx, int vreg) {
+    LiveInterval* it = &ctx->intervals[vreg];
+    LiveInterval tmp = {
+        .reg_class = it->reg_class, .n = it->n, .dt = it->dt,
+        .reg = -1, .hint = -1, .assigned = -1, .start = INT_MAX, .split_kid = -1
+    };
+
+    int i = dyn_array_length(ctx->intervals);
+    dyn_array_put(ctx->intervals, tmp);
+    return i;
+}
+
+static Inst* color_spill_move(Ctx* restrict ctx, RegIndex dst, RegIndex src, RegIndex spilled) {
+    Inst* inst = tb_arena_alloc(tmp_arena, sizeof(Inst) + (2 * sizeof(RegIndex)));
+    *inst = (Inst){ .type = MOV, .flags = INST_SPILL, .dt = ctx->intervals[spilled].dt, .out_count = 1, 1 };
+    inst->operands[0] = dst;
+    inst->operands[1] = src;
+    return inst;
+}
+
+// constants, symbols and stack addresses are cheaper to recompute than to reload,
+// as long as nothing but the frame is an input.
+static bool color_can_remat(Ctx* restrict ctx, int vreg, Inst* def) {
+    TB_Node* n = ctx->intervals[vreg].n;
+    if (n == NULL || !should_rematerialize(n) || def->out_count != 1 || def->tmp_count != 0) {
+        return false;
+    }
+
+    if (def->type != MOV && def->type != MOVABS && def->type != LEA && def->type != FP_MOV && def->type != INST_ZERO) {
+        return false;
+    }
+
+    FOREACH_N(i, 0, def->in_count) {
+        int r = def->operands[1 + i];
+        if (r != RSP && r != RBP) return false;
+    }
+
+    return true;
+}
+
+static Inst* color_remat(Ctx* restrict ctx, Inst* def, int dst) {
+    size_t size = sizeof(Inst) + ((def->out_count + def->in_count + def->tmp_count) * sizeof(RegIndex));
+    Inst* inst = tb_arena_alloc(tmp_arena, size);
+    memcpy(inst, def, size);
+    inst->next = NULL;
+    inst->operands[0] = dst;
+
+    // XOR clobbers the flags, we might be landing between a compare and its user
+    if (inst->type == INST_ZERO && ctx->intervals[dst].reg_class == REG_CLASS_GPR) {
+        inst->type = MOV;
+        inst->flags = INST_IMM;
+        inst->imm = 0;
+    }
+    return inst;
+}
+
+static void color_spill(ColorRA* restrict ra, Set* spills) {
+    Ctx* restrict ctx = ra->ctx;
+    int count = ra->count;
+
+    #define SPILLED(r) (ctx->intervals[r].reg < 0 && set_get(spills, color_find(ra, r)))
+
+    Inst** defs = tb_arena_alloc(tmp_arena, count * sizeof(Inst*));
+    int* def_count = tb_arena_alloc(tmp_arena, count * sizeof(int));
+    int* members = tb_arena_alloc(tmp_arena, count * sizeof(int));
+    int* slot_size = tb_arena_alloc(tmp_arena, count * sizeof(int));
+    int* slot = tb_arena_alloc(tmp_arena, count * sizeof(int));
+    Inst** remat = tb_arena_alloc(tmp_arena, count * sizeof(Inst*));
+    memset(def_count, 0, count * sizeof(int));
+    memset(members, 0, count * sizeof(int));
+    memset(slot_size, 0, count * sizeof(int));
+    memset(slot, 0, count * sizeof(int));
+    memset(remat, 0, count * sizeof(Inst*));
+
+    for (Inst* inst = ctx->first; inst; inst = inst->next) {
+        FOREACH_N(i, 0, inst->out_count) {
+            int r = inst->operands[i];
+            if (SPILLED(r)) def_count[r]++, defs[r] = inst;
+        }
+    }
+
+    FOREACH_N(i, 0, count) {
+        if (SPILLED(i)) members[color_find(ra, i)]++;
+    }
+
+    // pick stack slots, the whole group shares one since they never interfere
+    FOREACH_N(i, 0, count) {
+        if (!SPILLED(i)) continue;
+
+        int leader = color_find(ra, i);
+        if (members[leader] == 1 && def_count[i] == 1 && color_can_remat(ctx, i, defs[i])) {
+            REG_ALLOC_LOG printf("  # v%td: rematerialize\n", i);
+            remat[i] = defs[i];
+            continue;
+        }
+
+        // packed values need the whole 16 bytes
+        TB_X86_DataType dt = ctx->intervals[i].dt;
+        int size = (dt >= TB_X86_TYPE_PBYTE && dt <= TB_X86_TYPE_PQWORD) || dt >= TB_X86_TYPE_SSE_PS ? 16 : 8;
+        if (slot_size[leader] < size) slot_size[leader] = size;
+    }
+
+    FOREACH_N(i, 0, count) {
+        if (!SPILLED(i) || remat[i]) continue;
+
+        int leader = color_find(ra, i);
+        if (slot[leader] == 0) {
+            int size = slot_size[leader];
+            ra->stack_usage = align_up(ra->stack_usage + size, size);
+            slot[leader] = ra->stack_usage;
+        }
+
+        ctx->intervals[i].spill = slot[leader];
+        REG_ALLOC_LOG printf("  # v%td: spill to [RBP - %d]\n", i, ctx->intervals[i].spill);
+    }
+
+    // rewrite the uses & defs, the spilled values can stay put in plain copies since
+    // those just become the loads and stores.
+    Inst* prev = ctx->first;
+    for (Inst* inst = prev->next; inst; prev = inst, inst = inst->next) {
+        RegIndex* ops = inst->operands;
+        if (inst->out_count == 1 && ops[0] < count && remat[ops[0]] == inst) {
+            prev->next = inst->next;
+            inst = prev;
+            continue;
+        }
+
+        if (color_is_move(inst)) {
+            int d = ops[0], s = ops[1];
+            bool sd = SPILLED(d), ss = SPILLED(s);
+
+            // copies from earlier rounds might already have a side in memory
+            bool in_mem = (!sd && ctx->intervals[d].spill > 0) || (!ss && ctx->intervals[s].spill > 0);
+
+            if (in_mem) {
+                // needs a register in between, handled below
+            } else if (ss && remat[s] && !sd && ctx->intervals[d].reg_class == ctx->intervals[s].reg_class) {
+                // copying a rematerialized value is just the value
+                Inst* r = color_remat(ctx, remat[s], d);
+                r->next = inst->next;
+                prev->next = r;
+                inst = r;
+                continue;
+            } else if (sd && ss && !remat[s] && ctx->intervals[d].spill == ctx->intervals[s].spill) {
+                prev->next = inst->next;
+                inst = prev;
+                continue;
+            } else if (sd != ss && !remat[s] && inst->dt == ctx->intervals[sd ? d : s].dt) {
+                continue;
+            }
+        }
+
+        size_t total = inst->out_count + inst->in_count + inst->tmp_count;
+        bool any = false;
+        FOREACH_N(i, 0, total) {
+            any |= ops[i] < count && SPILLED(ops[i]);
+        }
+
+        if (!any) continue;
+
+        RegIndex* old = tb_arena_alloc(tmp_arena, total * sizeof(RegIndex));
+        memcpy(old, ops, total * sizeof(RegIndex));
+
+        // inputs first so a def of the same value reuses the temporary
+        Inst* last = inst;
+        FOREACH_N(k, 0, total) {
+            bool is_in  = k < inst->in_count;
+            bool is_out = !is_in && k < inst->in_count + inst->out_count;
+
+            ptrdiff_t i = k;
+            if (is_in) i = inst->out_count + k;
+            else if (is_out) i = k - inst->in_count;
+
+            int r = old[i];
+            if (r >= count || !SPILLED(r)) continue;
+
+            int tmp = -1;
+            FOREACH_N(j, 0, total) {
+                if (old[j] == r && ops[j] != r) {
+                    tmp = ops[j];
+                    break;
+                }
+            }
+
+            bool fresh = tmp < 0;
+            if (fresh) tmp = color_new_tmp(ctx, r);
+            ops[i] = tmp;
+
+            if (is_in && fresh) {
+                Inst* load = remat[r] ? color_remat(ctx, remat[r], tmp) : color_spill_move(ctx, tmp, r, r);
+                load->next = inst;
+                prev->next = load;
+                prev = load;
+            } else if (is_out) {
+                Inst* store = color_spill_move(ctx, r, tmp, r);
+                store->next = last->next;
+                last->next = store;
+                last = store;
+            }
+        }
+
+        // skip past the stores
+        inst = last;
+    }
+
+    #undef SPILLED
+}
+
+static int graph_color(Ctx* restrict ctx, TB_Function* f, int stack_usage, int end) {
+    ColorRA ra = { .ctx = ctx, .first_tmp = INT_MAX, .stack_usage = stack_usage };
+    mark_callee_saved_constraints(ctx, ra.callee_saved);
+
+    bool colored = false;
+    for (int round = 0; round < COLOR_MAX_ROUNDS; round++) {
+        size_t count = dyn_array_length(ctx->intervals);
+        if (count > COLOR_MAX_INTERVALS) {
+            break;
+        }
+
+        while (dyn_array_length(ra.alias) < count) {
+            dyn_array_put(ra.alias, dyn_array_length(ra.alias));
+            dyn_array_put(ra.fixed, -1);
+        }
+
+        size_t matrix_words = (((count * (count - 1)) / 2) + 63) / 64;
+        ra.count   = count;
+        ra.matrix  = tb_platform_heap_alloc(matrix_words * sizeof(uint64_t));
+        ra.adj     = tb_platform_heap_alloc(count * sizeof(DynArray(int)));
+        ra.forbid  = tb_arena_alloc(tmp_arena, count * sizeof(uint32_t));
+        ra.cost    = tb_arena_alloc(tmp_arena, count * sizeof(float));
+        ra.present = tb_arena_alloc(tmp_arena, count * sizeof(bool));
+        ra.color   = tb_arena_alloc(tmp_arena, count * sizeof(int));
+        ra.mark    = tb_arena_alloc(tmp_arena, count * sizeof(int));
+        memset(ra.matrix, 0, matrix_words * sizeof(uint64_t));
+        memset(ra.adj, 0, count * sizeof(DynArray(int)));
+        memset(ra.forbid, 0, count * sizeof(uint32_t));
+        memset(ra.cost, 0, count * sizeof(float));
+        memset(ra.present, 0, count * sizeof(bool));
+        memset(ra.mark, 0, count * sizeof(int));
+
+        CUIK_TIMED_BLOCK("build graph") {
+            color_build(&ra);
+        }
+
+        CUIK_TIMED_BLOCK("coalesce") {
+            color_coalesce(&ra);
+        }
+
+        Set spills = set_create_in_arena(tmp_arena, count);
+        CUIK_TIMED_BLOCK("select") {
+            colored = color_select(&ra, &spills);
+        }
+
+        // if the temporaries from the last round didn't fit, spilling more won't help
+        bool stuck = false;
+        if (colored) {
+            FOREACH_N(i, 0, count) {
+                int leader = color_find(&ra, i);
+                if (ctx->intervals[i].reg < 0 && ctx->intervals[i].spill <= 0 && ra.present[leader]) {
+                    ctx->intervals[i].assigned = ra.color[leader];
+                }
+            }
+        } else {
+            FOREACH_N(i, TB_MIN((size_t) ra.first_tmp, count), count) {
+                stuck |= set_get(&spills, i);
+            }
+
+            if (!stuck) {
+                if (ra.first_tmp == INT_MAX) ra.first_tmp = count;
+
+                CUIK_TIMED_BLOCK("spill") {
+                    color_spill(&ra, &spills);
+                }
+
+                nl_map_free(ctx->machine_bbs);
+                end = liveness(ctx, f);
+            }
+        }
+
+        dyn_array_destroy(ra.moves);
+        FOREACH_N(i, 0, count) {
+            dyn_array_destroy(ra.adj[i]);
+        }
+        tb_platform_heap_free(ra.adj);
+        tb_platform_heap_free(ra.matrix);
+
+        if (colored || stuck) break;
+    }
+
+    dyn_array_destroy(ra.alias);
+    dyn_array_destroy(ra.fixed);
+
+    if (!colored) {
+        REG_ALLOC_LOG printf("  # graph coloring gave up, falling back to linear scan\n");
+
+        dyn_array_for(i, ctx->intervals) {
+            if (ctx->intervals[i].reg < 0) ctx->intervals[i].assigned = -1;
+        }
+
+        return linear_scan(ctx, f, ra.stack_usage, end);
+    }
+
+    // save & restore the callee saved regs we touched, that includes the ones
+    // instructions write directly (RDI & RSI for REP MOVSB on win64).
+    LSRA shim = { .first = ctx->first, .cache = ctx->first, .intervals = ctx->intervals, .stack_usage = ra.stack_usage };
+    uint64_t used[CG_REGISTER_CLASSES] = { 0 };
+    dyn_array_for(i, shim.intervals) {
+        LiveInterval* it = &shim.intervals[i];
+        if (it->reg < 0 && it->assigned >= 0) {
+            used[it->reg_class] |= (1ull << it->assigned) & ra.callee_saved[it->reg_class];
+        }
+    }
+
+    for (Inst* inst = ctx->first; inst; inst = inst->next) {
+        FOREACH_N(i, 0, inst->out_count) {
+            LiveInterval* it = &shim.intervals[inst->operands[i]];
+            if (it->reg >= 0) {
+                used[it->reg_class] |= (1ull << it->reg) & ra.callee_saved[it->reg_class];
+            }
+        }
+    }
+
+    FOREACH_N(rc, 0, CG_REGISTER_CLASSES) {
+        FOREACH_N(reg, 0, 16) if (used[rc] & (1ull << reg)) {
+            REG_ALLOC_LOG printf("  #   spill callee saved register %s\n", reg_name(rc, reg));
+
+            int size = rc ? 16 : 8;
+            int vreg = (rc ? FIRST_XMM : FIRST_GPR) + reg;
+            shim.stack_usage = align_up(shim.stack_usage + size, size);
+
+            LiveInterval it = {
+                .spill = shim.stack_usage,
+                .dt = shim.intervals[vreg].dt,
+                .assigned = -1,
+                .reg = -1,
+                .split_kid = -1,
+            };
+
+            int spill_slot = dyn_array_length(shim.intervals);
+            dyn_array_put(shim.intervals, it);
+
+            insert_split_move(&shim, 0, vreg, spill_slot);
+            dyn_array_for(j, ctx->epilogues) {
+                insert_split_move(&shim, ctx->epilogues[j], spill_slot, vreg);
+            }
+        }
+    }
+
+    ctx->intervals = shim.intervals;
+    return shim.stack_usage;
+}
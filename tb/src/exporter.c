@@ -1,4 +1,5 @@
 #include "tb_internal.h"
+#include <hashes.h>
 
 TB_ExportBuffer tb_coff_write_output(TB_Module* restrict m, const IDebugFormat* dbg);
 TB_ExportBuffer tb_macho_write_output(TB_Module* restrict m, const IDebugFormat* dbg);
@@ -91,6 +92,19 @@ static void layout_section(TB_ModuleSection* restrict section) {
     }
 }
 
+// named objects need distinct addresses in C so we only merge what nobody
+// could have taken the address of by name, it's also gotta be a single
+// fully initialized region since we compare the raw bytes.
+static bool is_mergeable_global(TB_Global* g) {
+    if (g->linkage != TB_LINKAGE_PRIVATE || (g->super.name != NULL && g->super.name[0] != 0)) {
+        return false;
+    }
+
+    return g->size > 0 && g->obj_count == 1 &&
+        g->objects[0].type == TB_INIT_OBJ_REGION &&
+        g->objects[0].offset == 0 && g->objects[0].region.size == g->size;
+}
+
 ExportList tb_module_layout_sections(TB_Module* m) {
     TB_Arena* arena = &tb_thread_info(m)->tmp_arena;
 
@@ -105,7 +119,8 @@ ExportList tb_module_layout_sections(TB_Module* m) {
 
         // unpack symbols
         TB_Symbol** syms = (TB_Symbol**) info->symbols.data;
-        size_t cap = 1ull << info->symbols.exp;
+        // threads which never made symbols (like the one exporting) don't have a table
+        size_t cap = info->symbols.data ? 1ull << info->symbols.exp : 0;
         for (size_t i = 0; i < cap; i++) {
             TB_Symbol* s = syms[i];
             if (s == NULL || s == NL_HASHSET_TOMB) continue;
@@ -157,15 +172,36 @@ ExportList tb_module_layout_sections(TB_Module* m) {
                 offset += sec->funcs[i]->code_size;
             }
 
-            // then globals
+            // then globals, anonymous read-only blobs (string literals, compound
+            // literal tables) with identical contents get to share storage.
+            NL_Map(uint32_t, TB_Global*) dedup = NULL;
+            bool read_only = (sec->flags & TB_MODULE_SECTION_WRITE) == 0;
+
             dyn_array_for(i, sec->globals) {
                 TB_Global* g = sec->globals[i];
 
+                if (read_only && is_mergeable_global(g)) {
+                    uint32_t hash = tb__murmur3_32(g->objects[0].region.ptr, g->size);
+
+                    ptrdiff_t search = nl_map_get(dedup, hash);
+                    if (search >= 0) {
+                        TB_Global* other = dedup[search].v;
+                        if (other->size == g->size && (other->pos & (g->align - 1)) == 0 &&
+                            memcmp(other->objects[0].region.ptr, g->objects[0].region.ptr, g->size) == 0) {
+                            g->pos = other->pos;
+                            continue;
+                        }
+                    } else {
+                        nl_map_put(dedup, hash, g);
+                    }
+                }
+
                 offset = align_up(offset, g->align);
                 g->pos = offset;
                 offset += g->size;
             }
 
+            nl_map_free(dedup);
             sec->total_size = offset;
         }
     }
@@ -29,6 +29,7 @@ TB_API const char* tb_node_get_name(TB_Node* n) {
 
         case TB_PHI: return "phi";
         case TB_SELECT: return "select";
+        case TB_VBROADCAST: return "vbroadcast";
 
         case TB_ARRAY_ACCESS: return "array";
         case TB_MEMBER_ACCESS: return "member";
@@ -102,6 +103,7 @@ TB_API const char* tb_node_get_name(TB_Node* n) {
 
         case TB_CALL: return "call";
         case TB_SYSCALL: return "syscall";
+        case TB_TAILCALL: return "tailcall";
         case TB_BRANCH: return "branch";
 
         default: tb_todo();return "(unknown)";
@@ -146,6 +148,10 @@ static void tb_print_type(TB_DataType dt, TB_PrintCallback callback, void* user_
         }
         default: tb_todo();
     }
+
+    if (dt.width) {
+        P("x%d", 1 << dt.width);
+    }
 }
 
 #if 0
@@ -323,7 +329,7 @@ static bool print_graph_node(TB_Function* f, NL_HashSet* visited, TB_PrintCallba
 
     const char* fillcolor = is_effect ? "lightgrey" : "antiquewhite1";
     P("  r%p [style=\"filled\"; ordering=in; shape=box; fillcolor=%s; label=\"", n, fillcolor);
-    P("%zu: %s", n->gvn, tb_node_get_name(n));
+    P("%u: %s", n->gvn, tb_node_get_name(n));
     P("\"];\n");
 
     FOREACH_N(i, 0, n->input_count) if (n->inputs[i]) {
@@ -353,7 +359,7 @@ static void print_graph_bb(TB_Function* f, NL_HashSet* visited, TB_PrintCallback
     TB_Node* curr = r->end;
     do {
         nl_hashset_put(visited, curr);
-        P("    r%p [style=\"filled\"; shape=box; fillcolor=antiquewhite1; label=\"%zu: ", curr, curr->gvn);
+        P("    r%p [style=\"filled\"; shape=box; fillcolor=antiquewhite1; label=\"%u: ", curr, curr->gvn);
         if (curr->type == TB_END) {
             P("END");
         } else {
@@ -364,7 +370,7 @@ static void print_graph_bb(TB_Function* f, NL_HashSet* visited, TB_PrintCallback
     } while (curr != bb);
 
     // basic block header
-    P("    r%p [style=\"filled\"; shape=box; fillcolor=antiquewhite1; label=\"%zu: %s\"]\n", bb, bb->gvn, bb->type == TB_START ? "START" : "REGION");
+    P("    r%p [style=\"filled\"; shape=box; fillcolor=antiquewhite1; label=\"%u: %s\"]\n", bb, bb->gvn, bb->type == TB_START ? "START" : "REGION");
     if (bb->type == TB_START) {
         P("    { rank=min; r%p }\n", bb);
     } else if (r->end->type == TB_END) {
@@ -1,6 +1,10 @@
 #include "tb_internal.h"
 #include "host.h"
 
+#ifndef _WIN32
+#include <dlfcn.h>
+#endif
+
 enum {
     ALLOC_GRANULARITY = 16,
 
@@ -32,8 +36,27 @@ typedef struct {
     AllocRegion* region;
 } TB_JITHeap;
 
+// the module's code might not share the host's calling convention, calls
+// into the host go through one of these translating thunks.
+#if !defined(_WIN32) && (defined(__x86_64__) || defined(_M_X64))
+#define HOST_IS_SYSV 1
+#endif
+
+typedef struct {
+    void* target;
+    uint64_t float_args;
+    int arg_count;
+
+    void* thunk;
+} ABIThunk;
+
 struct TB_JIT {
     NL_Strmap(void*) loaded_funcs;
+    DynArray(ABIThunk) abi_thunks;
+
+    // public functions & globals in the module, an external in one TU
+    // might be defined by another one.
+    NL_Strmap(TB_Symbol*) defined;
 
     TB_JITHeap rx_heap;
     TB_JITHeap rw_heap;
@@ -55,6 +78,10 @@ static TB_JITHeap tb_jitheap_create(TB_MemProtect prot, void* ptr, size_t size)
 }
 
 static void* push_region(TB_JITHeap* c, size_t size) {
+    if (c->used + size > c->capacity) {
+        tb_panic("jit heap %s: out of memory (%zu bytes)", prot_names[c->prot], c->capacity);
+    }
+
     void* ptr = &c->block[c->used];
     c->used += size;
     return ptr;
@@ -159,15 +186,182 @@ static void* get_proc(TB_JIT* jit, const char* name) {
     nl_map_put_cstr(jit->loaded_funcs, name, addr);
     return addr;
     #else
-    return NULL;
+    // check cache first
+    ptrdiff_t search = nl_map_get_cstr(jit->loaded_funcs, name);
+    if (search >= 0) return jit->loaded_funcs[search].v;
+
+    // anything the host process has loaded (libc mostly) is fair game
+    void* addr = dlsym(RTLD_DEFAULT, name);
+    nl_map_put_cstr(jit->loaded_funcs, name, addr);
+    return addr;
     #endif
 }
 
-static void* get_symbol_address(const TB_Symbol* s) {
+#ifdef HOST_IS_SYSV
+enum { RAX, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11 };
+
+// [base + disp32] with reg in the middle field
+static uint8_t* thunk_mem(uint8_t* out, int reg, int base, int32_t disp) {
+    *out++ = 0x80 | ((reg & 7) << 3) | (base & 7);
+    if (base == RSP) *out++ = 0x24;
+
+    memcpy(out, &disp, sizeof(int32_t));
+    return out + 4;
+}
+
+// mov r64, [mem] (0x8B) or mov [mem], r64 (0x89)
+static uint8_t* thunk_gpr_mem(uint8_t* out, uint8_t op, int reg, int base, int32_t disp) {
+    *out++ = 0x48 | (reg >= 8 ? 4 : 0);
+    *out++ = op;
+    return thunk_mem(out, reg, base, disp);
+}
+
+// movsd xmm, [mem] (0x10) or movsd [mem], xmm (0x11), movdqu is 0xF3 with 0x6F/0x7F
+static uint8_t* thunk_xmm_mem(uint8_t* out, uint8_t prefix, uint8_t op, int reg, int base, int32_t disp) {
+    *out++ = prefix;
+    if (reg >= 8) *out++ = 0x44;
+    *out++ = 0x0F;
+    *out++ = op;
+    return thunk_mem(out, reg, base, disp);
+}
+
+// Win64 code calling into a SysV function, both agree on which registers
+// survive a call except RDI, RSI and XMM6-15 so those get saved here. Only
+// scalar arguments can be moved around, anything passed by reference in one
+// and by value in the other isn't something we can know about at this point.
+static void* get_abi_thunk(TB_JIT* jit, void* target, const TB_SymbolPatch* p) {
+    dyn_array_for(i, jit->abi_thunks) {
+        ABIThunk* t = &jit->abi_thunks[i];
+        if (t->target == target && t->float_args == p->float_args && t->arg_count == p->arg_count) {
+            return t->thunk;
+        }
+    }
+
+    int arg_count = p->arg_count;
+    if (arg_count > 64) {
+        tb_panic("JIT: too many arguments to call into the host (%d)", arg_count);
+    }
+
+    // figure out how much gets passed on the SysV stack
+    static const int sysv_gprs[] = { RDI, RSI, RDX, RCX, R8, R9 };
+    static const int win64_gprs[] = { RCX, RDX, R8, R9 };
+
+    int gprs_used = 0, xmms_used = 0, stack_used = 0;
+    FOREACH_N(k, 0, arg_count) {
+        if (p->float_args & (1ull << k)) {
+            if (xmms_used < 8) xmms_used++; else stack_used++;
+        } else {
+            if (gprs_used < 6) gprs_used++; else stack_used++;
+        }
+    }
+
+    // frame is [stack args] [xmm6-15] [rsi] [rdi] [rbp], we're 16 byte
+    // aligned at the CALL since the pushes land us back on a boundary.
+    int32_t stack_size = (stack_used * 8 + 15) & ~15;
+    int32_t frame_size = stack_size + 10*16;
+
+    uint8_t code[2048], *out = code;
+    *out++ = 0x55;                                     // push rbp
+    *out++ = 0x48, *out++ = 0x89, *out++ = 0xE5;       // mov rbp, rsp
+    *out++ = 0x57;                                     // push rdi
+    *out++ = 0x56;                                     // push rsi
+    *out++ = 0x48, *out++ = 0x81, *out++ = 0xEC;       // sub rsp, frame_size
+    memcpy(out, &frame_size, 4), out += 4;
+
+    FOREACH_N(i, 0, 10) {
+        out = thunk_xmm_mem(out, 0xF3, 0x7F, 6 + i, RSP, stack_size + i*16);
+    }
+
+    // arguments only move to a lower (or the same) position going Win64
+    // to SysV so doing them in order never clobbers one we haven't read.
+    gprs_used = 0, xmms_used = 0, stack_used = 0;
+    FOREACH_N(k, 0, arg_count) {
+        bool is_float = p->float_args & (1ull << k);
+        int32_t src_disp = 16 + k*8; // past the return address and shadow space
+
+        if (is_float && xmms_used < 8) {
+            int dst = xmms_used++;
+            if (k >= 4) {
+                out = thunk_xmm_mem(out, 0xF2, 0x10, dst, RBP, src_disp);
+            } else if (k != dst) {
+                // movaps dst, src
+                *out++ = 0x0F, *out++ = 0x28, *out++ = 0xC0 | (dst << 3) | k;
+            }
+        } else if (!is_float && gprs_used < 6) {
+            int dst = sysv_gprs[gprs_used++];
+            if (k >= 4) {
+                out = thunk_gpr_mem(out, 0x8B, dst, RBP, src_disp);
+            } else {
+                // mov dst, src
+                int src = win64_gprs[k];
+                *out++ = 0x48 | (src >= 8 ? 4 : 0) | (dst >= 8 ? 1 : 0);
+                *out++ = 0x89;
+                *out++ = 0xC0 | ((src & 7) << 3) | (dst & 7);
+            }
+        } else {
+            int32_t dst_disp = stack_used++ * 8;
+            if (k >= 4) {
+                out = thunk_gpr_mem(out, 0x8B, RAX, RBP, src_disp);
+                out = thunk_gpr_mem(out, 0x89, RAX, RSP, dst_disp);
+            } else if (is_float) {
+                out = thunk_xmm_mem(out, 0xF2, 0x11, k, RSP, dst_disp);
+            } else {
+                out = thunk_gpr_mem(out, 0x89, win64_gprs[k], RSP, dst_disp);
+            }
+        }
+    }
+
+    // varargs want the number of vector registers in AL
+    int32_t vector_count = xmms_used;
+    *out++ = 0xB8;                                     // mov eax, vector_count
+    memcpy(out, &vector_count, 4), out += 4;
+    *out++ = 0x49, *out++ = 0xBB;                      // mov r11, target
+    memcpy(out, &target, sizeof(void*)), out += sizeof(void*);
+    *out++ = 0x41, *out++ = 0xFF, *out++ = 0xD3;       // call r11
+
+    FOREACH_N(i, 0, 10) {
+        out = thunk_xmm_mem(out, 0xF3, 0x6F, 6 + i, RSP, stack_size + i*16);
+    }
+
+    *out++ = 0x48, *out++ = 0x81, *out++ = 0xC4;       // add rsp, frame_size
+    memcpy(out, &frame_size, 4), out += 4;
+    *out++ = 0x5E;                                     // pop rsi
+    *out++ = 0x5F;                                     // pop rdi
+    *out++ = 0x5D;                                     // pop rbp
+    *out++ = 0xC3;                                     // ret
+    assert(out - code <= sizeof(code));
+
+    void* thunk = tb_jitheap_alloc_region(&jit->rx_heap, out - code, 16);
+    memcpy(thunk, code, out - code);
+    log_debug("jit: abi thunk for %p (%d args)", target, arg_count);
+
+    ABIThunk t = { target, p->float_args, arg_count, thunk };
+    dyn_array_put(jit->abi_thunks, t);
+    return thunk;
+}
+#endif
+
+static TB_Symbol* find_definition(TB_JIT* jit, const char* name) {
+    ptrdiff_t search = nl_map_get_cstr(jit->defined, name);
+    return search >= 0 ? jit->defined[search].v : NULL;
+}
+
+static void* get_symbol_address(TB_JIT* jit, TB_Symbol* s) {
     if (s->tag == TB_SYMBOL_GLOBAL) {
-        return ((TB_Global*) s)->address;
+        return tb_jit_place_global(jit, (TB_Global*) s);
     } else if (s->tag == TB_SYMBOL_FUNCTION) {
-        return ((TB_Function*) s)->compiled_pos;
+        return tb_jit_place_function(jit, (TB_Function*) s);
+    } else if (s->tag == TB_SYMBOL_EXTERNAL) {
+        TB_Symbol* def = find_definition(jit, s->name);
+        if (def != NULL) {
+            return get_symbol_address(jit, def);
+        }
+
+        void* addr = s->address ? s->address : get_proc(jit, s->name);
+        if (addr == NULL) {
+            tb_panic("Could not find symbol: %s", s->name);
+        }
+        return addr;
     } else {
         tb_todo();
     }
@@ -179,6 +373,11 @@ void* tb_jit_place_function(TB_JIT* jit, TB_Function* f) {
         return f->compiled_pos;
     }
 
+    // never compiled, there's nothing to place
+    if (func_out == NULL) {
+        return NULL;
+    }
+
     // copy machine code
     char* dst = tb_jitheap_alloc_region(&jit->rx_heap, func_out->code_size, 16);
     memcpy(dst, func_out->code, func_out->code_size);
@@ -195,13 +394,44 @@ void* tb_jit_place_function(TB_JIT* jit, TB_Function* f) {
         if (tag == TB_SYMBOL_FUNCTION) {
             TB_Function* f = (TB_Function*) p->target;
             void* addr = tb_jit_place_function(jit, f);
+            if (addr == NULL) {
+                tb_panic("Could not find procedure: %s", f->super.name);
+            }
 
             int32_t rel32 = (intptr_t)addr - ((intptr_t)patch + 4);
             *patch += rel32;
         } else if (tag == TB_SYMBOL_EXTERNAL) {
             TB_External* e = (TB_External*) p->target;
 
+            // defined in the module, it's as close as the rest of our code
+            TB_Symbol* def = find_definition(jit, p->target->name);
+            if (def != NULL) {
+                void* addr = get_symbol_address(jit, def);
+                if (addr == NULL) {
+                    tb_panic("Could not find procedure: %s", p->target->name);
+                }
+
+                int32_t rel32 = (intptr_t)addr - ((intptr_t)patch + 4);
+                *patch += rel32;
+                continue;
+            }
+
             void* addr = e->thunk ? e->thunk : p->target->address;
+            #ifdef HOST_IS_SYSV
+            if (p->is_call && f->super.module->target_abi == TB_ABI_WIN64) {
+                // the host can't take Win64 calls, the translating thunk lives
+                // in our heap so it's always close enough. anything else which
+                // refers to the function (taking its address) still sees the raw
+                // SysV entry point.
+                addr = p->target->address ? p->target->address : get_proc(jit, p->target->name);
+                if (addr == NULL) {
+                    tb_panic("Could not find procedure: %s", p->target->name);
+                }
+
+                addr = get_abi_thunk(jit, addr, p);
+            }
+            #endif
+
             if (addr == NULL) {
                 addr = get_proc(jit, p->target->name);
                 if (addr == NULL) {
@@ -264,7 +494,7 @@ void* tb_jit_place_global(TB_JIT* jit, TB_Global* g) {
 
     FOREACH_N(k, 0, g->obj_count) {
         if (g->objects[k].type == TB_INIT_OBJ_RELOC) {
-            uintptr_t addr = (uintptr_t) get_symbol_address(g->objects[k].reloc);
+            uintptr_t addr = (uintptr_t) get_symbol_address(jit, (TB_Symbol*) g->objects[k].reloc);
 
             uintptr_t* dst = (uintptr_t*) &data[g->objects[k].offset];
             *dst += addr;
@@ -289,10 +519,29 @@ TB_JIT* tb_jit_begin(TB_Module* m, size_t jit_heap_capacity) {
         .rw_heap = tb_jitheap_create(TB_PAGE_RW, &ptr[semi_space], semi_space)
     };
 
+    TB_SymbolIter it = tb_symbol_iter(m);
+    TB_Symbol* sym;
+    while (sym = tb_symbol_iter_next(&it), sym != NULL) {
+        if (sym->name == NULL || *sym->name == 0) continue;
+
+        bool is_public = false;
+        if (sym->tag == TB_SYMBOL_FUNCTION) {
+            is_public = ((TB_Function*) sym)->linkage == TB_LINKAGE_PUBLIC;
+        } else if (sym->tag == TB_SYMBOL_GLOBAL) {
+            is_public = ((TB_Global*) sym)->linkage == TB_LINKAGE_PUBLIC;
+        }
+
+        if (is_public) {
+            nl_map_put_cstr(jit->defined, sym->name, sym);
+        }
+    }
+
     return jit;
 }
 
 void tb_jit_end(TB_JIT* jit) {
+    nl_map_free(jit->defined);
+    dyn_array_destroy(jit->abi_thunks);
     tb_platform_vfree(jit->rx_heap.block, jit->rx_heap.capacity);
     tb_platform_vfree(jit->rw_heap.block, jit->rw_heap.capacity);
     tb_platform_heap_free(jit);
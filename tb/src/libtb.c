@@ -3,6 +3,7 @@
 #include "hash.c"
 #include "abi.c"
 #include "tb_builder.c"
+#include "profile.c"
 #include "debug_builder.c"
 #include "ir_printer.c"
 #include "exporter.c"
@@ -58,6 +59,24 @@ bool tb_platform_vprotect(void* ptr, size_t size, TB_MemProtect prot) {
 
     return mprotect(ptr, size, protect) == 0;
 }
+
+void* tb_platform_vreserve(size_t size, bool huge) {
+    void* ptr = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (ptr == MAP_FAILED) {
+        return NULL;
+    }
+
+    #ifdef MADV_HUGEPAGE
+    // it's only advice, if THP is off we just get normal pages
+    if (huge) madvise(ptr, size, MADV_HUGEPAGE);
+    #endif
+
+    return ptr;
+}
+
+bool tb_platform_vcommit(void* ptr, size_t size) {
+    return mprotect(ptr, size, PROT_READ | PROT_WRITE) == 0;
+}
 #elif defined(_WIN32)
 #pragma comment(lib, "onecore.lib")
 
@@ -83,6 +102,16 @@ bool tb_platform_vprotect(void* ptr, size_t size, TB_MemProtect prot) {
     return VirtualProtect(ptr, size, protect, &old_protect);
 }
 
+// large pages on windows have to be committed up front (and need SeLockMemoryPrivilege)
+// so we only ever reserve normal pages here.
+void* tb_platform_vreserve(size_t size, bool huge) {
+    return VirtualAlloc(NULL, size, MEM_RESERVE, PAGE_NOACCESS);
+}
+
+bool tb_platform_vcommit(void* ptr, size_t size) {
+    return VirtualAlloc(ptr, size, MEM_COMMIT, PAGE_READWRITE) != NULL;
+}
+
 
 size_t get_large_pages(void) {
     static bool init;
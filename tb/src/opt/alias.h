@@ -0,0 +1,228 @@
+// Alias analysis, answers whether two memory accesses might touch the same bytes. it's
+// all local reasoning on the address expressions so it's cheap enough to call from the
+// peepholes:
+//
+//   * same base with known offsets compares the byte ranges.
+//   * different LOCALs and globals never overlap, neither does a LOCAL whose address
+//     doesn't escape with any pointer not derived from it.
+//   * restrict pointers (tb_function_attrib_restrict) don't alias the other identified
+//     bases (params, LOCALs, globals).
+//   * loads & stores with different non-zero type classes (tb_function_attrib_type_class)
+//     don't alias, that's C's strict aliasing. it's only consulted when the addresses
+//     can't tell us anything so union punning through the same address still works.
+typedef enum {
+    ALIAS_NO,
+    ALIAS_MAY,
+    ALIAS_MUST,
+} AliasResult;
+
+// how far we chase the users of a LOCAL looking for escapes
+enum { ALIAS_ESCAPE_DEPTH = 4 };
+
+typedef struct {
+    TB_Node* base;
+    int64_t offset;
+
+    // false if a variable index got in the way, the offset
+    // only covers the parts we know then.
+    bool known;
+} AliasLoc;
+
+static AliasLoc alias_loc(TB_Node* addr) {
+    AliasLoc l = { addr, 0, true };
+    for (;;) {
+        TB_Node* n = l.base;
+        if (n->type == TB_MEMBER_ACCESS) {
+            l.offset += TB_NODE_GET_EXTRA_T(n, TB_NodeMember)->offset;
+        } else if (n->type == TB_ARRAY_ACCESS) {
+            TB_Node* index = n->inputs[2];
+            if (index->type == TB_INTEGER_CONST) {
+                int64_t stride = TB_NODE_GET_EXTRA_T(n, TB_NodeArray)->stride;
+                l.offset += (int64_t) TB_NODE_GET_EXTRA_T(index, TB_NodeInt)->value * stride;
+            } else {
+                l.known = false;
+            }
+        } else {
+            return l;
+        }
+
+        l.base = n->inputs[1];
+    }
+}
+
+static TB_Attrib* alias_attrib(TB_Function* f, TB_Node* n) {
+    ptrdiff_t search = nl_map_get(f->attribs, n);
+    if (search >= 0) {
+        DynArray(TB_Attrib) attribs = f->attribs[search].v;
+        dyn_array_for(i, attribs) {
+            if (attribs[i].tag == TB_ATTRIB_ALIAS) return &attribs[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int alias_type_class(TB_Function* f, TB_Node* n) {
+    TB_Attrib* a = alias_attrib(f, n);
+    return a ? a->alias.type_class : 0;
+}
+
+static bool alias_is_restrict(TB_Function* f, TB_Node* n) {
+    TB_Attrib* a = alias_attrib(f, n);
+    return a && a->alias.is_restrict;
+}
+
+static bool alias_is_param(TB_Function* f, TB_Node* n) {
+    return n->type == TB_PROJ && n->inputs[0] == f->start_node && n->dt.type == TB_PTR;
+}
+
+// a separate allocation, two different ones can't overlap
+static bool alias_is_object(TB_Node* n) {
+    return n->type == TB_LOCAL || n->type == TB_SYMBOL;
+}
+
+// two SYMBOL nodes naming the same symbol are the same object even before
+// they've been GVN'd together.
+static bool alias_same_base(TB_Node* a, TB_Node* b) {
+    if (a == b) return true;
+    return a->type == TB_SYMBOL && b->type == TB_SYMBOL &&
+        TB_NODE_GET_EXTRA_T(a, TB_NodeSymbol)->sym == TB_NODE_GET_EXTRA_T(b, TB_NodeSymbol)->sym;
+}
+
+// the address of a LOCAL escapes once it's stored, passed along or merged with other
+// pointers, as long as it only feeds addresses nobody else can reach it.
+static bool alias_escapes(TB_Passes* restrict p, TB_Node* n, int depth) {
+    FOR_USERS(u, n) {
+        TB_Node* use = u->n;
+        switch (use->type) {
+            case TB_LOAD:
+            case TB_STORE:
+            case TB_MEMSET:
+            if (u->slot != 2) return true;
+            break;
+
+            case TB_MEMCPY:
+            if (u->slot != 2 && u->slot != 3) return true;
+            break;
+
+            case TB_MEMBER_ACCESS:
+            case TB_ARRAY_ACCESS:
+            if (u->slot != 1 || depth == 0 || alias_escapes(p, use, depth - 1)) return true;
+            break;
+
+            default:
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// size is in bytes, negative if it's not known
+static AliasResult alias_query(TB_Passes* restrict p, TB_Node* a, int64_t a_size, TB_Node* b, int64_t b_size) {
+    AliasLoc la = alias_loc(a);
+    AliasLoc lb = alias_loc(b);
+
+    if (alias_same_base(la.base, lb.base)) {
+        if (!la.known || !lb.known || a_size < 0 || b_size < 0) {
+            return ALIAS_MAY;
+        } else if (la.offset == lb.offset && a_size == b_size) {
+            return ALIAS_MUST;
+        } else if (la.offset + a_size <= lb.offset || lb.offset + b_size <= la.offset) {
+            return ALIAS_NO;
+        } else {
+            return ALIAS_MAY;
+        }
+    }
+
+    if (alias_is_object(la.base) && alias_is_object(lb.base)) {
+        return ALIAS_NO;
+    }
+
+    // nobody else can name a LOCAL which never escapes
+    if ((la.base->type == TB_LOCAL && !alias_escapes(p, la.base, ALIAS_ESCAPE_DEPTH)) ||
+        (lb.base->type == TB_LOCAL && !alias_escapes(p, lb.base, ALIAS_ESCAPE_DEPTH))) {
+        return ALIAS_NO;
+    }
+
+    TB_Function* f = p->f;
+    bool a_ident = alias_is_object(la.base) || alias_is_param(f, la.base);
+    bool b_ident = alias_is_object(lb.base) || alias_is_param(f, lb.base);
+    if (a_ident && b_ident && (alias_is_restrict(f, la.base) || alias_is_restrict(f, lb.base))) {
+        return ALIAS_NO;
+    }
+
+    return ALIAS_MAY;
+}
+
+// bytes touched by a memory op, negative if it's not known
+static int64_t alias_access_size(TB_Function* f, TB_Node* n) {
+    switch (n->type) {
+        case TB_LOAD:
+        case TB_STORE: {
+            TB_DataType dt = n->type == TB_LOAD ? n->dt : n->inputs[3]->dt;
+            int bits = bits_in_data_type(tb__find_code_generator(f->super.module)->pointer_size, dt);
+            return bits ? ((bits + 7) / 8) << dt.width : -1;
+        }
+
+        case TB_MEMSET:
+        case TB_MEMCPY: {
+            TB_Node* size = n->inputs[4];
+            return size->type == TB_INTEGER_CONST ? (int64_t) TB_NODE_GET_EXTRA_T(size, TB_NodeInt)->value : -1;
+        }
+
+        default:
+        return -1;
+    }
+}
+
+// true if every byte b touches is also touched by a, only ever says yes when
+// both are at known offsets from the same base.
+static bool alias_covers(TB_Passes* restrict p, TB_Node* a, TB_Node* b) {
+    AliasLoc la = alias_loc(a->inputs[2]);
+    AliasLoc lb = alias_loc(b->inputs[2]);
+    int64_t a_size = alias_access_size(p->f, a);
+    int64_t b_size = alias_access_size(p->f, b);
+
+    return alias_same_base(la.base, lb.base) && la.known && lb.known && a_size >= 0 && b_size >= 0 &&
+        la.offset <= lb.offset && lb.offset + b_size <= la.offset + a_size;
+}
+
+// a LOCAL which is only ever written to (and doesn't escape) has nothing
+// observing those writes.
+static bool alias_never_read(TB_Passes* restrict p, TB_Node* n, int depth) {
+    FOR_USERS(u, n) {
+        TB_Node* use = u->n;
+        switch (use->type) {
+            case TB_STORE:
+            case TB_MEMSET:
+            case TB_MEMCPY:
+            if (u->slot != 2) return false;
+            break;
+
+            case TB_MEMBER_ACCESS:
+            case TB_ARRAY_ACCESS:
+            if (u->slot != 1 || depth == 0 || !alias_never_read(p, use, depth - 1)) return false;
+            break;
+
+            default:
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// compares the destinations of two memory ops (LOAD, STORE, MEMSET or MEMCPY)
+static AliasResult alias_mem_ops(TB_Passes* restrict p, TB_Node* a, TB_Node* b) {
+    AliasResult r = alias_query(p, a->inputs[2], alias_access_size(p->f, a), b->inputs[2], alias_access_size(p->f, b));
+    if (r == ALIAS_MAY) {
+        int ka = alias_type_class(p->f, a);
+        int kb = alias_type_class(p->f, b);
+        if (ka != 0 && kb != 0 && ka != kb) {
+            return ALIAS_NO;
+        }
+    }
+
+    return r;
+}
@@ -6,15 +6,14 @@ static TB_Node* ideal_region(TB_Passes* restrict p, TB_Function* f, TB_Node* n)
     if (n->input_count == 1 && n->inputs[0]->type == TB_PROJ &&
         n->inputs[0]->inputs[0]->type == TB_BRANCH &&
         n->inputs[0]->inputs[0]->input_count == 1) {
-        // check for any phi nodes
-        User* use = n->users;
-        while (use != NULL) {
-            User* next = use->next;
-            if (use->n->type == TB_PHI) {
-                assert(use->n->input_count == 2);
-                subsume_node(p, f, use->n, use->n->inputs[1]);
+        // check for any phi nodes, backwards since killing one swaps
+        // the last user into its place.
+        FOREACH_REVERSE_N(i, 0, n->user_count) {
+            TB_Node* use_n = n->users[i].n;
+            if (use_n->type == TB_PHI) {
+                assert(use_n->input_count == 2);
+                subsume_node(p, f, use_n, use_n->inputs[1]);
             }
-            use = next;
         }
 
         TB_Node* top_node = unsafe_get_region(n->inputs[0]);
@@ -40,7 +39,8 @@ static TB_Node* ideal_region(TB_Passes* restrict p, TB_Function* f, TB_Node* n)
                 tb_pass_mark(p, succ);
                 tb_pass_mark_users(p, succ);
 
-                br->succ_count -= 1;
+                br->succ[i] = br->succ[--br->succ_count];
+                if (br->weights) br->weights[i] = br->weights[br->succ_count];
             } else {
                 i += 1;
             }
@@ -63,17 +63,23 @@ static void transmute_goto(TB_Passes* restrict opt, TB_Function* f, TB_Node* br,
     TB_Node* bb = unsafe_get_region(br);
     TB_NodeBranch* br_info = TB_NODE_GET_EXTRA(br);
 
+    // the first edge into dst survives, everything else gets cut. we swap
+    // removed successors with the last one so the list stays packed.
+    bool kept = false;
     size_t i = 0;
     while (i < br_info->succ_count) {
-        if (br_info->succ[i] != dst) {
-            if (remove_pred(opt, f, bb, br_info->succ[i])) {
-                br_info->succ_count -= 1;
-            }
+        if (br_info->succ[i] == dst && !kept) {
+            kept = true;
+            i += 1;
+        } else if (remove_pred(opt, f, bb, br_info->succ[i])) {
+            br_info->succ[i] = br_info->succ[--br_info->succ_count];
         } else {
             i += 1;
         }
     }
-    assert(br_info->succ[0] == dst);
+    assert(br_info->succ_count == 1);
+    br_info->succ[0] = dst;
+    br_info->weights = NULL;
 
     // we need to mark the changes to that jump
     // threading can clean it up
@@ -95,7 +101,7 @@ static TB_Node* ideal_phi(TB_Passes* restrict opt, TB_Function* f, TB_Node* n) {
     if (region->input_count == 2) {
         // for now we'll leave multi-phi scenarios alone, we need
         // to come up with a cost-model around this stuff.
-        for (User* use = find_users(opt, region); use; use = use->next) {
+        FOR_USERS(use, region) {
             if (use->n->type == TB_PHI) {
                 if (use->n != n) return NULL;
             }
@@ -127,6 +133,12 @@ static TB_Node* ideal_phi(TB_Passes* restrict opt, TB_Function* f, TB_Node* n) {
                 bool right_false = header_br->succ[0] == right;
                 uint64_t falsey = TB_NODE_GET_EXTRA_T(branch, TB_NodeBranch)->keys[0];
 
+                // there's no selecting between memories, the diamond can only go
+                // away when both sides carry the same one.
+                if (dt.type == TB_MEMORY && left_v != right_v) {
+                    return NULL;
+                }
+
                 // TODO(NeGate): handle non-zero falseys
                 if (falsey == 0) {
                     // kill both successors, since they were unique we can properly murder em'
@@ -149,6 +161,10 @@ static TB_Node* ideal_phi(TB_Passes* restrict opt, TB_Function* f, TB_Node* n) {
                         subsume_node(opt, f, region, parent);
                     }
 
+                    if (left_v == right_v) {
+                        return left_v;
+                    }
+
                     TB_Node* selector = tb_alloc_node(f, TB_SELECT, dt, 4, 0);
                     set_input(opt, selector, cond, 1);
                     set_input(opt, selector, left_v, 2 + right_false);
@@ -237,6 +253,7 @@ static TB_Node* ideal_branch(TB_Passes* restrict opt, TB_Function* f, TB_Node* n
                 TB_NODE_SET_EXTRA(new_cmp, TB_NodeCompare, .cmp_dt = TB_NODE_GET_EXTRA_T(cmp_node, TB_NodeCompare)->cmp_dt);
 
                 SWAP(TB_Node*, br->succ[0], br->succ[1]);
+                if (br->weights) SWAP(uint32_t, br->weights[0], br->weights[1]);
                 set_input(opt, n, new_cmp, 1);
                 tb_pass_mark(opt, new_cmp);
                 return n;
@@ -251,22 +268,24 @@ static TB_Node* ideal_branch(TB_Passes* restrict opt, TB_Function* f, TB_Node* n
                 // flip successors
                 if (cmp_type == TB_CMP_EQ) {
                     SWAP(TB_Node*, br->succ[0], br->succ[1]);
+                    if (br->weights) SWAP(uint32_t, br->weights[0], br->weights[1]);
                 }
                 return n;
             }
 
             // check if we're dominated by a branch that already checked it
             TB_Node* bb = unsafe_get_region(n->inputs[0]);
-            for (User* u = find_users(opt, cmp_node); u; u = u->next) {
+            FOR_USERS(u, cmp_node) {
                 if (u->n != n && u->slot == 1 && u->n->type == TB_BRANCH) {
                     TB_NodeBranch* dom_branch = TB_NODE_GET_EXTRA(u->n);
                     if (dom_branch->succ_count == 2 && dom_branch->keys[0] == 0) {
                         // found another branch, check if we're dominated by one of it's successors
-                        // if so, then all our paths to 'br' can use info from the branch.
+                        // if so, then all our paths to 'br' can use info from the branch. the
+                        // successor can't be a join point, then it's reachable without the edge.
                         ptrdiff_t match = -1;
                         FOREACH_N(i, 0, dom_branch->succ_count) {
                             TB_Node* target = dom_branch->succ[i];
-                            if (tb_is_dominated_by(target, bb)) {
+                            if (target->input_count == 1 && tb_is_dominated_by(target, bb)) {
                                 match = i;
                                 break;
                             }
@@ -275,6 +294,7 @@ static TB_Node* ideal_branch(TB_Passes* restrict opt, TB_Function* f, TB_Node* n
                         // we can now look for the condition to match
                         if (match >= 0) {
                             transmute_goto(opt, f, n, br->succ[match]);
+                            return n;
                         }
                     }
                 }
@@ -295,7 +315,7 @@ static TB_Node* ideal_branch(TB_Passes* restrict opt, TB_Function* f, TB_Node* n
             TB_Node* dead = make_dead(f, opt);
 
             // convert dead projections into DEAD and convert live projection into index 0
-            for (User* use = find_users(opt, n); use; use = use->next) {
+            FOR_USERS(use, n) {
                 if (use->n->type == TB_PROJ) {
                     int index = TB_NODE_GET_EXTRA_T(use->n, TB_NodeProj)->index;
                     if (index != taken) {
@@ -303,8 +323,8 @@ static TB_Node* ideal_branch(TB_Passes* restrict opt, TB_Function* f, TB_Node* n
                     } else {
                         TB_NODE_GET_EXTRA_T(use->n, TB_NodeProj)->index = 0;
 
-                        User* proj_use = find_users(opt, use->n);
-                        assert(proj_use->next == NULL && "control projection has conflicts?");
+                        assert(use->n->user_count == 1 && "control projection has conflicts?");
+                        User* proj_use = &use->n->users[0];
                         assert(proj_use->n->type == TB_REGION);
 
                         br->succ_count = 1;
@@ -326,7 +346,7 @@ static TB_Node* ideal_branch(TB_Passes* restrict opt, TB_Function* f, TB_Node* n
     if (parent->input_count == 0 && br->succ_count != 0) {
         // remove predecessor from successors
         TB_Node* dead = make_dead(f, opt);
-        for (User* use = find_users(opt, n); use; use = use->next) {
+        FOR_USERS(use, n) {
             if (use->n->type == TB_PROJ) {
                 subsume_node(opt, f, use->n, dead);
             }
@@ -102,9 +102,6 @@ void tb_compute_dominators(TB_Function* f, size_t count, TB_Node** blocks) {
     r->dom_depth = 0;
     r->dom = f->start_node;
 
-    // identify post order traversal order
-    int entry_dom = ctx.block_count - 1;
-
     bool changed = true;
     while (changed) {
         changed = false;
@@ -112,37 +109,36 @@ void tb_compute_dominators(TB_Function* f, size_t count, TB_Node** blocks) {
         // for all nodes, b, in reverse postorder (except start node)
         FOREACH_REVERSE_N(i, 0, count - 1) {
             TB_Node* b = blocks[i];
-            TB_Node* new_idom = unsafe_get_region(b->inputs[0]);
+            TB_Node* new_idom = NULL;
 
-            // for all other predecessors, p, of b
-            FOREACH_N(j, 1, b->input_count) {
+            // for all predecessors, p, of b
+            FOREACH_N(j, 0, b->input_count) {
                 TB_Node* p = unsafe_get_region(b->inputs[j]);
 
-                // if doms[p] already calculated
-                TB_Node* idom_p = TB_NODE_GET_EXTRA_T(p, TB_NodeRegion)->dom;
-                if (idom_p == NULL && p->input_count > 0) {
-                    int a = try_find_traversal_index(p);
-                    if (a >= 0) {
-                        int b = find_traversal_index(new_idom);
-                        while (a != b) {
-                            // while (finger1 < finger2)
-                            //   finger1 = doms[finger1]
-                            while (a < b) {
-                                TB_Node* d = idom(blocks[a]);
-                                a = d ? find_traversal_index(d) : entry_dom;
-                            }
-
-                            // while (finger2 < finger1)
-                            //   finger2 = doms[finger2]
-                            while (b < a) {
-                                TB_Node* d = idom(blocks[b]);
-                                b = d ? find_traversal_index(d) : entry_dom;
-                            }
-                        }
-
-                        new_idom = blocks[a];
-                    }
+                // if doms[p] already calculated (unreachable preds might have
+                // a stale id from some older walk)
+                int a = try_find_traversal_index(p);
+                if (a < 0 || a >= count || blocks[a] != p || idom(p) == NULL) {
+                    continue;
+                }
+
+                if (new_idom == NULL) {
+                    new_idom = p;
+                    continue;
+                }
+
+                int b = find_traversal_index(new_idom);
+                while (a != b) {
+                    // while (finger1 < finger2)
+                    //   finger1 = doms[finger1]
+                    while (a < b) a = find_traversal_index(idom(blocks[a]));
+
+                    // while (finger2 < finger1)
+                    //   finger2 = doms[finger2]
+                    while (b < a) b = find_traversal_index(idom(blocks[b]));
                 }
+
+                new_idom = blocks[a];
             }
 
             assert(new_idom != NULL);
@@ -173,6 +169,12 @@ TB_Node* tb_get_parent_region(TB_Node* n) {
 
 bool tb_is_dominated_by(TB_Node* expected_dom, TB_Node* bb) {
     while (expected_dom != bb) {
+        // the peepholes work off stale dominators, those can point at
+        // blocks which have since been killed. we can't say anything there.
+        if (bb == NULL || bb->type == TB_NULL) {
+            return false;
+        }
+
         TB_Node* new_bb = idom(bb);
         if (bb == new_bb) {
             return false;
@@ -61,20 +61,30 @@ static size_t extra_bytes(TB_Node* n) {
         case TB_NEG:
         case TB_NOT:
         case TB_END:
+        case TB_TRAP:
+        case TB_UNREACHABLE:
+        case TB_DEBUGBREAK:
         case TB_PROJ:
         case TB_PHI:
         case TB_VA_START:
         case TB_POISON:
         case TB_SELECT:
+        case TB_VBROADCAST:
         case TB_MERGEMEM:
         return 0;
 
+        // killed nodes can linger in the CSE set when they were edited after
+        // being inserted (their hash moved), they only need to survive a rehash.
+        case TB_NULL:
+        return 0;
+
         case TB_START:
         case TB_REGION:
         return sizeof(TB_NodeRegion);
 
         case TB_CALL:
         case TB_SYSCALL:
+        case TB_TAILCALL:
         return sizeof(TB_NodeCall);
 
         case TB_LOAD:
@@ -109,6 +119,52 @@ static size_t extra_bytes(TB_Node* n) {
     }
 }
 
+// the extra data might be bigger than what CSE hashes (CALL projections),
+// returns false for nodes we don't know how to clone.
+static bool clone_extra_bytes(TB_Node* n, size_t* out) {
+    switch (n->type) {
+        case TB_PROJ: *out = sizeof(TB_NodeProj); return true;
+
+        case TB_CALL: {
+            TB_NodeCall* c = TB_NODE_GET_EXTRA(n);
+            size_t ret_count = c->proto->return_count;
+            *out = sizeof(TB_NodeCall) + (2 + (ret_count > 1 ? ret_count : 1)) * sizeof(TB_Node*);
+            return true;
+        }
+
+        case TB_TRAP:
+        case TB_UNREACHABLE:
+        case TB_DEBUGBREAK:
+        case TB_CYCLE_COUNTER:
+        case TB_BSWAP:
+        case TB_CLZ:
+        case TB_CTZ:
+        case TB_POPCNT:
+        case TB_UINT2FLOAT:
+        case TB_FLOAT2UINT:
+        *out = 0;
+        return true;
+
+        // varargs are tied to the frame, the rest is just rare enough
+        case TB_NULL:
+        case TB_START:
+        case TB_VA_START:
+        case TB_MACHINE_OP:
+        case TB_SYSCALL:
+        case TB_TAILCALL:
+        case TB_SAFEPOINT_POLL:
+        case TB_X86INTRIN_LDMXCSR:
+        case TB_X86INTRIN_STMXCSR:
+        case TB_X86INTRIN_SQRT:
+        case TB_X86INTRIN_RSQRT:
+        return false;
+
+        default:
+        *out = extra_bytes(n);
+        return true;
+    }
+}
+
 uint32_t cse_hash(void* a) {
     TB_Node* n = a;
 
@@ -31,6 +31,7 @@ bool tb_uses_effects(TB_Node* n) {
         case TB_TRAP:
         case TB_SYSCALL:
         case TB_CALL:
+        case TB_TAILCALL:
         return true;
 
         default:
@@ -68,6 +69,7 @@ bool tb_has_effects(TB_Node* n) {
         case TB_TRAP:
         case TB_SYSCALL:
         case TB_CALL:
+        case TB_TAILCALL:
         return true;
 
         default:
@@ -226,7 +226,7 @@ static TB_Node* ideal_int_unary(TB_Passes* restrict opt, TB_Function* f, TB_Node
             src_i += 1;
         }
 
-        return make_int_node(f, opt, n->dt, src_i);
+        return make_int_node(f, opt, n->dt, src_i & tb__mask(n->dt.data));
     } else {
         return NULL;
     }
@@ -463,9 +463,11 @@ static TB_Node* identity_int_binop(TB_Passes* restrict opt, TB_Function* f, TB_N
         case TB_SHR:
         case TB_ADD:
         case TB_SUB:
-        case TB_MUL:
         return n->inputs[1];
 
+        case TB_MUL:
+        return n->inputs[2];
+
         case TB_UDIV:
         case TB_SDIV:
         return tb_inst_poison(f);
@@ -63,15 +63,46 @@ static TB_Node* find_lca(TB_Node* a, TB_Node* b) {
     return a;
 }
 
+// the postorder sits at the front of the worklist, stale blocks
+// might still remember an old slot in it.
+static bool is_live_block(TB_Passes* passes, TB_Node* bb) {
+    ptrdiff_t id = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->postorder_id;
+    return id >= 0 && id < dyn_array_length(passes->worklist.items) && passes->worklist.items[id] == bb;
+}
+
+// PHIs use their values at the end of the matching predecessor
+static TB_Node* late_use_block(TB_Node* n, TB_Node* y) {
+    TB_Node* use_block = tb_get_parent_region(y->inputs[0]);
+    if (y->type == TB_PHI) {
+        if (y->input_count != use_block->input_count + 1) {
+            tb_panic("phi has parent with mismatched predecessors");
+        }
+
+        ptrdiff_t j = 1;
+        for (; j < y->input_count; j++) {
+            if (y->inputs[j] == n) {
+                break;
+            }
+        }
+        assert(j >= 0);
+
+        use_block = get_block_begin(use_block->inputs[j - 1]);
+    }
+
+    return use_block;
+}
+
 static void schedule_late(TB_Passes* passes, TB_Node* n) {
     // already visited
     if (worklist_test_n_set(&passes->worklist, n)) {
         return;
     }
 
-    // schedule all users first
-    for (User* use = find_users(passes, n); use; use = use->next) {
-        schedule_late(passes, use->n);
+    // schedule all users first. placing them can add users to n (when it's a
+    // block) and grow the array under us so we don't hold onto it, anyone
+    // swapped out of the way still gets visited by the outer walk.
+    for (size_t i = 0; i < n->user_count; i++) {
+        schedule_late(passes, n->users[i].n);
     }
 
     // pinned nodes can't be rescheduled
@@ -81,28 +112,48 @@ static void schedule_late(TB_Passes* passes, TB_Node* n) {
 
     // we're gonna find the least common ancestor
     TB_Node* lca = NULL;
-    for (User* use = find_users(passes, n); use; use = use->next) {
+    FOR_USERS(use, n) {
         TB_Node* y = use->n;
         if (y->inputs[0] == NULL) continue; // dead
 
-        TB_Node* use_block = tb_get_parent_region(y->inputs[0]);
-        if (y->type == TB_PHI) {
-            if (y->input_count != use_block->input_count + 1) {
-                tb_panic("phi has parent with mismatched predecessors");
-            }
+        // unreachable blocks have stale dominators, whatever is in
+        // there doesn't get a say.
+        TB_Node* use_block = late_use_block(n, y);
+        if (!is_live_block(passes, tb_get_parent_region(use_block))) continue;
 
-            ptrdiff_t j = 1;
-            for (; j < y->input_count; j++) {
-                if (y->inputs[j] == n) {
-                    break;
-                }
-            }
-            assert(j >= 0);
+        lca = find_lca(lca, use_block);
+    }
 
-            use_block = get_block_begin(use_block->inputs[j - 1]);
+    // anti-dependencies: a load has to happen before anything which clobbers the
+    // memory it read from, so those count as uses too. we only care about the ones
+    // below our early block, the rest are on some other path.
+    if (n->type == TB_LOAD && lca != NULL && n->inputs[0] != NULL) {
+        TB_Node* early = tb_get_parent_region(n->inputs[0]);
+        TB_Node* mem = n->inputs[1];
+        FOR_USERS(use, mem) {
+            TB_Node* y = use->n;
+            if (y == n || y->inputs[0] == NULL || !is_mem_out_op(y)) continue;
+
+            TB_Node* use_block = late_use_block(mem, y);
+            TB_Node* bb = tb_get_parent_region(use_block);
+            if (is_live_block(passes, bb) && tb_is_dominated_by(early, bb)) {
+                lca = find_lca(lca, use_block);
+            }
         }
+    }
 
-        lca = find_lca(lca, use_block);
+    // LICM: anywhere between the early schedule and the LCA is legal, the
+    // block with the shallowest loop nest wins. loads and divisions stay put
+    // since hoisting them out of a loop which never runs could trap, constants
+    // get rematerialized at the use anyways.
+    if (lca != NULL && n->inputs[0] != NULL && n->type != TB_LOAD && n->type != TB_INTEGER_CONST && (n->type < TB_UDIV || n->type > TB_SMOD)) {
+        TB_Node* early = tb_get_parent_region(n->inputs[0]);
+        TB_Node* best = lca;
+        for (TB_Node* bb = lca; bb != early && dom_depth(bb) > dom_depth(early);) {
+            bb = idom(bb);
+            if (loop_depth(bb) < loop_depth(best)) best = bb;
+        }
+        lca = best;
     }
 
     if (passes->f->start_node == lca) {
@@ -128,6 +179,7 @@ void tb_pass_schedule(TB_Passes* p) {
 
             block_count = tb_push_postorder(p->f, ws);
             tb_compute_dominators(p->f, block_count, &ws->items[0]);
+            tb_compute_loop_depths(p->f, ws, block_count, &ws->items[0]);
         }
 
         CUIK_TIMED_BLOCK("early schedule") {
@@ -0,0 +1,456 @@
+// Module-level inliner, it builds a call graph out of the direct calls
+// (TB_CALL on a TB_SYMBOL which is a function in this module) and walks
+// it bottom up (Tarjan's SCCs come out in reverse topological order) so by
+// the time we clone a callee it's already had its own calls inlined. Calls
+// within the same SCC are left alone since that's recursion.
+//
+// Cloning doesn't need use lists, we copy the callee's live nodes into the
+// caller's arena, wire the START projections up to the call's inputs and
+// then redirect the call's projections to what the callee's END took in.
+// The redirect happens in one sweep over the caller once all its inlines
+// are done (substitutions can chain when one inlined call feeds another).
+#define INLINE_CALLER_LIMIT 8192
+
+typedef struct {
+    TB_Node* call;
+    int callee;
+} InlineCall;
+
+typedef struct {
+    TB_Function* f;
+    DynArray(InlineCall) calls;
+
+    // live node count, this is the cost model.
+    size_t size;
+    bool can_inline;
+
+    // Tarjan's bookkeeping
+    int index, lowlink, scc;
+    bool on_stack;
+} InlineFunc;
+
+typedef struct {
+    TB_Arena* arena;
+    int budget;
+
+    size_t func_count;
+    InlineFunc* funcs;
+
+    int next_index, scc_count;
+    DynArray(int) stack;
+} Inliner;
+
+static TB_Node* inline_resolve(TB_Node** subst, size_t cap, TB_Node* n) {
+    while (n->gvn < cap && subst[n->gvn] != NULL) {
+        n = subst[n->gvn];
+    }
+    return n;
+}
+
+// tb_get_parent_region except it sees through the calls we've already inlined
+static TB_Node* inline_parent_region(TB_Node** subst, size_t cap, TB_Node* n) {
+    for (;;) {
+        n = inline_resolve(subst, cap, n);
+        if (n->type == TB_REGION || n->type == TB_START) {
+            return n;
+        }
+
+        n = n->inputs[0];
+    }
+}
+
+// pushes the projections which are only referenced by extra data so they get cloned too
+static void inline_push_extra_refs(Worklist* ws, TB_Node* n) {
+    TB_Node* refs[2] = { 0 };
+    switch (n->type) {
+        case TB_CALL: {
+            TB_NodeCall* c = TB_NODE_GET_EXTRA(n);
+            size_t proj_count = 2 + c->proto->return_count;
+            FOREACH_N(i, 0, proj_count) {
+                if (c->projs[i] && !worklist_test_n_set(ws, c->projs[i])) {
+                    dyn_array_put(ws->items, c->projs[i]);
+                }
+            }
+            return;
+        }
+
+        case TB_ATOMIC_LOAD:
+        case TB_ATOMIC_XCHG:
+        case TB_ATOMIC_ADD:
+        case TB_ATOMIC_SUB:
+        case TB_ATOMIC_AND:
+        case TB_ATOMIC_XOR:
+        case TB_ATOMIC_OR:
+        case TB_ATOMIC_CAS: {
+            TB_NodeAtomic* a = TB_NODE_GET_EXTRA(n);
+            refs[0] = a->proj0, refs[1] = a->proj1;
+            break;
+        }
+
+        case TB_ADDPAIR:
+        case TB_MULPAIR: {
+            TB_NodeArithPair* a = TB_NODE_GET_EXTRA(n);
+            refs[0] = a->lo, refs[1] = a->hi;
+            break;
+        }
+
+        default: return;
+    }
+
+    FOREACH_N(i, 0, 2) {
+        if (refs[i] && !worklist_test_n_set(ws, refs[i])) {
+            dyn_array_put(ws->items, refs[i]);
+        }
+    }
+}
+
+static TB_Node* inline_map(TB_Node** map, TB_Node* n) {
+    return n ? map[n->gvn] : NULL;
+}
+
+static void inline_clone(Inliner* ctx, TB_Function* f, TB_Node* call, TB_Function* g, TB_Node** subst, size_t cap) {
+    Worklist ws;
+    worklist_alloc(&ws, g->node_count);
+    push_all_nodes(&ws, g->start_node);
+    for (size_t i = 0; i < dyn_array_length(ws.items); i++) {
+        inline_push_extra_refs(&ws, ws.items[i]);
+    }
+
+    TB_Node** map = tb_platform_heap_alloc(g->node_count * sizeof(TB_Node*));
+    memset(map, 0, g->node_count * sizeof(TB_Node*));
+
+    // START and its projections turn into the call's inputs, the
+    // return address is only used by END so it can be anything.
+    TB_Node* end = g->stop_node;
+    map[g->start_node->gvn] = f->start_node;
+    dyn_array_for(i, ws.items) {
+        TB_Node* n = ws.items[i];
+        if (n->type == TB_PROJ && n->inputs[0] == g->start_node) {
+            int index = TB_NODE_GET_EXTRA_T(n, TB_NodeProj)->index;
+            map[n->gvn] = index == 2 ? f->params[2] : inline_resolve(subst, cap, call->inputs[index]);
+        }
+    }
+
+    // make copies
+    dyn_array_for(i, ws.items) {
+        TB_Node* n = ws.items[i];
+        if (map[n->gvn] != NULL || n == end) continue;
+
+        size_t extra;
+        bool ok = clone_extra_bytes(n, &extra);
+        assert(ok && "we should've rejected this callee");
+
+        TB_Node* k = tb_alloc_node(f, n->type, n->dt, n->input_count, extra);
+        memcpy(k->extra, n->extra, extra);
+        map[n->gvn] = k;
+    }
+
+    // wire up edges, both inputs and the ones hiding in extra data
+    dyn_array_for(i, ws.items) {
+        TB_Node* n = ws.items[i];
+        if (n == end || n->type == TB_START || (n->type == TB_PROJ && n->inputs[0] == g->start_node)) {
+            continue;
+        }
+
+        TB_Node* k = map[n->gvn];
+        FOREACH_N(j, 0, n->input_count) {
+            k->inputs[j] = inline_map(map, n->inputs[j]);
+            assert(n->inputs[j] == NULL || k->inputs[j] != NULL);
+        }
+
+        switch (n->type) {
+            case TB_REGION: {
+                TB_NodeRegion* r = TB_NODE_GET_EXTRA(k);
+                r->end = inline_map(map, r->end);
+                r->mem_in = inline_map(map, r->mem_in);
+                r->mem_out = inline_map(map, r->mem_out);
+                r->dom = NULL;
+                break;
+            }
+
+            case TB_BRANCH: {
+                TB_NodeBranch* br = TB_NODE_GET_EXTRA(k);
+                TB_Node** succ = tb_arena_alloc(f->arena, br->succ_count * sizeof(TB_Node*));
+                FOREACH_N(j, 0, br->succ_count) {
+                    succ[j] = map[br->succ[j]->gvn];
+                }
+                br->succ = succ;
+
+                // the weights get swapped around with the successors, it can't share them with the callee
+                if (br->weights) {
+                    uint32_t* weights = tb_arena_alloc(f->arena, br->succ_count * sizeof(uint32_t));
+                    memcpy(weights, br->weights, br->succ_count * sizeof(uint32_t));
+                    br->weights = weights;
+                }
+                break;
+            }
+
+            case TB_CALL: {
+                TB_NodeCall* c = TB_NODE_GET_EXTRA(k);
+                size_t proj_count = 2 + c->proto->return_count;
+                FOREACH_N(j, 0, proj_count) {
+                    c->projs[j] = inline_map(map, c->projs[j]);
+                }
+
+                // the callee's tail calls aren't in tail position once
+                // they're spliced into the middle of the caller
+                c->tail = false;
+                break;
+            }
+
+            case TB_ATOMIC_LOAD:
+            case TB_ATOMIC_XCHG:
+            case TB_ATOMIC_ADD:
+            case TB_ATOMIC_SUB:
+            case TB_ATOMIC_AND:
+            case TB_ATOMIC_XOR:
+            case TB_ATOMIC_OR:
+            case TB_ATOMIC_CAS: {
+                TB_NodeAtomic* a = TB_NODE_GET_EXTRA(k);
+                a->proj0 = inline_map(map, a->proj0);
+                a->proj1 = inline_map(map, a->proj1);
+                break;
+            }
+
+            case TB_ADDPAIR:
+            case TB_MULPAIR: {
+                TB_NodeArithPair* a = TB_NODE_GET_EXTRA(k);
+                a->lo = inline_map(map, a->lo);
+                a->hi = inline_map(map, a->hi);
+                break;
+            }
+
+            default: break;
+        }
+    }
+
+    // split the call's block around the callee, the entry block takes over
+    // the top half and the return region gets the bottom half.
+    TB_Node* bb = inline_parent_region(subst, cap, call);
+    TB_NodeRegion* bb_r = TB_NODE_GET_EXTRA(bb);
+    TB_Node* ret = map[end->inputs[0]->gvn];
+
+    TB_NODE_GET_EXTRA_T(ret, TB_NodeRegion)->end = bb_r->end;
+    bb_r->end = map[TB_NODE_GET_EXTRA_T(g->start_node, TB_NodeRegion)->end->gvn];
+
+    // anyone using the call's results will be redirected in the final sweep
+    TB_NodeCall* c = TB_NODE_GET_EXTRA(call);
+    subst[c->projs[0]->gvn] = ret;
+    subst[c->projs[1]->gvn] = map[end->inputs[1]->gvn];
+    FOREACH_N(i, 0, c->proto->return_count) {
+        if (c->projs[2 + i]) {
+            subst[c->projs[2 + i]->gvn] = map[end->inputs[3 + i]->gvn];
+        }
+    }
+
+    tb_platform_heap_free(map);
+    worklist_free(&ws);
+}
+
+// redirects users of the call projections. it can't just be push_all_nodes
+// since the clones are only reachable once the edges into them get fixed up,
+// so we resolve the inputs before walking them. returns the live node count.
+static size_t inline_sweep(TB_Function* f, TB_Node** subst, size_t cap) {
+    Worklist ws;
+    worklist_alloc(&ws, f->node_count);
+
+    DynArray(TB_Node*) stack = dyn_array_create(TB_Node*, 1024);
+    worklist_test_n_set(&ws, f->start_node);
+    dyn_array_put(stack, f->start_node);
+
+    while (dyn_array_length(stack)) {
+        TB_Node* n = dyn_array_pop(stack);
+        FOREACH_N(i, 0, n->input_count) {
+            if (n->inputs[i]) {
+                TB_Node* in = n->inputs[i] = inline_resolve(subst, cap, n->inputs[i]);
+                if (!worklist_test_n_set(&ws, in)) {
+                    dyn_array_put(stack, in);
+                }
+            }
+        }
+
+        // walk the CFG forward, block ends take us to the successors
+        if (n->type == TB_START || n->type == TB_REGION) {
+            TB_Node* end = TB_NODE_GET_EXTRA_T(n, TB_NodeRegion)->end;
+            if (!worklist_test_n_set(&ws, end)) {
+                dyn_array_put(stack, end);
+            }
+        } else if (n->type == TB_BRANCH) {
+            TB_NodeBranch* br = TB_NODE_GET_EXTRA(n);
+            FOREACH_N(i, 0, br->succ_count) {
+                if (!worklist_test_n_set(&ws, br->succ[i])) {
+                    dyn_array_put(stack, br->succ[i]);
+                }
+            }
+        }
+    }
+
+    size_t live = worklist_popcount(&ws);
+    dyn_array_destroy(stack);
+    worklist_free(&ws);
+    return live;
+}
+
+static bool inline_call_matches(TB_Node* call, TB_Function* g) {
+    TB_NodeCall* c = TB_NODE_GET_EXTRA(call);
+    if (c->proto->return_count != g->prototype->return_count || call->input_count - 3 != g->param_count) {
+        return false;
+    }
+
+    FOREACH_N(i, 0, g->param_count) {
+        if (call->inputs[3 + i]->dt.raw != g->params[3 + i]->dt.raw) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+static void inline_function(Inliner* ctx, InlineFunc* fn) {
+    TB_Function* f = fn->f;
+    size_t cap = f->node_count;
+    TB_Node** subst = NULL;
+
+    TB_Arena* old_arena = f->arena;
+    f->arena = ctx->arena;
+    f->line_attrib.loc.file = NULL;
+
+    dyn_array_for(i, fn->calls) {
+        InlineFunc* callee = &ctx->funcs[fn->calls[i].callee];
+        TB_Node* call = fn->calls[i].call;
+
+        // recursion or too big
+        if (callee->scc == fn->scc || !callee->can_inline || callee->size > ctx->budget) continue;
+        if (fn->size + callee->size > INLINE_CALLER_LIMIT) continue;
+        if (!inline_call_matches(call, callee->f)) continue;
+
+        if (subst == NULL) {
+            subst = tb_platform_heap_alloc(cap * sizeof(TB_Node*));
+            memset(subst, 0, cap * sizeof(TB_Node*));
+        }
+
+        DO_IF(TB_OPTDEBUG_PEEP)(log_debug("%s: inlining %s", f->super.name, callee->f->super.name));
+        inline_clone(ctx, f, call, callee->f, subst, cap);
+        fn->size += callee->size;
+    }
+
+    f->arena = old_arena;
+    if (subst == NULL) {
+        return;
+    }
+
+    // the running sum above counts the calls and the callees' START/END which
+    // are dead now, callers further up should see what's actually left.
+    fn->size = inline_sweep(f, subst, cap);
+    tb_platform_heap_free(subst);
+}
+
+static void inline_scc(Inliner* ctx, int v) {
+    InlineFunc* fn = &ctx->funcs[v];
+    fn->index = fn->lowlink = ctx->next_index++;
+    fn->on_stack = true;
+    dyn_array_put(ctx->stack, v);
+
+    dyn_array_for(i, fn->calls) {
+        int w = fn->calls[i].callee;
+        InlineFunc* other = &ctx->funcs[w];
+        if (other->index < 0) {
+            inline_scc(ctx, w);
+            if (other->lowlink < fn->lowlink) fn->lowlink = other->lowlink;
+        } else if (other->on_stack) {
+            if (other->index < fn->lowlink) fn->lowlink = other->index;
+        }
+    }
+
+    if (fn->lowlink != fn->index) {
+        return;
+    }
+
+    // pop the SCC, everything it calls outside of itself is done by now
+    int scc = ctx->scc_count++;
+    size_t base = dyn_array_length(ctx->stack);
+    do {
+        base -= 1;
+        ctx->funcs[ctx->stack[base]].on_stack = false;
+        ctx->funcs[ctx->stack[base]].scc = scc;
+    } while (ctx->stack[base] != v);
+
+    FOREACH_N(i, base, dyn_array_length(ctx->stack)) {
+        inline_function(ctx, &ctx->funcs[ctx->stack[i]]);
+    }
+    dyn_array_set_length(ctx->stack, base);
+}
+
+void tb_module_inline(TB_Module* m, TB_Arena* arena, int budget) {
+    Inliner ctx = { .arena = arena, .budget = budget };
+
+    // find all the function bodies
+    NL_Map(TB_Function*, int) lookup = NULL;
+    DynArray(InlineFunc) funcs = NULL;
+
+    TB_SymbolIter it = tb_symbol_iter(m);
+    TB_Symbol* sym;
+    while (sym = tb_symbol_iter_next(&it), sym) {
+        TB_Function* f = (TB_Function*) sym;
+        if (sym->tag == TB_SYMBOL_FUNCTION && f->start_node != NULL && f->stop_node != NULL) {
+            nl_map_put(lookup, f, dyn_array_length(funcs));
+            dyn_array_put(funcs, (InlineFunc){ .f = f, .index = -1 });
+        }
+    }
+
+    ctx.funcs = funcs;
+    ctx.func_count = dyn_array_length(funcs);
+
+    // build the call graph
+    FOREACH_N(i, 0, ctx.func_count) {
+        InlineFunc* fn = &funcs[i];
+        TB_Function* f = fn->f;
+
+        Worklist ws;
+        worklist_alloc(&ws, f->node_count);
+        push_all_nodes(&ws, f->start_node);
+
+        TB_Node* entry_end = TB_NODE_GET_EXTRA_T(f->start_node, TB_NodeRegion)->end;
+        fn->size = dyn_array_length(ws.items);
+        fn->can_inline = !f->prototype->has_varargs && entry_end->type != TB_END && f->stop_node->inputs[0]->type == TB_REGION;
+
+        // a function which never returns has nothing to splice the caller's
+        // bottom half onto, its END isn't among the live nodes.
+        if (!worklist_test(&ws, f->stop_node)) {
+            fn->can_inline = false;
+        }
+
+        dyn_array_for(j, ws.items) {
+            TB_Node* n = ws.items[j];
+
+            size_t extra;
+            if (!clone_extra_bytes(n, &extra) && n->type != TB_START) {
+                fn->can_inline = false;
+            }
+
+            if (n->type == TB_CALL && n->inputs[2]->type == TB_SYMBOL) {
+                TB_Function* target = (TB_Function*) TB_NODE_GET_EXTRA_T(n->inputs[2], TB_NodeSymbol)->sym;
+                ptrdiff_t search = nl_map_get(lookup, target);
+                if (search >= 0) {
+                    dyn_array_put(fn->calls, (InlineCall){ n, lookup[search].v });
+                }
+            }
+        }
+
+        worklist_free(&ws);
+    }
+
+    // walk SCCs bottom up
+    FOREACH_N(i, 0, ctx.func_count) {
+        if (funcs[i].index < 0) {
+            inline_scc(&ctx, i);
+        }
+    }
+
+    FOREACH_N(i, 0, ctx.func_count) {
+        dyn_array_destroy(funcs[i].calls);
+    }
+    dyn_array_destroy(ctx.stack);
+    dyn_array_destroy(funcs);
+    nl_map_free(lookup);
+}
@@ -0,0 +1,424 @@
+// Module-level interprocedural pass, it runs after the inliner and before the
+// per function passes. Two things come out of it:
+//
+// * function facts: readonly/readnone, noreturn and non-null returns. they're
+//   solved optimistically over the call graph (every function starts with all
+//   of them and we iterate until nothing else gets knocked out, that's how
+//   recursion gets a sane answer) and stored on the TB_Function so the call
+//   sites can lean on them during the peepholes.
+//
+// * constant arguments: a private function whose address never escapes has
+//   all its call sites in the module, if every one of them passes the same
+//   constant for a parameter we substitute it into the body.
+//
+// We run before mem2reg so locals are still in memory, accesses based off a
+// TB_LOCAL don't count as effects since nobody outside the function can see
+// them once it returns.
+enum {
+    IPO_READS  = 1,
+    IPO_WRITES = 2,
+};
+
+// how deep we'll chase PHIs when proving a return value isn't NULL
+#define IPO_NONNULL_DEPTH 8
+
+typedef struct {
+    TB_Function* f;
+    Worklist ws;
+
+    // can only be called from the call sites we know about
+    bool escapes;
+    DynArray(TB_Node*) sites;
+} IPOFunc;
+
+typedef struct {
+    TB_Arena* arena;
+
+    size_t func_count;
+    IPOFunc* funcs;
+    NL_Map(TB_Function*, int) lookup;
+} IPO;
+
+static TB_Function* ipo_direct_callee(TB_Node* call) {
+    if (call->inputs[2]->type != TB_SYMBOL) {
+        return NULL;
+    }
+
+    TB_Symbol* sym = TB_NODE_GET_EXTRA_T(call->inputs[2], TB_NodeSymbol)->sym;
+    return sym->tag == TB_SYMBOL_FUNCTION ? (TB_Function*) sym : NULL;
+}
+
+static bool ipo_is_local_addr(TB_Node* n) {
+    while (n->type == TB_MEMBER_ACCESS || n->type == TB_ARRAY_ACCESS) {
+        n = n->inputs[1];
+    }
+    return n->type == TB_LOCAL;
+}
+
+static int ipo_node_effects(TB_Node* n) {
+    switch (n->type) {
+        case TB_LOAD:
+        return ipo_is_local_addr(n->inputs[2]) ? 0 : IPO_READS;
+
+        case TB_STORE:
+        case TB_MEMSET:
+        return ipo_is_local_addr(n->inputs[2]) ? 0 : IPO_WRITES;
+
+        case TB_MEMCPY:
+        return (ipo_is_local_addr(n->inputs[2]) ? 0 : IPO_WRITES) | (ipo_is_local_addr(n->inputs[3]) ? 0 : IPO_READS);
+
+        case TB_CALL: {
+            // functions outside the module (or ones we haven't solved) have no facts
+            TB_Function* callee = ipo_direct_callee(n);
+            uint32_t facts = callee ? callee->facts : 0;
+            if (facts & TB_FUNC_READNONE) return 0;
+            if (facts & TB_FUNC_READONLY) return IPO_READS;
+            return IPO_READS | IPO_WRITES;
+        }
+
+        // just plumbing
+        case TB_START:
+        case TB_END:
+        case TB_REGION:
+        case TB_PHI:
+        case TB_PROJ:
+        case TB_MERGEMEM:
+        case TB_BRANCH:
+        case TB_ADDPAIR:
+        case TB_MULPAIR:
+        return 0;
+
+        case TB_SYSCALL:
+        case TB_SAFEPOINT_POLL:
+        return IPO_READS | IPO_WRITES;
+
+        // volatiles, atomics, machine ops... anything else touching memory
+        default:
+        return n->dt.type == TB_MEMORY || n->dt.type == TB_TUPLE ? IPO_READS | IPO_WRITES : 0;
+    }
+}
+
+static bool ipo_non_null(TB_Node* n, int depth) {
+    switch (n->type) {
+        case TB_LOCAL:
+        case TB_SYMBOL:
+        return true;
+
+        case TB_INTEGER_CONST:
+        return TB_NODE_GET_EXTRA_T(n, TB_NodeInt)->value != 0;
+
+        case TB_MEMBER_ACCESS:
+        case TB_ARRAY_ACCESS:
+        return ipo_non_null(n->inputs[1], depth);
+
+        case TB_PROJ: {
+            TB_Node* call = n->inputs[0];
+            if (call->type == TB_CALL && TB_NODE_GET_EXTRA_T(n, TB_NodeProj)->index == 2) {
+                TB_Function* callee = ipo_direct_callee(call);
+                return callee && (callee->facts & TB_FUNC_NONNULL_RET);
+            }
+            return false;
+        }
+
+        case TB_PHI: {
+            if (depth == 0) return false;
+
+            FOREACH_N(i, 1, n->input_count) {
+                if (n->inputs[i] != n && !ipo_non_null(n->inputs[i], depth - 1)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        default:
+        return false;
+    }
+}
+
+// walks the CFG from the entry, a block which calls a noreturn function
+// doesn't get to reach its successors.
+static bool ipo_can_return(TB_Function* f) {
+    Worklist ws;
+    worklist_alloc(&ws, f->node_count);
+
+    DynArray(TB_Node*) stack = dyn_array_create(TB_Node*, 64);
+    worklist_test_n_set(&ws, f->start_node);
+    dyn_array_put(stack, f->start_node);
+
+    bool returns = false;
+    while (!returns && dyn_array_length(stack)) {
+        TB_Node* bb = dyn_array_pop(stack);
+        TB_Node* end = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->end;
+
+        bool stops = false;
+        for (TB_Node* n = end; n != bb; n = n->inputs[0]) {
+            if (n->type == TB_CALL) {
+                TB_Function* callee = ipo_direct_callee(n);
+                if (callee && (callee->facts & TB_FUNC_NORETURN)) {
+                    stops = true;
+                    break;
+                }
+            }
+        }
+
+        if (stops) continue;
+
+        if (end->type == TB_END) {
+            returns = true;
+        } else if (end->type == TB_BRANCH) {
+            TB_NodeBranch* br = TB_NODE_GET_EXTRA(end);
+            FOREACH_N(i, 0, br->succ_count) {
+                if (!worklist_test_n_set(&ws, br->succ[i])) {
+                    dyn_array_put(stack, br->succ[i]);
+                }
+            }
+        }
+    }
+
+    dyn_array_destroy(stack);
+    worklist_free(&ws);
+    return returns;
+}
+
+// recomputes the facts for fn assuming everyone else's current facts hold
+static uint32_t ipo_solve_facts(IPOFunc* fn) {
+    TB_Function* f = fn->f;
+
+    int effects = 0;
+    dyn_array_for(i, fn->ws.items) {
+        effects |= ipo_node_effects(fn->ws.items[i]);
+        if (effects == (IPO_READS | IPO_WRITES)) break;
+    }
+
+    uint32_t facts = 0;
+    if ((effects & IPO_WRITES) == 0) facts |= TB_FUNC_READONLY;
+    if (effects == 0) facts |= TB_FUNC_READNONE;
+    if (!ipo_can_return(f)) facts |= TB_FUNC_NORETURN;
+
+    // END is (Control, Memory, RPC, Data...), the return value is the 4th input
+    TB_Node* end = f->stop_node;
+    if (f->prototype->return_count == 1 && end->input_count > 3 && end->inputs[3]->dt.type == TB_PTR) {
+        if (ipo_non_null(end->inputs[3], IPO_NONNULL_DEPTH)) {
+            facts |= TB_FUNC_NONNULL_RET;
+        }
+    }
+
+    return facts;
+}
+
+static bool ipo_same_const(TB_Node* a, TB_Node* b) {
+    if (a->type != b->type || a->dt.raw != b->dt.raw) {
+        return false;
+    }
+
+    switch (a->type) {
+        case TB_INTEGER_CONST: return TB_NODE_GET_EXTRA_T(a, TB_NodeInt)->value == TB_NODE_GET_EXTRA_T(b, TB_NodeInt)->value;
+        case TB_SYMBOL:        return TB_NODE_GET_EXTRA_T(a, TB_NodeSymbol)->sym == TB_NODE_GET_EXTRA_T(b, TB_NodeSymbol)->sym;
+        default:               return false;
+    }
+}
+
+static TB_Node* ipo_clone_const(TB_Function* f, TB_Node* n) {
+    if (n->type == TB_INTEGER_CONST) {
+        TB_Node* k = tb_alloc_node(f, TB_INTEGER_CONST, n->dt, 1, sizeof(TB_NodeInt));
+        TB_NODE_SET_EXTRA(k, TB_NodeInt, .value = TB_NODE_GET_EXTRA_T(n, TB_NodeInt)->value);
+        return k;
+    } else {
+        TB_Node* k = tb_alloc_node(f, TB_SYMBOL, n->dt, 1, sizeof(TB_NodeSymbol));
+        TB_NODE_SET_EXTRA(k, TB_NodeSymbol, .sym = TB_NODE_GET_EXTRA_T(n, TB_NodeSymbol)->sym);
+        return k;
+    }
+}
+
+static void ipo_const_args(IPO* ctx, IPOFunc* fn) {
+    TB_Function* f = fn->f;
+    size_t cap = f->node_count;
+    TB_Node** subst = NULL;
+
+    FOREACH_N(i, 0, f->param_count) {
+        TB_Node* param = f->params[3 + i];
+        if (param == NULL) continue;
+
+        // recursive calls which pass the parameter along don't disagree with anyone
+        TB_Node* k = NULL;
+        dyn_array_for(j, fn->sites) {
+            TB_Node* arg = fn->sites[j]->inputs[3 + i];
+            if (arg == param) continue;
+
+            if (k == NULL && (arg->type == TB_INTEGER_CONST || arg->type == TB_SYMBOL)) {
+                k = arg;
+            } else if (k == NULL || !ipo_same_const(k, arg)) {
+                k = NULL;
+                break;
+            }
+        }
+
+        if (k == NULL) continue;
+        if (subst == NULL) {
+            subst = tb_platform_heap_alloc(cap * sizeof(TB_Node*));
+            memset(subst, 0, cap * sizeof(TB_Node*));
+        }
+
+        DO_IF(TB_OPTDEBUG_PEEP)(log_debug("%s: param %zu is always constant", f->super.name, i));
+        subst[param->gvn] = ipo_clone_const(f, k);
+    }
+
+    if (subst != NULL) {
+        inline_sweep(f, subst, cap);
+        tb_platform_heap_free(subst);
+    }
+}
+
+void tb_module_ipo(TB_Module* m, TB_Arena* arena) {
+    IPO ctx = { .arena = arena };
+
+    DynArray(IPOFunc) funcs = NULL;
+    TB_SymbolIter it = tb_symbol_iter(m);
+    TB_Symbol* sym;
+    while (sym = tb_symbol_iter_next(&it), sym) {
+        TB_Function* f = (TB_Function*) sym;
+        if (sym->tag == TB_SYMBOL_FUNCTION && f->start_node != NULL && f->stop_node != NULL) {
+            nl_map_put(ctx.lookup, f, dyn_array_length(funcs));
+            dyn_array_put(funcs, (IPOFunc){ .f = f, .escapes = f->linkage != TB_LINKAGE_PRIVATE });
+        }
+    }
+
+    ctx.funcs = funcs;
+    ctx.func_count = dyn_array_length(funcs);
+
+    // find the call sites, any other use of a function's address means we
+    // can't see all the callers.
+    FOREACH_N(i, 0, ctx.func_count) {
+        IPOFunc* fn = &funcs[i];
+        worklist_alloc(&fn->ws, fn->f->node_count);
+        push_all_nodes(&fn->ws, fn->f->start_node);
+
+        dyn_array_for(j, fn->ws.items) {
+            TB_Node* n = fn->ws.items[j];
+            FOREACH_N(k, 0, n->input_count) {
+                TB_Node* in = n->inputs[k];
+                if (in == NULL || in->type != TB_SYMBOL) continue;
+
+                TB_Function* target = (TB_Function*) TB_NODE_GET_EXTRA_T(in, TB_NodeSymbol)->sym;
+                ptrdiff_t search = nl_map_get(ctx.lookup, target);
+                if (search < 0) continue;
+
+                IPOFunc* callee = &funcs[ctx.lookup[search].v];
+                if (n->type == TB_CALL && k == 2 && inline_call_matches(n, callee->f)) {
+                    dyn_array_put(callee->sites, n);
+                } else {
+                    callee->escapes = true;
+                }
+            }
+        }
+    }
+
+    // function pointers in global initializers
+    it = tb_symbol_iter(m);
+    while (sym = tb_symbol_iter_next(&it), sym) {
+        if (sym->tag != TB_SYMBOL_GLOBAL) continue;
+
+        TB_Global* g = (TB_Global*) sym;
+        FOREACH_N(i, 0, g->obj_count) {
+            if (g->objects[i].type != TB_INIT_OBJ_RELOC) continue;
+
+            TB_Function* target = (TB_Function*) g->objects[i].reloc;
+            ptrdiff_t search = nl_map_get(ctx.lookup, target);
+            if (search >= 0) {
+                funcs[ctx.lookup[search].v].escapes = true;
+            }
+        }
+    }
+
+    CUIK_TIMED_BLOCK("const args") {
+        FOREACH_N(i, 0, ctx.func_count) {
+            IPOFunc* fn = &funcs[i];
+            if (!fn->escapes && dyn_array_length(fn->sites) > 0) {
+                TB_Arena* old_arena = fn->f->arena;
+                fn->f->arena = ctx.arena;
+                ipo_const_args(&ctx, fn);
+                fn->f->arena = old_arena;
+            }
+        }
+    }
+
+    CUIK_TIMED_BLOCK("facts") {
+        FOREACH_N(i, 0, ctx.func_count) {
+            funcs[i].f->facts = TB_FUNC_READONLY | TB_FUNC_READNONE | TB_FUNC_NORETURN | TB_FUNC_NONNULL_RET;
+        }
+
+        // every round can only take facts away so this terminates
+        bool progress;
+        do {
+            progress = false;
+            FOREACH_N(i, 0, ctx.func_count) {
+                TB_Function* f = funcs[i].f;
+                uint32_t facts = ipo_solve_facts(&funcs[i]) & f->facts;
+                if (facts != f->facts) {
+                    f->facts = facts;
+                    progress = true;
+                }
+            }
+        } while (progress);
+    }
+
+    FOREACH_N(i, 0, ctx.func_count) {
+        DO_IF(TB_OPTDEBUG_PEEP)(log_debug("%s: facts %#x", funcs[i].f->super.name, funcs[i].f->facts));
+        worklist_free(&funcs[i].ws);
+        dyn_array_destroy(funcs[i].sites);
+    }
+
+    dyn_array_destroy(funcs);
+    nl_map_free(ctx.lookup);
+}
+
+// call sites get to use whatever tb_module_ipo proved about the callee
+static TB_Node* ideal_call(TB_Passes* restrict p, TB_Function* f, TB_Node* n) {
+    TB_Function* callee = ipo_direct_callee(n);
+    if (callee == NULL || callee->facts == 0) {
+        return NULL;
+    }
+
+    TB_NodeCall* c = TB_NODE_GET_EXTRA(n);
+
+    // the callee never comes back, everything after the call moves into a
+    // block nobody can reach and the region peephole cuts it loose from the
+    // successors.
+    TB_Node* ctrl = c->projs[0];
+    if ((callee->facts & TB_FUNC_NORETURN) && ctrl != NULL) {
+        if (ctrl->user_count > 0 && !(ctrl->user_count == 1 && ctrl->users[0].n->type == TB_UNREACHABLE)) {
+            TB_Node* bb = tb_get_parent_region(n);
+            TB_NodeRegion* r = TB_NODE_GET_EXTRA(bb);
+
+            TB_Node* dead = tb_alloc_node(f, TB_REGION, TB_TYPE_CONTROL, 0, sizeof(TB_NodeRegion));
+            TB_NODE_SET_EXTRA(dead, TB_NodeRegion, .end = r->end, .tag = "dead", .postorder_id = -1, .dom_depth = r->dom_depth + 1, .dom = bb);
+
+            while (ctrl->user_count > 0) {
+                User use = ctrl->users[ctrl->user_count - 1];
+                set_input(p, use.n, dead, use.slot);
+            }
+
+            TB_Node* k = tb_alloc_node(f, TB_UNREACHABLE, TB_TYPE_VOID, 1, 0);
+            set_input(p, k, ctrl, 0);
+            r->end = k;
+
+            tb_pass_mark(p, dead);
+            tb_pass_mark(p, bb);
+            return n;
+        }
+    }
+
+    // nothing gets written so the memory after the call is the memory before
+    // it, loads can forward across it. the scheduler's anti-dependencies keep
+    // the stores which come later from passing it.
+    TB_Node* mem = c->projs[1];
+    if ((callee->facts & TB_FUNC_READONLY) && mem != NULL && mem->user_count > 0) {
+        tb_pass_mark_users(p, mem);
+        subsume_node(p, f, mem, n->inputs[1]);
+        c->projs[1] = NULL;
+        return n;
+    }
+
+    return NULL;
+}
@@ -63,13 +63,84 @@ static bool lattice_cmp(void* a, void* b) {
     return aa->tag == bb->tag ? memcmp(aa, bb, sizeof(Lattice)) == 0 : false;
 }
 
+// the padding is zeroed so hashing and comparisons behave, the result
+// lives in the tmp arena.
+static Lattice* lattice_intern(LatticeUniverse* uni, Lattice l) {
+    Lattice* k = tb_arena_alloc(tmp_arena, sizeof(Lattice));
+    memset(k, 0, sizeof(Lattice));
+
+    k->tag = l.tag;
+    switch (l.tag) {
+        case LATTICE_INT:     k->_int = l._int; break;
+        case LATTICE_POINTER: k->_ptr = l._ptr; break;
+        default:              k->_float = l._float; break;
+    }
+
+    Lattice* old = nl_hashset_put2(&uni->pool, k, lattice_hash, lattice_cmp);
+    if (old != NULL) {
+        tb_arena_free(tmp_arena, k, sizeof(Lattice));
+        return old;
+    }
+
+    return k;
+}
+
+// tightens the range using the known bits (and the other way around for constants)
+static LatticeInt lattice_int_normalize(LatticeInt i, uint64_t mask) {
+    i.known_zeros &= mask;
+    i.known_ones &= mask;
+    i.top &= mask;
+
+    // the smallest value has at least the known ones set, the biggest can't
+    // have any of the known zeros.
+    uint64_t hi = ~i.known_zeros & mask;
+    if (i.bot < i.known_ones) i.bot = i.known_ones;
+    if (i.top > hi) i.top = hi;
+
+    if (i.bot == i.top) {
+        i.known_ones = i.bot;
+        i.known_zeros = ~i.bot & mask;
+    }
+
+    return i;
+}
+
+static Lattice lattice_int_const(uint64_t x, uint64_t mask) {
+    x &= mask;
+    return (Lattice){ LATTICE_INT, ._int = { x, x, ~x & mask, x } };
+}
+
+static bool lattice_is_int_const(const Lattice* l, uint64_t mask, uint64_t* out) {
+    if (l->tag == LATTICE_INT) {
+        if (l->_int.bot == l->_int.top) {
+            *out = l->_int.bot;
+            return true;
+        } else if (((l->_int.known_zeros | l->_int.known_ones) & mask) == mask) {
+            *out = l->_int.known_ones;
+            return true;
+        }
+    } else if (l->tag == LATTICE_POINTER && l->_ptr.trifecta == LATTICE_KNOWN_NULL) {
+        *out = 0;
+        return true;
+    }
+
+    return false;
+}
+
+static bool lattice_is_non_zero(const Lattice* l) {
+    switch (l->tag) {
+        case LATTICE_INT:     return l->_int.bot > 0 || l->_int.known_ones != 0;
+        case LATTICE_POINTER: return l->_ptr.trifecta == LATTICE_KNOWN_NOT_NULL;
+        default:              return false;
+    }
+}
+
 // maximal subset
 static Lattice lattice_top(TB_DataType dt) {
     switch (dt.type) {
         case TB_INT: {
-            assert(dt.data <= 64);
-            uint64_t max_bits = UINT64_MAX >> dt.data;
-            tb_todo();
+            assert(dt.data > 0 && dt.data <= 64);
+            uint64_t max_bits = UINT64_MAX >> (64 - dt.data);
 
             return (Lattice){ LATTICE_INT, ._int = { 0, max_bits } };
         }
@@ -18,7 +18,7 @@ static TB_Node* ideal_libcall(TB_Passes* restrict passes, TB_Function* f, TB_Nod
         set_input(passes, n2, n->inputs[5], 4); // size
         TB_NODE_SET_EXTRA(n2, TB_NodeMemAccess, .align = 1);
 
-        TB_Node* dst_ptr = n->inputs[2];
+        TB_Node* dst_ptr = n->inputs[3];
         TB_Node* ctrl = n->inputs[0];
 
         // returns the destination pointer, convert any users of that to dst
@@ -1,157 +1,1163 @@
-#if 0
-TB_Attrib* get_debug_var(TB_Node* n) {
-    dyn_array_for(i, n->attribs) {
-        if (n->attribs[i].tag == TB_ATTRIB_VARIABLE) return &n->attribs[i];
+// Loop optimizations:
+//   * canonical form: every loop header gets exactly two predecessors, the
+//     preheader (entry) and the latch (backedge).
+//   * induction variables: header PHIs which step by a constant each trip.
+//   * vectorization: simple counted loops storing into base[iv] get a vector
+//     copy in front of them, the original loop handles the leftover trips.
+//   * strength reduction: base[iv] turns into a pointer which is bumped by
+//     the stride every trip.
+//   * full unrolling: loops which are a single block with a small constant
+//     trip count get replaced by straight-line copies of the body.
+//
+// LICM doesn't happen here, the GCM picks the shallowest loop depth between
+// the early and late schedule (see gcm.h) which is what hoists the invariants.
+#define LOOP_UNROLL_MAX_TRIPS 8
+#define LOOP_UNROLL_MAX_NODES 96
+
+// 128bit vectors, lane count depends on the element type
+#define LOOP_VECTOR_BYTES        16
+#define LOOP_VECTORIZE_MAX_NODES 32
+
+typedef struct {
+    TB_Passes* p;
+    TB_Function* f;
+
+    // postorder walk, the visited set doubles as the reachability check
+    Worklist blocks;
+    size_t block_count;
+} LoopOpt;
+
+typedef struct {
+    TB_Node* phi;
+    TB_Node* init;
+    TB_Node* next;
+    int64_t step;
+} LoopIV;
+
+////////////////////////////////
+// Analysis
+////////////////////////////////
+void tb_compute_loop_depths(TB_Function* f, Worklist* restrict ws, size_t count, TB_Node** blocks) {
+    // last loop header to visit each block, keeps nested walks from double counting
+    int* stamp = tb_arena_alloc(tmp_arena, count * sizeof(int));
+    FOREACH_N(i, 0, count) {
+        TB_NODE_GET_EXTRA_T(blocks[i], TB_NodeRegion)->loop_depth = 0;
+        stamp[i] = -1;
     }
 
-    return NULL;
+    DynArray(TB_Node*) stack = NULL;
+    FOREACH_N(i, 0, count) {
+        TB_Node* header = blocks[i];
+        if (header->type != TB_REGION) continue;
+
+        FOREACH_N(j, 0, header->input_count) {
+            TB_Node* latch = tb_get_parent_region(header->inputs[j]);
+            if (!worklist_test(ws, latch) || !tb_is_dominated_by(header, latch)) {
+                continue;
+            }
+
+            // natural loop body: everything between the latch and the header
+            // walking backwards, the header stops the walk.
+            if (stamp[i] != i) {
+                stamp[i] = i;
+                TB_NODE_GET_EXTRA_T(header, TB_NodeRegion)->loop_depth += 1;
+            }
+
+            dyn_array_put(stack, latch);
+            while (dyn_array_length(stack)) {
+                TB_Node* bb = dyn_array_pop(stack);
+                TB_NodeRegion* r = TB_NODE_GET_EXTRA(bb);
+                if (stamp[r->postorder_id] == i) continue;
+
+                stamp[r->postorder_id] = i;
+                r->loop_depth += 1;
+
+                FOREACH_N(k, 0, bb->input_count) {
+                    TB_Node* pred = tb_get_parent_region(bb->inputs[k]);
+                    if (worklist_test(ws, pred) && tb_is_dominated_by(header, pred)) {
+                        dyn_array_put(stack, pred);
+                    }
+                }
+            }
+        }
+    }
+
+    dyn_array_destroy(stack);
+    tb_arena_free(tmp_arena, stamp, count * sizeof(int));
 }
 
-static void add_region_pred_tracked(TB_Passes* opt, TB_Function* f, TB_Node* n, TB_Node* pred) {
-    // detach old predecessor list, make bigger one
-    assert(n->type == TB_REGION);
+static void loop_compute_cfg(LoopOpt* ctx) {
+    worklist_clear(&ctx->blocks);
 
-    size_t old_count = n->input_count;
-    TB_Node** new_inputs = alloc_from_node_arena(f, (old_count + 1) * sizeof(TB_Node*));
-    memcpy(new_inputs, n->inputs, old_count * sizeof(TB_Node*));
-    new_inputs[old_count] = pred;
+    ctx->block_count = tb_push_postorder(ctx->f, &ctx->blocks);
+    tb_compute_dominators(ctx->f, ctx->block_count, ctx->blocks.items);
+    tb_compute_loop_depths(ctx->f, &ctx->blocks, ctx->block_count, ctx->blocks.items);
+}
 
-    n->inputs = new_inputs;
-    n->input_count = old_count + 1;
+static bool loop_is_backedge(LoopOpt* ctx, TB_Node* header, TB_Node* pred) {
+    TB_Node* bb = tb_get_parent_region(pred);
+    return worklist_test(&ctx->blocks, bb) && tb_is_dominated_by(header, bb);
+}
 
-    add_user(opt, n, pred, old_count, NULL);
+// a reachable block which strictly dominates the header, it's outside the loop
+static bool loop_is_outside(LoopOpt* ctx, TB_Node* header, TB_Node* bb) {
+    return bb != header && worklist_test(&ctx->blocks, bb) && tb_is_dominated_by(bb, header);
 }
 
-bool tb_passes_loop(TB_Passes* p) {
-    verify_tmp_arena(p);
+static bool loop_is_invariant(LoopOpt* ctx, TB_Node* header, TB_Node* n, int depth) {
+    if (depth > 4) {
+        return false;
+    }
 
-    TB_Function* f = p->f;
-    TB_PostorderWalk order = p->order;
+    if (n->type == TB_PHI) {
+        return loop_is_outside(ctx, header, n->inputs[0]);
+    }
 
-    // canonicalize loops
-    DynArray(ptrdiff_t) backedges = NULL;
-    FOREACH_N(i, 0, order.count) {
-        TB_Node* header = order.traversal[i];
-        if (header->input_count != 2) {
-            continue;
+    if (n->input_count > 0 && n->inputs[0] != NULL && !loop_is_outside(ctx, header, tb_get_parent_region(n->inputs[0]))) {
+        return false;
+    }
+
+    FOREACH_N(i, 1, n->input_count) {
+        if (n->inputs[i] && !loop_is_invariant(ctx, header, n->inputs[i], depth + 1)) {
+            return false;
         }
+    }
 
-        // find backedges, we'll be unifying them soon
-        dyn_array_clear(backedges);
-        FOREACH_N(j, 0, header->input_count) {
-            if (tb_is_dominated_by(header, tb_get_parent_region(header->inputs[j]))) {
-                dyn_array_put(backedges, j);
+    return true;
+}
+
+// canonical loops have one entry and one backedge, we hand out the slots
+static bool loop_shape(LoopOpt* ctx, TB_Node* header, int* entry, int* backedge) {
+    if (header->type != TB_REGION || header->input_count != 2 || !worklist_test(&ctx->blocks, header)) {
+        return false;
+    }
+
+    bool b0 = loop_is_backedge(ctx, header, header->inputs[0]);
+    bool b1 = loop_is_backedge(ctx, header, header->inputs[1]);
+    if (b0 == b1) {
+        return false;
+    }
+
+    *backedge = b0 ? 0 : 1;
+    *entry = b0 ? 1 : 0;
+    return true;
+}
+
+// loops shaped like:
+//   header: phis, if (cond) body else exit
+//   body:   ..., goto header
+typedef struct {
+    int entry, backedge;
+    // which successor of the header's branch is the body
+    int body_i;
+
+    TB_Node *br, *body, *goto_b, *exit;
+} LoopSimple;
+
+static bool loop_simple_shape(LoopOpt* ctx, TB_Node* header, LoopSimple* out) {
+    if (!loop_shape(ctx, header, &out->entry, &out->backedge)) {
+        return false;
+    }
+
+    uint64_t falsey;
+    TB_Node* br_h = TB_NODE_GET_EXTRA_T(header, TB_NodeRegion)->end;
+    if (!is_if_branch(br_h, &falsey) || falsey != 0) {
+        return false;
+    }
+
+    TB_Node* latch = header->inputs[out->backedge];
+    TB_Node* goto_b = latch->inputs[0];
+    TB_Node* body = goto_b->inputs[0];
+    if (goto_b->input_count != 1 || body->type != TB_REGION || body->input_count != 1 ||
+        TB_NODE_GET_EXTRA_T(body, TB_NodeRegion)->end != goto_b ||
+        body->inputs[0]->type != TB_PROJ || body->inputs[0]->inputs[0] != br_h) {
+        return false;
+    }
+
+    TB_NodeBranch* br_info = TB_NODE_GET_EXTRA(br_h);
+    int body_i = br_info->succ[0] == body ? 0 : 1;
+    TB_Node* exit = br_info->succ[1 - body_i];
+    if (br_info->succ[body_i] != body || exit == body || exit == header) {
+        return false;
+    }
+
+    out->body_i = body_i;
+    out->br = br_h, out->body = body, out->goto_b = goto_b, out->exit = exit;
+    return true;
+}
+
+static bool loop_find_iv(TB_Node* header, TB_Node* phi, int entry, int backedge, LoopIV* out) {
+    if (phi->type != TB_PHI || phi->inputs[0] != header || phi->dt.type != TB_INT) {
+        return false;
+    }
+
+    TB_Node* next = phi->inputs[1 + backedge];
+    if ((next->type != TB_ADD && next->type != TB_SUB) || next->inputs[1] != phi || next->inputs[2]->type != TB_INTEGER_CONST) {
+        return false;
+    }
+
+    uint64_t bits = phi->dt.data;
+    int64_t step = tb__sxt(TB_NODE_GET_EXTRA_T(next->inputs[2], TB_NodeInt)->value, bits, 64);
+
+    *out = (LoopIV){ phi, phi->inputs[1 + entry], next, next->type == TB_SUB ? -step : step };
+    return true;
+}
+
+static bool loop_eval_cmp(TB_Node* cmp, uint64_t a, uint64_t b) {
+    uint64_t bits = TB_NODE_GET_EXTRA_T(cmp, TB_NodeCompare)->cmp_dt.data;
+    uint64_t mask = tb__mask(bits);
+    a &= mask, b &= mask;
+
+    int64_t sa = tb__sxt(a, bits, 64), sb = tb__sxt(b, bits, 64);
+    switch (cmp->type) {
+        case TB_CMP_EQ:  return a == b;
+        case TB_CMP_NE:  return a != b;
+        case TB_CMP_ULT: return a < b;
+        case TB_CMP_ULE: return a <= b;
+        case TB_CMP_SLT: return sa < sb;
+        case TB_CMP_SLE: return sa <= sb;
+        default: tb_unreachable(); return false;
+    }
+}
+
+// how many times the body runs, -1 if we can't tell (or it's too many)
+static int loop_trip_count(TB_Node* header, int entry, int backedge, TB_Node* cmp, bool continue_on) {
+    if (cmp->type < TB_CMP_EQ || cmp->type > TB_CMP_SLE || TB_NODE_GET_EXTRA_T(cmp, TB_NodeCompare)->cmp_dt.type != TB_INT) {
+        return -1;
+    }
+
+    // one side is the IV (or its next value), the other is a constant
+    FOREACH_N(side, 0, 2) {
+        TB_Node* a = cmp->inputs[1 + side];
+        TB_Node* b = cmp->inputs[2 - side];
+        if (b->type != TB_INTEGER_CONST) continue;
+
+        LoopIV iv;
+        bool is_next = false;
+        if (!loop_find_iv(header, a, entry, backedge, &iv)) {
+            // the compare might be on the incremented value
+            if (a->type != TB_ADD && a->type != TB_SUB) continue;
+            if (!loop_find_iv(header, a->inputs[1], entry, backedge, &iv) || iv.next != a) continue;
+            is_next = true;
+        }
+
+        if (iv.init->type != TB_INTEGER_CONST) continue;
+
+        uint64_t k = TB_NODE_GET_EXTRA_T(b, TB_NodeInt)->value;
+        uint64_t x = TB_NODE_GET_EXTRA_T(iv.init, TB_NodeInt)->value;
+        FOREACH_N(trips, 0, LOOP_UNROLL_MAX_TRIPS + 1) {
+            uint64_t v = is_next ? x + iv.step : x;
+            bool cond = side == 0 ? loop_eval_cmp(cmp, v, k) : loop_eval_cmp(cmp, k, v);
+            if (cond != continue_on) {
+                return trips;
             }
+
+            x += iv.step;
         }
 
-        size_t backedge_count = dyn_array_length(backedges);
-        if (backedge_count == 0) {
-            continue;
+        return -1;
+    }
+
+    return -1;
+}
+
+////////////////////////////////
+// Canonicalization
+////////////////////////////////
+// moves the backedges (or the entries) of the header into a new block
+// which jumps into the header, the PHIs get split along the same lines.
+static TB_Node* loop_split_preds(LoopOpt* ctx, TB_Node* header, bool backedges) {
+    TB_Passes* p = ctx->p;
+    TB_Function* f = ctx->f;
+
+    size_t count = 0;
+    FOREACH_N(i, 0, header->input_count) {
+        if (loop_is_backedge(ctx, header, header->inputs[i]) == backedges) count++;
+    }
+
+    DynArray(TB_Node*) phis = NULL;
+    FOR_USERS(use, header) {
+        if (use->n->type == TB_PHI && use->slot == 0) {
+            dyn_array_put(phis, use->n);
         }
+    }
+
+    TB_Node* region = tb_alloc_node(f, TB_REGION, TB_TYPE_CONTROL, count, sizeof(TB_NodeRegion));
+    TB_Node* br = tb_alloc_node(f, TB_BRANCH, TB_TYPE_TUPLE, 1, sizeof(TB_NodeBranch));
+    set_input(p, br, region, 0);
+
+    TB_NodeBranch* br_info = TB_NODE_GET_EXTRA(br);
+    br_info->succ_count = 1;
+    br_info->succ = tb_arena_alloc(f->arena, sizeof(TB_Node*));
+    br_info->succ[0] = header;
+
+    TB_NODE_SET_EXTRA(region, TB_NodeRegion, .end = br, .tag = backedges ? "loop.latch" : "loop.preheader", .postorder_id = -1, .dom_depth = -1);
+    TB_Node* proj = make_proj_node(f, p, TB_TYPE_CONTROL, br, 0);
+
+    TB_Node** split_phis = tb_arena_alloc(tmp_arena, dyn_array_length(phis) * sizeof(TB_Node*));
+    dyn_array_for(j, phis) {
+        split_phis[j] = tb_alloc_node(f, TB_PHI, phis[j]->dt, 1 + count, 0);
+        set_input(p, split_phis[j], region, 0);
+    }
+
+    // move the edges over, the branches now jump to the new block
+    size_t pred_count = header->input_count;
+    bool* moved = tb_arena_alloc(tmp_arena, pred_count * sizeof(bool));
+    size_t k = 0;
+    FOREACH_N(i, 0, header->input_count) {
+        TB_Node* pred = header->inputs[i];
+        moved[i] = loop_is_backedge(ctx, header, pred) == backedges;
+        if (!moved[i]) continue;
+
+        TB_NodeBranch* pred_br = TB_NODE_GET_EXTRA(pred->inputs[0]);
+        FOREACH_N(j, 0, pred_br->succ_count) {
+            if (pred_br->succ[j] == header) pred_br->succ[j] = region;
+        }
+
+        set_input(p, region, pred, k);
+        dyn_array_for(j, phis) {
+            set_input(p, split_phis[j], phis[j]->inputs[1 + i], 1 + k);
+        }
+        k++;
+    }
+
+    // backwards so the swap removal only moves edges we've already looked at
+    FOREACH_REVERSE_N(i, 0, pred_count) if (moved[i]) {
+        remove_input(p, f, header, i);
+        dyn_array_for(j, phis) {
+            remove_input(p, f, phis[j], 1 + i);
+        }
+    }
+
+    // we removed at least two edges so the input arrays have room for one more
+    header->inputs[header->input_count++] = NULL;
+    set_input(p, header, proj, header->input_count - 1);
+    dyn_array_for(j, phis) {
+        phis[j]->inputs[phis[j]->input_count++] = NULL;
+        set_input(p, phis[j], split_phis[j], phis[j]->input_count - 1);
+
+        tb_pass_mark(p, phis[j]);
+        tb_pass_mark(p, split_phis[j]);
+    }
+
+    tb_pass_mark(p, region);
+    tb_pass_mark(p, header);
+    tb_pass_mark_users(p, header);
+
+    DO_IF(TB_OPTDEBUG_LOOP)(printf("loop v%u: new %s (%zu edges)\n", header->gvn, backedges ? "latch" : "preheader", count));
+
+    tb_arena_free(tmp_arena, moved, pred_count * sizeof(bool));
+    dyn_array_destroy(phis);
+    return region;
+}
+
+static bool loop_canonicalize(LoopOpt* ctx, TB_Node* header) {
+    if (header->type != TB_REGION) {
+        return false;
+    }
+
+    size_t entries = 0, backedges = 0;
+    FOREACH_N(i, 0, header->input_count) {
+        TB_Node* pred = header->inputs[i];
+        if (pred->type != TB_PROJ || pred->inputs[0]->type != TB_BRANCH) {
+            return false;
+        }
+
+        if (loop_is_backedge(ctx, header, pred)) backedges++;
+        else entries++;
+    }
+
+    if (backedges == 0 || entries == 0) {
+        return false;
+    }
+
+    if (entries > 1) loop_split_preds(ctx, header, false);
+    if (backedges > 1) loop_split_preds(ctx, header, true);
+    return entries > 1 || backedges > 1;
+}
+
+////////////////////////////////
+// Strength reduction
+////////////////////////////////
+// base[ext(iv)] => ptr where ptr starts at base[ext(init)] and moves by step*stride
+static void loop_reduce_access(LoopOpt* ctx, TB_Node* header, int entry, int backedge, LoopIV* iv, TB_Node* ext, TB_Node* access) {
+    TB_Passes* p = ctx->p;
+    TB_Function* f = ctx->f;
+    int64_t stride = TB_NODE_GET_EXTRA_T(access, TB_NodeArray)->stride;
+
+    TB_Node* init = iv->init;
+    if (ext != NULL) {
+        init = tb_alloc_node(f, ext->type, ext->dt, 2, 0);
+        set_input(p, init, iv->init, 1);
+        tb_pass_mark(p, init);
+    }
+
+    TB_Node* start = tb_alloc_node(f, TB_ARRAY_ACCESS, access->dt, 3, sizeof(TB_NodeArray));
+    set_input(p, start, access->inputs[1], 1);
+    set_input(p, start, init, 2);
+    TB_NODE_SET_EXTRA(start, TB_NodeArray, .stride = stride);
+
+    TB_Node* phi = tb_alloc_node(f, TB_PHI, access->dt, 3, 0);
+    TB_Node* bump = tb_alloc_node(f, TB_MEMBER_ACCESS, access->dt, 2, sizeof(TB_NodeMember));
+    set_input(p, bump, phi, 1);
+    TB_NODE_SET_EXTRA(bump, TB_NodeMember, .offset = iv->step * stride);
 
-        DO_IF(TB_OPTDEBUG_LOOP)(printf("Loop %p:\n", header));
-        tb_assert(backedge_count == 1, "TODO: we only support one backedge rn");
+    set_input(p, phi, header, 0);
+    set_input(p, phi, start, 1 + entry);
+    set_input(p, phi, bump, 1 + backedge);
 
-        // the header in uncanonical form has a branch at the top to exit,
-        // also this branch should be a trivial IF not anything wacky like
-        // a switch... tf?
-        TB_Node* br = TB_NODE_GET_EXTRA_T(header, TB_NodeRegion)->end;
-        TB_NodeBranch* br_info = TB_NODE_GET_EXTRA(br);
-        if (br->type != TB_BRANCH || br->input_count != 2 || br_info->succ_count != 2) {
+    DO_IF(TB_OPTDEBUG_LOOP)(printf("loop v%u: strength reduced v%u (stride %"PRId64")\n", header->gvn, access->gvn, iv->step * stride));
+
+    tb_pass_mark(p, start);
+    tb_pass_mark(p, phi);
+    tb_pass_mark(p, bump);
+    tb_pass_mark_users(p, access);
+    subsume_node(p, f, access, phi);
+}
+
+static bool loop_is_array_index(TB_Node* n, TB_Node* index, LoopOpt* ctx, TB_Node* header) {
+    return n->type == TB_ARRAY_ACCESS && n->inputs[2] == index && loop_is_invariant(ctx, header, n->inputs[1], 0);
+}
+
+static void loop_strength_reduce(LoopOpt* ctx, TB_Node* header) {
+    TB_Passes* p = ctx->p;
+    int entry, backedge;
+    if (!loop_shape(ctx, header, &entry, &backedge)) {
+        return;
+    }
+
+    DynArray(TB_Node*) phis = NULL;
+    FOR_USERS(use, header) {
+        if (use->n->type == TB_PHI && use->slot == 0) {
+            dyn_array_put(phis, use->n);
+        }
+    }
+
+    DynArray(TB_Node*) accesses = NULL;
+    DynArray(TB_Node*) exts = NULL;
+    dyn_array_for(i, phis) {
+        LoopIV iv;
+        if (!loop_find_iv(header, phis[i], entry, backedge, &iv)) {
             continue;
         }
 
-        // find the loop exit path
-        ptrdiff_t exit_i = -1;
-        TB_Node* backedge_proj = header->inputs[backedges[0]];
-        TB_Node* backedge_bb = tb_get_parent_region(backedge_proj);
-        FOREACH_N(j, 0, br_info->succ_count) {
-            if (!tb_is_dominated_by(br_info->succ[j], backedge_bb)) {
-                DO_IF(TB_OPTDEBUG_LOOP)(printf("  exit %p\n", br_info->succ[j]));
-                exit_i = j;
-                break;
+        // the widened index only tracks the narrow IV if it can't wrap
+        TB_ArithmeticBehavior ab = TB_NODE_GET_EXTRA_T(iv.next, TB_NodeBinopInt)->ab;
+
+        dyn_array_clear(accesses);
+        dyn_array_clear(exts);
+        FOR_USERS(use, iv.phi) {
+            TB_Node* n = use->n;
+            if (iv.phi->dt.data == 64 && loop_is_array_index(n, iv.phi, ctx, header)) {
+                dyn_array_put(accesses, n);
+                dyn_array_put(exts, NULL);
+            } else if (n->dt.type == TB_INT && n->dt.data == 64 &&
+                ((n->type == TB_SIGN_EXT && (ab & TB_ARITHMATIC_NSW)) ||
+                 (n->type == TB_ZERO_EXT && (ab & TB_ARITHMATIC_NUW) && iv.step > 0))) {
+                FOR_USERS(ext_use, n) {
+                    if (loop_is_array_index(ext_use->n, n, ctx, header)) {
+                        dyn_array_put(accesses, ext_use->n);
+                        dyn_array_put(exts, n);
+                    }
+                }
             }
         }
 
-        // we didn't find the loop exit here... it's not a valid candidate
-        // for loop rotation
-        if (i < 0) {
-            continue;
+        dyn_array_for(j, accesses) {
+            loop_reduce_access(ctx, header, entry, backedge, &iv, exts[j], accesses[j]);
+        }
+    }
+
+    dyn_array_destroy(exts);
+    dyn_array_destroy(accesses);
+    dyn_array_destroy(phis);
+}
+
+////////////////////////////////
+// Vectorization
+////////////////////////////////
+// simple counted loops which store one value per trip into base[iv] (with
+// the value coming from loads at the same index, invariants and lane-wise
+// arithmatic) get a vector copy which runs in front of the original loop:
+//
+//   guard:  if (the store can't overlap a later lane's load) vhead else merge
+//   vhead:  if (vi + L - 1 < n) vbody else merge
+//   vbody:  base[vi..vi+L] = ..., vi += L, goto vhead
+//   merge:  goto header (the original loop finishes the last few trips)
+typedef struct {
+    LoopOpt* ctx;
+    TB_Node *header, *mem;
+
+    // every access is base[index] with the stride of the lane type
+    TB_Node* index;
+    TB_Node* store_base;
+    TB_DataType elem;
+    int width;
+
+    // load bases which aren't the store's base, these need the guard
+    DynArray(TB_Node*) bases;
+    int budget;
+
+    // vector body
+    TB_Node *vbody, *vmem, *vindex;
+    size_t cap;
+    TB_Node** map;
+} LoopVec;
+
+static int loop_vec_elem_size(TB_DataType dt) {
+    if (dt.width != 0) {
+        return 0;
+    } else if (dt.type == TB_FLOAT) {
+        return dt.data == TB_FLT_32 ? 4 : 8;
+    } else if (dt.type == TB_INT && (dt.data == 8 || dt.data == 16 || dt.data == 32 || dt.data == 64)) {
+        return dt.data / 8;
+    } else {
+        return 0;
+    }
+}
+
+static bool loop_vec_access(LoopVec* v, TB_Node* addr) {
+    return addr->type == TB_ARRAY_ACCESS && addr->inputs[2] == v->index &&
+        TB_NODE_GET_EXTRA_T(addr, TB_NodeArray)->stride == loop_vec_elem_size(v->elem) &&
+        loop_is_invariant(v->ctx, v->header, addr->inputs[1], 0);
+}
+
+// can n be computed lane-wise as a vector of v->elem? integer ops wider than
+// the lanes are fine as long as they only need the low bits to be right
+// (the store truncates them anyways).
+static bool loop_vec_check(LoopVec* v, TB_Node* n) {
+    if (v->budget-- <= 0) {
+        return false;
+    }
+
+    TB_DataType elem = v->elem;
+    bool narrow = elem.type == TB_INT && n->dt.type == TB_INT && n->dt.width == 0 && n->dt.data > elem.data;
+    if (!narrow && !TB_DATA_TYPE_EQUALS(n->dt, elem)) {
+        return false;
+    }
+
+    // gets broadcasted
+    if (loop_is_invariant(v->ctx, v->header, n, 0)) {
+        return true;
+    }
+
+    switch (n->type) {
+        case TB_LOAD: {
+            if (narrow || n->inputs[1] != v->mem || !loop_vec_access(v, n->inputs[2])) {
+                return false;
+            }
+
+            TB_Node* base = n->inputs[2]->inputs[1];
+            if (base != v->store_base) {
+                dyn_array_for(i, v->bases) {
+                    if (v->bases[i] == base) return true;
+                }
+                dyn_array_put(v->bases, base);
+            }
+            return true;
+        }
+
+        // the low bits are just the source
+        case TB_SIGN_EXT:
+        case TB_ZERO_EXT:
+        return narrow && TB_DATA_TYPE_EQUALS(n->inputs[1]->dt, elem) && loop_vec_check(v, n->inputs[1]);
+
+        case TB_TRUNCATE:
+        return n->inputs[1]->dt.type == TB_INT && loop_vec_check(v, n->inputs[1]);
+
+        case TB_FADD:
+        case TB_FSUB:
+        case TB_FMUL:
+        case TB_FDIV:
+        case TB_FMAX:
+        case TB_FMIN:
+        return elem.type == TB_FLOAT && loop_vec_check(v, n->inputs[1]) && loop_vec_check(v, n->inputs[2]);
+
+        case TB_AND:
+        case TB_OR:
+        case TB_XOR:
+        case TB_ADD:
+        case TB_SUB:
+        return elem.type == TB_INT && loop_vec_check(v, n->inputs[1]) && loop_vec_check(v, n->inputs[2]);
+
+        // SSE2 only has the 16bit lane multiply
+        case TB_MUL:
+        return elem.type == TB_INT && elem.data == 16 && loop_vec_check(v, n->inputs[1]) && loop_vec_check(v, n->inputs[2]);
+
+        default:
+        return false;
+    }
+}
+
+static TB_Node* loop_vec_build(LoopVec* v, TB_Node* n) {
+    TB_Passes* p = v->ctx->p;
+    TB_Function* f = v->ctx->f;
+    if (n->gvn < v->cap && v->map[n->gvn] != NULL) {
+        return v->map[n->gvn];
+    }
+
+    TB_DataType vdt = v->elem;
+    vdt.width = v->width;
+
+    TB_Node* k;
+    if (loop_is_invariant(v->ctx, v->header, n, 0)) {
+        TB_Node* src = n;
+        if (!TB_DATA_TYPE_EQUALS(n->dt, v->elem)) {
+            if (n->type == TB_INTEGER_CONST) {
+                src = make_int_node(f, p, v->elem, TB_NODE_GET_EXTRA_T(n, TB_NodeInt)->value & tb__mask(v->elem.data));
+            } else {
+                src = tb_alloc_node(f, TB_TRUNCATE, v->elem, 2, 0);
+                set_input(p, src, n, 1);
+                tb_pass_mark(p, src);
+            }
+        }
+
+        k = tb_alloc_node(f, TB_VBROADCAST, vdt, 2, 0);
+        set_input(p, k, src, 1);
+    } else if (n->type == TB_LOAD) {
+        TB_Node* addr = n->inputs[2];
+        TB_Node* vaddr = v->map[addr->gvn];
+        if (vaddr == NULL) {
+            vaddr = tb_alloc_node(f, TB_ARRAY_ACCESS, addr->dt, 3, sizeof(TB_NodeArray));
+            set_input(p, vaddr, addr->inputs[1], 1);
+            set_input(p, vaddr, v->vindex, 2);
+            TB_NODE_SET_EXTRA(vaddr, TB_NodeArray, .stride = TB_NODE_GET_EXTRA_T(addr, TB_NodeArray)->stride);
+            tb_pass_mark(p, vaddr);
+            v->map[addr->gvn] = vaddr;
+        }
+
+        k = tb_alloc_node(f, TB_LOAD, vdt, 3, sizeof(TB_NodeMemAccess));
+        set_input(p, k, v->vbody, 0);
+        set_input(p, k, v->vmem, 1);
+        set_input(p, k, vaddr, 2);
+        TB_NODE_SET_EXTRA(k, TB_NodeMemAccess, .align = TB_NODE_GET_EXTRA_T(n, TB_NodeMemAccess)->align);
+    } else if (n->type == TB_SIGN_EXT || n->type == TB_ZERO_EXT || n->type == TB_TRUNCATE) {
+        k = loop_vec_build(v, n->inputs[1]);
+    } else if (n->type >= TB_FADD && n->type <= TB_FMIN) {
+        k = tb_alloc_node(f, n->type, vdt, 3, 0);
+        set_input(p, k, loop_vec_build(v, n->inputs[1]), 1);
+        set_input(p, k, loop_vec_build(v, n->inputs[2]), 2);
+    } else {
+        // narrowed lanes can wrap where the original couldn't, drop the flags
+        k = tb_alloc_node(f, n->type, vdt, 3, sizeof(TB_NodeBinopInt));
+        set_input(p, k, loop_vec_build(v, n->inputs[1]), 1);
+        set_input(p, k, loop_vec_build(v, n->inputs[2]), 2);
+        TB_NODE_SET_EXTRA(k, TB_NodeBinopInt, .ab = 0);
+    }
+
+    tb_pass_mark(p, k);
+    v->map[n->gvn] = k;
+    return k;
+}
+
+static TB_Node* loop_new_block(LoopOpt* ctx, size_t preds) {
+    TB_Node* bb = tb_alloc_node(ctx->f, TB_REGION, TB_TYPE_CONTROL, preds, sizeof(TB_NodeRegion));
+    tb_pass_mark(ctx->p, bb);
+    return bb;
+}
+
+// ends bb with an if (or a goto when cond is NULL), the projections are
+// plugged into the given slots of the successors.
+static void loop_new_branch(LoopOpt* ctx, TB_Node* bb, const char* tag, TB_Node* cond, TB_Node* t, int t_slot, TB_Node* e, int e_slot) {
+    TB_Passes* p = ctx->p;
+    TB_Function* f = ctx->f;
+
+    int succ_count = cond ? 2 : 1;
+    TB_Node* br = tb_alloc_node(f, TB_BRANCH, TB_TYPE_TUPLE, succ_count, sizeof(TB_NodeBranch) + (succ_count - 1) * sizeof(int64_t));
+    set_input(p, br, bb, 0);
+    if (cond) {
+        set_input(p, br, cond, 1);
+    }
+
+    TB_NodeBranch* info = TB_NODE_GET_EXTRA(br);
+    info->succ_count = succ_count;
+    info->succ = tb_arena_alloc(f->arena, succ_count * sizeof(TB_Node*));
+    info->succ[0] = t;
+    set_input(p, t, make_proj_node(f, p, TB_TYPE_CONTROL, br, 0), t_slot);
+    if (cond) {
+        info->keys[0] = 0;
+        info->succ[1] = e;
+        set_input(p, e, make_proj_node(f, p, TB_TYPE_CONTROL, br, 1), e_slot);
+    }
+
+    TB_NODE_SET_EXTRA(bb, TB_NodeRegion, .end = br, .tag = tag, .postorder_id = -1, .dom_depth = -1);
+    tb_pass_mark(p, br);
+}
+
+static TB_Node* loop_new_phi(LoopOpt* ctx, TB_Node* bb, TB_DataType dt, TB_Node* a, TB_Node* b) {
+    TB_Node* phi = tb_alloc_node(ctx->f, TB_PHI, dt, 3, 0);
+    set_input(ctx->p, phi, bb, 0);
+    set_input(ctx->p, phi, a, 1);
+    set_input(ctx->p, phi, b, 2);
+    tb_pass_mark(ctx->p, phi);
+    return phi;
+}
+
+static TB_Node* loop_new_op(LoopOpt* ctx, TB_NodeType type, TB_DataType dt, TB_Node* a, TB_Node* b) {
+    TB_Node* n;
+    if (type >= TB_CMP_EQ && type <= TB_CMP_FLE) {
+        n = tb_alloc_node(ctx->f, type, TB_TYPE_BOOL, 3, sizeof(TB_NodeCompare));
+        TB_NODE_SET_EXTRA(n, TB_NodeCompare, .cmp_dt = a->dt);
+    } else if (b == NULL) {
+        n = tb_alloc_node(ctx->f, type, dt, 2, 0);
+    } else {
+        n = tb_alloc_node(ctx->f, type, dt, 3, sizeof(TB_NodeBinopInt));
+        TB_NODE_SET_EXTRA(n, TB_NodeBinopInt, .ab = 0);
+    }
+
+    set_input(ctx->p, n, a, 1);
+    if (b) {
+        set_input(ctx->p, n, b, 2);
+    }
+    tb_pass_mark(ctx->p, n);
+    return n;
+}
+
+static bool loop_vectorize(LoopOpt* ctx, TB_Node* header) {
+    TB_Passes* p = ctx->p;
+    TB_Function* f = ctx->f;
+
+    LoopSimple l;
+    if (!loop_simple_shape(ctx, header, &l) || l.body_i != 0) {
+        return false;
+    }
+
+    // the only state carried around the loop is the IV and memory
+    LoopIV iv = { 0 };
+    TB_Node* mem = NULL;
+    FOR_USERS(use, header) {
+        TB_Node* n = use->n;
+        if (n == l.br) continue;
+        if (n->type != TB_PHI || use->slot != 0) return false;
+
+        if (n->dt.type == TB_MEMORY && mem == NULL) {
+            mem = n;
+        } else if (iv.phi == NULL && loop_find_iv(header, n, l.entry, l.backedge, &iv) && iv.step == 1) {
+            // found it
+        } else {
+            return false;
+        }
+    }
+
+    if (mem == NULL || iv.phi == NULL) {
+        return false;
+    }
+
+    // iv < n
+    TB_Node* cmp = l.br->inputs[1];
+    if ((cmp->type != TB_CMP_SLT && cmp->type != TB_CMP_ULT) || cmp->inputs[1] != iv.phi ||
+        !loop_is_invariant(ctx, header, cmp->inputs[2], 0)) {
+        return false;
+    }
+
+    // short loops are better off unrolled
+    if (loop_trip_count(header, l.entry, l.backedge, cmp, true) >= 0) {
+        return false;
+    }
+
+    // only effect in the body is the one store
+    TB_Node* st = mem->inputs[1 + l.backedge];
+    if (st->type != TB_STORE || st->inputs[0] != l.body || st->inputs[1] != mem) {
+        return false;
+    }
+
+    FOR_USERS(use, l.body) {
+        TB_Node* n = use->n;
+        if (n != l.goto_b && n != st && n->type != TB_LOAD) return false;
+    }
+
+    TB_Node* addr = st->inputs[2];
+    TB_Node* val = st->inputs[3];
+    int elem_size = loop_vec_elem_size(val->dt);
+    if (elem_size == 0 || addr->type != TB_ARRAY_ACCESS) {
+        return false;
+    }
+
+    // the index is the IV or a widened IV which doesn't wrap
+    TB_Node* index = addr->inputs[2];
+    TB_ArithmeticBehavior ab = TB_NODE_GET_EXTRA_T(iv.next, TB_NodeBinopInt)->ab;
+    if (index != iv.phi || iv.phi->dt.data != 64) {
+        if (!((index->type == TB_SIGN_EXT && (ab & TB_ARITHMATIC_NSW)) || (index->type == TB_ZERO_EXT && (ab & TB_ARITHMATIC_NUW))) ||
+            index->inputs[1] != iv.phi || index->dt.data != 64) {
+            return false;
         }
+    }
+
+    int lanes = LOOP_VECTOR_BYTES / elem_size;
+    LoopVec v = {
+        .ctx = ctx, .header = header, .mem = mem,
+        .index = index, .store_base = addr->inputs[1],
+        .elem = val->dt, .width = tb_ffs(lanes) - 1,
+        .budget = LOOP_VECTORIZE_MAX_NODES,
+    };
+
+    if (!loop_vec_access(&v, addr) || !loop_vec_check(&v, val)) {
+        dyn_array_destroy(v.bases);
+        return false;
+    }
+
+    DO_IF(TB_OPTDEBUG_LOOP)(printf("loop v%u: vectorized by %d (%zu overlap checks)\n", header->gvn, lanes, dyn_array_length(v.bases)));
+
+    TB_Node* pre = header->inputs[l.entry];
+    TB_NodeBranch* pre_br = TB_NODE_GET_EXTRA(pre->inputs[0]);
+    TB_Node* mem_init = mem->inputs[1 + l.entry];
+    bool guarded = dyn_array_length(v.bases) > 0;
+
+    TB_Node* vhead = loop_new_block(ctx, 2);
+    TB_Node* vbody = loop_new_block(ctx, 1);
+    TB_Node* merge = loop_new_block(ctx, guarded ? 2 : 1);
+
+    // the preheader now enters the guard (or the vector loop directly)
+    TB_Node* into = guarded ? loop_new_block(ctx, 1) : vhead;
+    FOREACH_N(j, 0, pre_br->succ_count) {
+        if (pre_br->succ[j] == header) pre_br->succ[j] = into;
+    }
+    set_input(p, into, pre, 0);
+
+    if (guarded) {
+        // storing to dst and loading from src only goes wrong when a lane's
+        // store lands on a later lane's load within the same vector:
+        //   0 < dst - src < L*size  =>  (dst - src - 1) >=u L*size - 1 is safe
+        TB_Node* dst = loop_new_op(ctx, TB_PTR2INT, TB_TYPE_I64, v.store_base, NULL);
+        TB_Node* safe = NULL;
+        dyn_array_for(i, v.bases) {
+            TB_Node* src = loop_new_op(ctx, TB_PTR2INT, TB_TYPE_I64, v.bases[i], NULL);
+            TB_Node* diff = loop_new_op(ctx, TB_SUB, TB_TYPE_I64, dst, src);
+            diff = loop_new_op(ctx, TB_SUB, TB_TYPE_I64, diff, make_int_node(f, p, TB_TYPE_I64, 1));
+
+            TB_Node* c = loop_new_op(ctx, TB_CMP_ULE, TB_TYPE_BOOL, make_int_node(f, p, TB_TYPE_I64, LOOP_VECTOR_BYTES - 1), diff);
+            safe = safe ? loop_new_op(ctx, TB_AND, TB_TYPE_BOOL, safe, c) : c;
+        }
+
+        loop_new_branch(ctx, into, "vec.guard", safe, vhead, 0, merge, 1);
+    }
+
+    // vector header: run while every lane is in bounds, that's done
+    // in 64bit so it can't wrap.
+    TB_Node* vi = loop_new_phi(ctx, vhead, iv.phi->dt, iv.init, NULL);
+    TB_Node* vmem = loop_new_phi(ctx, vhead, TB_TYPE_MEMORY, mem_init, NULL);
+    {
+        TB_Node* bound = cmp->inputs[2];
+        TB_Node* wide = vi;
+        if (iv.phi->dt.data != 64) {
+            TB_NodeType ext = cmp->type == TB_CMP_SLT ? TB_SIGN_EXT : TB_ZERO_EXT;
+            wide = loop_new_op(ctx, ext, TB_TYPE_I64, vi, NULL);
+            bound = loop_new_op(ctx, ext, TB_TYPE_I64, bound, NULL);
+        }
+
+        TB_Node* last = loop_new_op(ctx, TB_ADD, TB_TYPE_I64, wide, make_int_node(f, p, TB_TYPE_I64, lanes - 1));
+        TB_Node* vcmp = loop_new_op(ctx, cmp->type, TB_TYPE_BOOL, last, bound);
+        loop_new_branch(ctx, vhead, "vec.header", vcmp, vbody, 0, merge, 0);
+    }
 
-        // Loop rotation is not fun:
-        //
-        //       header         header:                    header:
-        //         |              ...                        ...
-        //         v              if (A) body else exit      if (A) body else exit
-        //     +->body->exit    body:                      body:
-        //     |   |              ...                        ...
-        //     |   v              jmp body                   if (A) body else exit
-        //     +-latch          exit:                      exit:
-        //
-        TB_Node* cond = br->inputs[1];
-        TB_Node* exit = br_info->succ[exit_i];
-        TB_Node* body = br_info->succ[1 - exit_i];
-
-        // move phi nodes from the header to the body
-        User* use = find_users(p, header);
-        while (use != NULL) {
-            User* next = use->next;
-            if (use->n->type == TB_PHI) {
-                set_input(p, use->n, body, 0);
+    // vector body
+    v.vbody = vbody, v.vmem = vmem;
+    v.vindex = index == iv.phi ? vi : loop_new_op(ctx, index->type, index->dt, vi, NULL);
+    v.cap = f->node_count;
+    v.map = tb_arena_alloc(tmp_arena, v.cap * sizeof(TB_Node*));
+    memset(v.map, 0, v.cap * sizeof(TB_Node*));
+    {
+        TB_Node* vaddr = tb_alloc_node(f, TB_ARRAY_ACCESS, addr->dt, 3, sizeof(TB_NodeArray));
+        set_input(p, vaddr, v.store_base, 1);
+        set_input(p, vaddr, v.vindex, 2);
+        TB_NODE_SET_EXTRA(vaddr, TB_NodeArray, .stride = elem_size);
+        tb_pass_mark(p, vaddr);
+        v.map[addr->gvn] = vaddr;
+
+        TB_Node* vst = tb_alloc_node(f, TB_STORE, TB_TYPE_MEMORY, 4, sizeof(TB_NodeMemAccess));
+        set_input(p, vst, vbody, 0);
+        set_input(p, vst, vmem, 1);
+        set_input(p, vst, vaddr, 2);
+        set_input(p, vst, loop_vec_build(&v, val), 3);
+        TB_NODE_SET_EXTRA(vst, TB_NodeMemAccess, .align = TB_NODE_GET_EXTRA_T(st, TB_NodeMemAccess)->align);
+        tb_pass_mark(p, vst);
+
+        TB_Node* vnext = loop_new_op(ctx, TB_ADD, iv.phi->dt, vi, make_int_node(f, p, iv.phi->dt, lanes));
+        TB_NODE_GET_EXTRA_T(vnext, TB_NodeBinopInt)->ab = ab;
+
+        set_input(p, vi, vnext, 2);
+        set_input(p, vmem, vst, 2);
+        loop_new_branch(ctx, vbody, "vec.body", NULL, vhead, 1, NULL, 0);
+    }
+
+    // whatever's left goes through the scalar loop
+    TB_Node* mi = vi;
+    TB_Node* mm = vmem;
+    if (guarded) {
+        mi = loop_new_phi(ctx, merge, iv.phi->dt, vi, iv.init);
+        mm = loop_new_phi(ctx, merge, TB_TYPE_MEMORY, vmem, mem_init);
+    }
+    loop_new_branch(ctx, merge, "vec.exit", NULL, header, l.entry, NULL, 0);
+
+    set_input(p, iv.phi, mi, 1 + l.entry);
+    set_input(p, mem, mm, 1 + l.entry);
+    tb_pass_mark(p, iv.phi);
+    tb_pass_mark(p, mem);
+    tb_pass_mark(p, header);
+
+    tb_arena_free(tmp_arena, v.map, v.cap * sizeof(TB_Node*));
+    dyn_array_destroy(v.bases);
+    return true;
+}
+
+////////////////////////////////
+// Full unrolling
+////////////////////////////////
+typedef struct {
+    LoopOpt* ctx;
+    TB_Node *header, *body;
+
+    size_t cap;
+    // 0 = unknown, 1 = outside the loop, 2 = in the loop
+    uint8_t* state;
+    TB_Node** map;
+
+    DynArray(TB_Node*) order;
+} LoopClone;
+
+static bool loop_in_body(LoopClone* c, TB_Node* n) {
+    if (n == c->header || n == c->body) return true;
+    if (n->gvn >= c->cap) return false;
+    if (c->state[n->gvn]) return c->state[n->gvn] == 2;
+
+    // the loop is just the header and body so any other PHI is from outside
+    bool in_loop = false;
+    if (n->type == TB_PHI) {
+        in_loop = n->inputs[0] == c->header;
+    } else if (n->type != TB_START && n->type != TB_REGION) {
+        // mark it first, we'll stop at the header PHIs anyways
+        c->state[n->gvn] = 1;
+        FOREACH_N(i, 0, n->input_count) {
+            if (n->inputs[i] && loop_in_body(c, n->inputs[i])) in_loop = true;
+        }
+    }
+
+    c->state[n->gvn] = in_loop ? 2 : 1;
+    return in_loop;
+}
+
+// postorder over the nodes in the body that need copies, header PHIs are
+// handled separately since they become the values from the last iteration.
+static void loop_collect_body(LoopClone* c, Worklist* ws, TB_Node* n) {
+    if (n == c->header || n == c->body || (n->type == TB_PHI && n->inputs[0] == c->header)) return;
+    if (!loop_in_body(c, n) || worklist_test_n_set(ws, n)) return;
+
+    FOREACH_N(i, 0, n->input_count) if (n->inputs[i]) {
+        loop_collect_body(c, ws, n->inputs[i]);
+    }
+    dyn_array_put(c->order, n);
+}
+
+static TB_Node* loop_get(LoopClone* c, TB_Node* copy_bb, TB_Node* n) {
+    if (n == c->header || n == c->body) return copy_bb;
+    if (n->gvn < c->cap && c->map[n->gvn] != NULL) return c->map[n->gvn];
+    return n;
+}
+
+// simple loops (see loop_simple_shape) where the condition is (iv cmp k)
+// with a known trip count get copied out N times and the header falls
+// straight into the exit.
+static bool loop_unroll(LoopOpt* ctx, TB_Node* header) {
+    TB_Passes* p = ctx->p;
+    TB_Function* f = ctx->f;
+
+    LoopSimple l;
+    if (!loop_simple_shape(ctx, header, &l)) {
+        return false;
+    }
+
+    int entry = l.entry, backedge = l.backedge, body_i = l.body_i;
+    TB_Node *br_h = l.br, *body = l.body, *goto_b = l.goto_b, *exit = l.exit;
+
+    // the header runs once after unrolling, it can't have effects of its own
+    FOR_USERS(use, header) {
+        TB_Node* n = use->n;
+        if (n != br_h && n->type != TB_PHI && n->type != TB_LOAD) return false;
+    }
+
+    int trips = loop_trip_count(header, entry, backedge, br_h->inputs[1], body_i == 0);
+    if (trips <= 0) {
+        return false;
+    }
+
+    DynArray(TB_Node*) phis = NULL;
+    FOR_USERS(use, header) {
+        if (use->n->type == TB_PHI && use->slot == 0) dyn_array_put(phis, use->n);
+    }
+
+    LoopClone c = { ctx, header, body, f->node_count };
+    c.state = tb_arena_alloc(tmp_arena, c.cap * sizeof(uint8_t));
+    c.map = tb_arena_alloc(tmp_arena, c.cap * sizeof(TB_Node*));
+    memset(c.state, 0, c.cap * sizeof(uint8_t));
+    memset(c.map, 0, c.cap * sizeof(TB_Node*));
+
+    Worklist ws;
+    worklist_alloc(&ws, c.cap);
+    loop_collect_body(&c, &ws, goto_b->inputs[0]);
+    dyn_array_for(i, phis) {
+        loop_collect_body(&c, &ws, phis[i]->inputs[1 + backedge]);
+    }
+
+    // everything pinned to the body must be part of what we copy
+    bool ok = dyn_array_length(c.order) * trips <= LOOP_UNROLL_MAX_NODES;
+    FOR_USERS(use, body) {
+        if (use->n != goto_b && !worklist_test(&ws, use->n)) { ok = false; break; }
+    }
+
+    dyn_array_for(i, c.order) {
+        TB_Node* n = c.order[i];
+        size_t extra;
+        if (n->dt.type == TB_TUPLE || n->type == TB_PROJ || n->type == TB_PHI || n->type == TB_LOCAL || !clone_extra_bytes(n, &extra)) {
+            ok = false;
+            break;
+        }
+    }
+
+    if (ok) {
+        DO_IF(TB_OPTDEBUG_LOOP)(printf("loop v%u: unrolled %d times (%zu nodes)\n", header->gvn, trips, dyn_array_length(c.order)));
+
+        size_t phi_count = dyn_array_length(phis);
+        TB_Node** vals = tb_arena_alloc(tmp_arena, phi_count * sizeof(TB_Node*));
+        FOREACH_N(j, 0, phi_count) {
+            vals[j] = phis[j]->inputs[1 + entry];
+        }
+
+        // the preheader jumps into the first copy now
+        TB_Node* into = header->inputs[entry];
+        TB_NodeBranch* pre_br = TB_NODE_GET_EXTRA(into->inputs[0]);
+        TB_Node* prev_goto = NULL;
+
+        FOREACH_N(k, 0, trips) {
+            TB_Node* bb = tb_alloc_node(f, TB_REGION, TB_TYPE_CONTROL, 1, sizeof(TB_NodeRegion));
+            if (k == 0) {
+                FOREACH_N(j, 0, pre_br->succ_count) {
+                    if (pre_br->succ[j] == header) pre_br->succ[j] = bb;
+                }
+                set_input(p, bb, into, 0);
+            } else {
+                TB_NODE_GET_EXTRA_T(prev_goto, TB_NodeBranch)->succ[0] = bb;
+                set_input(p, bb, make_proj_node(f, p, TB_TYPE_CONTROL, prev_goto, 0), 0);
+            }
+
+            // the header PHIs are whatever the last trip left us
+            FOREACH_N(j, 0, phi_count) {
+                c.map[phis[j]->gvn] = vals[j];
+            }
+
+            dyn_array_for(i, c.order) {
+                TB_Node* n = c.order[i];
+                size_t extra;
+                clone_extra_bytes(n, &extra);
+
+                TB_Node* clone = tb_alloc_node(f, n->type, n->dt, n->input_count, extra);
+                memcpy(clone->extra, n->extra, extra);
+                FOREACH_N(j, 0, n->input_count) if (n->inputs[j]) {
+                    set_input(p, clone, loop_get(&c, bb, n->inputs[j]), j);
+                }
+
+                c.map[n->gvn] = clone;
+                tb_pass_mark(p, clone);
+            }
+
+            FOREACH_N(j, 0, phi_count) {
+                vals[j] = loop_get(&c, bb, phis[j]->inputs[1 + backedge]);
             }
-            use = next;
+
+            TB_Node* br = tb_alloc_node(f, TB_BRANCH, TB_TYPE_TUPLE, 1, sizeof(TB_NodeBranch));
+            set_input(p, br, loop_get(&c, bb, goto_b->inputs[0]), 0);
+
+            TB_NodeBranch* info = TB_NODE_GET_EXTRA(br);
+            info->succ_count = 1;
+            info->succ = tb_arena_alloc(f->arena, sizeof(TB_Node*));
+            info->succ[0] = header;
+
+            TB_NODE_SET_EXTRA(bb, TB_NodeRegion, .end = br, .tag = "loop.unrolled", .postorder_id = -1, .dom_depth = -1);
+            tb_pass_mark(p, bb);
+            tb_pass_mark(p, br);
+            prev_goto = br;
+        }
+
+        // the last copy enters the header which now just leaves, the old body
+        // dies and the peepholes fold the header into the last copy.
+        set_input(p, header, make_proj_node(f, p, TB_TYPE_CONTROL, prev_goto, 0), entry);
+        FOREACH_N(j, 0, phi_count) {
+            set_input(p, phis[j], vals[j], 1 + entry);
+            tb_pass_mark(p, phis[j]);
         }
 
-        DO_IF(TB_OPTDEBUG_LOOP)(r->tag = lil_name(f, "loop.header.%d", i));
-        br_info->succ_count = 1;
-        br_info->succ[0] = body;
+        transmute_goto(p, f, br_h, exit);
+
+        // cut the backedge now rather than leaving it to the peepholes, we're
+        // about to recompute dominators and a dead predecessor confuses them.
+        TB_NODE_GET_EXTRA_T(goto_b, TB_NodeBranch)->succ_count = 0;
+        remove_pred(p, f, body, header);
+        tb_pass_mark(p, body);
+        tb_arena_free(tmp_arena, vals, phi_count * sizeof(TB_Node*));
+    }
+
+    worklist_free(&ws);
+    dyn_array_destroy(c.order);
+    dyn_array_destroy(phis);
+    tb_arena_free(tmp_arena, c.map, c.cap * sizeof(TB_Node*));
+    tb_arena_free(tmp_arena, c.state, c.cap * sizeof(uint8_t));
+    return ok;
+}
 
-        // duplicate condition for backedge
-        bool n;
-        TB_Node* dupped_cond = clone_node(p, f, header, cond, &n);
-        set_input(p, br, dupped_cond, 0);
+void tb_pass_loop(TB_Passes* p) {
+    cuikperf_region_start("loop", NULL);
+    verify_tmp_arena(p);
 
-        // backedge needs to refer to the body not the header
-        TB_Node* backedge_br = backedge_proj->inputs[0];
-        TB_NodeBranch* backedge_br_info = TB_NODE_GET_EXTRA(backedge_br);
-        DO_IF(TB_OPTDEBUG_LOOP)(backedge->tag = lil_name(f, "loop.back.%d", i));
+    TB_Function* f = p->f;
+    LoopOpt ctx = { .p = p, .f = f };
+    worklist_alloc(&ctx.blocks, f->node_count);
 
-        backedge_br_info->succ_count = 2;
-        backedge_br_info->succ = alloc_from_node_arena(f, 2 * sizeof(TB_Node*));
-        backedge_br_info->succ[0] = body;
-        backedge_br_info->succ[1] = exit;
+    CUIK_TIMED_BLOCK("canonicalize") {
+        loop_compute_cfg(&ctx);
 
-        // backedge should now point into the body
-        add_region_pred_tracked(p, f, body, backedge_proj);
-        add_region_pred_tracked(p, f, exit, backedge_proj);
+        // new blocks don't get pushed onto the postorder so we can keep walking it
+        bool changed = false;
+        FOREACH_N(i, 0, ctx.block_count) {
+            changed |= loop_canonicalize(&ctx, ctx.blocks.items[i]);
+        }
 
-        {
-            TB_Node* old = backedge_br->inputs[0];
+        if (changed) {
+            loop_compute_cfg(&ctx);
+        }
+    }
 
-            backedge_br->input_count = 2;
-            backedge_br->inputs = alloc_from_node_arena(f, 2 * sizeof(TB_Node*));
-            backedge_br->inputs[0] = old;
+    CUIK_TIMED_BLOCK("vectorize") {
+        bool changed = false;
+        FOREACH_N(i, 0, ctx.block_count) {
+            changed |= loop_vectorize(&ctx, ctx.blocks.items[i]);
+        }
 
-            add_user(p, backedge_br, cond, 1, NULL);
-            backedge_br->inputs[1] = cond;
+        if (changed) {
+            loop_compute_cfg(&ctx);
         }
+    }
 
-        // the other path leaves the loop
-        {
-            TB_Node* proj = tb_alloc_node(f, TB_PROJ, TB_TYPE_CONTROL, 1, sizeof(TB_NodeProj));
-            set_input(p, proj, backedge_proj->inputs[0], 0);
-            TB_NODE_SET_EXTRA(proj, TB_NodeProj, .index = 1);
-            add_region_pred_tracked(p, f, exit, proj);
+    CUIK_TIMED_BLOCK("strength reduce") {
+        FOREACH_N(i, 0, ctx.block_count) {
+            loop_strength_reduce(&ctx, ctx.blocks.items[i]);
         }
+    }
 
-        if (backedges[0] == 1) {
-            set_input(p, header, header->inputs[1 - backedges[0]], 0);
+    // each unroll changes the CFG so we recompute it and start over, inner
+    // loops come first in the postorder so they get flattened first.
+    CUIK_TIMED_BLOCK("unroll") {
+        bool progress = true;
+        while (progress) {
+            progress = false;
+            FOREACH_N(i, 0, ctx.block_count) {
+                if (loop_unroll(&ctx, ctx.blocks.items[i])) {
+                    loop_compute_cfg(&ctx);
+                    progress = true;
+                    break;
+                }
+            }
         }
-        header->input_count = 1;
     }
 
-    tb_function_print(f, tb_default_print_callback, stdout);
-    return false;
+    worklist_free(&ctx.blocks);
+    cuikperf_region_end();
 }
-#endif
@@ -33,6 +33,10 @@ typedef struct Mem2Reg_Ctx {
 
     // [to_promote_count]
     Mem2Reg_Def* defs;
+
+    // PHIs we inserted, a stored value can be a PHI too so
+    // the node type alone doesn't tell them apart.
+    NL_HashSet phis;
 } Mem2Reg_Ctx;
 
 static int bits_in_data_type(int pointer_size, TB_DataType dt);
@@ -63,9 +67,15 @@ static TB_Node* new_phi(Mem2Reg_Ctx* restrict c, TB_Function* f, int var, TB_Nod
 
     DO_IF(TB_OPTDEBUG_MEM2REG)(log_debug("%p: insert new PHI node (in %p)", n, block));
     tb_pass_mark(c->p, n);
+    nl_hashset_put(&c->phis, n);
     return n;
 }
 
+static bool is_new_phi(Mem2Reg_Ctx* restrict c, TB_Node* n) {
+    size_t i = nl_hashset_lookup(&c->phis, n);
+    return i != SIZE_MAX && (i & NL_HASHSET_HIGH_BIT);
+}
+
 static void add_phi_operand(Mem2Reg_Ctx* restrict c, TB_Function* f, TB_Node* phi_node, TB_Node* bb, TB_Node* node) {
     // we're using NULL nodes as the baseline PHI0
     if (phi_node == node) {
@@ -81,14 +91,14 @@ static void add_phi_operand(Mem2Reg_Ctx* restrict c, TB_Function* f, TB_Node* ph
     TB_Node* phi_region = phi_node->inputs[0];
     DO_IF(TB_OPTDEBUG_MEM2REG)(log_debug("%p: adding %p to PHI", phi_node, node));
 
-    // the slot to fill is based on the predecessor list of the region
+    // the slot to fill is based on the predecessor list of the region, a block can
+    // show up more than once there (both sides of a branch to the same place).
     FOREACH_N(i, 0, phi_region->input_count) {
         TB_Node* pred = phi_region->inputs[i];
         while (pred->type != TB_REGION && pred->type != TB_START) pred = pred->inputs[0];
 
         if (pred == bb) {
             set_input(c->p, phi_node, node, i+1);
-            break;
         }
     }
 
@@ -110,13 +120,13 @@ static void ssa_replace_phi_arg(Mem2Reg_Ctx* c, TB_Function* f, TB_Node* bb, TB_
         if (search < 0) continue;
 
         TB_Node* phi_reg = c->defs[var][search].v;
-        if (phi_reg->type != TB_PHI) continue;
+        if (!is_new_phi(c, phi_reg)) continue;
 
         TB_Node* top;
         if (dyn_array_length(stack[var]) == 0) {
             // this is UB land, insert poison
             log_warn("%s: ir: generated poison due to read of uninitialized local", f->super.name);
-            top = make_poison(f, c->p, TB_TYPE_VOID);
+            top = make_poison(f, c->p, phi_reg->dt);
         } else {
             top = stack[var][dyn_array_length(stack[var]) - 1];
         }
@@ -163,8 +173,10 @@ static void ssa_rename_node(Mem2Reg_Ctx* c, TB_Node* bb, TB_Node* n, DynArray(TB
         }
     }
 
-    // check for any loads and replace them
-    for (User* u = find_users(c->p, n); u; u = u->next) {
+    // check for any loads and replace them, backwards since unlinking a load
+    // swaps the last user into its place.
+    FOREACH_REVERSE_N(i, 0, n->user_count) {
+        User* u = &n->users[i];
         TB_Node* use = u->n;
 
         if (u->slot == 1 && use->type == TB_LOAD) {
@@ -174,7 +186,7 @@ static void ssa_rename_node(Mem2Reg_Ctx* c, TB_Node* bb, TB_Node* n, DynArray(TB
                 if (dyn_array_length(stack[var]) == 0) {
                     // this is UB since it implies we've read before initializing the
                     // stack slot.
-                    val = make_poison(c->f, c->p, TB_TYPE_VOID);
+                    val = make_poison(c->f, c->p, use->dt);
                     log_warn("%p: found load-before-init in mem2reg, this is UB", use);
                 } else {
                     val = stack[var][dyn_array_length(stack[var]) - 1];
@@ -213,12 +225,14 @@ static void ssa_rename(Mem2Reg_Ctx* c, TB_Function* f, TB_Node* bb, DynArray(TB_
     // push phi nodes
     size_t* old_len = tb_tls_push(c->tls, sizeof(size_t) * c->to_promote_count);
     FOREACH_N(var, 0, c->to_promote_count) {
+        // the phi is only visible to the blocks this one dominates, it
+        // gets popped along with everything else once we leave.
+        old_len[var] = dyn_array_length(stack[var]);
+
         ptrdiff_t search = nl_map_get(c->defs[var], bb);
-        if (search >= 0 && c->defs[var][search].v->type == TB_PHI) {
+        if (search >= 0 && is_new_phi(c, c->defs[var][search].v)) {
             dyn_array_put(stack[var], c->defs[var][search].v);
         }
-
-        old_len[var] = dyn_array_length(stack[var]);
     }
 
     // rewrite operations
@@ -292,7 +306,7 @@ static ptrdiff_t compatible_with_configs(size_t config_count, AggregateConfig* c
     FOREACH_N(i, 0, config_count) {
         int64_t max2 = configs[i].offset + configs[i].size;
 
-        if (offset >= configs[i].offset && max <= max2) {
+        if (offset < max2 && configs[i].offset < max) {
             // they overlap... but is it a clean overlap?
             if (offset == configs[i].offset && max == max2 && TB_DATA_TYPE_EQUALS(dt, configs[i].dt)) {
                 return i;
@@ -362,6 +376,10 @@ bool tb_pass_mem2reg(TB_Passes* p) {
                 DO_IF(TB_OPTDEBUG_MEM2REG)(log_debug("%s: %p could not mem2reg (data type is too inconsistent)", f->super.name, n));
                 break;
             }
+            case COHERENCY_DEAD: {
+                // nothing left to promote, the stores into it were all dead
+                break;
+            }
             default: tb_todo();
         }
     }
@@ -381,6 +399,7 @@ bool tb_pass_mem2reg(TB_Passes* p) {
 
     c.defs = tb_tls_push(c.tls, to_promote_count * sizeof(Mem2Reg_Def));
     memset(c.defs, 0, to_promote_count * sizeof(Mem2Reg_Def));
+    c.phis = nl_hashset_alloc(32);
 
     c.block_count = tb_push_postorder(f, &p->worklist);
     c.blocks = &p->worklist.items[0];
@@ -396,12 +415,27 @@ bool tb_pass_mem2reg(TB_Passes* p) {
     FOREACH_REVERSE_N(i, 0, c.block_count) {
         TB_Node* end = TB_NODE_GET_EXTRA_T(c.blocks[i], TB_NodeRegion)->end;
 
+        // don't walk past the block entry, branch projections don't stop it
+        // and we'd steal the predecessor's memory
         TB_Node* ctrl = end->inputs[0];
         TB_Node* latest_mem = NULL;
-        do {
+        for (;;) {
             latest_mem = mem_user(p, ctrl, 0);
+
+            // calls hand their memory out through a projection
+            if (latest_mem == NULL && is_effect_tuple(ctrl)) {
+                FOR_USERS(u, ctrl) {
+                    if (u->n->type == TB_PROJ && u->n->dt.type == TB_MEMORY) {
+                        latest_mem = u->n;
+                        break;
+                    }
+                }
+            }
+
+            if (latest_mem != NULL || ctrl == c.blocks[i]) break;
+            if (ctrl->type == TB_START || ctrl->type == TB_REGION) break;
             ctrl = ctrl->inputs[0];
-        } while (latest_mem == NULL && ctrl->type != TB_START && ctrl->type != TB_REGION);
+        }
 
         if (latest_mem) {
             for (;;) {
@@ -459,7 +493,7 @@ bool tb_pass_mem2reg(TB_Passes* p) {
                     } else {
                         phi_reg = c.defs[var][search].v;
 
-                        if (phi_reg->type != TB_PHI) {
+                        if (!is_new_phi(&c, phi_reg)) {
                             TB_Node* old_reg = phi_reg;
                             phi_reg = new_phi(&c, f, var, l, dt);
                             add_phi_operand(&c, f, phi_reg, l, old_reg);
@@ -489,6 +523,7 @@ bool tb_pass_mem2reg(TB_Passes* p) {
     }
 
     ssa_rename(&c, f, f->start_node, stack);
+    nl_hashset_free(c.phis);
 
     // don't need these anymore
     FOREACH_N(var, 0, c.to_promote_count) {
@@ -510,14 +545,14 @@ static bool sane_writer(TB_Node* n) {
 }
 
 // false means failure to SROA
-static bool add_configs(TB_Passes* p, TB_TemporaryStorage* tls, User* use, TB_Node* base_address, size_t base_offset, size_t* config_count, AggregateConfig* configs, int pointer_size) {
-    for (; use; use = use->next) {
+static bool add_configs(TB_Passes* p, TB_TemporaryStorage* tls, TB_Node* addr, TB_Node* base_address, size_t base_offset, size_t* config_count, AggregateConfig* configs, int pointer_size) {
+    FOR_USERS(use, addr) {
         TB_Node* n = use->n;
 
         if (n->type == TB_MEMBER_ACCESS && use->slot == 1) {
             // same rules, different offset
             int64_t offset = TB_NODE_GET_EXTRA_T(n, TB_NodeMember)->offset;
-            if (!add_configs(p, tls, find_users(p, n), base_address, base_offset + offset, config_count, configs, pointer_size)) {
+            if (!add_configs(p, tls, n, base_address, base_offset + offset, config_count, configs, pointer_size)) {
                 return false;
             }
             continue;
@@ -536,7 +571,7 @@ static bool add_configs(TB_Passes* p, TB_TemporaryStorage* tls, User* use, TB_No
 
         TB_DataType dt = n->type == TB_LOAD ? n->dt : n->inputs[3]->dt;
         TB_Node* address = n->inputs[2];
-        int size = (bits_in_data_type(pointer_size, dt) + 7) / 8;
+        int size = ((bits_in_data_type(pointer_size, dt) + 7) / 8) << dt.width;
 
         // see if it's a compatible configuration
         int match = compatible_with_configs(*config_count, configs, base_offset, size, dt);
@@ -569,14 +604,14 @@ void tb_pass_sroa(TB_Passes* p) {
 
         size_t config_count = 0;
         AggregateConfig* configs = tb_tls_push(tls, 0);
-        if (!add_configs(p, tls, find_users(p, address), address, 0, &config_count, configs, pointer_size)) {
+        if (!add_configs(p, tls, address, address, 0, &config_count, configs, pointer_size)) {
             TB_NODE_GET_EXTRA_T(address, TB_NodeLocal)->alias_index = 0;
             continue;
         }
 
         // split allocation into pieces
         if (config_count > 1) {
-            DO_IF(TB_OPTDEBUG_MEM2REG)(log_debug("%s: v%zu was able to SROA into %zu pieces", f->super.name, address->gvn, config_count));
+            DO_IF(TB_OPTDEBUG_MEM2REG)(log_debug("%s: v%u was able to SROA into %zu pieces", f->super.name, address->gvn, config_count));
 
             uint32_t alignment = TB_NODE_GET_EXTRA_T(address, TB_NodeLocal)->align;
             FOREACH_N(i, 0, config_count) {
@@ -602,8 +637,7 @@ void tb_pass_sroa(TB_Passes* p) {
 // NOTE(NeGate): a stack slot is coherent when all loads and stores share
 // the same type and alignment along with not needing any address usage.
 static Coherency tb_get_stack_slot_coherency(TB_Passes* p, TB_Function* f, TB_Node* address, TB_DataType* out_dt) {
-    User* use = find_users(p, address);
-    if (use == NULL) {
+    if (address->user_count == 0) {
         return COHERENCY_DEAD;
     }
 
@@ -616,22 +650,23 @@ static Coherency tb_get_stack_slot_coherency(TB_Passes* p, TB_Function* f, TB_No
     bool initialized = false;
     int dt_bits = 0;
 
-    for (; use; use = use->next) {
+    FOR_USERS(use, address) {
         TB_Node* n = use->n;
         if (n->type == TB_READ || n->type == TB_WRITE) {
             return COHERENCY_VOLATILE;
         } else if ((n->type == TB_LOAD || n->type == TB_STORE) && n->inputs[2] == address) {
             TB_DataType mem_dt = n->type == TB_LOAD ? n->dt : n->inputs[3]->dt;
+
+            // we're hoping all data types match in size to continue along
+            int bits = bits_in_data_type(pointer_size, mem_dt);
+            if (bits == 0 || (initialized && (bits != dt_bits || mem_dt.width != dt.width))) {
+                return COHERENCY_BAD_DATA_TYPE;
+            }
+
             if (!initialized) {
                 dt = mem_dt;
-                initialized = true;
-            } else {
-                // we're hoping all data types match in size to continue along
-                int bits = bits_in_data_type(pointer_size, mem_dt);
-                if (bits == 0 || (dt_bits > 0 && bits != dt_bits)) {
-                    return COHERENCY_BAD_DATA_TYPE;
-                }
                 dt_bits = bits;
+                initialized = true;
             }
         } else {
             DO_IF(TB_OPTDEBUG_MEM2REG)(log_debug("%p uses pointer arithmatic (%s)", address, tb_node_get_name(n)));
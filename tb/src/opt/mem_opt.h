@@ -1,6 +1,11 @@
 // Certain aliasing optimizations technically count as peepholes lmao, these can get fancy
 // so the sliding window notion starts to break down but there's no global analysis and
-// i can make them incremental technically so we'll go wit it.
+// i can make them incremental technically so we'll go wit it. the aliasing questions
+// themselves are answered by alias.h.
+//
+// how many memory effects we'll walk past before giving up
+enum { MEM_WALK_LIMIT = 16 };
+
 typedef struct {
     TB_Node* base;
     int64_t offset;
@@ -14,6 +19,42 @@ static KnownPointer known_pointer(TB_Node* n) {
     }
 }
 
+// bytes [offset, offset+size) of whatever a STORE or MEMSET wrote, only works when
+// it's a constant (or a broadcasted one) and size is at most 8.
+static bool known_mem_bytes(TB_Function* f, TB_Node* n, int64_t offset, int size, uint64_t* out) {
+    TB_Node* val = n->inputs[3];
+    int elem = 1;
+    if (n->type == TB_STORE) {
+        if (val->type == TB_VBROADCAST) {
+            val = val->inputs[1];
+        }
+
+        if (val->dt.type != TB_INT) {
+            return false;
+        }
+
+        int bits = bits_in_data_type(tb__find_code_generator(f->super.module)->pointer_size, val->dt);
+        if (bits == 0 || bits % 8 != 0) {
+            return false;
+        }
+        elem = bits / 8;
+    }
+
+    if (val->type != TB_INTEGER_CONST || size > 8) {
+        return false;
+    }
+
+    uint64_t c = TB_NODE_GET_EXTRA_T(val, TB_NodeInt)->value;
+    uint64_t result = 0;
+    FOREACH_N(i, 0, size) {
+        uint64_t byte = (c >> (8 * ((offset + i) % elem))) & 0xFF;
+        result |= byte << (8 * i);
+    }
+
+    *out = result;
+    return true;
+}
+
 static TB_Node* data_phi_from_memory_phi(TB_Passes* restrict p, TB_Function* f, TB_DataType dt, TB_Node* n, TB_Node* addr, TB_CharUnits* out_align) {
     assert(n->type == TB_PHI);
     assert(n->dt.type == TB_MEMORY && "memory input should be memory");
@@ -83,11 +124,49 @@ static TB_Node* ideal_load(TB_Passes* restrict p, TB_Function* f, TB_Node* n) {
         }
     }
 
+    // stores which can't touch the loaded bytes don't need to be waited on, if we
+    // find the one that wrote our bytes we just take the value. otherwise we can
+    // only skip the stores within our block since the anti-dependencies on those
+    // are what keeps us from sinking past whatever comes after them.
+    if (mem->type == TB_STORE || mem->type == TB_MEMSET) {
+        TB_Node* bb = n->inputs[0] ? tb_get_parent_region(n->inputs[0]) : NULL;
+        TB_Node* skip_to = mem;
+        TB_Node* m = mem;
+        for (int i = 0; i < MEM_WALK_LIMIT && (m->type == TB_STORE || m->type == TB_MEMSET); i++) {
+            AliasResult r = alias_mem_ops(p, n, m);
+            if (r == ALIAS_MUST && m->type == TB_STORE && m->inputs[3]->dt.raw == n->dt.raw && is_same_align(n, m)) {
+                return m->inputs[3];
+            }
+
+            // reading constant bytes out of a wider store or memset
+            uint64_t bytes;
+            int64_t size = alias_access_size(f, n);
+            if (n->dt.type == TB_INT && n->dt.width == 0 && alias_covers(p, m, n) &&
+                known_mem_bytes(f, m, alias_loc(addr).offset - alias_loc(m->inputs[2]).offset, size, &bytes)) {
+                return make_int_node(f, p, n->dt, bytes);
+            }
+
+            if (r != ALIAS_NO) {
+                break;
+            }
+
+            m = m->inputs[1];
+            if (skip_to->inputs[1] == m && bb != NULL && skip_to->inputs[0] != NULL && tb_get_parent_region(skip_to->inputs[0]) == bb) {
+                skip_to = m;
+            }
+        }
+
+        if (skip_to != mem) {
+            set_input(p, n, skip_to, 1);
+            return n;
+        }
+    }
+
     // if LOAD has already been safely accessed we can relax our control dependency
     if (n->inputs[0] != NULL && n->inputs[0]->type == TB_REGION && n->inputs[0]->input_count == 1) {
         TB_Node* parent_bb = get_block_begin(n->inputs[0]->inputs[0]);
 
-        for (User* u = find_users(p, parent_bb); u; u = u->next) {
+        FOR_USERS(u, parent_bb) {
             TB_Node* use = u->n;
             if (use != n && use->type == TB_LOAD && use->inputs[2] == addr) {
                 tb_pass_mark_users(p, get_block_begin(n->inputs[0]));
@@ -132,37 +211,249 @@ static TB_Node* identity_load(TB_Passes* restrict p, TB_Function* f, TB_Node* n)
     // god i need a pattern matcher
     //   (load (store X A Y) A) => Y
     TB_Node *mem = n->inputs[1], *addr = n->inputs[2];
-    if (mem->type == TB_STORE && mem->inputs[2] == addr &&
-        n->dt.raw == mem->inputs[3]->dt.raw && is_same_align(n, mem)) {
+    if (mem->type == TB_STORE && n->dt.raw == mem->inputs[3]->dt.raw && is_same_align(n, mem) &&
+        (mem->inputs[2] == addr || alias_mem_ops(p, n, mem) == ALIAS_MUST)) {
         return mem->inputs[3];
     }
 
     return n;
 }
 
-static TB_Node* ideal_store(TB_Passes* restrict p, TB_Function* f, TB_Node* n) {
-    TB_Node *mem = n->inputs[1], *addr = n->inputs[2], *val = n->inputs[3];
-    TB_DataType dt = val->dt;
-
-    // if a store has only one user in this chain it means it's only job was
-    // to facilitate the creation of that user store... if we can detect that
-    // user store is itself dead, everything in the middle is too.
-    /*while (mem->type == TB_STORE && single_use(p, mem)) {
-        if (mem->inputs[2] == addr && mem->inputs[3]->dt.raw == dt.raw && is_same_align(n, mem)) {
-            set_input(p, n, mem->inputs[1], 1);
+// if an earlier store or memset has us as its only user (possibly through others
+// which don't overlap with either of us) and we overwrite every byte of it, nobody
+// could've seen it.
+static TB_Node* ideal_dead_store(TB_Passes* restrict p, TB_Function* f, TB_Node* n) {
+    TB_Node* user = n;
+    TB_Node* mem = n->inputs[1];
+    for (int i = 0; i < MEM_WALK_LIMIT; i++) {
+        if ((mem->type != TB_STORE && mem->type != TB_MEMSET) || !single_use(p, mem)) break;
+
+        if (alias_covers(p, n, mem)) {
+            tb_pass_mark(p, mem);
+            tb_pass_mark(p, user);
+            set_input(p, user, mem->inputs[1], 1);
             return n;
+        } else if (alias_mem_ops(p, n, mem) != ALIAS_NO) {
+            break;
         }
 
+        user = mem;
         mem = mem->inputs[1];
-    }*/
+    }
 
     return NULL;
 }
 
+// adjacent integer constant stores in the same block get glued together:
+//   (store (store M A+4 hi) A lo) => (store M A lo | hi<<32)
+static TB_Node* ideal_merge_stores(TB_Passes* restrict p, TB_Function* f, TB_Node* n) {
+    TB_Node* prev = n->inputs[1];
+    TB_Node *val = n->inputs[3], *prev_val;
+    if (prev->type != TB_STORE || prev->inputs[0] != n->inputs[0] || !single_use(p, prev) ||
+        val->type != TB_INTEGER_CONST || val->dt.width != 0) {
+        return NULL;
+    }
+
+    prev_val = prev->inputs[3];
+    int bits = val->dt.data;
+    if (prev_val->type != TB_INTEGER_CONST || prev_val->dt.raw != val->dt.raw || (bits != 8 && bits != 16 && bits != 32)) {
+        return NULL;
+    }
+
+    AliasLoc l = alias_loc(n->inputs[2]);
+    AliasLoc prev_l = alias_loc(prev->inputs[2]);
+    if (l.base != prev_l.base || !l.known || !prev_l.known) {
+        return NULL;
+    }
+
+    TB_Node *lo, *hi;
+    if (prev_l.offset + bits/8 == l.offset) {
+        lo = prev, hi = n;
+    } else if (l.offset + bits/8 == prev_l.offset) {
+        lo = n, hi = prev;
+    } else {
+        return NULL;
+    }
+
+    uint64_t mask = UINT64_MAX >> (64 - bits);
+    uint64_t lo_val = TB_NODE_GET_EXTRA_T(lo->inputs[3], TB_NodeInt)->value & mask;
+    uint64_t hi_val = TB_NODE_GET_EXTRA_T(hi->inputs[3], TB_NodeInt)->value & mask;
+
+    TB_CharUnits align = TB_NODE_GET_EXTRA_T(n, TB_NodeMemAccess)->align;
+    TB_CharUnits prev_align = TB_NODE_GET_EXTRA_T(prev, TB_NodeMemAccess)->align;
+
+    TB_Node* k = tb_alloc_node(f, TB_STORE, TB_TYPE_MEMORY, 4, sizeof(TB_NodeMemAccess));
+    set_input(p, k, n->inputs[0], 0);
+    set_input(p, k, prev->inputs[1], 1);
+    set_input(p, k, lo->inputs[2], 2);
+    set_input(p, k, make_int_node(f, p, TB_TYPE_INTN(bits * 2), lo_val | (hi_val << bits)), 3);
+    TB_NODE_SET_EXTRA(k, TB_NodeMemAccess, .align = align < prev_align ? align : prev_align);
+
+    // once we replace n, prev is dead
+    tb_pass_mark(p, prev);
+    return k;
+}
+
+static TB_Node* ideal_store(TB_Passes* restrict p, TB_Function* f, TB_Node* n) {
+    TB_Node* k = ideal_dead_store(p, f, n);
+    return k ? k : ideal_merge_stores(p, f, n);
+}
+
+// works for STORE, MEMSET and MEMCPY
+static TB_Node* identity_store(TB_Passes* restrict p, TB_Function* f, TB_Node* n) {
+    TB_Node *mem = n->inputs[1], *addr = n->inputs[2];
+    if (n->type != TB_STORE && alias_access_size(f, n) == 0) {
+        return mem;
+    }
+
+    // LOCALs which are never read don't need their stores
+    AliasLoc l = alias_loc(addr);
+    if (l.base->type == TB_LOCAL && alias_never_read(p, l.base, ALIAS_ESCAPE_DEPTH)) {
+        return mem;
+    }
+
+    // storing back what we just loaded
+    //   (store M A (load M A)) => M
+    TB_Node* val = n->inputs[3];
+    if (n->type == TB_STORE && val->type == TB_LOAD && val->inputs[1] == mem && val->inputs[2] == addr) {
+        return mem;
+    }
+
+    // storing bytes which are already there
+    int64_t size = alias_access_size(f, n);
+    if (n->type == TB_STORE && size > 0 && size <= 8) {
+        uint64_t bytes;
+        if (!known_mem_bytes(f, n, 0, size, &bytes)) {
+            return n;
+        }
+
+        TB_Node* m = mem;
+        for (int i = 0; i < MEM_WALK_LIMIT && (m->type == TB_STORE || m->type == TB_MEMSET); i++) {
+            uint64_t prev_bytes;
+            if (alias_covers(p, m, n) && known_mem_bytes(f, m, l.offset - alias_loc(m->inputs[2]).offset, size, &prev_bytes)) {
+                return prev_bytes == bytes ? mem : n;
+            } else if (alias_mem_ops(p, n, m) != ALIAS_NO) {
+                break;
+            }
+
+            m = m->inputs[1];
+        }
+    }
+
+    return n;
+}
+
 static TB_Node* ideal_end(TB_Passes* restrict p, TB_Function* f, TB_Node* n) {
     return NULL;
 }
 
+// small MEMCPY and MEMSET with known sizes are just a few moves, we use 16byte
+// vector moves when the target's got them.
+enum { MEM_LOWER_LIMIT = 64 };
+
+static TB_Node* mem_lower_addr(TB_Passes* restrict p, TB_Function* f, TB_Node* base, int64_t offset) {
+    if (offset == 0) {
+        return base;
+    }
+
+    TB_Node* k = tb_alloc_node(f, TB_MEMBER_ACCESS, TB_TYPE_PTR, 2, sizeof(TB_NodeMember));
+    set_input(p, k, base, 1);
+    TB_NODE_SET_EXTRA(k, TB_NodeMember, .offset = offset);
+    tb_pass_mark(p, k);
+    return k;
+}
+
+static int mem_lower_chunk(TB_Function* f, uint64_t left) {
+    if (left >= 16 && f->super.module->target_arch == TB_ARCH_X86_64) return 16;
+    if (left >= 8) return 8;
+    if (left >= 4) return 4;
+    if (left >= 2) return 2;
+    return 1;
+}
+
+static TB_DataType mem_lower_type(int chunk) {
+    return chunk == 16 ? TB_TYPE_I64x2 : TB_TYPE_INTN(chunk * 8);
+}
+
+// the op's alignment might not hold further into it
+static TB_CharUnits mem_lower_align(TB_Node* n, uint64_t offset) {
+    TB_CharUnits align = TB_NODE_GET_EXTRA_T(n, TB_NodeMemAccess)->align;
+    while (align > 1 && offset % align != 0) {
+        align >>= 1;
+    }
+    return align;
+}
+
+static TB_Node* mem_lower_store(TB_Passes* restrict p, TB_Function* f, TB_Node* n, TB_Node* mem, uint64_t offset, TB_Node* val) {
+    TB_Node* k = tb_alloc_node(f, TB_STORE, TB_TYPE_MEMORY, 4, sizeof(TB_NodeMemAccess));
+    set_input(p, k, n->inputs[0], 0);
+    set_input(p, k, mem, 1);
+    set_input(p, k, mem_lower_addr(p, f, n->inputs[2], offset), 2);
+    set_input(p, k, val, 3);
+    TB_NODE_SET_EXTRA(k, TB_NodeMemAccess, .align = mem_lower_align(n, offset));
+    tb_pass_mark(p, k);
+    return k;
+}
+
 static TB_Node* ideal_memcpy(TB_Passes* restrict p, TB_Function* f, TB_Node* n) {
-    return NULL;
+    TB_Node* size = n->inputs[4];
+    if (size->type != TB_INTEGER_CONST) {
+        return NULL;
+    }
+
+    uint64_t count = TB_NODE_GET_EXTRA_T(size, TB_NodeInt)->value;
+    if (count == 0 || count > MEM_LOWER_LIMIT) {
+        return NULL;
+    }
+
+    // all the loads read the incoming memory, the source and destination
+    // aren't allowed to overlap.
+    TB_Node* mem = n->inputs[1];
+    for (uint64_t i = 0; i < count;) {
+        int chunk = mem_lower_chunk(f, count - i);
+
+        TB_Node* ld = tb_alloc_node(f, TB_LOAD, mem_lower_type(chunk), 3, sizeof(TB_NodeMemAccess));
+        set_input(p, ld, n->inputs[0], 0);
+        set_input(p, ld, n->inputs[1], 1);
+        set_input(p, ld, mem_lower_addr(p, f, n->inputs[3], i), 2);
+        TB_NODE_SET_EXTRA(ld, TB_NodeMemAccess, .align = mem_lower_align(n, i));
+        tb_pass_mark(p, ld);
+
+        mem = mem_lower_store(p, f, n, mem, i, ld);
+        i += chunk;
+    }
+
+    return mem;
+}
+
+static TB_Node* ideal_memset(TB_Passes* restrict p, TB_Function* f, TB_Node* n) {
+    TB_Node *val = n->inputs[3], *size = n->inputs[4];
+    if (val->type != TB_INTEGER_CONST || size->type != TB_INTEGER_CONST) {
+        return NULL;
+    }
+
+    uint64_t count = TB_NODE_GET_EXTRA_T(size, TB_NodeInt)->value;
+    if (count == 0 || count > MEM_LOWER_LIMIT) {
+        return NULL;
+    }
+
+    uint64_t splat = (TB_NODE_GET_EXTRA_T(val, TB_NodeInt)->value & 0xFF) * 0x0101010101010101ull;
+    TB_Node* mem = n->inputs[1];
+    for (uint64_t i = 0; i < count;) {
+        int chunk = mem_lower_chunk(f, count - i);
+
+        TB_Node* v;
+        if (chunk == 16) {
+            v = tb_alloc_node(f, TB_VBROADCAST, TB_TYPE_I64x2, 2, 0);
+            set_input(p, v, make_int_node(f, p, TB_TYPE_I64, splat), 1);
+            tb_pass_mark(p, v);
+        } else {
+            v = make_int_node(f, p, TB_TYPE_INTN(chunk * 8), splat & (UINT64_MAX >> (64 - chunk*8)));
+        }
+
+        mem = mem_lower_store(p, f, n, mem, i, v);
+        i += chunk;
+    }
+
+    return mem;
 }
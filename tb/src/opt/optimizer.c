@@ -18,8 +18,8 @@ thread_local TB_Arena* tmp_arena;
 
 // helps us do some matching later
 static TB_Node* unsafe_get_region(TB_Node* n);
-static void add_user(TB_Passes* restrict p, TB_Node* n, TB_Node* in, int slot, User* recycled);
-static User* remove_user(TB_Passes* restrict p, TB_Node* n, int slot);
+static void add_user(TB_Passes* restrict p, TB_Node* n, TB_Node* in, int slot);
+static void remove_user(TB_Passes* restrict p, TB_Node* n, int slot);
 static void remove_input(TB_Passes* restrict p, TB_Function* f, TB_Node* n, size_t i);
 
 // transmutations let us generate new nodes from old ones
@@ -129,6 +129,52 @@ int worklist_popcount(Worklist* ws) {
     return sum;
 }
 
+////////////////////////////////
+// Peephole bookkeeping
+////////////////////////////////
+static bool in_cse_test(TB_Passes* restrict p, TB_Node* n) {
+    uint64_t gvn_word = n->gvn / 64;
+    return gvn_word < p->in_cse_cap && (p->in_cse[gvn_word] & (1ull << (n->gvn % 64)));
+}
+
+static void in_cse_set(TB_Passes* restrict p, TB_Node* n) {
+    uint64_t gvn_word = n->gvn / 64;
+    if (gvn_word >= p->in_cse_cap) {
+        size_t new_cap = gvn_word + 16;
+        p->in_cse = tb_platform_heap_realloc(p->in_cse, new_cap * sizeof(uint64_t));
+        FOREACH_N(i, p->in_cse_cap, new_cap) {
+            p->in_cse[i] = 0;
+        }
+        p->in_cse_cap = new_cap;
+    }
+
+    p->in_cse[gvn_word] |= 1ull << (n->gvn % 64);
+}
+
+static void in_cse_clear(TB_Passes* restrict p, TB_Node* n) {
+    uint64_t gvn_word = n->gvn / 64;
+    if (gvn_word < p->in_cse_cap) {
+        p->in_cse[gvn_word] &= ~(1ull << (n->gvn % 64));
+    }
+}
+
+static int order_get(TB_Passes* restrict p, TB_Node* n) {
+    return n->gvn < p->order_cap ? p->order[n->gvn] : 0;
+}
+
+static void order_set(TB_Passes* restrict p, TB_Node* n, int order) {
+    if (n->gvn >= p->order_cap) {
+        size_t new_cap = n->gvn + 256;
+        p->order = tb_platform_heap_realloc(p->order, new_cap * sizeof(int));
+        FOREACH_N(i, p->order_cap, new_cap) {
+            p->order[i] = 0;
+        }
+        p->order_cap = new_cap;
+    }
+
+    p->order[n->gvn] = order;
+}
+
 void verify_tmp_arena(TB_Passes* p) {
     // once passes are run on a thread, they're pinned to it.
     TB_Module* m = p->f->super.module;
@@ -171,7 +217,7 @@ static char* lil_name(TB_Function* f, const char* fmt, ...) {
 }
 
 static TB_Node* mem_user(TB_Passes* restrict p, TB_Node* n, int slot) {
-    for (User* u = find_users(p, n); u; u = u->next) {
+    FOR_USERS(u, n) {
         if (u->slot == slot && is_mem_out_op(u->n)) return u->n;
     }
 
@@ -179,13 +225,12 @@ static TB_Node* mem_user(TB_Passes* restrict p, TB_Node* n, int slot) {
 }
 
 static TB_Node* single_user(TB_Passes* restrict p, TB_Node* n) {
-    User* u = find_users(p, n);
-    assert(u && u->next == NULL);
-    return u->n;
+    assert(n->user_count == 1);
+    return n->users[0].n;
 }
 
 static bool single_use(TB_Passes* restrict p, TB_Node* n) {
-    return find_users(p, n)->next == NULL;
+    return n->user_count == 1;
 }
 
 static bool is_same_align(TB_Node* a, TB_Node* b) {
@@ -201,8 +246,7 @@ static bool is_empty_bb(TB_Passes* restrict p, TB_Node* end) {
     }
 
     TB_Node* bb = end->inputs[0];
-    for (User* use = find_users(p, bb); use; use = use->next) {
-        TB_Node* n = use->n;
+    FOR_USERS(use, bb) {
         if (use->n != end) return false;
     }
 
@@ -224,24 +268,29 @@ static bool is_if_branch(TB_Node* n, uint64_t* falsey) {
 #include "cse.h"
 #include "dce.h"
 #include "fold.h"
+#include "alias.h"
 #include "mem_opt.h"
-#include "loop.h"
 #include "branches.h"
+#include "inliner.h"
+#include "ipo.h"
+#include "sccp.h"
+#include "loop.h"
 #include "print.h"
 #include "mem2reg.h"
 #include "gcm.h"
 #include "libcalls.h"
 #include "scheduler.h"
+#include "tailcall.h"
 
 static TB_Node* gvn(TB_Passes* restrict p, TB_Node* n, size_t extra) {
     // try CSE, if we succeed, just delete the node and use the old copy
     TB_Node* k = nl_hashset_put2(&p->cse_nodes, n, cse_hash, cse_compare);
     if (k != NULL) {
         // try free
-        tb_arena_free(p->f->arena, n->inputs, sizeof(TB_Node*));
-        tb_arena_free(p->f->arena, n, sizeof(TB_Node) + extra);
+        tb_arena_free(p->f->arena, n, tb_node_alloc_size(n->input_count, extra));
         return k;
     } else {
+        in_cse_set(p, n);
         return n;
     }
 }
@@ -287,7 +336,7 @@ static bool remove_pred(TB_Passes* restrict p, TB_Function* f, TB_Node* src, TB_
             remove_input(p, f, dst, i);
 
             // update PHIs
-            for (User* use = find_users(p, dst); use; use = use->next) {
+            FOR_USERS(use, dst) {
                 if (use->n->type == TB_PHI && use->slot == 0) {
                     remove_input(p, f, use->n, i + 1);
                 }
@@ -303,8 +352,12 @@ static bool remove_pred(TB_Passes* restrict p, TB_Function* f, TB_Node* src, TB_
 }
 
 void tb_pass_kill_node(TB_Passes* restrict p, TB_Node* n) {
-    // remove from CSE if we're murdering it
-    nl_hashset_remove2(&p->cse_nodes, n, cse_hash, cse_compare);
+    // remove from CSE if we're murdering it (codegen can kill nodes without ever
+    // having peepholed)
+    if (p->cse_nodes.data != NULL) {
+        nl_hashset_remove2(&p->cse_nodes, n, cse_hash, cse_compare);
+    }
+    in_cse_clear(p, n);
 
     if (n->type == TB_LOCAL) {
         // remove from local list
@@ -320,30 +373,25 @@ void tb_pass_kill_node(TB_Passes* restrict p, TB_Node* n) {
     }
 
     n->users = NULL;
+    n->user_count = 0;
 
     n->input_count = 0;
     n->type = TB_NULL;
 }
 
-static User* remove_user(TB_Passes* restrict p, TB_Node* n, int slot) {
-    // early out: there was no previous input
-    if (n->inputs[slot] == NULL) return NULL;
+static void remove_user(TB_Passes* restrict p, TB_Node* n, int slot) {
+    // early out: there was no previous input (or it's already been killed)
+    if (n->inputs[slot] == NULL || n->inputs[slot]->user_count == 0) return;
 
+    // remove old user (this must succeed unless our users go desync'd), the
+    // recent ones are the likely ones to go so we look from the back and swap
+    // the last one into the hole.
     TB_Node* old = n->inputs[slot];
-    User* old_use = old->users;
-    if (old_use == NULL) return NULL;
-
-    // remove old user (this must succeed unless our users go desync'd)
-    for (User* prev = NULL; old_use; prev = old_use, old_use = old_use->next) {
-        if (old_use->slot == slot && old_use->n == n) {
-            // remove
-            if (prev != NULL) {
-                prev->next = old_use->next;
-            } else {
-                old->users = old_use->next;
-            }
-
-            return old_use;
+    User* users = old->users;
+    FOREACH_REVERSE_N(i, 0, old->user_count) {
+        if (users[i].slot == slot && users[i].n == n) {
+            users[i] = users[--old->user_count];
+            return;
         }
     }
 
@@ -351,26 +399,72 @@ static User* remove_user(TB_Passes* restrict p, TB_Node* n, int slot) {
 }
 
 void set_input(TB_Passes* restrict p, TB_Node* n, TB_Node* in, int slot) {
-    // recycle the user
-    User* old_use = remove_user(p, n, slot);
+    // the hash is about to change, the next GVN will have to re-insert it. the old
+    // entry stays behind but cse_compare looks at the current inputs so it can't
+    // produce a bogus hit.
+    in_cse_clear(p, n);
+
+    remove_user(p, n, slot);
 
     n->inputs[slot] = in;
     if (in != NULL) {
-        add_user(p, n, in, slot, old_use);
+        add_user(p, n, in, slot);
     }
 }
 
-// we sometimes get the choice to recycle users because we just deleted something
-static void add_user(TB_Passes* restrict p, TB_Node* n, TB_Node* in, int slot, User* recycled) {
-    User* use = recycled ? recycled : TB_ARENA_ALLOC(tmp_arena, User);
-    use->next = in->users;
-    use->n = n;
-    use->slot = slot;
-    in->users = use;
+static bool is_pow2_or_zero(uint32_t x) {
+    return (x & (x - 1)) == 0;
+}
+
+// log2 of the capacity a user array with count entries is known to have, -1 if none
+static int users_log2_cap(uint32_t count) {
+    return count <= 1 ? (int) count - 1 : 64 - tb_clz64(count - 1);
+}
+
+static void free_users(TB_Passes* restrict p, User* users, int log2_cap) {
+    *(User**) users = p->free_users[log2_cap];
+    p->free_users[log2_cap] = users;
+}
+
+static User* alloc_users(TB_Passes* restrict p, int log2_cap) {
+    // take the smallest free array which fits, the arrays which got outgrown
+    // are mostly bigger than what's asked for so we split them in half until
+    // they're the right size.
+    FOREACH_N(k, log2_cap, 32) if (p->free_users[k] != NULL) {
+        User* users = p->free_users[k];
+        p->free_users[k] = *(User**) users;
+
+        while (k > log2_cap) {
+            k -= 1;
+            free_users(p, users + (1u << k), k);
+        }
+        return users;
+    }
+
+    return tb_arena_alloc(tmp_arena, (1u << log2_cap) * sizeof(User));
+}
+
+static void add_user(TB_Passes* restrict p, TB_Node* n, TB_Node* in, int slot) {
+    // the capacity is the count rounded up to a power of two so
+    // hitting one means we're full. the old array might've been
+    // bigger once but we only recycle it at the size we know of.
+    uint32_t count = in->user_count;
+    if (is_pow2_or_zero(count)) {
+        int log2_cap = count ? tb_ffs(count) : 0;
+        User* users = alloc_users(p, log2_cap);
+        if (count) {
+            memcpy(users, in->users, count * sizeof(User));
+            free_users(p, in->users, log2_cap - 1);
+        }
+        in->users = users;
+    }
+
+    in->users[count] = (User){ n, slot };
+    in->user_count = count + 1;
 }
 
 static void tb_pass_mark_users_raw(TB_Passes* restrict p, TB_Node* n) {
-    for (User* use = n->users; use; use = use->next) {
+    FOR_USERS(use, n) {
         tb_pass_mark(p, use->n);
     }
 }
@@ -380,7 +474,7 @@ void tb_pass_mark(TB_Passes* opt, TB_Node* n) {
 }
 
 void tb_pass_mark_users(TB_Passes* restrict p, TB_Node* n) {
-    for (User* use = n->users; use; use = use->next) {
+    FOR_USERS(use, n) {
         tb_pass_mark(p, use->n);
         TB_NodeTypeEnum type = use->n->type;
 
@@ -432,9 +526,15 @@ static void push_all_bb(Worklist* restrict ws, DynArray(TB_Node*)* stack_ptr, TB
 
     DynArray(TB_Node*) stack = *stack_ptr;
 
-    // place endpoint, we'll construct the rest from there
-    worklist_test_n_set(ws, end);
-    dyn_array_put(stack, end);
+    // place endpoint, we'll construct the rest from there. it might've been
+    // seen already by walking the inputs of a successor's region.
+    if (!worklist_test_n_set(ws, end)) {
+        dyn_array_put(stack, end);
+    }
+
+    // the region got marked on the way in so the walk would skip it (and
+    // the predecessor edges), place it explicitly.
+    dyn_array_put(stack, root);
 
     while (dyn_array_length(stack)) {
         TB_Node* n = dyn_array_pop(stack);
@@ -491,7 +591,7 @@ void print_node_sexpr(TB_Node* n, int depth) {
             printf("sym%p", sym);
         }
     } else if (depth >= 1) {
-        printf("(v%zu: %s", n->gvn, tb_node_get_name(n));
+        printf("(v%u: %s", n->gvn, tb_node_get_name(n));
         cool_print_type(n);
         printf(" ...)");
     } else {
@@ -563,7 +663,10 @@ static TB_Node* idealize(TB_Passes* restrict p, TB_Function* f, TB_Node* n, TB_P
         return (flags & TB_PEEPHOLE_MEMORY) ? ideal_end(p, f, n) : NULL;
 
         case TB_MEMCPY:
-        return ideal_memcpy(p, f, n);
+        return (flags & TB_PEEPHOLE_MEMORY) ? ideal_memcpy(p, f, n) : NULL;
+
+        case TB_MEMSET:
+        return (flags & TB_PEEPHOLE_MEMORY) ? ideal_memset(p, f, n) : NULL;
 
         // division
         case TB_SDIV:
@@ -582,8 +685,10 @@ static TB_Node* idealize(TB_Passes* restrict p, TB_Function* f, TB_Node* n, TB_P
         case TB_TRUNCATE:
         return ideal_truncate(p, f, n);
 
-        case TB_CALL:
-        return ideal_libcall(p, f, n);
+        case TB_CALL: {
+            TB_Node* k = ideal_libcall(p, f, n);
+            return k ? k : ideal_call(p, f, n);
+        }
 
         case TB_SELECT:
         return ideal_select(p, f, n);
@@ -637,6 +742,11 @@ static TB_Node* identity(TB_Passes* restrict p, TB_Function* f, TB_Node* n, TB_P
         case TB_LOAD:
         return (flags & TB_PEEPHOLE_MEMORY) ? identity_load(p, f, n) : n;
 
+        case TB_STORE:
+        case TB_MEMSET:
+        case TB_MEMCPY:
+        return (flags & TB_PEEPHOLE_MEMORY) ? identity_store(p, f, n) : n;
+
         // dumb phis
         case TB_PHI: if (flags & TB_PEEPHOLE_PHI) {
             TB_Node* same = NULL;
@@ -679,12 +789,27 @@ static TB_Node* unsafe_get_region(TB_Node* n) {
 static bool peephole(TB_Passes* restrict p, TB_Function* f, TB_Node* n, TB_PeepholeFlags flags) {
     // must've dead sometime between getting scheduled and getting
     // here.
-    if (n->type != TB_END && find_users(p, n) == NULL) {
+    if (n->type != TB_END && n->user_count == 0) {
+        // dead PHIs are still attached to their region so codegen would
+        // go and move values into them, cut them loose here.
+        if (n->type == TB_PHI) {
+            FOREACH_N(i, 1, n->input_count) if (n->inputs[i]) {
+                tb_pass_mark(p, n->inputs[i]);
+            }
+            tb_pass_kill_node(p, n);
+        } else if (n->type == TB_STORE || n->type == TB_MEMSET || n->type == TB_MEMCPY) {
+            // dead stores would keep the memory before them looking shared,
+            // whoever else uses it might be able to do something now.
+            TB_Node* mem = n->inputs[1];
+            tb_pass_kill_node(p, n);
+            tb_pass_mark(p, mem);
+            tb_pass_mark_users(p, mem);
+        }
         return false;
     }
 
     DO_IF(TB_OPTDEBUG_STATS)(p->stats.peeps++);
-    DO_IF(TB_OPTDEBUG_PEEP)(printf("peep v%zu? ", n->gvn), print_node_sexpr(n, 0));
+    DO_IF(TB_OPTDEBUG_PEEP)(printf("peep v%u? ", n->gvn), print_node_sexpr(n, 0));
 
     // idealize node (in a loop of course)
     TB_Node* k = idealize(p, f, n, flags);
@@ -701,6 +826,10 @@ static bool peephole(TB_Passes* restrict p, TB_Function* f, TB_Node* n, TB_Peeph
             tb_assert(!is_terminator(n), "can't peephole a branch into a new branch");
             subsume_node(p, f, n, k);
             n = k;
+        } else {
+            // modified in place, whatever entry it had in the CSE table
+            // was hashed with the old contents.
+            in_cse_clear(p, n);
         }
 
         // try again, maybe we get another transformation
@@ -719,52 +848,119 @@ static bool peephole(TB_Passes* restrict p, TB_Function* f, TB_Node* n, TB_Peeph
         return k;
     }
 
-    // common subexpression elim
-    k = nl_hashset_put2(&p->cse_nodes, n, cse_hash, cse_compare);
-    if (k && (k != n)) {
-        DO_IF(TB_OPTDEBUG_STATS)(p->stats.cse_hit++);
-        DO_IF(TB_OPTDEBUG_PEEP)(printf(" => \x1b[31mCSE\x1b[0m"));
+    // common subexpression elim happens once the round is over
+    if (!in_cse_test(p, n)) {
+        dyn_array_put(p->gvn_batch, n);
+    }
 
-        subsume_node(p, f, n, k);
+    return n;
+}
 
-        // because certain optimizations apply when things are merged
-        // we mark ALL users including the ones who didn't get changed.
-        tb_pass_mark_users(p, k);
-        return k;
-    } else {
-        DO_IF(TB_OPTDEBUG_STATS)(p->stats.cse_miss++);
+// inserts the round's survivors into the CSE table, anything which hits gets
+// replaced and it's users go into the next round.
+static void gvn_batch_flush(TB_Passes* restrict p, TB_Function* f) {
+    dyn_array_for(i, p->gvn_batch) {
+        TB_Node* n = p->gvn_batch[i];
+
+        // killed (or already re-inserted) since it got batched
+        if (n->type == TB_NULL || in_cse_test(p, n)) {
+            continue;
+        }
+
+        TB_Node* k = nl_hashset_put2(&p->cse_nodes, n, cse_hash, cse_compare);
+        if (k && (k != n)) {
+            DO_IF(TB_OPTDEBUG_STATS)(p->stats.cse_hit++);
+            DO_IF(TB_OPTDEBUG_PEEP)(printf("v%u => \x1b[31mCSE\x1b[0m v%u\n", n->gvn, k->gvn));
+
+            subsume_node(p, f, n, k);
+
+            // because certain optimizations apply when things are merged
+            // we mark ALL users including the ones who didn't get changed.
+            tb_pass_mark_users(p, k);
+        } else {
+            DO_IF(TB_OPTDEBUG_STATS)(p->stats.cse_miss++);
+            in_cse_set(p, n);
+        }
     }
 
-    return n;
+    dyn_array_clear(p->gvn_batch);
 }
 
 static void subsume_node(TB_Passes* restrict p, TB_Function* f, TB_Node* n, TB_Node* new_n) {
-    User* use = find_users(p, n);
-    while (use != NULL) {
-        tb_assert(use->n->inputs[use->slot] == n, "Mismatch between def-use and use-def data");
+    uint32_t count = n->user_count;
+    if (count > 0) {
+        // every user of n is moving over to new_n so rather than going through set_input
+        // per edge we retarget the inputs and hand over the user array in one go.
+        User* moved = n->users;
+        FOREACH_N(i, 0, count) {
+            TB_Node* use_n = moved[i].n;
+            tb_assert(use_n->inputs[moved[i].slot] == n, "Mismatch between def-use and use-def data");
+
+            in_cse_clear(p, use_n);
+            use_n->inputs[moved[i].slot] = new_n;
+        }
 
-        // set_input will delete 'use' so we can't use it afterwards
-        TB_Node* use_n = use->n;
-        User* next = use->next;
+        n->users = NULL;
+        n->user_count = 0;
 
-        set_input(p, use->n, new_n, use->slot);
-        use = next;
+        uint32_t old_count = new_n->user_count;
+        if (old_count == 0) {
+            new_n->users = moved;
+            new_n->user_count = count;
+        } else {
+            int have = users_log2_cap(old_count);
+            int need = users_log2_cap(old_count + count);
+            if (need > have) {
+                User* users = alloc_users(p, need);
+                memcpy(users, new_n->users, old_count * sizeof(User));
+                free_users(p, new_n->users, have);
+                new_n->users = users;
+            }
+
+            memcpy(&new_n->users[old_count], moved, count * sizeof(User));
+            new_n->user_count = old_count + count;
+            free_users(p, moved, users_log2_cap(count));
+        }
     }
 
     tb_pass_kill_node(p, n);
 }
 
 static void generate_use_lists(TB_Passes* restrict p, TB_Function* f) {
-    dyn_array_for(i, p->worklist.items) {
-        TB_Node* n = p->worklist.items[i];
+    DynArray(TB_Node*) items = p->worklist.items;
+    size_t count = dyn_array_length(items);
+
+    // anything left from an earlier TB_Passes points into a dead arena
+    FOREACH_N(i, 0, count) {
+        items[i]->user_count = 0;
+    }
+
+    // count the uses first so each node gets its user array allocated
+    // once at the right size instead of growing it edge by edge.
+    FOREACH_N(i, 0, count) {
+        TB_Node* n = items[i];
+        FOREACH_N(j, 0, n->input_count) if (n->inputs[j]) {
+            n->inputs[j]->user_count += 1;
+        }
+    }
+
+    FOREACH_N(i, 0, count) {
+        TB_Node* n = items[i];
+        uint32_t uses = n->user_count;
+        n->users = uses ? tb_arena_alloc(tmp_arena, tb_next_pow2(uses) * sizeof(User)) : NULL;
+        n->user_count = 0;
 
         if (n->type == TB_LOCAL) {
             // we don't need to check for duplicates here, the worklist is uniques
             dyn_array_put(p->locals, n);
         }
+    }
 
-        FOREACH_N(i, 0, n->input_count) if (n->inputs[i]) {
-            add_user(p, n, n->inputs[i], i, NULL);
+    FOREACH_N(i, 0, count) {
+        TB_Node* n = items[i];
+        FOREACH_N(j, 0, n->input_count) if (n->inputs[j]) {
+            TB_Node* in = n->inputs[j];
+            in->users[in->user_count++] = (User){ n, j };
         }
     }
 }
@@ -802,6 +998,21 @@ TB_Passes* tb_pass_enter(TB_Function* f, TB_Arena* arena) {
         generate_use_lists(p, f);
     }
 
+    // the worklist pops from the back and that's where the defs ended up,
+    // remember that order so the peephole rounds can keep it.
+    p->order_cap = f->node_count;
+    p->order = tb_platform_heap_alloc(p->order_cap * sizeof(int));
+    memset(p->order, 0, p->order_cap * sizeof(int));
+
+    size_t count = dyn_array_length(p->worklist.items);
+    FOREACH_N(i, 0, count) {
+        p->order[p->worklist.items[i]->gvn] = count - i;
+    }
+
+    p->in_cse_cap = (f->node_count + 63) / 64;
+    p->in_cse = tb_platform_heap_alloc(p->in_cse_cap * sizeof(uint64_t));
+    memset(p->in_cse, 0, p->in_cse_cap * sizeof(uint64_t));
+
     return p;
 }
 
@@ -811,6 +1022,37 @@ void tb_pass_optimize(TB_Passes* p) {
     tb_pass_peephole(p, TB_PEEPHOLE_ALL);
     tb_pass_mem2reg(p);
     tb_pass_peephole(p, TB_PEEPHOLE_ALL);
+    tb_pass_sccp(p);
+    tb_pass_peephole(p, TB_PEEPHOLE_ALL);
+    tb_pass_loop(p);
+    tb_pass_peephole(p, TB_PEEPHOLE_ALL);
+}
+
+typedef struct {
+    // order in the top bits, gvn breaks ties
+    uint64_t key;
+    TB_Node* n;
+} PeepItem;
+
+static ptrdiff_t partition_peep_items(PeepItem* arr, ptrdiff_t lo, ptrdiff_t hi) {
+    uint64_t pivot = arr[(hi - lo) / 2 + lo].key; // middle
+
+    ptrdiff_t i = lo - 1, j = hi + 1;
+    for (;;) {
+        do { i += 1; } while (arr[i].key < pivot);
+        do { j -= 1; } while (arr[j].key > pivot);
+
+        if (i >= j) return j;
+        SWAP(PeepItem, arr[i], arr[j]);
+    }
+}
+
+static void sort_peep_items(PeepItem* arr, ptrdiff_t lo, ptrdiff_t hi) {
+    if (lo < hi) {
+        ptrdiff_t p = partition_peep_items(arr, lo, hi);
+        sort_peep_items(arr, lo, p);
+        sort_peep_items(arr, p + 1, hi);
+    }
 }
 
 void tb_pass_peephole(TB_Passes* p, TB_PeepholeFlags flags) {
@@ -822,12 +1064,56 @@ void tb_pass_peephole(TB_Passes* p, TB_PeepholeFlags flags) {
 
     TB_Function* f = p->f;
     CUIK_TIMED_BLOCK("peephole") {
-        TB_Node* n;
-        while ((n = worklist_pop(&p->worklist))) {
-            if (peephole(p, f, n, flags)) {
-                DO_IF(TB_OPTDEBUG_PEEP)(printf("\n"));
+        Worklist* ws = &p->worklist;
+        DynArray(PeepItem) round = dyn_array_create(PeepItem, 256);
+
+        // each round takes whatever is on the worklist and walks it in priority
+        // order, anything marked along the way waits for the next round.
+        while (dyn_array_length(ws->items)) {
+            // the worklist is LIFO so the back is usually the
+            // front of the order already.
+            bool sorted = true;
+            dyn_array_clear(round);
+            FOREACH_REVERSE_N(i, 0, dyn_array_length(ws->items)) {
+                TB_Node* n = ws->items[i];
+                uint64_t order = order_get(p, n);
+                PeepItem item = { ((order ? order : INT_MAX) << 32ull) | (uint32_t) n->gvn, n };
+                if (sorted && dyn_array_length(round) && round[dyn_array_length(round) - 1].key > item.key) {
+                    sorted = false;
+                }
+                dyn_array_put(round, item);
+            }
+            dyn_array_clear(ws->items);
+
+            if (!sorted) {
+                sort_peep_items(round, 0, dyn_array_length(round) - 1);
             }
+
+            dyn_array_for(i, round) {
+                TB_Node* n = round[i].n;
+
+                // it's not on the worklist anymore, if it's marked again it'll come
+                // back next round.
+                uint64_t gvn_word = n->gvn / 64;
+                ws->visited[gvn_word] &= ~(1ull << (n->gvn % 64));
+
+                size_t before = dyn_array_length(ws->items);
+                if (peephole(p, f, n, flags)) {
+                    DO_IF(TB_OPTDEBUG_PEEP)(printf("\n"));
+                }
+
+                // new nodes are placed where the node which made them was
+                FOREACH_N(j, before, dyn_array_length(ws->items)) {
+                    if (order_get(p, ws->items[j]) == 0) {
+                        order_set(p, ws->items[j], round[i].key >> 32ull);
+                    }
+                }
+            }
+
+            gvn_batch_flush(p, f);
         }
+
+        dyn_array_destroy(round);
     }
 }
 
@@ -851,6 +1137,9 @@ void tb_pass_exit(TB_Passes* p) {
     worklist_free(&p->worklist);
     nl_hashset_free(p->cse_nodes);
     dyn_array_destroy(p->locals);
+    dyn_array_destroy(p->gvn_batch);
+    tb_platform_heap_free(p->in_cse);
+    tb_platform_heap_free(p->order);
 
     tb_arena_clear(tmp_arena);
 }
@@ -42,6 +42,10 @@ static void print_type(TB_DataType dt) {
         }
         default: tb_todo();
     }
+
+    if (dt.width) {
+        printf("x%d", 1 << dt.width);
+    }
 }
 
 static void print_ref_to_node(PrinterCtx* ctx, TB_Node* n, bool def) {
@@ -59,7 +63,7 @@ static void print_ref_to_node(PrinterCtx* ctx, TB_Node* n, bool def) {
                 if (params[i] == NULL) {
                     printf("_");
                 } else {
-                    printf("v%zu: ", params[i]->gvn);
+                    printf("v%u: ", params[i]->gvn);
                     print_type(params[i]->dt);
                 }
             }
@@ -210,6 +214,15 @@ static void print_bb(PrinterCtx* ctx, TB_Node* bb) {
                     }
                     printf("  }");
                 }
+
+                if (br->weights) {
+                    printf(" weights(");
+                    FOREACH_N(i, 0, br->succ_count) {
+                        if (i != 0) printf(", ");
+                        printf("%u", br->weights[i]);
+                    }
+                    printf(")");
+                }
                 break;
             }
 
@@ -233,7 +246,7 @@ static void print_bb(PrinterCtx* ctx, TB_Node* bb) {
                     TB_Node* projs[4];
                     for (size_t i = 0; i < 4; i++) projs[i] = NULL;
 
-                    for (User* use = find_users(ctx->opt, n); use; use = use->next) {
+                    FOR_USERS(use, n) {
                         if (use->n->type == TB_PROJ) {
                             int index = TB_NODE_GET_EXTRA_T(use->n, TB_NodeProj)->index;
                             projs[index] = use->n;
@@ -246,7 +259,7 @@ static void print_bb(PrinterCtx* ctx, TB_Node* bb) {
                     FOREACH_N(i, first, 4) {
                         if (projs[i] == NULL) break;
                         if (i > first) printf(", ");
-                        printf("v%zu", projs[i]->gvn);
+                        printf("v%u", projs[i]->gvn);
                     }
                     printf(" = %s.(", tb_node_get_name(n));
                     FOREACH_N(i, first, 4) {
@@ -260,7 +273,7 @@ static void print_bb(PrinterCtx* ctx, TB_Node* bb) {
                     if (n->dt.type == TB_INT && n->dt.data == 0) {
                         printf("  %s.", tb_node_get_name(n));
                     } else {
-                        printf("  v%zu = %s.", n->gvn, tb_node_get_name(n));
+                        printf("  v%u = %s.", n->gvn, tb_node_get_name(n));
                     }
 
                     TB_DataType dt = n->dt;
@@ -290,6 +303,7 @@ static void print_bb(PrinterCtx* ctx, TB_Node* bb) {
                     case TB_CMP_FLT:
                     case TB_CMP_FLE:
                     case TB_SELECT:
+                    case TB_VBROADCAST:
                     case TB_BITCAST:
                     break;
 
@@ -362,6 +376,7 @@ static void print_bb(PrinterCtx* ctx, TB_Node* bb) {
 
                     case TB_CALL:
                     case TB_SYSCALL:
+                    case TB_TAILCALL:
                     case TB_SAFEPOINT_POLL:
                     break;
 
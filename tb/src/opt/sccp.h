@@ -0,0 +1,575 @@
+// Sparse conditional constant propagation (Wegman & Zadeck) over the lattice
+// in lattice.h. It's optimistic: values start as "nothing yet" (NULL) and
+// blocks start unreachable, we only ever widen them as we learn more which
+// lets us see through things like loop-carried constants that the pessimistic
+// peepholes can't.
+//
+// once it settles we replace constant values with constant nodes and turn
+// branches with only one feasible successor into gotos, the peepholes then
+// clean up the dead regions (see ideal_region).
+typedef struct {
+    TB_Passes* p;
+    LatticeUniverse uni;
+
+    // indexed by gvn, NULL means nothing has reached it yet
+    size_t cap;
+    Lattice** types;
+    // how many times a node's type has moved, ranges can creep upwards
+    // one step at a time through loops so we widen them past a limit.
+    uint8_t* changes;
+
+    // visited set is the reachable blocks, items are the ones we haven't processed
+    Worklist reach;
+    Worklist ws;
+} SCCP;
+
+#define SCCP_WIDEN_LIMIT 8
+
+static bool sccp_tracked(TB_DataType dt) {
+    return (dt.type == TB_INT && dt.data > 0 && dt.data <= 64) || dt.type == TB_PTR;
+}
+
+static Lattice* sccp_get(SCCP* restrict s, TB_Node* n) {
+    if (n->gvn >= s->cap) {
+        return lattice_intern(&s->uni, lattice_top(n->dt));
+    }
+
+    return s->types[n->gvn];
+}
+
+static Lattice* sccp_top(SCCP* restrict s, TB_DataType dt) {
+    return lattice_intern(&s->uni, lattice_top(dt));
+}
+
+static Lattice* sccp_int(SCCP* restrict s, LatticeInt i, uint64_t mask) {
+    return lattice_intern(&s->uni, (Lattice){ LATTICE_INT, ._int = lattice_int_normalize(i, mask) });
+}
+
+static Lattice* sccp_bool(SCCP* restrict s, bool x) {
+    return lattice_intern(&s->uni, lattice_int_const(x, 1));
+}
+
+static Lattice* sccp_ptr(SCCP* restrict s, LatticeTrifecta t) {
+    return lattice_intern(&s->uni, (Lattice){ LATTICE_POINTER, ._ptr = { t } });
+}
+
+static bool sccp_is_reachable(SCCP* restrict s, TB_Node* bb) {
+    return worklist_test(&s->reach, bb);
+}
+
+static void sccp_reach(SCCP* restrict s, TB_Node* bb) {
+    if (!worklist_test_n_set(&s->reach, bb)) {
+        dyn_array_put(s->reach.items, bb);
+    }
+}
+
+// can the i'th successor of br be taken given what we know about the key
+static bool sccp_feasible(SCCP* restrict s, TB_Node* br, size_t i) {
+    TB_NodeBranch* info = TB_NODE_GET_EXTRA(br);
+    if (br->input_count == 1) {
+        return true;
+    }
+
+    TB_Node* key_n = br->inputs[1];
+    if (!sccp_tracked(key_n->dt)) {
+        return true;
+    }
+
+    Lattice* key = sccp_get(s, key_n);
+    if (key == NULL) {
+        return false;
+    }
+
+    uint64_t mask = key_n->dt.type == TB_INT ? tb__mask(key_n->dt.data) : UINT64_MAX;
+    uint64_t k;
+    if (lattice_is_int_const(key, mask, &k)) {
+        size_t taken = 0;
+        FOREACH_N(j, 0, info->succ_count - 1) {
+            if (((uint64_t) info->keys[j] & mask) == k) {
+                taken = j + 1;
+                break;
+            }
+        }
+
+        return i == taken;
+    }
+
+    // if (x) where x is known to not be zero (non-null pointers mostly)
+    if (info->succ_count == 2 && info->keys[0] == 0 && lattice_is_non_zero(key)) {
+        return i == 0;
+    }
+
+    return true;
+}
+
+static bool sccp_edge_feasible(SCCP* restrict s, TB_Node* pred, TB_Node* dst) {
+    TB_Node* bb = tb_get_parent_region(pred);
+    if (!sccp_is_reachable(s, bb)) {
+        return false;
+    }
+
+    TB_Node* end = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->end;
+    if (end == NULL || end->type != TB_BRANCH) {
+        return true;
+    }
+
+    TB_NodeBranch* info = TB_NODE_GET_EXTRA(end);
+    FOREACH_N(i, 0, info->succ_count) {
+        if (info->succ[i] == dst && sccp_feasible(s, end, i)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static Lattice* sccp_compare(SCCP* restrict s, TB_Node* n, Lattice* a, Lattice* b) {
+    TB_DataType cmp_dt = TB_NODE_GET_EXTRA_T(n, TB_NodeCompare)->cmp_dt;
+
+    if (cmp_dt.type == TB_PTR) {
+        LatticeTrifecta x = a->_ptr.trifecta, y = b->_ptr.trifecta;
+        if (n->type == TB_CMP_EQ || n->type == TB_CMP_NE) {
+            bool eq = n->type == TB_CMP_EQ;
+
+            if (x == LATTICE_KNOWN_NULL && y == LATTICE_KNOWN_NULL) {
+                return sccp_bool(s, eq);
+            } else if ((x == LATTICE_KNOWN_NULL && y == LATTICE_KNOWN_NOT_NULL) ||
+                (x == LATTICE_KNOWN_NOT_NULL && y == LATTICE_KNOWN_NULL)) {
+                return sccp_bool(s, !eq);
+            }
+        }
+
+        return sccp_top(s, n->dt);
+    }
+
+    uint64_t mask = tb__mask(cmp_dt.data);
+    LatticeInt aa = a->_int, bb = b->_int;
+
+    uint64_t x, y;
+    if (lattice_is_int_const(a, mask, &x) && lattice_is_int_const(b, mask, &y)) {
+        switch (n->type) {
+            case TB_CMP_EQ:  return sccp_bool(s, x == y);
+            case TB_CMP_NE:  return sccp_bool(s, x != y);
+            case TB_CMP_ULT: return sccp_bool(s, x < y);
+            case TB_CMP_ULE: return sccp_bool(s, x <= y);
+            case TB_CMP_SLT: return sccp_bool(s, (int64_t) tb__sxt(x, cmp_dt.data, 64) <  (int64_t) tb__sxt(y, cmp_dt.data, 64));
+            case TB_CMP_SLE: return sccp_bool(s, (int64_t) tb__sxt(x, cmp_dt.data, 64) <= (int64_t) tb__sxt(y, cmp_dt.data, 64));
+            default: tb_todo();
+        }
+    }
+
+    switch (n->type) {
+        case TB_CMP_EQ:
+        case TB_CMP_NE: {
+            // a bit that's known one on one side and known zero on the other
+            bool differ = (aa.known_ones & bb.known_zeros) || (aa.known_zeros & bb.known_ones) ||
+                aa.top < bb.bot || bb.top < aa.bot;
+
+            if (differ) return sccp_bool(s, n->type == TB_CMP_NE);
+            break;
+        }
+
+        case TB_CMP_ULT:
+        if (aa.top < bb.bot) return sccp_bool(s, true);
+        if (aa.bot >= bb.top) return sccp_bool(s, false);
+        break;
+
+        case TB_CMP_ULE:
+        if (aa.top <= bb.bot) return sccp_bool(s, true);
+        if (aa.bot > bb.top) return sccp_bool(s, false);
+        break;
+
+        default: break;
+    }
+
+    return sccp_top(s, n->dt);
+}
+
+static Lattice* sccp_compute(SCCP* restrict s, TB_Node* n) {
+    TB_DataType dt = n->dt;
+    uint64_t mask = dt.type == TB_INT ? tb__mask(dt.data) : UINT64_MAX;
+
+    switch (n->type) {
+        case TB_INTEGER_CONST: {
+            TB_NodeInt* i = TB_NODE_GET_EXTRA(n);
+            if (dt.type == TB_PTR) {
+                return sccp_ptr(s, i->value ? LATTICE_KNOWN_NOT_NULL : LATTICE_KNOWN_NULL);
+            }
+
+            return lattice_intern(&s->uni, lattice_int_const(i->value, mask));
+        }
+
+        case TB_PHI: {
+            TB_Node* region = n->inputs[0];
+            if (!sccp_is_reachable(s, region)) {
+                return NULL;
+            }
+
+            Lattice* l = NULL;
+            FOREACH_N(i, 1, n->input_count) {
+                TB_Node* pred = region->inputs[i - 1];
+                if (pred == NULL || n->inputs[i] == NULL || !sccp_edge_feasible(s, pred, region)) {
+                    continue;
+                }
+
+                Lattice* in = sccp_get(s, n->inputs[i]);
+                if (in != NULL) {
+                    l = l ? lattice_intern(&s->uni, lattice_meet(l, in)) : in;
+                }
+            }
+
+            return l;
+        }
+
+        case TB_SELECT: {
+            Lattice* cond = sccp_get(s, n->inputs[1]);
+            Lattice* a = sccp_get(s, n->inputs[2]);
+            Lattice* b = sccp_get(s, n->inputs[3]);
+            if (cond == NULL || a == NULL || b == NULL) {
+                return NULL;
+            }
+
+            uint64_t c;
+            if (lattice_is_int_const(cond, tb__mask(n->inputs[1]->dt.data), &c)) {
+                return c ? a : b;
+            } else if (lattice_is_non_zero(cond)) {
+                return a;
+            }
+
+            return lattice_intern(&s->uni, lattice_meet(a, b));
+        }
+
+        // calls to functions which never return NULL (see ipo.h)
+        case TB_PROJ: {
+            if (dt.type == TB_PTR && ipo_non_null(n, 0)) {
+                return sccp_ptr(s, LATTICE_KNOWN_NOT_NULL);
+            }
+
+            return sccp_top(s, dt);
+        }
+
+        // pointers which can't be NULL
+        case TB_LOCAL:
+        case TB_SYMBOL:
+        return sccp_ptr(s, LATTICE_KNOWN_NOT_NULL);
+
+        // offsetting a pointer into an object keeps it non-null
+        case TB_MEMBER_ACCESS:
+        case TB_ARRAY_ACCESS: {
+            Lattice* base = sccp_get(s, n->inputs[1]);
+            if (base == NULL) return NULL;
+
+            return sccp_ptr(s, base->_ptr.trifecta == LATTICE_KNOWN_NOT_NULL ? LATTICE_KNOWN_NOT_NULL : LATTICE_UNKNOWN);
+        }
+
+        case TB_INT2PTR: {
+            Lattice* src = sccp_get(s, n->inputs[1]);
+            if (src == NULL) return NULL;
+
+            uint64_t x;
+            if (lattice_is_int_const(src, tb__mask(n->inputs[1]->dt.data), &x) && x == 0) {
+                return sccp_ptr(s, LATTICE_KNOWN_NULL);
+            } else if (lattice_is_non_zero(src)) {
+                return sccp_ptr(s, LATTICE_KNOWN_NOT_NULL);
+            }
+
+            return sccp_ptr(s, LATTICE_UNKNOWN);
+        }
+
+        case TB_NOT: {
+            Lattice* a = sccp_get(s, n->inputs[1]);
+            if (a == NULL) return NULL;
+
+            LatticeInt i = { 0, mask, a->_int.known_ones, a->_int.known_zeros };
+            return sccp_int(s, i, mask);
+        }
+
+        case TB_TRUNCATE: {
+            Lattice* a = sccp_get(s, n->inputs[1]);
+            if (a == NULL) return NULL;
+
+            LatticeInt i = { 0, mask, a->_int.known_zeros, a->_int.known_ones };
+            return sccp_int(s, i, mask);
+        }
+
+        case TB_ZERO_EXT:
+        case TB_SIGN_EXT: {
+            TB_Node* src = n->inputs[1];
+            Lattice* a = sccp_get(s, src);
+            if (a == NULL) return NULL;
+
+            uint64_t src_bits = src->dt.data;
+            LatticeInt i = { 0, mask, a->_int.known_zeros, a->_int.known_ones };
+            if (n->type == TB_ZERO_EXT) {
+                i.known_zeros |= mask & ~tb__mask(src_bits);
+                i.bot = a->_int.bot, i.top = a->_int.top;
+            } else {
+                // the sign bit's knowledge gets smeared across the new bits
+                i.known_zeros = tb__sxt(i.known_zeros, src_bits, 64);
+                i.known_ones = tb__sxt(i.known_ones, src_bits, 64);
+            }
+
+            return sccp_int(s, i, mask);
+        }
+
+        case TB_AND:
+        case TB_OR:
+        case TB_XOR:
+        case TB_ADD:
+        case TB_SUB:
+        case TB_MUL:
+        case TB_SHL:
+        case TB_SHR:
+        case TB_SAR: {
+            if (dt.type != TB_INT) {
+                return sccp_top(s, dt);
+            }
+
+            Lattice* a = sccp_get(s, n->inputs[1]);
+            Lattice* b = sccp_get(s, n->inputs[2]);
+            if (a == NULL || b == NULL) {
+                return NULL;
+            }
+
+            LatticeInt aa = a->_int, bb = b->_int;
+            LatticeInt i = { 0, mask };
+
+            uint64_t x = 0, y = 0;
+            bool a_const = lattice_is_int_const(a, mask, &x);
+            bool b_const = lattice_is_int_const(b, tb__mask(n->inputs[2]->dt.data), &y);
+
+            switch (n->type) {
+                case TB_AND:
+                i.known_ones = aa.known_ones & bb.known_ones;
+                i.known_zeros = aa.known_zeros | bb.known_zeros;
+                i.top = aa.top < bb.top ? aa.top : bb.top;
+                break;
+
+                case TB_OR:
+                i.known_ones = aa.known_ones | bb.known_ones;
+                i.known_zeros = aa.known_zeros & bb.known_zeros;
+                i.bot = aa.bot > bb.bot ? aa.bot : bb.bot;
+                break;
+
+                case TB_XOR:
+                i.known_ones = (aa.known_ones & bb.known_zeros) | (aa.known_zeros & bb.known_ones);
+                i.known_zeros = (aa.known_zeros & bb.known_zeros) | (aa.known_ones & bb.known_ones);
+                break;
+
+                case TB_ADD:
+                case TB_SUB:
+                case TB_MUL:
+                if (a_const && b_const) {
+                    uint64_t r = n->type == TB_ADD ? x + y : n->type == TB_SUB ? x - y : x * y;
+                    return lattice_intern(&s->uni, lattice_int_const(r, mask));
+                }
+                break;
+
+                case TB_SHL:
+                case TB_SHR:
+                case TB_SAR: {
+                    // we only know how to shift bits around by known amounts
+                    if (!b_const || y >= dt.data) break;
+
+                    if (n->type == TB_SHL) {
+                        i.known_ones = aa.known_ones << y;
+                        i.known_zeros = (aa.known_zeros << y) | (y ? tb__mask(y) : 0);
+                    } else if (n->type == TB_SHR) {
+                        i.known_ones = aa.known_ones >> y;
+                        i.known_zeros = (aa.known_zeros >> y) | ~(mask >> y);
+                        i.top = aa.top >> y, i.bot = aa.bot >> y;
+                    } else {
+                        i.known_ones = tb__sxt(aa.known_ones, dt.data, 64) >> y;
+                        i.known_zeros = tb__sxt(aa.known_zeros, dt.data, 64) >> y;
+                        // >> on unsigned fills with zeros so redo the sign
+                        i.known_ones = tb__sxt(i.known_ones, dt.data - y, 64);
+                        i.known_zeros = tb__sxt(i.known_zeros, dt.data - y, 64);
+                    }
+                    break;
+                }
+
+                default: tb_todo();
+            }
+
+            return sccp_int(s, i, mask);
+        }
+
+        case TB_CMP_EQ:
+        case TB_CMP_NE:
+        case TB_CMP_ULT:
+        case TB_CMP_ULE:
+        case TB_CMP_SLT:
+        case TB_CMP_SLE: {
+            TB_DataType cmp_dt = TB_NODE_GET_EXTRA_T(n, TB_NodeCompare)->cmp_dt;
+            if (!sccp_tracked(cmp_dt)) {
+                return sccp_top(s, dt);
+            }
+
+            Lattice* a = sccp_get(s, n->inputs[1]);
+            Lattice* b = sccp_get(s, n->inputs[2]);
+            if (a == NULL || b == NULL) {
+                return NULL;
+            }
+
+            return sccp_compare(s, n, a, b);
+        }
+
+        // anything we don't understand can be anything
+        default:
+        return sccp_top(s, dt);
+    }
+}
+
+// only ever move down the lattice (towards "anything"), that's how we know we'll stop
+static Lattice* sccp_merge(SCCP* restrict s, TB_Node* n, Lattice* old, Lattice* new) {
+    if (old == NULL || old == new) {
+        return new;
+    }
+
+    Lattice l = lattice_meet(old, new);
+    if (l.tag == LATTICE_INT && s->changes[n->gvn]++ >= SCCP_WIDEN_LIMIT) {
+        uint64_t mask = tb__mask(n->dt.data);
+        l._int.bot = 0, l._int.top = mask;
+        l._int = lattice_int_normalize(l._int, mask);
+    }
+
+    return lattice_intern(&s->uni, l);
+}
+
+static void sccp_branch(SCCP* restrict s, TB_Node* br) {
+    if (!sccp_is_reachable(s, tb_get_parent_region(br))) {
+        return;
+    }
+
+    TB_NodeBranch* info = TB_NODE_GET_EXTRA(br);
+    FOREACH_N(i, 0, info->succ_count) {
+        if (sccp_feasible(s, br, i)) {
+            TB_Node* succ = info->succ[i];
+            sccp_reach(s, succ);
+
+            // a new edge might've come alive, the PHIs should know
+            FOR_USERS(u, succ) {
+                if (u->n->type == TB_PHI) worklist_push(&s->ws, u->n);
+            }
+        }
+    }
+}
+
+void tb_pass_sccp(TB_Passes* p) {
+    cuikperf_region_start("sccp", NULL);
+    verify_tmp_arena(p);
+
+    TB_Function* f = p->f;
+    SCCP s = { .p = p, .cap = f->node_count };
+    s.uni.pool = nl_hashset_alloc(64);
+
+    s.types = tb_arena_alloc(tmp_arena, s.cap * sizeof(Lattice*));
+    s.changes = tb_arena_alloc(tmp_arena, s.cap * sizeof(uint8_t));
+    memset(s.types, 0, s.cap * sizeof(Lattice*));
+    memset(s.changes, 0, s.cap * sizeof(uint8_t));
+
+    worklist_alloc(&s.reach, s.cap);
+    worklist_alloc(&s.ws, s.cap);
+
+    // everyone gets looked at once, we keep the list around for the rewrite later
+    push_all_nodes(&s.ws, f->start_node);
+    size_t node_count = dyn_array_length(s.ws.items);
+    TB_Node** nodes = tb_arena_alloc(tmp_arena, node_count * sizeof(TB_Node*));
+    memcpy(nodes, s.ws.items, node_count * sizeof(TB_Node*));
+
+    CUIK_TIMED_BLOCK("solve") {
+        sccp_reach(&s, f->start_node);
+
+        for (;;) {
+            // newly reachable blocks first, their PHIs and terminators care
+            if (dyn_array_length(s.reach.items)) {
+                TB_Node* bb = dyn_array_pop(s.reach.items);
+                FOR_USERS(u, bb) {
+                    worklist_push(&s.ws, u->n);
+                }
+
+                TB_Node* end = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->end;
+                if (end != NULL) worklist_push(&s.ws, end);
+                continue;
+            }
+
+            TB_Node* n = worklist_pop(&s.ws);
+            if (n == NULL) break;
+
+            if (n->type == TB_BRANCH) {
+                sccp_branch(&s, n);
+                continue;
+            }
+
+            if (n->gvn >= s.cap || !sccp_tracked(n->dt)) {
+                continue;
+            }
+
+            Lattice* new = sccp_compute(&s, n);
+            if (new == NULL) continue;
+
+            Lattice* old = s.types[n->gvn];
+            new = sccp_merge(&s, n, old, new);
+            if (old != new) {
+                s.types[n->gvn] = new;
+                FOR_USERS(u, n) {
+                    worklist_push(&s.ws, u->n);
+                }
+            }
+        }
+    }
+
+    CUIK_TIMED_BLOCK("rewrite") {
+        // branches with a single way out become gotos, the dead regions get
+        // cleaned up by the peepholes. this goes first since the constant
+        // rewrite makes nodes the solver hasn't seen.
+        FOREACH_N(i, 0, node_count) {
+            TB_Node* n = nodes[i];
+            if (n->type != TB_BRANCH || n->input_count != 2 || !sccp_is_reachable(&s, tb_get_parent_region(n))) {
+                continue;
+            }
+
+            TB_NodeBranch* info = TB_NODE_GET_EXTRA(n);
+            ptrdiff_t taken = -1;
+            FOREACH_N(j, 0, info->succ_count) {
+                if (sccp_feasible(&s, n, j)) {
+                    if (taken >= 0 && info->succ[taken] != info->succ[j]) {
+                        taken = -1;
+                        break;
+                    }
+
+                    taken = j;
+                }
+            }
+
+            if (taken >= 0) {
+                DO_IF(TB_OPTDEBUG_PEEP)(printf("sccp v%u => goto\n", n->gvn));
+                transmute_goto(p, f, n, info->succ[taken]);
+            }
+        }
+
+        // replace constants
+        FOREACH_N(i, 0, node_count) {
+            TB_Node* n = nodes[i];
+            if (n->type == TB_NULL || n->type == TB_INTEGER_CONST || n->dt.type != TB_INT) {
+                continue;
+            }
+
+            Lattice* l = s.types[n->gvn];
+            uint64_t x;
+            if (l != NULL && lattice_is_int_const(l, tb__mask(n->dt.data), &x)) {
+                DO_IF(TB_OPTDEBUG_PEEP)(printf("sccp v%u => %"PRIu64"\n", n->gvn, x));
+
+                TB_Node* k = make_int_node(f, p, n->dt, x);
+                tb_pass_mark(p, k);
+                tb_pass_mark_users(p, n);
+                subsume_node(p, f, n, k);
+            }
+        }
+    }
+
+    worklist_free(&s.reach);
+    worklist_free(&s.ws);
+    nl_hashset_free(s.uni.pool);
+    cuikperf_region_end();
+}
@@ -1,5 +1,6 @@
 // Local instruction scheduling is handled here, the idea is just to do a topological
-// sort which is anti-dependency aware, a future TB could implement multiple schedulers.
+// sort which is anti-dependency aware (sched_walk), sched_list can then reorder that to
+// hide latency.
 //
 // Once the worklist is filled, you can walk backwards and generate instructions accordingly.
 static bool is_same_bb(TB_Node* bb, TB_Node* n) {
@@ -14,6 +15,20 @@ static bool is_same_bb(TB_Node* bb, TB_Node* n) {
     return n == bb;
 }
 
+// does n use dep somewhere within the block, anti-dependencies can't be
+// honored when it does (that's fine, it means the memory op doesn't clobber
+// anything n cares about). we give up past some depth and say yes.
+static bool sched_uses(TB_Node* bb, TB_Node* n, TB_Node* dep, int depth) {
+    if (n == dep) return true;
+    if (!is_same_bb(bb, n) || n->type == TB_REGION || n->type == TB_START) return false;
+    if (depth == 0) return true;
+
+    FOREACH_N(i, 0, n->input_count) {
+        if (n->inputs[i] && sched_uses(bb, n->inputs[i], dep, depth - 1)) return true;
+    }
+    return false;
+}
+
 static void sched_walk_phi(TB_Passes* passes, Worklist* ws, DynArray(PhiVal)* phi_vals, TB_Node* bb, TB_Node* phi, size_t phi_index) {
     TB_Node* val = phi->inputs[1 + phi_index];
 
@@ -56,7 +71,7 @@ void sched_walk(TB_Passes* passes, Worklist* ws, DynArray(PhiVal)* phi_vals, TB_
             if (phi_index < 0) continue;
 
             // schedule memory PHIs
-            for (User* use = find_users(passes, dst); use; use = use->next) {
+            FOR_USERS(use, dst) {
                 TB_Node* phi = use->n;
                 if (phi->type == TB_PHI && phi->dt.type == TB_MEMORY) {
                     sched_walk_phi(passes, ws, phi_vals, bb, phi, phi_index);
@@ -64,7 +79,7 @@ void sched_walk(TB_Passes* passes, Worklist* ws, DynArray(PhiVal)* phi_vals, TB_
             }
 
             // schedule data PHIs, we schedule these afterwards because it's "generally" better
-            for (User* use = find_users(passes, dst); use; use = use->next) {
+            FOR_USERS(use, dst) {
                 TB_Node* phi = use->n;
                 if (phi->type == TB_PHI && phi->dt.type != TB_MEMORY) {
                     sched_walk_phi(passes, ws, phi_vals, bb, phi, phi_index);
@@ -73,25 +88,40 @@ void sched_walk(TB_Passes* passes, Worklist* ws, DynArray(PhiVal)* phi_vals, TB_
         }
     }
 
-    // push inputs
-    FOREACH_REVERSE_N(i, 0, n->input_count) if (n->inputs[i]) {
-        sched_walk(passes, ws, phi_vals, bb, n->inputs[i]);
+    // push inputs, a region's predecessors and a PHI's values come from the ends
+    // of other blocks (or of this one when it loops onto itself) so they're not ours.
+    if (n->type == TB_PHI) {
+        sched_walk(passes, ws, phi_vals, bb, n->inputs[0]);
+    } else if (n->type != TB_REGION) {
+        FOREACH_REVERSE_N(i, 0, n->input_count) if (n->inputs[i]) {
+            sched_walk(passes, ws, phi_vals, bb, n->inputs[i]);
+        }
     }
 
     // before the terminator we should eval leftovers that GCM linked here
     if (is_block_end(n)) {
         TB_Node* parent = get_block_begin(n);
-        for (User* use = find_users(passes, parent); use; use = use->next) {
+        FOR_USERS(use, parent) {
             sched_walk(passes, ws, phi_vals, bb, use->n);
         }
     }
 
+    if (is_mem_out_op(n)) {
+        // memory effects have anti-dependencies, the loads reading the previous
+        // memory must finish before the next memory effect is applied.
+        FOR_USERS(use, n->inputs[1]) {
+            TB_Node* ld = use->n;
+            if (use->slot == 1 && ld != n && ld->type == TB_LOAD && !sched_uses(bb, ld, n, 8)) {
+                sched_walk(passes, ws, phi_vals, bb, ld);
+            }
+        }
+    }
+
     dyn_array_put(ws->items, n);
 
     if (is_mem_out_op(n)) {
-        // memory effects have anti-dependencies, the previous loads
-        // must finish before the next memory effect is applied.
-        for (User* use = find_users(passes, n->inputs[1]); use; use = use->next) {
+        // whatever else hangs off the previous memory goes after
+        FOR_USERS(use, n->inputs[1]) {
             if (use->slot == 1 && use->n != n) {
                 sched_walk(passes, ws, phi_vals, bb, use->n);
             }
@@ -100,7 +130,7 @@ void sched_walk(TB_Passes* passes, Worklist* ws, DynArray(PhiVal)* phi_vals, TB_
 
     // push outputs (projections, if they apply)
     if (n->dt.type == TB_TUPLE && n->type != TB_BRANCH) {
-        for (User* use = find_users(passes, n); use; use = use->next) {
+        FOR_USERS(use, n) {
             TB_Node* use_n = use->n;
             if (use_n->type == TB_PROJ) {
                 sched_walk(passes, ws, phi_vals, bb, use_n);
@@ -108,3 +138,258 @@ void sched_walk(TB_Passes* passes, Worklist* ws, DynArray(PhiVal)* phi_vals, TB_
         }
     }
 }
+
+////////////////////////////////
+// List scheduler
+////////////////////////////////
+// sched_walk gives us a valid order but it'll happily place a load right before
+// its user, this reorders the block so the long latency stuff starts early. it's
+// a cycle-by-cycle list scheduler: every cycle we issue the ready nodes with the
+// longest path to the end of the block, as long as they've got a port free.
+//
+// effects (anything touching control or memory that isn't a load) keep their order
+// and the pure nodes around them can only move up, never past the effect which used
+// to follow them. that means loads never move past a store they were ahead of and
+// isel folding a load into a later node reads the same memory it used to.
+// we don't hoist across calls, whatever we hoist just gets spilled around them.
+typedef struct {
+    TB_Node* n;
+
+    int height;   // longest latency path to the end of the block
+    int earliest; // cycle where the inputs are ready
+    int preds;    // unscheduled predecessors
+    int users;    // unscheduled in-block users, the value dies once it's 0
+
+    // successors within the block, the low bit says if it's a data edge
+    // (the others just keep the order and don't wait for our latency)
+    int succ_count, succ_cap;
+    int* succ;
+
+    SchedCost cost;
+} SchedNode;
+
+typedef NL_Map(TB_Node*, int) SchedIndexMap;
+
+static bool sched_is_free(TB_Node* n) {
+    if (is_pinned(n) || n->type == TB_CYCLE_COUNTER || n->type == TB_MACHINE_OP) return false;
+    if (n->dt.type == TB_TUPLE || n->dt.type == TB_CONTROL || n->dt.type == TB_MEMORY) return false;
+    if (n->type == TB_LOAD) return true;
+
+    FOREACH_N(i, 0, n->input_count) {
+        if (n->inputs[i] && n->inputs[i]->dt.type == TB_MEMORY) return false;
+    }
+    return true;
+}
+
+static bool sched_is_call(TB_Node* n) {
+    return n->type == TB_CALL || n->type == TB_SYSCALL || n->type == TB_TAILCALL;
+}
+
+static void sched_edge(TB_Arena* arena, SchedNode* nodes, int from, int to, bool data) {
+    SchedNode* a = &nodes[from];
+    if (a->succ_count == a->succ_cap) {
+        int new_cap = a->succ_cap ? a->succ_cap * 2 : 4;
+        int* new_succ = tb_arena_alloc(arena, new_cap * sizeof(int));
+        if (a->succ_count) memcpy(new_succ, a->succ, a->succ_count * sizeof(int));
+
+        a->succ = new_succ;
+        a->succ_cap = new_cap;
+    }
+
+    a->succ[a->succ_count++] = (to << 1) | data;
+    nodes[to].preds += 1;
+}
+
+// values from other blocks are in the map as -1 (so we only count them once)
+static int sched_index(SchedIndexMap index, TB_Node* n) {
+    ptrdiff_t search = nl_map_get(index, n);
+    return search >= 0 ? index[search].v : -1;
+}
+
+// does the value take up a register while it's live (constants get rematerialized)
+static bool sched_needs_reg(TB_Node* n) {
+    switch (n->type) {
+        case TB_INTEGER_CONST: case TB_FLOAT32_CONST: case TB_FLOAT64_CONST:
+        case TB_SYMBOL: case TB_LOCAL: case TB_REGION: case TB_START:
+        return false;
+
+        default:
+        return n->dt.type != TB_CONTROL && n->dt.type != TB_MEMORY && n->dt.type != TB_TUPLE;
+    }
+}
+
+// negative is good, it's how many more values are live after n issues
+static int sched_pressure_delta(SchedNode* nodes, SchedIndexMap index, SchedNode* s) {
+    int delta = s->n->user_count > 0 && s->cost.ports != 0 ? 1 : 0;
+    FOREACH_N(i, 0, s->n->input_count) {
+        TB_Node* in = s->n->inputs[i];
+        if (in == NULL) continue;
+
+        int j = sched_index(index, in);
+        if (j >= 0 && nodes[j].users == 1) delta -= 1;
+    }
+    return delta;
+}
+
+void sched_list(TB_Passes* passes, Worklist* ws, size_t start, TB_Node* end, const SchedModel* model) {
+    // everything past the terminator stays put (memory users which got walked late)
+    size_t stop = dyn_array_length(ws->items);
+    FOREACH_N(i, start, stop) {
+        if (ws->items[i] == end) { stop = i; break; }
+    }
+
+    int count = stop - start;
+    if (count < 3) return;
+
+    TB_ArenaSavepoint sp = tb_arena_save(tmp_arena);
+    SchedNode* nodes = tb_arena_alloc(tmp_arena, count * sizeof(SchedNode));
+
+    SchedIndexMap index = NULL;
+    nl_map_create(index, count);
+    FOREACH_N(i, 0, count) {
+        TB_Node* n = ws->items[start + i];
+        nodes[i] = (SchedNode){ .n = n, .cost = model->cost(model->model, n) };
+        nl_map_put(index, n, i);
+    }
+
+    // build dependencies, everything points forward in the original order. dead loops
+    // can leave nodes which read themselves (or later nodes), those edges get dropped
+    // since they'd make a cycle.
+    int live = 0, last_effect = -1, last_call = -1, segment_start = 0;
+    FOREACH_N(i, 0, count) {
+        TB_Node* n = nodes[i].n;
+
+        FOREACH_N(j, 0, n->input_count) {
+            TB_Node* in = n->inputs[j];
+            // a PHI in a block which loops onto itself reads the last trip's values
+            if (in == NULL || (j > 0 && n->type == TB_PHI)) continue;
+
+            ptrdiff_t search = nl_map_get(index, in);
+            if (search < 0) {
+                // coming from another block, it's live the whole time (as far as we care)
+                if (sched_needs_reg(in)) live += 1;
+                nl_map_put(index, in, -1);
+            } else if (index[search].v >= 0 && index[search].v < i) {
+                sched_edge(tmp_arena, nodes, index[search].v, i, true);
+                nodes[index[search].v].users += 1;
+            }
+        }
+
+        if (sched_is_free(n)) {
+            if (last_call >= 0) sched_edge(tmp_arena, nodes, last_call, i, false);
+        } else {
+            // the pure nodes in front of us can't sink past us
+            FOREACH_N(j, segment_start, i) {
+                if (sched_is_free(nodes[j].n)) sched_edge(tmp_arena, nodes, j, i, false);
+            }
+            segment_start = i + 1;
+
+            if (last_effect >= 0) sched_edge(tmp_arena, nodes, last_effect, i, false);
+            last_effect = i;
+            if (sched_is_call(n)) last_call = i;
+        }
+    }
+
+    // critical path heights (reverse topological is just the original order backwards)
+    FOREACH_REVERSE_N(i, 0, count) {
+        SchedNode* s = &nodes[i];
+
+        int h = 0;
+        FOREACH_N(j, 0, s->succ_count) {
+            int succ_h = nodes[s->succ[j] >> 1].height;
+            if (h < succ_h) h = succ_h;
+        }
+        s->height = h + s->cost.latency;
+    }
+
+    int* ready = tb_arena_alloc(tmp_arena, count * sizeof(int));
+    int ready_count = 0;
+    FOREACH_N(i, 0, count) {
+        if (nodes[i].preds == 0) ready[ready_count++] = i;
+    }
+
+    int cycle = 0, placed = 0;
+    while (placed < count) {
+        int issued = 0;
+        uint32_t used_ports = 0;
+
+        for (;;) {
+            // pick the best candidate for this cycle, once we're out of registers we stop
+            // caring about latency (stalling beats spilling) and go for whatever kills the
+            // most values, ties go to the original order since sched_walk is pretty
+            // good at keeping pressure down. otherwise it's the critical path first.
+            bool pressured = live >= model->reg_limit;
+            int best = -1, best_delta = 0;
+            FOREACH_N(i, 0, ready_count) {
+                SchedNode* s = &nodes[ready[i]];
+                if (!pressured) {
+                    if (s->earliest > cycle) continue;
+                    if (s->cost.ports && (s->cost.ports & ~used_ports) == 0) continue;
+                }
+
+                int delta = pressured ? sched_pressure_delta(nodes, index, s) : 0;
+                if (best >= 0) {
+                    SchedNode* b = &nodes[ready[best]];
+                    if (delta > best_delta) continue;
+                    if (delta == best_delta) {
+                        if (!pressured && s->height < b->height) continue;
+                        if ((pressured || s->height == b->height) && ready[i] > ready[best]) continue;
+                    }
+                }
+
+                best = i, best_delta = delta;
+            }
+
+            if (best < 0) break;
+
+            int id = ready[best];
+            ready[best] = ready[--ready_count];
+
+            SchedNode* s = &nodes[id];
+            ws->items[start + placed] = s->n;
+            placed += 1;
+
+            // grab one of the ports, nodes without any are free (projections, constants)
+            if (s->cost.ports) {
+                uint32_t free_ports = s->cost.ports & ~used_ports;
+                used_ports |= free_ports & -free_ports;
+                issued += 1;
+            }
+
+            // track the live values
+            if (s->n->user_count > 0 && s->cost.ports) live += 1;
+            FOREACH_N(i, 0, s->n->input_count) {
+                TB_Node* in = s->n->inputs[i];
+                if (in == NULL) continue;
+
+                int j = sched_index(index, in);
+                if (j >= 0 && --nodes[j].users == 0 && nodes[j].cost.ports) {
+                    live -= 1;
+                }
+            }
+
+            FOREACH_N(i, 0, s->succ_count) {
+                int succ_id = s->succ[i] >> 1;
+                SchedNode* succ = &nodes[succ_id];
+
+                int t = cycle + (s->succ[i] & 1 ? s->cost.latency : 0);
+                if (succ->earliest < t) succ->earliest = t;
+                if (--succ->preds == 0) ready[ready_count++] = succ_id;
+            }
+
+            if (issued >= model->issue_width) break;
+        }
+
+        // nothing left to do this cycle, skip ahead to the next one something's ready in
+        int next = INT_MAX;
+        FOREACH_N(i, 0, ready_count) {
+            int t = nodes[ready[i]].earliest;
+            if (next > t) next = t;
+        }
+        assert((placed == count || ready_count > 0) && "cycle in the scheduling graph?");
+        cycle = next > cycle + 1 ? next : cycle + 1;
+    }
+
+    nl_map_free(index);
+    tb_arena_restore(tmp_arena, sp);
+}
@@ -0,0 +1,174 @@
+// Tail calls: a CALL whose results go straight into the END can hand our stack frame
+// over to the callee, codegen tears down the frame and jumps instead of calling so the
+// callee returns to our caller. it's done right before isel (after GCM, nothing else
+// knows what a TAILCALL is), there's two shapes of tail position:
+//
+//   call -> goto ret -> end       the ret region's PHIs take the call's projections
+//   call -> end                   once the ret region got folded into the call's block
+//
+// the CALL is retagged as a TAILCALL which terminates the block and the return path it
+// used to take gets cut off. calls from tb_inst_tailcall have to go this way, the rest
+// only do if none of our LOCALs escape since the callee might be holding a pointer into
+// the frame we're throwing away.
+typedef struct {
+    TB_Node* bb;
+    TB_Node* call;
+    // the goto into the ret region, NULL if the END is right after the call
+    TB_Node* br;
+} TailSite;
+
+static bool tail_locals_escape(TB_Passes* restrict p) {
+    dyn_array_for(i, p->locals) {
+        if (alias_escapes(p, p->locals[i], ALIAS_ESCAPE_DEPTH)) return true;
+    }
+    return false;
+}
+
+// what gets returned when control comes in through the path-th edge of the ret
+// region (or the END's input itself when path is -1), anything that's not a PHI
+// of the ret region is the same value on every path.
+static TB_Node* tail_ret_input(TB_Node* end, int slot, int path) {
+    TB_Node* n = end->inputs[slot];
+    if (path < 0) return n;
+
+    return n->type == TB_PHI && n->inputs[0] == end->inputs[0] ? n->inputs[1 + path] : n;
+}
+
+// the projections of the call can't be used by anything but the return
+static bool tail_is_ret_of(TB_Node* end, TB_Node* call, int path) {
+    TB_NodeCall* c = TB_NODE_GET_EXTRA(call);
+    if (c->proto == NULL || c->proto->return_count > 1) return false;
+
+    // either we return the call's memory or the optimizer figured out the call doesn't
+    // touch memory and we return whatever went into it.
+    TB_Node* mem = tail_ret_input(end, 1, path);
+    TB_Node* mproj = c->projs[1];
+    if (mproj != NULL && mproj->user_count > 0) {
+        if (mem != mproj || mproj->user_count != 1) return false;
+    } else if (mem != call->inputs[1]) {
+        return false;
+    }
+
+    TB_Node* dproj = c->proto->return_count ? c->projs[2] : NULL;
+    if (end->input_count > 3) {
+        return dproj != NULL && tail_ret_input(end, 3, path) == dproj && dproj->user_count == 1;
+    } else {
+        return dproj == NULL || dproj->user_count == 0;
+    }
+}
+
+// the call which the control edge comes straight out of
+static TB_Node* tail_call_of(TB_Node* ctrl) {
+    if (ctrl->type != TB_PROJ || ctrl->user_count != 1) return NULL;
+
+    TB_Node* call = ctrl->inputs[0];
+    return call->type == TB_CALL ? call : NULL;
+}
+
+static void tail_kill_projs(TB_Passes* restrict p, TB_Node* call) {
+    TB_NodeCall* c = TB_NODE_GET_EXTRA(call);
+    size_t proj_count = 2 + (c->proto->return_count ? 1 : 0);
+    FOREACH_N(i, 0, proj_count) {
+        if (c->projs[i] && c->projs[i]->user_count == 0) {
+            tb_pass_kill_node(p, c->projs[i]);
+            c->projs[i] = NULL;
+        }
+    }
+}
+
+int tb_pass_tail_calls(TB_Passes* restrict p, TB_TailCallLegal legal) {
+    TB_Function* f = p->f;
+    TB_Node* end = f->stop_node;
+
+    // only plain returns with a single value can be handed off
+    bool plain_ret = end != NULL && end->inputs[0] != NULL && end->inputs[2] == f->params[2] && end->input_count <= 4;
+    TB_Node* ret_bb = plain_ret && end->inputs[0]->type == TB_REGION ? end->inputs[0] : NULL;
+
+    Worklist* ws = &p->worklist;
+    worklist_clear(ws);
+    size_t block_count = tb_push_postorder(f, ws);
+
+    TailSite* sites = tb_arena_alloc(tmp_arena, block_count * sizeof(TailSite));
+    size_t site_count = 0;
+
+    int escapes = -1;
+    FOREACH_N(i, 0, block_count) {
+        TB_Node* bb = ws->items[i];
+        TB_Node* term = TB_NODE_GET_EXTRA_T(bb, TB_NodeRegion)->end;
+
+        TailSite s = { bb };
+        if (plain_ret && term == end) {
+            s.call = tail_call_of(end->inputs[0]);
+            if (s.call && !tail_is_ret_of(end, s.call, -1)) s.call = NULL;
+        } else if (ret_bb && term->type == TB_BRANCH && TB_NODE_GET_EXTRA_T(term, TB_NodeBranch)->succ_count == 1 &&
+            TB_NODE_GET_EXTRA_T(term, TB_NodeBranch)->succ[0] == ret_bb && term->user_count == 1) {
+            TB_Node* br_proj = term->users[0].n;
+            if (br_proj->user_count == 1) {
+                s.call = tail_call_of(term->inputs[0]);
+                s.br = term;
+
+                int path = br_proj->users[0].slot;
+                if (s.call && !tail_is_ret_of(end, s.call, path)) s.call = NULL;
+            }
+        }
+
+        // tb_inst_tailcall promised the caller this would work
+        for (TB_Node* n = term; n && n != bb; n = n->inputs[0]) {
+            if (n->type == TB_CALL && n != s.call && TB_NODE_GET_EXTRA_T(n, TB_NodeCall)->tail) {
+                tb_panic("%s: tail call isn't in tail position\n", f->super.name);
+            }
+        }
+
+        if (s.call == NULL) continue;
+
+        if (!TB_NODE_GET_EXTRA_T(s.call, TB_NodeCall)->tail) {
+            if (escapes < 0) escapes = tail_locals_escape(p);
+            if (escapes) continue;
+        }
+
+        if (!legal(f, s.call)) {
+            if (TB_NODE_GET_EXTRA_T(s.call, TB_NodeCall)->tail) {
+                tb_panic("%s: target can't lower tail call\n", f->super.name);
+            }
+            continue;
+        }
+
+        sites[site_count++] = s;
+    }
+
+    FOREACH_N(i, 0, site_count) {
+        TB_Node* bb = sites[i].bb;
+        TB_Node* call = sites[i].call;
+        TB_NodeRegion* r = TB_NODE_GET_EXTRA(bb);
+
+        if (sites[i].br) {
+            // cut the edge into the ret region, the PHIs drop our path too
+            TB_Node* br = sites[i].br;
+            remove_pred(p, f, bb, ret_bb);
+
+            tb_pass_kill_node(p, br->users[0].n);
+            tb_pass_kill_node(p, br);
+        } else {
+            // the END moves into a block nobody can reach (just like the noreturn calls)
+            TB_Node* dead = tb_alloc_node(f, TB_REGION, TB_TYPE_CONTROL, 0, sizeof(TB_NodeRegion));
+            TB_NODE_SET_EXTRA(dead, TB_NodeRegion, .end = end, .tag = "dead", .postorder_id = -1, .dom_depth = r->dom_depth + 1, .dom = bb);
+            set_input(p, end, dead, 0);
+        }
+
+        call->type = TB_TAILCALL;
+        call->dt = TB_TYPE_CONTROL;
+        tail_kill_projs(p, call);
+        r->end = call;
+    }
+
+    // the CFG changed under the schedule, codegen wants the postorder ids to
+    // match what it's about to walk.
+    if (site_count > 0) {
+        worklist_clear(ws);
+        block_count = tb_push_postorder(f, ws);
+        tb_compute_dominators(f, block_count, ws->items);
+    }
+
+    worklist_clear(ws);
+    return site_count;
+}
@@ -44,6 +44,11 @@ struct TB_Passes {
     TB_Function* f;
     bool scheduled;
 
+    // which register allocator codegen uses
+    TB_RegAlloc regalloc;
+    // how codegen orders nodes within a block
+    TB_LocalSched local_sched;
+
     // we use this to verify that we're on the same thread
     // for the entire duration of the TB_Passes.
     TB_ThreadInfo* pinned_thread;
@@ -56,6 +61,24 @@ struct TB_Passes {
     // this is used to do CSE
     NL_HashSet cse_nodes;
 
+    // which nodes are in cse_nodes with their current inputs (keyed by gvn),
+    // the batched GVN skips those since re-hashing them can't find anything new.
+    size_t in_cse_cap; // in words
+    uint64_t* in_cse;
+
+    // nodes which made it through a peephole round, they get GVN'd together
+    // once the round is over.
+    DynArray(TB_Node*) gvn_batch;
+
+    // peephole priority (keyed by gvn), it's the reverse postorder from when we
+    // entered the passes so defs come before their uses. 0 means unranked.
+    size_t order_cap;
+    int* order;
+
+    // user arrays which got outgrown, bucketed by log2 of their capacity. the
+    // first word of each one links to the next.
+    User* free_users[32];
+
     // debug shit:
     TB_Node* error_n;
 
@@ -111,6 +134,10 @@ static TB_Node* idom(TB_Node* n) {
     return TB_NODE_GET_EXTRA_T(n, TB_NodeRegion)->dom;
 }
 
+static int loop_depth(TB_Node* n) {
+    return TB_NODE_GET_EXTRA_T(tb_get_parent_region(n), TB_NodeRegion)->loop_depth;
+}
+
 static int dom_depth(TB_Node* n) {
     if (n == NULL) {
         return 0;
@@ -128,9 +155,9 @@ extern thread_local TB_Arena* tmp_arena;
 void verify_tmp_arena(TB_Passes* p);
 void set_input(TB_Passes* restrict p, TB_Node* n, TB_Node* in, int slot);
 
-static User* find_users(TB_Passes* restrict p, TB_Node* n) {
-    return n->users;
-}
+// walks the users of n, the user array can't change during the walk (set_input
+// on one of them can shuffle it) so copy what you need out first in that case.
+#define FOR_USERS(u, n) for (User *u = (n)->users, *u##_end_ = u + (n)->user_count; u != u##_end_; u++)
 
 // CFG
 //   pushes postorder walk into worklist items, also modifies the visited set.
@@ -138,6 +165,8 @@ static User* find_users(TB_Passes* restrict p, TB_Node* n) {
 size_t tb_push_postorder(TB_Function* f, Worklist* restrict ws);
 //   postorder walk -> dominators
 void tb_compute_dominators(TB_Function* f, size_t count, TB_Node** blocks);
+//   dominators -> loop nesting depth, ws still needs the visited set from the postorder walk
+void tb_compute_loop_depths(TB_Function* f, Worklist* restrict ws, size_t count, TB_Node** blocks);
 
 // Worklist API
 void worklist_alloc(Worklist* restrict ws, size_t initial_cap);
@@ -153,4 +182,32 @@ TB_Node* worklist_pop(Worklist* ws);
 // Local scheduler
 void sched_walk(TB_Passes* passes, Worklist* ws, DynArray(PhiVal)* phi_vals, TB_Node* bb, TB_Node* n);
 
+// List scheduler
+//   reorders what sched_walk produced for a block (items from start onwards) so
+//   long latency ops get going early. the target describes each node with a
+//   latency and the ports it can issue on.
+typedef struct {
+    int latency;
+    uint32_t ports;
+} SchedCost;
+
+typedef struct {
+    // ops issued per cycle
+    int issue_width;
+    // once this many values are live we stop hoisting and prefer nodes which
+    // finish off live ranges.
+    int reg_limit;
+
+    SchedCost (*cost)(const void* model, TB_Node* n);
+    const void* model;
+} SchedModel;
+
+void sched_list(TB_Passes* passes, Worklist* ws, size_t start, TB_Node* end, const SchedModel* model);
+
+// Tail calls
+//   turns CALLs in tail position into TAILCALLs (after GCM), the target decides which
+//   ones it can lower. returns how many there were.
+typedef bool (*TB_TailCallLegal)(TB_Function* f, TB_Node* call);
+int tb_pass_tail_calls(TB_Passes* restrict p, TB_TailCallLegal legal);
+
 static void push_all_nodes(Worklist* restrict ws, TB_Node* n);
@@ -0,0 +1,432 @@
+// Profile guided optimizations, instrumentation happens while the IR is being built:
+//
+//   * every function gets a private counters global laid out as a record:
+//       [name hash u64] [counter count u64] [counters u64...]
+//     counter 0 is the function entry, the rest are handed out in the order the
+//     tb_inst_if & tb_inst_branch calls happen (one per successor).
+//   * each successor edge gets a block which bumps its counter and jumps to the
+//     real target, plain non-atomic adds so threaded programs might lose some.
+//   * the first entry of any function registers __tb_profile_dump with atexit, which
+//     appends the module's records to the profile file. the JIT doesn't get any of
+//     that, tb_jit_profile_write reads the counters from the host side.
+//
+// since the ids only depend on the order things get built, loading the profile back
+// is just a matter of building the same source again.
+//
+// the file is a series of segments (one per module per run):
+//   [magic u32] [version u32] [record count u32] [reserved u32] [records...]
+// records with the same hash get summed when loading, if the counter counts don't
+// match it's from a different version of the function and we ignore it.
+enum {
+    PROF_MAGIC   = 0x46504254, // 'TBPF'
+    PROF_VERSION = 1,
+
+    // bytes before the counters
+    PROF_RECORD_HEADER = 16,
+    PROF_SEGMENT_HEADER = 16,
+};
+
+static uint64_t prof_hash(const char* name) {
+    // FNV-1a
+    uint64_t h = 0xcbf29ce484222325ull;
+    for (; *name; name++) {
+        h = (h ^ (uint8_t) *name) * 0x100000001b3ull;
+    }
+    return h;
+}
+
+static TB_ProfileRecord* prof_find(TB_Module* m, uint64_t hash) {
+    size_t lo = 0, hi = m->prof_record_count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (m->prof_records[mid].hash < hash) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return lo < m->prof_record_count && m->prof_records[lo].hash == hash ? &m->prof_records[lo] : NULL;
+}
+
+// NULL ret means it returns nothing
+static TB_FunctionPrototype* prof_proto(TB_Module* m, size_t param_count, const TB_DataType* params, const TB_DataType* ret) {
+    TB_PrototypeParam p[4];
+    FOREACH_N(i, 0, param_count) {
+        p[i] = (TB_PrototypeParam){ params[i] };
+    }
+
+    TB_PrototypeParam r = { ret ? *ret : TB_TYPE_VOID };
+    return tb_prototype_create(m, TB_STDCALL, param_count, p, ret != NULL, &r, false);
+}
+
+static TB_Node* prof_call(TB_Function* f, TB_FunctionPrototype* proto, TB_Symbol* target, size_t param_count, TB_Node** params) {
+    return tb_inst_call(f, proto, tb_inst_get_symbol_address(f, target), param_count, params).single;
+}
+
+// bumps the counter and returns the old value
+static TB_Node* prof_bump(TB_Function* f, uint32_t id) {
+    TB_Node* addr = tb_inst_get_symbol_address(f, (TB_Symbol*) f->prof_counters);
+    addr = tb_inst_member_access(f, addr, PROF_RECORD_HEADER + id*sizeof(uint64_t));
+
+    TB_Node* old = tb_inst_load(f, TB_TYPE_I64, addr, 8, false);
+    tb_inst_store(f, TB_TYPE_I64, addr, tb_inst_add(f, old, tb_inst_uint(f, TB_TYPE_I64, 1), 0), 8, false);
+    return old;
+}
+
+void tb__profile_begin(TB_Function* f) {
+    TB_Module* m = f->super.module;
+    f->prof_edges = 1;
+    if (f->super.name == NULL) {
+        return;
+    }
+
+    if (m->prof_records != NULL) {
+        TB_ProfileRecord* r = prof_find(m, prof_hash(f->super.name));
+        if (r != NULL) {
+            f->prof_counts = r->counts;
+            f->prof_count_len = r->count;
+        }
+    }
+
+    if (m->prof_path == NULL || f == m->prof_dump || f == m->prof_register) {
+        return;
+    }
+
+    f->prof_counters = tb_global_create(m, 0, NULL, NULL, TB_LINKAGE_PRIVATE);
+    TB_Node* old = prof_bump(f, 0);
+
+    // first time in, make sure the counts get dumped
+    if (m->prof_register != NULL) {
+        TB_Node* first = tb_inst_region(f);
+        TB_Node* rest = tb_inst_region(f);
+        TB_Node* n = build_if(f, tb_inst_cmp_eq(f, old, tb_inst_uint(f, TB_TYPE_I64, 0)), first, rest);
+
+        uint32_t weights[2] = { EXPECT_UNLIKELY, EXPECT_LIKELY };
+        tb_inst_set_branch_weights(f, n, weights);
+
+        tb_inst_set_control(f, first);
+        prof_call(f, m->prof_register->prototype, (TB_Symbol*) m->prof_register, 0, NULL);
+        tb_inst_goto(f, rest);
+        tb_inst_set_control(f, rest);
+    }
+}
+
+void tb__profile_edges(TB_Function* f, uint32_t id, size_t count, TB_Node** edges, TB_Node** targets) {
+    FOREACH_N(i, 0, count) {
+        tb_inst_set_control(f, edges[i]);
+        prof_bump(f, id + i);
+        tb_inst_goto(f, targets[i]);
+    }
+}
+
+void tb__profile_weights(TB_Function* f, TB_Node* n, uint32_t id) {
+    TB_NodeBranch* br = TB_NODE_GET_EXTRA(n);
+    if (f->prof_counts == NULL || id + br->succ_count > f->prof_count_len) {
+        return;
+    }
+
+    const uint64_t* counts = &f->prof_counts[id];
+    uint64_t max = 0;
+    FOREACH_N(i, 0, br->succ_count) {
+        if (counts[i] > max) max = counts[i];
+    }
+
+    // never ran, whatever the hints said is all we've got
+    if (max == 0) {
+        return;
+    }
+
+    int shift = 0;
+    while ((max >> shift) > UINT32_MAX) shift++;
+
+    if (br->weights == NULL) {
+        br->weights = alloc_from_node_arena(f, br->succ_count * sizeof(uint32_t));
+    }
+
+    FOREACH_N(i, 0, br->succ_count) {
+        br->weights[i] = counts[i] >> shift;
+    }
+}
+
+void tb_module_profile_generate(TB_Module* m, const char* path) {
+    m->prof_path = tb__arena_strdup(m, -1, path);
+    if (m->is_jit) {
+        return;
+    }
+
+    TB_ModuleSectionHandle text = tb_module_get_text(m);
+    TB_ModuleSectionHandle data = tb_module_get_data(m);
+
+    // [segment header] [record pointers...], filled in by tb_module_profile_finish
+    m->prof_table = tb_global_create(m, 0, NULL, NULL, TB_LINKAGE_PRIVATE);
+
+    TB_Global* flag = tb_global_create(m, 0, NULL, NULL, TB_LINKAGE_PRIVATE);
+    tb_global_set_storage(m, data, flag, 4, 4, 0);
+
+    TB_Symbol* fopen_sym  = (TB_Symbol*) tb_extern_create(m, -1, "fopen", TB_EXTERNAL_SO_LOCAL);
+    TB_Symbol* fwrite_sym = (TB_Symbol*) tb_extern_create(m, -1, "fwrite", TB_EXTERNAL_SO_LOCAL);
+    TB_Symbol* fclose_sym = (TB_Symbol*) tb_extern_create(m, -1, "fclose", TB_EXTERNAL_SO_LOCAL);
+    TB_Symbol* atexit_sym = (TB_Symbol*) tb_extern_create(m, -1, "atexit", TB_EXTERNAL_SO_LOCAL);
+
+    TB_FunctionPrototype* void_proto   = prof_proto(m, 0, NULL, NULL);
+    TB_FunctionPrototype* fopen_proto  = prof_proto(m, 2, (TB_DataType[]){ TB_TYPE_PTR, TB_TYPE_PTR }, &TB_TYPE_PTR);
+    TB_FunctionPrototype* fwrite_proto = prof_proto(m, 4, (TB_DataType[]){ TB_TYPE_PTR, TB_TYPE_I64, TB_TYPE_I64, TB_TYPE_PTR }, &TB_TYPE_I64);
+    TB_FunctionPrototype* fclose_proto = prof_proto(m, 1, (TB_DataType[]){ TB_TYPE_PTR }, &TB_TYPE_I32);
+    TB_FunctionPrototype* atexit_proto = prof_proto(m, 1, (TB_DataType[]){ TB_TYPE_PTR }, &TB_TYPE_I32);
+
+    m->prof_dump = tb_function_create(m, -1, "__tb_profile_dump", TB_LINKAGE_PRIVATE);
+    m->prof_register = tb_function_create(m, -1, "__tb_profile_register", TB_LINKAGE_PRIVATE);
+
+    // __tb_profile_dump:
+    //   fp = fopen(path, "ab")
+    //   if (fp) {
+    //     fwrite(table, 16, 1, fp)
+    //     for (i = 0; i < table->record_count; i++) {
+    //       r = table->records[i]
+    //       fwrite(r, 16 + r->count*8, 1, fp)
+    //     }
+    //     fclose(fp)
+    //   }
+    {
+        TB_Function* f = m->prof_dump;
+        tb_function_set_prototype(f, text, void_proto, NULL);
+
+        TB_Node* table = tb_inst_get_symbol_address(f, (TB_Symbol*) m->prof_table);
+        TB_Node* one = tb_inst_uint(f, TB_TYPE_I64, 1);
+
+        TB_Node* fp = prof_call(f, fopen_proto, fopen_sym, 2, (TB_Node*[]){ tb_inst_cstring(f, m->prof_path), tb_inst_cstring(f, "ab") });
+
+        TB_Node* open = tb_inst_region(f);
+        TB_Node* header = tb_inst_region(f);
+        TB_Node* body = tb_inst_region(f);
+        TB_Node* close = tb_inst_region(f);
+        TB_Node* exit = tb_inst_region(f);
+        build_if(f, tb_inst_cmp_eq(f, fp, tb_inst_uint(f, TB_TYPE_PTR, 0)), exit, open);
+
+        tb_inst_set_control(f, open);
+        prof_call(f, fwrite_proto, fwrite_sym, 4, (TB_Node*[]){ table, tb_inst_uint(f, TB_TYPE_I64, PROF_SEGMENT_HEADER), one, fp });
+        TB_Node* record_count = tb_inst_zxt(f, tb_inst_load(f, TB_TYPE_I32, tb_inst_member_access(f, table, 8), 4, false), TB_TYPE_I64);
+        TB_Node* i_slot = tb_inst_local(f, 8, 8);
+        tb_inst_store(f, TB_TYPE_I64, i_slot, tb_inst_uint(f, TB_TYPE_I64, 0), 8, false);
+        tb_inst_goto(f, header);
+
+        tb_inst_set_control(f, header);
+        TB_Node* i = tb_inst_load(f, TB_TYPE_I64, i_slot, 8, false);
+        build_if(f, tb_inst_cmp_ilt(f, i, record_count, false), body, close);
+
+        tb_inst_set_control(f, body);
+        TB_Node* records = tb_inst_member_access(f, table, PROF_SEGMENT_HEADER);
+        TB_Node* r = tb_inst_load(f, TB_TYPE_PTR, tb_inst_array_access(f, records, i, sizeof(void*)), 8, false);
+        TB_Node* len = tb_inst_load(f, TB_TYPE_I64, tb_inst_member_access(f, r, 8), 8, false);
+        len = tb_inst_add(f, tb_inst_shl(f, len, tb_inst_uint(f, TB_TYPE_I64, 3), 0), tb_inst_uint(f, TB_TYPE_I64, PROF_RECORD_HEADER), 0);
+        prof_call(f, fwrite_proto, fwrite_sym, 4, (TB_Node*[]){ r, len, one, fp });
+        tb_inst_store(f, TB_TYPE_I64, i_slot, tb_inst_add(f, i, one, 0), 8, false);
+        tb_inst_goto(f, header);
+
+        tb_inst_set_control(f, close);
+        prof_call(f, fclose_proto, fclose_sym, 1, &fp);
+        tb_inst_goto(f, exit);
+
+        tb_inst_set_control(f, exit);
+        tb_inst_ret(f, 0, NULL);
+    }
+
+    // __tb_profile_register:
+    //   if (!flag) { flag = 1, atexit(__tb_profile_dump) }
+    {
+        TB_Function* f = m->prof_register;
+        tb_function_set_prototype(f, text, void_proto, NULL);
+
+        TB_Node* flag_addr = tb_inst_get_symbol_address(f, (TB_Symbol*) flag);
+        TB_Node* first = tb_inst_region(f);
+        TB_Node* exit = tb_inst_region(f);
+        TB_Node* old = tb_inst_load(f, TB_TYPE_I32, flag_addr, 4, false);
+        build_if(f, tb_inst_cmp_eq(f, old, tb_inst_uint(f, TB_TYPE_I32, 0)), first, exit);
+
+        tb_inst_set_control(f, first);
+        tb_inst_store(f, TB_TYPE_I32, flag_addr, tb_inst_uint(f, TB_TYPE_I32, 1), 4, false);
+        TB_Node* dump = tb_inst_get_symbol_address(f, (TB_Symbol*) m->prof_dump);
+        prof_call(f, atexit_proto, atexit_sym, 1, &dump);
+        tb_inst_goto(f, exit);
+
+        tb_inst_set_control(f, exit);
+        tb_inst_ret(f, 0, NULL);
+    }
+}
+
+void tb_module_profile_finish(TB_Module* m, TB_Arena* arena) {
+    if (m->prof_path == NULL) {
+        return;
+    }
+
+    // now that every function is built we know how many counters they need
+    size_t record_count = 0;
+    TB_SymbolIter it = tb_symbol_iter(m);
+    TB_Symbol* sym;
+    while (sym = tb_symbol_iter_next(&it), sym) {
+        TB_Function* f = (TB_Function*) sym;
+        if (sym->tag != TB_SYMBOL_FUNCTION || f->prof_counters == NULL) continue;
+
+        size_t size = PROF_RECORD_HEADER + f->prof_edges*sizeof(uint64_t);
+        tb_global_set_storage(m, tb_module_get_data(m), f->prof_counters, size, 8, 1);
+
+        uint64_t* header = tb_global_add_region(m, f->prof_counters, 0, PROF_RECORD_HEADER);
+        header[0] = prof_hash(f->super.name);
+        header[1] = f->prof_edges;
+        record_count++;
+    }
+
+    if (m->prof_table == NULL) {
+        return;
+    }
+
+    size_t size = PROF_SEGMENT_HEADER + record_count*sizeof(void*);
+    tb_global_set_storage(m, tb_module_get_data(m), m->prof_table, size, 8, 1 + record_count);
+
+    uint32_t* header = tb_global_add_region(m, m->prof_table, 0, PROF_SEGMENT_HEADER);
+    header[0] = PROF_MAGIC;
+    header[1] = PROF_VERSION;
+    header[2] = record_count;
+    header[3] = 0;
+
+    size_t i = 0;
+    it = tb_symbol_iter(m);
+    while (sym = tb_symbol_iter_next(&it), sym) {
+        TB_Function* f = (TB_Function*) sym;
+        if (sym->tag != TB_SYMBOL_FUNCTION || f->prof_counters == NULL) continue;
+
+        tb_global_add_symbol_reloc(m, m->prof_table, PROF_SEGMENT_HEADER + i*sizeof(void*), (TB_Symbol*) f->prof_counters);
+        i++;
+    }
+
+    // at -O0 the frontend compiles functions as it goes, it didn't know about these
+    TB_Function* funcs[2] = { m->prof_dump, m->prof_register };
+    FOREACH_N(j, 0, 2) {
+        if (funcs[j]->output == NULL) {
+            TB_Passes* p = tb_pass_enter(funcs[j], arena);
+            tb_pass_codegen(p, false);
+            tb_pass_exit(p);
+        }
+    }
+}
+
+bool tb_jit_profile_write(TB_Module* m) {
+    if (m->prof_path == NULL) {
+        return true;
+    }
+
+    FILE* fp = fopen(m->prof_path, "ab");
+    if (fp == NULL) {
+        return false;
+    }
+
+    uint32_t record_count = 0;
+    TB_SymbolIter it = tb_symbol_iter(m);
+    TB_Symbol* sym;
+    while (sym = tb_symbol_iter_next(&it), sym) {
+        TB_Function* f = (TB_Function*) sym;
+        if (sym->tag == TB_SYMBOL_FUNCTION && f->prof_counters != NULL && f->prof_counters->address != NULL) {
+            record_count++;
+        }
+    }
+
+    uint32_t header[4] = { PROF_MAGIC, PROF_VERSION, record_count, 0 };
+    fwrite(header, sizeof(header), 1, fp);
+
+    it = tb_symbol_iter(m);
+    while (sym = tb_symbol_iter_next(&it), sym) {
+        TB_Function* f = (TB_Function*) sym;
+        if (sym->tag == TB_SYMBOL_FUNCTION && f->prof_counters != NULL && f->prof_counters->address != NULL) {
+            fwrite(f->prof_counters->address, f->prof_counters->size, 1, fp);
+        }
+    }
+
+    fclose(fp);
+    return true;
+}
+
+static int prof_record_cmp(const void* a, const void* b) {
+    uint64_t x = ((const TB_ProfileRecord*) a)->hash;
+    uint64_t y = ((const TB_ProfileRecord*) b)->hash;
+    return (x > y) - (x < y);
+}
+
+bool tb_module_profile_use(TB_Module* m, const char* path) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return false;
+    }
+
+    fseek(fp, 0, SEEK_END);
+    size_t size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+
+    uint8_t* buffer = tb_platform_heap_alloc(size + 1);
+    size_t read = fread(buffer, 1, size, fp);
+    fclose(fp);
+    if (read != size) {
+        tb_platform_heap_free(buffer);
+        return false;
+    }
+
+    DynArray(TB_ProfileRecord) records = NULL;
+    size_t pos = 0;
+    while (pos + PROF_SEGMENT_HEADER <= size) {
+        uint32_t header[4];
+        memcpy(header, &buffer[pos], sizeof(header));
+        if (header[0] != PROF_MAGIC || header[1] != PROF_VERSION) {
+            break;
+        }
+
+        pos += PROF_SEGMENT_HEADER;
+        FOREACH_N(i, 0, header[2]) {
+            if (pos + PROF_RECORD_HEADER > size) break;
+
+            TB_ProfileRecord r;
+            memcpy(&r.hash, &buffer[pos], 8);
+            memcpy(&r.count, &buffer[pos + 8], 8);
+            if (r.count > (size - pos - PROF_RECORD_HEADER) / sizeof(uint64_t)) {
+                pos = size;
+                break;
+            }
+
+            r.counts = (uint64_t*) &buffer[pos + PROF_RECORD_HEADER];
+            dyn_array_put(records, r);
+            pos += PROF_RECORD_HEADER + r.count*sizeof(uint64_t);
+        }
+    }
+
+    size_t count = dyn_array_length(records);
+    if (count == 0) {
+        dyn_array_destroy(records);
+        tb_platform_heap_free(buffer);
+        return false;
+    }
+
+    // sum up the runs, a copy which doesn't match the counter count gets dropped
+    TB_ProfileRecord* sorted = tb_platform_heap_alloc(count * sizeof(TB_ProfileRecord));
+    memcpy(sorted, records, count * sizeof(TB_ProfileRecord));
+    dyn_array_destroy(records);
+    qsort(sorted, count, sizeof(TB_ProfileRecord), prof_record_cmp);
+
+    size_t j = 0;
+    FOREACH_N(i, 0, count) {
+        if (j > 0 && sorted[j - 1].hash == sorted[i].hash) {
+            if (sorted[j - 1].count == sorted[i].count) {
+                FOREACH_N(k, 0, sorted[i].count) {
+                    sorted[j - 1].counts[k] += sorted[i].counts[k];
+                }
+            }
+        } else {
+            sorted[j++] = sorted[i];
+        }
+    }
+
+    tb_platform_heap_free(m->prof_records);
+    tb_platform_heap_free(m->prof_file);
+    m->prof_records = sorted;
+    m->prof_record_count = j;
+    m->prof_file = buffer;
+    return true;
+}
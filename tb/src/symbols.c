@@ -6,8 +6,8 @@ TB_SymbolIter tb_symbol_iter(TB_Module* mod) {
 }
 
 TB_Symbol* tb_symbol_iter_next(TB_SymbolIter* iter) {
-    for (TB_ThreadInfo* info = iter->info; info != NULL; info = info->next_in_module) {
-        size_t cap = 1ull << info->symbols.exp;
+    for (TB_ThreadInfo* info = iter->info; info != NULL; info = info->next_in_module, iter->i = 0) {
+        size_t cap = info->symbols.data ? 1ull << info->symbols.exp : 0;
         for (size_t i = iter->i; i < cap; i++) {
             void* ptr = info->symbols.data[i];
             if (ptr == NULL) continue;
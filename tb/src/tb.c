@@ -76,10 +76,61 @@ char* tb__arena_strdup(TB_Module* m, ptrdiff_t len, const char* src) {
     return newstr;
 }
 
-static TB_CodeRegion* get_or_allocate_code_region(TB_ThreadInfo* info) {
+bool tb_module_reserve_code(TB_Module* m, size_t size) {
+    assert(m->code_reserve.mapping == NULL && m->compiled_function_count == 0 && "reserve before compiling anything");
+
+    // over-reserve so the base can sit on a huge page boundary
+    size = align_up(size, CODE_RESERVE_CHUNK_SIZE);
+    size_t mapping_size = size + CODE_RESERVE_ALIGN;
+    void* mapping = tb_platform_vreserve(mapping_size, true);
+    if (mapping == NULL) {
+        return false;
+    }
+
+    m->code_reserve.mapping = mapping;
+    m->code_reserve.mapping_size = mapping_size;
+    m->code_reserve.base = (uint8_t*) align_up((uintptr_t) mapping, CODE_RESERVE_ALIGN);
+    m->code_reserve.size = size;
+    return true;
+}
+
+// regions come out of the module's reservation when it has one, anything which
+// doesn't fit in a chunk (or once the reservation runs dry) gets mapped on its own.
+TB_CodeRegion* tb__alloc_code_region(TB_Module* m, size_t min_size) {
+    size_t size = 0;
+    TB_CodeRegion* region = NULL;
+
+    if (m->code_reserve.base != NULL && sizeof(TB_CodeRegion) + min_size <= CODE_RESERVE_CHUNK_SIZE) {
+        size_t pos = atomic_fetch_add(&m->code_reserve.used, CODE_RESERVE_CHUNK_SIZE);
+        if (pos + CODE_RESERVE_CHUNK_SIZE <= m->code_reserve.size && tb_platform_vcommit(&m->code_reserve.base[pos], CODE_RESERVE_CHUNK_SIZE)) {
+            region = (TB_CodeRegion*) &m->code_reserve.base[pos];
+            size = CODE_RESERVE_CHUNK_SIZE;
+        }
+    }
+
+    if (region == NULL) {
+        size = align_up(sizeof(TB_CodeRegion) + min_size, CODE_REGION_BUFFER_SIZE);
+        region = tb_platform_valloc(size);
+        if (region == NULL) tb_panic("could not allocate code region!");
+    }
+
+    *region = (TB_CodeRegion){ .capacity = size - sizeof(TB_CodeRegion) };
+    return region;
+}
+
+void tb__free_code_region(TB_Module* m, TB_CodeRegion* region) {
+    // chunks go away with the reservation
+    uint8_t* ptr = (uint8_t*) region;
+    if (m->code_reserve.base != NULL && ptr >= m->code_reserve.base && ptr < &m->code_reserve.base[m->code_reserve.size]) {
+        return;
+    }
+
+    tb_platform_vfree(region, sizeof(TB_CodeRegion) + region->capacity);
+}
+
+static TB_CodeRegion* get_or_allocate_code_region(TB_Module* m, TB_ThreadInfo* info) {
     if (info->code == NULL) {
-        info->code = tb_platform_valloc(CODE_REGION_BUFFER_SIZE);
-        info->code->capacity = CODE_REGION_BUFFER_SIZE - sizeof(TB_CodeRegion);
+        info->code = tb__alloc_code_region(m, 0);
     }
 
     return info->code;
@@ -157,6 +208,14 @@ TB_Module* tb_module_create(TB_Arch arch, TB_System sys, const TB_FeatureSet* fe
     return m;
 }
 
+void tb_pass_regalloc(TB_Passes* p, TB_RegAlloc ra) {
+    p->regalloc = ra;
+}
+
+void tb_pass_local_schedule(TB_Passes* p, TB_LocalSched s) {
+    p->local_sched = s;
+}
+
 TB_FunctionOutput* tb_pass_codegen(TB_Passes* p, bool emit_asm) {
     TB_Function* f = p->f;
     TB_Module* m = f->super.module;
@@ -164,17 +223,16 @@ TB_FunctionOutput* tb_pass_codegen(TB_Passes* p, bool emit_asm) {
 
     // Machine code gen
     TB_ThreadInfo* info = tb_thread_info(m);
-    TB_CodeRegion* region = get_or_allocate_code_region(info);
+    TB_CodeRegion* region = get_or_allocate_code_region(m, info);
 
     size_t align_mask = _Alignof(TB_FunctionOutput) - 1;
     size_t next_size = (region->size + align_mask) & ~align_mask;
     if (next_size + sizeof(TB_FunctionOutput) >= region->capacity) {
         // append new region
-        TB_CodeRegion* new_region = tb_platform_valloc(CODE_REGION_BUFFER_SIZE);
-        if (new_region == NULL) tb_panic("could not allocate code region!");
-
-        new_region->capacity = CODE_REGION_BUFFER_SIZE - sizeof(TB_CodeRegion);
+        TB_CodeRegion* new_region = tb__alloc_code_region(m, sizeof(TB_FunctionOutput));
         new_region->prev = region;
+
+        info->code = region = new_region;
     } else {
         region->size = next_size;
     }
@@ -250,7 +308,7 @@ void tb_module_destroy(TB_Module* m) {
         TB_CodeRegion* code = info->code;
         while (code != NULL) {
             TB_CodeRegion* prev = code->prev;
-            tb_platform_vfree(code, CODE_REGION_BUFFER_SIZE);
+            tb__free_code_region(m, code);
             code = prev;
         }
 
@@ -265,13 +323,24 @@ void tb_module_destroy(TB_Module* m) {
         } else {
             info->prev->next = info->next;
         }
+
+        // a thread can hold infos for several modules at once
+        if (info->next != NULL) {
+            info->next->prev = info->prev;
+        }
         mtx_unlock(info->lock);
 
         tb_platform_heap_free(info);
         info = next;
     }
 
+    if (m->code_reserve.mapping != NULL) {
+        tb_platform_vfree(m->code_reserve.mapping, m->code_reserve.mapping_size);
+    }
+
     dyn_array_destroy(m->files);
+    tb_platform_heap_free(m->prof_records);
+    tb_platform_heap_free(m->prof_file);
     tb_platform_heap_free(m);
 }
 
@@ -374,6 +443,7 @@ void tb_function_set_prototype(TB_Function* f, TB_ModuleSectionHandle section, T
     }
 
     f->prototype = p;
+    tb__profile_begin(f);
 }
 
 TB_FunctionPrototype* tb_function_get_prototype(TB_Function* f) {
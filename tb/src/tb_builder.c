@@ -66,6 +66,18 @@ void tb_function_attrib_location(TB_Function* f, TB_Node* n, TB_SourceFile* file
     append_attrib(f, n, (TB_Attrib){ TB_ATTRIB_LOCATION, .loc = { file, line, column } });
 }
 
+void tb_function_attrib_type_class(TB_Function* f, TB_Node* n, int type_class) {
+    append_attrib(f, n, (TB_Attrib){ TB_ATTRIB_ALIAS, .alias = { type_class, false } });
+}
+
+void tb_function_attrib_restrict(TB_Function* f, TB_Node* n) {
+    append_attrib(f, n, (TB_Attrib){ TB_ATTRIB_ALIAS, .alias = { 0, true } });
+}
+
+void tb_function_attrib_expect(TB_Function* f, TB_Node* n, uint64_t value) {
+    append_attrib(f, n, (TB_Attrib){ TB_ATTRIB_EXPECT, .expect = { value } });
+}
+
 void tb_inst_set_location(TB_Function* f, TB_SourceFile* file, int line, int column) {
     f->line_attrib = (TB_Attrib){ TB_ATTRIB_LOCATION, .loc = { file, line, column } };
 }
@@ -86,15 +98,17 @@ static void* alloc_from_node_arena(TB_Function* f, size_t necessary_size) {
 TB_Node* tb_alloc_node(TB_Function* f, int type, TB_DataType dt, int input_count, size_t extra) {
     assert(input_count < UINT16_MAX && "too many inputs!");
 
-    TB_Node* n = alloc_from_node_arena(f, sizeof(TB_Node) + extra);
+    TB_Node* n = alloc_from_node_arena(f, tb_node_alloc_size(input_count, extra));
     n->type = type;
     n->dt = dt;
     n->gvn = f->node_count++;
     n->input_count = input_count;
+    n->user_count = 0;
     n->users = NULL;
 
     if (input_count > 0) {
-        n->inputs = alloc_from_node_arena(f, input_count * sizeof(TB_Node*));
+        // inline with the node, it only moves out if it grows (add_input_late)
+        n->inputs = (TB_Node**) ((char*) n + tb_node_alloc_size(0, extra));
         memset(n->inputs, 0, input_count * sizeof(TB_Node*));
     } else {
         // basically only true for START, maybe it's best
@@ -221,6 +235,22 @@ TB_Node* tb_inst_get_control(TB_Function* f) {
     return f->active_control_node;
 }
 
+// control never makes it past a trap, but the END might not exist yet and
+// whatever's made here decides how many values the function returns.
+static void ret_poison(TB_Function* f) {
+    TB_FunctionPrototype* proto = f->prototype;
+    TB_PrototypeParam* rets = TB_PROTOTYPE_RETURNS(proto);
+
+    TB_TemporaryStorage* tls = tb_tls_steal();
+    TB_Node** values = tb_tls_push(tls, proto->return_count * sizeof(TB_Node*));
+    FOREACH_N(i, 0, proto->return_count) {
+        values[i] = tb_alloc_node(f, TB_POISON, rets[i].dt, 1, 0);
+    }
+
+    tb_inst_ret(f, proto->return_count, values);
+    tb_tls_restore(tls, values);
+}
+
 void tb_inst_unreachable(TB_Function* f) {
     TB_Node* n = tb_alloc_node(f, TB_UNREACHABLE, TB_TYPE_VOID, 1, 0);
     n->inputs[0] = f->active_control_node;
@@ -230,7 +260,7 @@ void tb_inst_unreachable(TB_Function* f) {
     f->active_control_node = n;
 
     // return afterwards
-    tb_inst_ret(f, 0, NULL);
+    ret_poison(f);
 }
 
 void tb_inst_debugbreak(TB_Function* f) {
@@ -248,7 +278,7 @@ void tb_inst_trap(TB_Function* f) {
     f->active_control_node = n;
 
     // return afterwards
-    tb_inst_ret(f, 0, NULL);
+    ret_poison(f);
 }
 
 TB_Node* tb_inst_poison(TB_Function* f) {
@@ -296,7 +326,7 @@ TB_Node* tb_inst_load(TB_Function* f, TB_DataType dt, TB_Node* addr, TB_CharUnit
     }
 }
 
-void tb_inst_store(TB_Function* f, TB_DataType dt, TB_Node* addr, TB_Node* val, uint32_t alignment, bool is_volatile) {
+TB_Node* tb_inst_store(TB_Function* f, TB_DataType dt, TB_Node* addr, TB_Node* val, uint32_t alignment, bool is_volatile) {
     assert(TB_DATA_TYPE_EQUALS(dt, val->dt));
 
     TB_Node* n = tb_alloc_node(f, is_volatile ? TB_WRITE : TB_STORE, TB_TYPE_MEMORY, 4, sizeof(TB_NodeMemAccess));
@@ -305,6 +335,7 @@ void tb_inst_store(TB_Function* f, TB_DataType dt, TB_Node* addr, TB_Node* val,
     n->inputs[2] = addr;
     n->inputs[3] = val;
     TB_NODE_SET_EXTRA(n, TB_NodeMemAccess, .align = alignment);
+    return n;
 }
 
 void tb_inst_memset(TB_Function* f, TB_Node* dst, TB_Node* val, TB_Node* size, TB_CharUnits align) {
@@ -436,6 +467,7 @@ TB_Node* tb_inst_syscall(TB_Function* f, TB_DataType dt, TB_Node* syscall_num, s
 
     TB_NodeCall* c = TB_NODE_GET_EXTRA(n);
     c->proto = NULL;
+    c->tail = false;
     c->projs[0] = cproj;
     c->projs[1] = mproj;
     c->projs[2] = dproj;
@@ -452,6 +484,7 @@ TB_MultiOutput tb_inst_call(TB_Function* f, TB_FunctionPrototype* proto, TB_Node
 
     TB_NodeCall* c = TB_NODE_GET_EXTRA(n);
     c->proto = proto;
+    c->tail = false;
 
     // control proj
     TB_Node* cproj = tb__make_proj(f, TB_TYPE_CONTROL, n, 0);
@@ -468,7 +501,7 @@ TB_MultiOutput tb_inst_call(TB_Function* f, TB_FunctionPrototype* proto, TB_Node
 
     // we'll slot a NULL so it's easy to tell when it's empty
     if (proto->return_count == 0) {
-        c->projs[1] = NULL;
+        c->projs[2] = NULL;
     }
 
     c->projs[0] = cproj;
@@ -482,6 +515,16 @@ TB_MultiOutput tb_inst_call(TB_Function* f, TB_FunctionPrototype* proto, TB_Node
     }
 }
 
+void tb_inst_tailcall(TB_Function* f, TB_FunctionPrototype* proto, TB_Node* target, size_t param_count, TB_Node** params) {
+    TB_MultiOutput out = tb_inst_call(f, proto, target, param_count, params);
+
+    // codegen is the one which actually reuses the frame, we just mark it
+    TB_Node* call = f->active_control_node->inputs[0];
+    TB_NODE_GET_EXTRA_T(call, TB_NodeCall)->tail = true;
+
+    tb_inst_ret(f, out.count, out.count > 1 ? out.multiple : &out.single);
+}
+
 TB_Node* tb_inst_not(TB_Function* f, TB_Node* src) {
     TB_Node* n = tb_alloc_node(f, TB_NOT, src->dt, 2, 0);
     n->inputs[1] = src;
@@ -552,6 +595,17 @@ TB_Node* tb_inst_select(TB_Function* f, TB_Node* cond, TB_Node* a, TB_Node* b) {
     return n;
 }
 
+TB_Node* tb_inst_vbroadcast(TB_Function* f, TB_Node* src, int width) {
+    assert(src->dt.width == 0 && width > 0);
+
+    TB_DataType dt = src->dt;
+    dt.width = width;
+
+    TB_Node* n = tb_alloc_node(f, TB_VBROADCAST, dt, 2, 0);
+    n->inputs[1] = src;
+    return n;
+}
+
 TB_Node* tb_inst_and(TB_Function* f, TB_Node* a, TB_Node* b) {
     // bitwise operators can't wrap
     return tb_bin_arith(f, TB_AND, 0, a, b);
@@ -892,7 +946,39 @@ void tb_inst_goto(TB_Function* f, TB_Node* target) {
     }
 }
 
-void tb_inst_if(TB_Function* f, TB_Node* cond, TB_Node* if_true, TB_Node* if_false) {
+// weights for branches built on top of __builtin_expect
+enum { EXPECT_LIKELY = 2000, EXPECT_UNLIKELY = 1 };
+
+// looks through the casts between __builtin_expect and whatever
+// the branch ended up testing.
+static bool find_expect(TB_Function* f, TB_Node* n, uint64_t* out_value) {
+    for (;;) {
+        ptrdiff_t search = nl_map_get(f->attribs, n);
+        if (search >= 0) {
+            DynArray(TB_Attrib) attribs = f->attribs[search].v;
+            dyn_array_for(i, attribs) {
+                if (attribs[i].tag == TB_ATTRIB_EXPECT) {
+                    *out_value = attribs[i].expect.value;
+                    return true;
+                }
+            }
+        }
+
+        if (n->type != TB_ZERO_EXT && n->type != TB_SIGN_EXT && n->type != TB_TRUNCATE) {
+            return false;
+        }
+        n = n->inputs[1];
+    }
+}
+
+void tb_inst_set_branch_weights(TB_Function* f, TB_Node* n, const uint32_t* weights) {
+    assert(n->type == TB_BRANCH);
+    TB_NodeBranch* br = TB_NODE_GET_EXTRA(n);
+    br->weights = alloc_from_node_arena(f, br->succ_count * sizeof(uint32_t));
+    memcpy(br->weights, weights, br->succ_count * sizeof(uint32_t));
+}
+
+static TB_Node* build_if(TB_Function* f, TB_Node* cond, TB_Node* if_true, TB_Node* if_false) {
     TB_Node* mem_state = peek_mem(f, f->active_control_node);
 
     // generate control projections
@@ -915,9 +1001,53 @@ void tb_inst_if(TB_Function* f, TB_Node* cond, TB_Node* if_true, TB_Node* if_fal
     succ[0] = if_true;
     succ[1] = if_false;
     f->active_control_node = NULL;
+    return n;
+}
+
+TB_Node* tb_inst_if(TB_Function* f, TB_Node* cond, TB_Node* if_true, TB_Node* if_false) {
+    uint32_t id = f->prof_edges;
+    f->prof_edges += 2;
+
+    TB_Node* n;
+    if (f->prof_counters) {
+        // every edge gets a block to bump its counter in
+        TB_Node* edges[2] = { tb_inst_region(f), tb_inst_region(f) };
+        TB_Node* targets[2] = { if_true, if_false };
+
+        n = build_if(f, cond, edges[0], edges[1]);
+        tb__profile_edges(f, id, 2, edges, targets);
+    } else {
+        n = build_if(f, cond, if_true, if_false);
+    }
+
+    // if (x != 0) and if (x == 0) on top of the hint work too
+    bool flip = false;
+    uint64_t expect;
+    for (;;) {
+        if (find_expect(f, cond, &expect)) {
+            bool taken = (expect != 0) != flip;
+            uint32_t weights[2] = { taken ? EXPECT_LIKELY : EXPECT_UNLIKELY, taken ? EXPECT_UNLIKELY : EXPECT_LIKELY };
+            tb_inst_set_branch_weights(f, n, weights);
+            break;
+        }
+
+        while (cond->type == TB_ZERO_EXT || cond->type == TB_SIGN_EXT || cond->type == TB_TRUNCATE) {
+            cond = cond->inputs[1];
+        }
+
+        if ((cond->type != TB_CMP_NE && cond->type != TB_CMP_EQ) || !tb_node_is_constant_zero(cond->inputs[2])) {
+            break;
+        }
+
+        flip ^= cond->type == TB_CMP_EQ;
+        cond = cond->inputs[1];
+    }
+
+    tb__profile_weights(f, n, id);
+    return n;
 }
 
-void tb_inst_branch(TB_Function* f, TB_DataType dt, TB_Node* key, TB_Node* default_label, size_t entry_count, const TB_SwitchEntry* entries) {
+static TB_Node* build_branch(TB_Function* f, TB_Node* key, TB_Node* default_label, size_t entry_count, const TB_SwitchEntry* entries) {
     TB_Node* mem_state = peek_mem(f, f->active_control_node);
 
     // generate control projections
@@ -945,6 +1075,50 @@ void tb_inst_branch(TB_Function* f, TB_DataType dt, TB_Node* key, TB_Node* defau
     }
 
     f->active_control_node = NULL;
+    return n;
+}
+
+TB_Node* tb_inst_branch(TB_Function* f, TB_DataType dt, TB_Node* key, TB_Node* default_label, size_t entry_count, const TB_SwitchEntry* entries) {
+    uint32_t id = f->prof_edges;
+    f->prof_edges += 1 + entry_count;
+
+    TB_Node* n;
+    if (f->prof_counters) {
+        TB_Node** edges = alloc_from_node_arena(f, 2 * (1 + entry_count) * sizeof(TB_Node*));
+        TB_Node** targets = &edges[1 + entry_count];
+        TB_SwitchEntry* edge_entries = alloc_from_node_arena(f, entry_count * sizeof(TB_SwitchEntry));
+        FOREACH_N(i, 0, 1 + entry_count) {
+            edges[i] = tb_inst_region(f);
+            targets[i] = i ? entries[i - 1].value : default_label;
+        }
+
+        FOREACH_N(i, 0, entry_count) {
+            edge_entries[i] = (TB_SwitchEntry){ entries[i].key, edges[1 + i] };
+        }
+
+        n = build_branch(f, key, edges[0], entry_count, edge_entries);
+        tb__profile_edges(f, id, 1 + entry_count, edges, targets);
+    } else {
+        n = build_branch(f, key, default_label, entry_count, entries);
+    }
+
+    // the expected case gets the weight, the default takes it if there's no such case
+    uint64_t expect;
+    if (find_expect(f, key, &expect)) {
+        size_t likely = 0;
+        FOREACH_N(i, 0, entry_count) {
+            if (entries[i].key == (int64_t) expect) likely = 1 + i;
+        }
+
+        TB_NodeBranch* br = TB_NODE_GET_EXTRA(n);
+        br->weights = alloc_from_node_arena(f, (1 + entry_count) * sizeof(uint32_t));
+        FOREACH_N(i, 0, 1 + entry_count) {
+            br->weights[i] = i == likely ? EXPECT_LIKELY : EXPECT_UNLIKELY;
+        }
+    }
+
+    tb__profile_weights(f, n, id);
+    return n;
 }
 
 void tb_inst_ret(TB_Function* f, size_t count, TB_Node** values) {
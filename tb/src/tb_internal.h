@@ -78,6 +78,11 @@ for (uint64_t _bits_ = (bits), it = (start); _bits_; _bits_ >>= 1, ++it) if (_bi
 
 #define CODE_REGION_BUFFER_SIZE (128 * 1024 * 1024)
 
+// with a code reservation (tb_module_reserve_code) every thread takes at least one
+// chunk so they're smaller, it's still a multiple of the 2MiB huge page size.
+#define CODE_RESERVE_CHUNK_SIZE (16 * 1024 * 1024)
+#define CODE_RESERVE_ALIGN      (2 * 1024 * 1024)
+
 typedef struct TB_Emitter {
     size_t capacity, count;
     uint8_t* data;
@@ -94,6 +99,12 @@ struct TB_SymbolPatch {
     uint32_t pos;  // relative to the start of the function body
     bool internal; // handled already by the code gen's emit_call_patches
     const TB_Symbol* target;
+
+    // direct calls know what they passed, the JIT needs that when
+    // the host wants its arguments in a different calling convention.
+    bool is_call;
+    uint8_t arg_count;
+    uint64_t float_args; // bit per argument which went through an XMM
 };
 
 struct TB_External {
@@ -210,6 +221,8 @@ struct TB_DebugType {
     x(TB_ATTRIB_VARIABLE, var,   TB_Node* parent; char* name; TB_DebugType* storage) \
     x(TB_ATTRIB_SCOPE,    scope, TB_Node* parent) \
     x(TB_ATTRIB_LOCATION, loc,   TB_SourceFile* file; int line, column) \
+    x(TB_ATTRIB_ALIAS,    alias, int type_class; bool is_restrict) \
+    x(TB_ATTRIB_EXPECT,   expect, uint64_t value) \
 )
 #include "tagged_union.h"
 
@@ -274,6 +287,14 @@ typedef struct TB_FunctionOutput {
     TB_SymbolPatch* last_patch;
 } TB_FunctionOutput;
 
+// facts tb_module_ipo proved about a function, call sites can rely on them
+enum {
+    TB_FUNC_READONLY    = 1, // doesn't write to memory anyone else can see
+    TB_FUNC_READNONE    = 2, // doesn't touch memory anyone else can see
+    TB_FUNC_NORETURN    = 4,
+    TB_FUNC_NONNULL_RET = 8, // the returned pointer is never NULL
+};
+
 struct TB_Function {
     TB_Symbol super;
     TB_ModuleSectionHandle section;
@@ -289,6 +310,9 @@ struct TB_Function {
     TB_Node* start_node;
     TB_Node* stop_node;
 
+    // TB_FUNC_* bits, filled in by tb_module_ipo
+    uint32_t facts;
+
     // for GVN
     size_t node_count;
 
@@ -303,6 +327,13 @@ struct TB_Function {
     // Attributes
     NL_Map(uint64_t, DynArray(TB_Attrib)) attribs;
 
+    // profiling, prof_edges hands out the counter ids (0 is the entry).
+    // counters are filled when generating, counts when using.
+    uint32_t prof_edges;
+    uint32_t prof_count_len;
+    TB_Global* prof_counters;
+    const uint64_t* prof_counts;
+
     // Compilation output
     union {
         void* compiled_pos;
@@ -370,6 +401,12 @@ struct TB_ThreadInfo {
     TB_CodeRegion* code; // compiled output
 };
 
+typedef struct {
+    uint64_t hash;
+    uint64_t count;
+    uint64_t* counts;
+} TB_ProfileRecord;
+
 struct TB_Module {
     bool is_jit;
 
@@ -407,6 +444,27 @@ struct TB_Module {
 
     // windows specific lol
     TB_LinkerSectionPiece* xdata;
+
+    // profiling (see profile.c)
+    const char* prof_path;
+    TB_Function* prof_dump;
+    TB_Function* prof_register;
+    TB_Global* prof_table;
+
+    size_t prof_record_count;
+    TB_ProfileRecord* prof_records;
+    void* prof_file;
+
+    // code regions get carved out of this if it's there (see tb_module_reserve_code),
+    // base is aligned up from the start of the mapping.
+    struct {
+        void* mapping;
+        size_t mapping_size;
+
+        uint8_t* base;
+        size_t size;
+        _Atomic size_t used;
+    } code_reserve;
 };
 
 typedef struct {
@@ -565,6 +623,11 @@ inline static bool tb_is_power_of_two(uint64_t x) {
 #endif
 
 TB_Node* tb_alloc_node(TB_Function* f, int type, TB_DataType dt, int input_count, size_t extra);
+// bytes tb_alloc_node takes from the arena, the inputs go right after the extra data
+inline static size_t tb_node_alloc_size(int input_count, size_t extra) {
+    return align_up(sizeof(TB_Node) + extra, sizeof(TB_Node*)) + input_count*sizeof(TB_Node*);
+}
+
 TB_Node* tb__make_proj(TB_Function* f, TB_DataType dt, TB_Node* src, int index);
 
 typedef struct {
@@ -601,6 +664,15 @@ uint64_t tb__sxt(uint64_t src, uint64_t src_bits, uint64_t dst_bits);
 
 char* tb__arena_strdup(TB_Module* m, ptrdiff_t len, const char* src);
 
+// fits at least min_size bytes of code
+TB_CodeRegion* tb__alloc_code_region(TB_Module* m, size_t min_size);
+void tb__free_code_region(TB_Module* m, TB_CodeRegion* region);
+
+// profile.c, ids are allocated from f->prof_edges
+void tb__profile_begin(TB_Function* f);
+void tb__profile_edges(TB_Function* f, uint32_t id, size_t count, TB_Node** edges, TB_Node** targets);
+void tb__profile_weights(TB_Function* f, TB_Node* n, uint32_t id);
+
 static bool is_same_location(TB_Attrib* a, TB_Attrib* b) {
     return a->loc.file == b->loc.file && a->loc.line == b->loc.line && a->loc.column == b->loc.column;
 }
@@ -28,3 +28,9 @@ typedef enum {
 void* tb_platform_valloc(size_t size);
 void  tb_platform_vfree(void* ptr, size_t size);
 bool  tb_platform_vprotect(void* ptr, size_t size, TB_MemProtect prot);
+
+// reserves address space without backing it, tb_platform_vcommit makes a piece of it
+// read/write and tb_platform_vfree releases the whole thing. huge asks the OS to back
+// it with large pages where that's an opt-in (transparent huge pages on linux).
+void* tb_platform_vreserve(size_t size, bool huge);
+bool  tb_platform_vcommit(void* ptr, size_t size);
@@ -116,6 +116,10 @@ static TB_X86_DataType legalize_float(TB_DataType dt) {
 static TB_X86_DataType legalize(TB_DataType dt) {
     if (dt.type == TB_FLOAT) {
         return legalize_float(dt);
+    } else if (dt.width) {
+        // only 128bit integer vectors for now
+        assert(dt.type == TB_INT && (dt.data << dt.width) == 128);
+        return TB_X86_TYPE_PBYTE + (4 - dt.width);
     } else {
         uint64_t m;
         return legalize_int(dt, &m);
@@ -123,7 +127,7 @@ static TB_X86_DataType legalize(TB_DataType dt) {
 }
 
 static int classify_reg_class(TB_DataType dt) {
-    return dt.type == TB_FLOAT ? REG_CLASS_XMM : REG_CLASS_GPR;
+    return dt.type == TB_FLOAT || dt.width ? REG_CLASS_XMM : REG_CLASS_GPR;
 }
 
 static bool wont_spill_around(int t) {
@@ -134,10 +138,165 @@ static bool is_terminator(int t) {
     return t == INST_TERMINATOR || t == INT3 || t == UD2;
 }
 
+// the stack arguments of a tail call go where our incoming ones are, win64 always
+// gives us the shadow space on top of our params. system v doesn't promise anything
+// so those tail calls can only use registers.
+static bool can_tail_call(TB_Function* f, TB_Node* call) {
+    const TB_FunctionPrototype* proto = f->prototype;
+    if (proto->has_varargs) {
+        return false;
+    }
+
+    if (f->super.module->target_abi == TB_ABI_SYSTEMV) {
+        const struct ParamDescriptor* restrict desc = &param_descs[1];
+
+        int xmms_used = 0, gprs_used = 0;
+        FOREACH_N(i, 3, call->input_count) {
+            TB_DataType dt = call->inputs[i]->dt;
+            int reg = TB_IS_FLOAT_TYPE(dt) || dt.width ? xmms_used++ : gprs_used++;
+            if (reg >= desc->gpr_count) {
+                return false;
+            }
+        }
+
+        return true;
+    } else {
+        return call->input_count - 3 <= TB_MAX(4, proto->param_count);
+    }
+}
+
+// Scheduling model: the ports are just bits, each table decides what they mean
+enum {
+    SCHED_NONE, // constants, projections, anything that's not really an instruction
+    SCHED_ALU,
+    SCHED_SHIFT,
+    SCHED_LEA,
+    SCHED_IMUL,
+    SCHED_IDIV,
+    SCHED_LOAD,
+    SCHED_STORE,
+    SCHED_FADD,
+    SCHED_FMUL,
+    SCHED_FDIV,
+    SCHED_CVT,
+    SCHED_BRANCH,
+    SCHED_CALL,
+
+    SCHED_CLASS_COUNT
+};
+
+#define P(x) (1u << (x))
+// p0 p1 p5 p6 do integer ops, p2 p3 loads and p4 stores
+static const SchedCost sched_skylake[SCHED_CLASS_COUNT] = {
+    [SCHED_ALU]    = {  1, P(0) | P(1) | P(5) | P(6) },
+    [SCHED_SHIFT]  = {  1, P(0) | P(6) },
+    [SCHED_LEA]    = {  1, P(1) | P(5) },
+    [SCHED_IMUL]   = {  3, P(1) },
+    [SCHED_IDIV]   = { 26, P(0) },
+    [SCHED_LOAD]   = {  5, P(2) | P(3) },
+    [SCHED_STORE]  = {  1, P(4) },
+    [SCHED_FADD]   = {  4, P(0) | P(1) },
+    [SCHED_FMUL]   = {  4, P(0) | P(1) },
+    [SCHED_FDIV]   = { 13, P(0) },
+    [SCHED_CVT]    = {  5, P(0) | P(1) },
+    [SCHED_BRANCH] = {  1, P(0) | P(6) },
+    [SCHED_CALL]   = {  1, P(6) },
+};
+
+// 0-3 are the ALUs, 4 5 are the load AGUs and 6 the store one, 7-10 are the FP pipes
+static const SchedCost sched_zen[SCHED_CLASS_COUNT] = {
+    [SCHED_ALU]    = {  1, P(0) | P(1) | P(2) | P(3) },
+    [SCHED_SHIFT]  = {  1, P(1) | P(2) },
+    [SCHED_LEA]    = {  1, P(0) | P(1) | P(2) | P(3) },
+    [SCHED_IMUL]   = {  3, P(1) },
+    [SCHED_IDIV]   = { 20, P(2) },
+    [SCHED_LOAD]   = {  4, P(4) | P(5) },
+    [SCHED_STORE]  = {  1, P(6) },
+    [SCHED_FADD]   = {  3, P(9) | P(10) },
+    [SCHED_FMUL]   = {  3, P(7) | P(8) },
+    [SCHED_FDIV]   = { 13, P(10) },
+    [SCHED_CVT]    = {  4, P(10) },
+    [SCHED_BRANCH] = {  1, P(0) | P(3) },
+    [SCHED_CALL]   = {  1, P(0) | P(3) },
+};
+
+// somewhere in between, it shouldn't be too wrong on either
+static const SchedCost sched_generic[SCHED_CLASS_COUNT] = {
+    [SCHED_ALU]    = {  1, P(0) | P(1) | P(2) | P(3) },
+    [SCHED_SHIFT]  = {  1, P(0) | P(3) },
+    [SCHED_LEA]    = {  1, P(1) | P(2) },
+    [SCHED_IMUL]   = {  3, P(1) },
+    [SCHED_IDIV]   = { 24, P(0) },
+    [SCHED_LOAD]   = {  4, P(4) | P(5) },
+    [SCHED_STORE]  = {  1, P(6) },
+    [SCHED_FADD]   = {  4, P(7) | P(8) },
+    [SCHED_FMUL]   = {  4, P(7) | P(8) },
+    [SCHED_FDIV]   = { 13, P(7) },
+    [SCHED_CVT]    = {  5, P(7) | P(8) },
+    [SCHED_BRANCH] = {  1, P(0) | P(3) },
+    [SCHED_CALL]   = {  1, P(3) },
+};
+#undef P
+
+static int sched_class(TB_Node* n) {
+    bool is_float = n->dt.type == TB_FLOAT || n->dt.width;
+    switch (n->type) {
+        case TB_INTEGER_CONST: case TB_FLOAT32_CONST: case TB_FLOAT64_CONST:
+        case TB_PROJ: case TB_LOCAL: case TB_SYMBOL: case TB_PHI:
+        case TB_REGION: case TB_START: case TB_POISON:
+        return SCHED_NONE;
+
+        case TB_LOAD: return SCHED_LOAD;
+        case TB_STORE: case TB_MEMSET: case TB_MEMCPY: return SCHED_STORE;
+
+        case TB_SHL: case TB_SHR: case TB_SAR: case TB_ROL: case TB_ROR:
+        return SCHED_SHIFT;
+
+        case TB_MEMBER_ACCESS: case TB_ARRAY_ACCESS: return SCHED_LEA;
+
+        case TB_MUL: return SCHED_IMUL;
+        case TB_UDIV: case TB_SDIV: case TB_UMOD: case TB_SMOD: return SCHED_IDIV;
+
+        case TB_FADD: case TB_FSUB: case TB_FMAX: case TB_FMIN: return SCHED_FADD;
+        case TB_FMUL: return SCHED_FMUL;
+        case TB_FDIV: case TB_X86INTRIN_SQRT: return SCHED_FDIV;
+
+        case TB_INT2FLOAT: case TB_UINT2FLOAT: case TB_FLOAT2INT:
+        case TB_FLOAT2UINT: case TB_FLOAT_EXT:
+        return SCHED_CVT;
+
+        case TB_CMP_FLT: case TB_CMP_FLE: return SCHED_FADD;
+        case TB_CMP_EQ: case TB_CMP_NE:
+        return TB_IS_FLOAT_TYPE(TB_NODE_GET_EXTRA_T(n, TB_NodeCompare)->cmp_dt) ? SCHED_FADD : SCHED_ALU;
+
+        case TB_BRANCH: case TB_END: case TB_TAILCALL: return SCHED_BRANCH;
+        case TB_CALL: case TB_SYSCALL: return SCHED_CALL;
+
+        default: return is_float ? SCHED_FADD : SCHED_ALU;
+    }
+}
+
+static SchedCost sched_cost(const void* model, TB_Node* n) {
+    const SchedCost* table = model;
+    return table[sched_class(n)];
+}
+
+// RSP and RBP are out, we leave a couple for the temporaries isel makes
+static const SchedModel sched_models[] = {
+    [TB_X64_TUNE_GENERIC] = { .issue_width = 4, .reg_limit = 10, .cost = sched_cost, .model = sched_generic },
+    [TB_X64_TUNE_SKYLAKE] = { .issue_width = 4, .reg_limit = 10, .cost = sched_cost, .model = sched_skylake },
+    [TB_X64_TUNE_ZEN]     = { .issue_width = 5, .reg_limit = 10, .cost = sched_cost, .model = sched_zen },
+};
+
+static const SchedModel* sched_model(const TB_FeatureSet* features) {
+    return &sched_models[features->x64_tune];
+}
+
 static bool try_for_imm32(Ctx* restrict ctx, TB_Node* n, int32_t* out_x) {
     if (n->type == TB_INTEGER_CONST) {
+        // 32bit ops only look at the low half anyways
         TB_NodeInt* i = TB_NODE_GET_EXTRA(n);
-        if (fits_into_int32(i->value)) {
+        if ((n->dt.type == TB_INT && n->dt.data <= 32) || fits_into_int32(i->value)) {
             *out_x = i->value;
             return true;
         }
@@ -176,28 +335,14 @@ static Inst* inst_jcc(TB_Node* target, Cond cc) {
     return i;
 }
 
-// store(binop(load(a), b))
-static int can_folded_store(Ctx* restrict ctx, TB_Node* mem, TB_Node* addr, TB_Node* src) {
-    switch (src->type) {
-        default: return -1;
-
-        case TB_AND:
-        case TB_OR:
-        case TB_XOR:
-        case TB_ADD:
-        case TB_SUB: {
-            if (src->inputs[1]->type == TB_LOAD &&
-                src->inputs[1]->inputs[1] == mem &&
-                src->inputs[1]->inputs[2] == addr &&
-                on_last_use(ctx, src) &&
-                on_last_use(ctx, src->inputs[1])) {
-                const static InstType ops[] = { AND, OR, XOR, ADD, SUB };
-                return ops[src->type - TB_AND];
-            }
-
-            return -1;
-        }
+// the scaled index can go into dst unless it's still holding the other input
+static int isel_addr_tmp(Ctx* restrict ctx, int dst, int store_op, bool has_second_in) {
+    if (dst < 0 || has_second_in) {
+        assert(store_op >= 0 || has_second_in);
+        return DEF(NULL, TB_TYPE_I64);
     }
+
+    return dst;
 }
 
 // generates an LEA for computing the address of n.
@@ -279,14 +424,10 @@ static Inst* isel_addr(Ctx* restrict ctx, TB_Node* n, int dst, int store_op, int
             scale = tb_ffs(stride) - 1;
 
             if (scale > 3) {
-                if (dst < 0) {
-                    assert(store_op >= 0);
-                    dst = DEF(NULL, TB_TYPE_I64);
-                }
-
                 // we can't fit this into an LEA, might as well just do a shift
-                SUBMIT(inst_op_rri(SHL, TB_TYPE_I64, dst, index, scale));
-                index = dst, scale = 1;
+                int tmp = isel_addr_tmp(ctx, dst, store_op, has_second_in);
+                SUBMIT(inst_op_rri(SHL, TB_TYPE_I64, tmp, index, scale));
+                index = tmp, scale = SCALE_X1;
             }
         } else {
             // needs a proper multiply (we may wanna invest in a few special patterns
@@ -299,13 +440,9 @@ static Inst* isel_addr(Ctx* restrict ctx, TB_Node* n, int dst, int store_op, int
             //
             //   LEA b,   [a * 8]
             //   LEA dst, [b * 2 + b]
-            if (dst < 0) {
-                assert(store_op >= 0);
-                dst = DEF(NULL, TB_TYPE_I64);
-            }
-
-            SUBMIT(inst_op_rri(IMUL, TB_TYPE_I64, dst, index, stride));
-            index = dst;
+            int tmp = isel_addr_tmp(ctx, dst, store_op, has_second_in);
+            SUBMIT(inst_op_rri(IMUL, TB_TYPE_I64, tmp, index, stride));
+            index = tmp;
         }
 
         n = base;
@@ -350,6 +487,126 @@ static Inst* isel_addr2(Ctx* restrict ctx, TB_Node* n, int dst, int store_op, in
     }
 }
 
+////////////////////////////////
+// Folding
+////////////////////////////////
+enum {
+    LD      = 1,
+    COMM    = 2,
+    RMW     = 4,
+    RMW_IMM = 8,
+    UNARY   = 16,
+    NO8     = 32,
+};
+
+typedef struct {
+    int op, fp_op;
+    uint8_t forms;
+} FoldDesc;
+
+static const FoldDesc fold_table[] = {
+    #define X(node, op, fp_op, forms) [node] = { op, fp_op, forms },
+    #include "x64_fold.inc"
+};
+
+static const FoldDesc* fold_desc(TB_Node* n) {
+    static const FoldDesc none = { -1, -1, 0 };
+    return n->type < COUNTOF(fold_table) ? &fold_table[n->type] : &none;
+}
+
+// a load which the instruction we're emitting right now can read straight out of
+// memory, nobody else wants it and no memory effect got scheduled between the two.
+// packed ops want their memory operands aligned and we don't know that.
+static bool can_fold_load(Ctx* restrict ctx, TB_Node* n) {
+    if (n->type != TB_LOAD || n->dt.width) {
+        return false;
+    }
+
+    ValueDesc* v = lookup_val(ctx, n);
+    return v != NULL && v->uses == 1 && v->vreg < 0 && v->epoch == ctx->epoch;
+}
+
+// op a, [b] where one of the inputs is a load we can fold, *lhs is the other one.
+static TB_Node* fold_load(Ctx* restrict ctx, TB_Node* n, TB_Node** lhs) {
+    const FoldDesc* desc = fold_desc(n);
+    TB_Node *a = n->inputs[1], *b = n->inputs[2];
+
+    *lhs = a;
+    if ((desc->forms & LD) == 0 || ((desc->forms & NO8) && n->dt.type == TB_INT && n->dt.data <= 8)) {
+        return NULL;
+    }
+
+    if (can_fold_load(ctx, b)) {
+        return b;
+    } else if ((desc->forms & COMM) && can_fold_load(ctx, a)) {
+        *lhs = b;
+        return a;
+    } else {
+        return NULL;
+    }
+}
+
+// op dst, [ld] where dst already holds the left hand side
+static Inst* isel_load_op(Ctx* restrict ctx, int op, TB_DataType dt, int dst, TB_Node* ld) {
+    use(ctx, ld);
+
+    Inst* inst = isel_addr2(ctx, ld->inputs[2], dst, -1, dst);
+    inst->type = op;
+    inst->dt = legalize(dt);
+    return inst;
+}
+
+// op lhs, [ld] which only writes the flags
+static Inst* isel_load_cmp(Ctx* restrict ctx, int op, TB_DataType dt, int lhs, TB_Node* ld) {
+    Inst* inst = isel_load_op(ctx, op, dt, lhs, ld);
+
+    // lhs stops being the destination, it's just the first input
+    inst->out_count = 0;
+    inst->mem_slot -= 1;
+    memmove(&inst->operands[0], &inst->operands[1], inst->in_count * sizeof(RegIndex));
+    return inst;
+}
+
+static bool is_rmw_load(Ctx* restrict ctx, TB_Node* n, TB_Node* mem, TB_Node* addr) {
+    return n->type == TB_LOAD && n->inputs[1] == mem && n->inputs[2] == addr && on_last_use(ctx, n);
+}
+
+// store(op(load(a), b)) into a, *out_ld is the load and *out_src is b (NULL
+// for the unary ops).
+static int can_folded_store(Ctx* restrict ctx, TB_Node* mem, TB_Node* addr, TB_Node* src, TB_Node** out_ld, TB_Node** out_src) {
+    const FoldDesc* desc = fold_desc(src);
+
+    // there's no RMW forms for the SSE ops
+    if (src->dt.width || src->dt.type != TB_INT || (desc->forms & (RMW | RMW_IMM | UNARY)) == 0 || !on_last_use(ctx, src)) {
+        return -1;
+    }
+
+    TB_Node* ld = src->inputs[1];
+    TB_Node* other = desc->forms & UNARY ? NULL : src->inputs[2];
+    if (!is_rmw_load(ctx, ld, mem, addr)) {
+        if ((desc->forms & COMM) == 0 || !is_rmw_load(ctx, other, mem, addr)) {
+            return -1;
+        }
+
+        SWAP(TB_Node*, ld, other);
+    }
+
+    int op = desc->op;
+    int32_t x;
+    if (desc->forms & RMW_IMM) {
+        if (!try_for_imm32(ctx, other, &x) || x != (int8_t) x) {
+            return -1;
+        }
+    } else if ((op == ADD || op == SUB) && try_for_imm32(ctx, other, &x) && (x == 1 || x == -1)) {
+        // add [a], 1 => inc [a]
+        op = (x == 1) == (op == ADD) ? INC : DEC;
+    }
+
+    *out_ld = ld;
+    *out_src = other;
+    return op;
+}
+
 static Cond isel_cmp(Ctx* restrict ctx, TB_Node* n) {
     bool invert = false;
     if (n->type == TB_CMP_EQ && n->dt.type == TB_INT && n->dt.data == 1 && n->inputs[2]->type == TB_INTEGER_CONST) {
@@ -369,8 +626,12 @@ static Cond isel_cmp(Ctx* restrict ctx, TB_Node* n) {
 
         if (TB_IS_FLOAT_TYPE(cmp_dt)) {
             int lhs = input_reg(ctx, n->inputs[1]);
-            int rhs = input_reg(ctx, n->inputs[2]);
-            SUBMIT(inst_op_rr_no_dst(FP_UCOMI, cmp_dt, lhs, rhs));
+            if (can_fold_load(ctx, n->inputs[2])) {
+                SUBMIT(isel_load_cmp(ctx, FP_UCOMI, cmp_dt, lhs, n->inputs[2]));
+            } else {
+                int rhs = input_reg(ctx, n->inputs[2]);
+                SUBMIT(inst_op_rr_no_dst(FP_UCOMI, cmp_dt, lhs, rhs));
+            }
 
             switch (n->type) {
                 case TB_CMP_EQ:  cc = E;  break;
@@ -382,16 +643,43 @@ static Cond isel_cmp(Ctx* restrict ctx, TB_Node* n) {
         } else {
             bool invert = false;
             int32_t x;
-            int lhs = input_reg(ctx, n->inputs[1]);
+            TB_Node* lhs_n;
+            TB_Node* ld;
             if (try_for_imm32(ctx, n->inputs[2], &x)) {
                 use(ctx, n->inputs[2]);
 
-                if (x == 0 && (n->type == TB_CMP_EQ || n->type == TB_CMP_NE)) {
-                    SUBMIT(inst_op_rr_no_dst(TEST, cmp_dt, lhs, lhs));
+                if (can_fold_load(ctx, n->inputs[1])) {
+                    // cmp [mem], imm
+                    use(ctx, n->inputs[1]);
+
+                    Inst* inst = isel_addr2(ctx, n->inputs[1]->inputs[2], -1, CMP, -1);
+                    inst->in_count -= 1;
+                    inst->dt = legalize(cmp_dt);
+                    inst->flags |= INST_IMM;
+                    inst->imm = x;
+                    SUBMIT(inst);
                 } else {
-                    SUBMIT(inst_op_ri(CMP, cmp_dt, lhs, x));
+                    int lhs = input_reg(ctx, n->inputs[1]);
+                    if (x == 0 && (n->type == TB_CMP_EQ || n->type == TB_CMP_NE)) {
+                        SUBMIT(inst_op_rr_no_dst(TEST, cmp_dt, lhs, lhs));
+                    } else {
+                        SUBMIT(inst_op_ri(CMP, cmp_dt, lhs, x));
+                    }
                 }
+            } else if (ld = fold_load(ctx, n, &lhs_n), ld == n->inputs[2]) {
+                // cmp lhs, [mem]
+                int lhs = input_reg(ctx, lhs_n);
+                SUBMIT(isel_load_cmp(ctx, CMP, cmp_dt, lhs, ld));
+            } else if (ld != NULL) {
+                // cmp [mem], rhs
+                use(ctx, ld);
+
+                int rhs = input_reg(ctx, lhs_n);
+                Inst* inst = isel_addr2(ctx, ld->inputs[2], -1, CMP, rhs);
+                inst->dt = legalize(cmp_dt);
+                SUBMIT(inst);
             } else {
+                int lhs = input_reg(ctx, n->inputs[1]);
                 int rhs = input_reg(ctx, n->inputs[2]);
                 SUBMIT(inst_op_rr_no_dst(CMP, cmp_dt, lhs, rhs));
             }
@@ -505,18 +793,21 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
             bool has_param_slots = false;
             FOREACH_N(i, 0, ctx->f->param_count) {
                 TB_Node* proj = params[3 + i];
-                User* use = find_users(ctx->p, proj);
-                if (use == NULL || use->next != NULL || use->slot == 0) {
+                if (proj->user_count != 1 || proj->users[0].slot == 0) {
                     continue;
                 }
 
+                User* use = &proj->users[0];
+
                 TB_Node* store_op = use->n;
                 if (store_op->type != TB_STORE || tb_get_parent_region(store_op->inputs[0]) != n) {
                     continue;
                 }
 
+                // the home slots are only 8 bytes, bigger LOCALs just happen to
+                // have the param stored into them.
                 TB_Node* addr = store_op->inputs[2];
-                if (addr->type != TB_LOCAL) {
+                if (addr->type != TB_LOCAL || TB_NODE_GET_EXTRA_T(addr, TB_NodeLocal)->size > 8) {
                     continue;
                 }
 
@@ -561,6 +852,12 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
             break;
         }
 
+        // any value works, zero is the cheapest one to make
+        case TB_POISON: {
+            SUBMIT(inst_op_zero(n->dt, dst));
+            break;
+        }
+
         case TB_INTEGER_CONST: {
             uint64_t x = TB_NODE_GET_EXTRA_T(n, TB_NodeInt)->value;
 
@@ -570,7 +867,7 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
                 x &= (1ull << bits_in_type) - 1;
             }
 
-            if (!fits_into_int32(x)) {
+            if (bits_in_type > 32 && !fits_into_int32(x)) {
                 // movabs reg, imm64
                 SUBMIT(inst_op_abs(MOVABS, n->dt, dst, x));
             } else if (x == 0) {
@@ -581,6 +878,33 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
             break;
         }
 
+        case TB_VBROADCAST: {
+            TB_Node* src = n->inputs[1];
+            int src_reg = input_reg(ctx, src);
+
+            if (src->dt.type == TB_FLOAT) {
+                // shufps x, x, 0 (or shufpd) splats the bottom lane
+                hint_reg(ctx, dst, src_reg);
+                SUBMIT(inst_op_rri(SHUFP, n->dt, dst, src_reg, 0));
+            } else if (src->dt.data == 64) {
+                SUBMIT(inst_op_rr(MOV_I2F, src->dt, dst, src_reg));
+                SUBMIT(inst_op_rri(PSHUFD, n->dt, dst, dst, 0x44));
+            } else {
+                // narrow ints are replicated into a dword before splatting
+                // that dword with pshufd
+                if (src->dt.data < 32) {
+                    int tmp = DEF(NULL, TB_TYPE_I32);
+                    SUBMIT(inst_op_rr(src->dt.data <= 8 ? MOVZXB : MOVZXW, TB_TYPE_I32, tmp, src_reg));
+                    SUBMIT(inst_op_rri(IMUL, TB_TYPE_I32, tmp, tmp, src->dt.data <= 8 ? 0x01010101 : 0x00010001));
+                    src_reg = tmp;
+                }
+
+                SUBMIT(inst_op_rr(MOV_I2F, TB_TYPE_I32, dst, src_reg));
+                SUBMIT(inst_op_rri(PSHUFD, n->dt, dst, dst, 0));
+            }
+            break;
+        }
+
         case TB_SELECT: {
             assert(n->dt.type != TB_FLOAT);
             int lhs = input_reg(ctx, n->inputs[2]);
@@ -597,14 +921,28 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
         case TB_XOR:
         case TB_ADD:
         case TB_SUB: {
-            const static InstType ops[] = { AND, OR, XOR, ADD, SUB };
-            InstType op = ops[type - TB_AND];
+            InstType op = fold_table[type].op;
 
-            int lhs = input_reg(ctx, n->inputs[1]);
+            int32_t x;
+            TB_Node* lhs_n = n->inputs[1];
+            TB_Node* ld = try_for_imm32(ctx, n->inputs[2], &x) ? NULL : fold_load(ctx, n, &lhs_n);
+
+            int lhs = input_reg(ctx, lhs_n);
             hint_reg(ctx, dst, lhs);
 
-            int32_t x;
-            if (try_for_imm32(ctx, n->inputs[2], &x)) {
+            if (n->dt.width) {
+                const static InstType vops[] = { FP_AND, FP_OR, FP_XOR, PADD, PSUB };
+                int rhs = input_reg(ctx, n->inputs[2]);
+
+                SUBMIT(inst_move(n->dt, dst, lhs));
+                SUBMIT(inst_op_rrr(vops[type - TB_AND], n->dt, dst, dst, rhs));
+                break;
+            }
+
+            if (ld != NULL) {
+                SUBMIT(inst_move(n->dt, dst, lhs));
+                SUBMIT(isel_load_op(ctx, op, n->dt, dst, ld));
+            } else if (try_for_imm32(ctx, n->inputs[2], &x)) {
                 use(ctx, n->inputs[2]);
 
                 SUBMIT(inst_move(n->dt, dst, lhs));
@@ -619,9 +957,23 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
         }
 
         case TB_MUL: {
-            int lhs = input_reg(ctx, n->inputs[1]);
+            int32_t x;
+            TB_Node* lhs_n = n->inputs[1];
+            TB_Node* ld = try_for_imm32(ctx, n->inputs[2], &x) ? NULL : fold_load(ctx, n, &lhs_n);
+
+            int lhs = input_reg(ctx, lhs_n);
             hint_reg(ctx, dst, lhs);
 
+            if (n->dt.width) {
+                // SSE2 only has a full lane-wise multiply for 16bit
+                assert(n->dt.data == 16 && "TODO: vector multiply");
+                int rhs = input_reg(ctx, n->inputs[2]);
+
+                SUBMIT(inst_move(n->dt, dst, lhs));
+                SUBMIT(inst_op_rrr(PMULLW, n->dt, dst, dst, rhs));
+                break;
+            }
+
             // promote any <16bit multiplies up a bit:
             //   should be fair game to compute the multiply
             //   with garbage bits at the top as long as we
@@ -632,8 +984,10 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
                 dt.data = 16;
             }
 
-            int32_t x;
-            if (try_for_imm32(ctx, n->inputs[2], &x)) {
+            if (ld != NULL) {
+                SUBMIT(inst_move(n->dt, dst, lhs));
+                SUBMIT(isel_load_op(ctx, IMUL, dt, dst, ld));
+            } else if (try_for_imm32(ctx, n->inputs[2], &x)) {
                 use(ctx, n->inputs[2]);
 
                 SUBMIT(inst_move(n->dt, dst, lhs));
@@ -813,22 +1167,20 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
         case TB_FDIV:
         case TB_FMAX:
         case TB_FMIN: {
-            const static InstType ops[] = { FP_ADD, FP_SUB, FP_MUL, FP_DIV, FP_MAX, FP_MIN };
+            InstType op = fold_table[type].fp_op;
 
-            int lhs = input_reg(ctx, n->inputs[1]);
+            TB_Node* lhs_n;
+            TB_Node* ld = fold_load(ctx, n, &lhs_n);
+
+            int lhs = input_reg(ctx, lhs_n);
             hint_reg(ctx, dst, lhs);
             SUBMIT(inst_move(n->dt, dst, lhs));
 
-            if (n->inputs[2]->type == TB_LOAD) {
-                use(ctx, n->inputs[2]);
-
-                Inst* inst = isel_addr2(ctx, n->inputs[2]->inputs[2], dst, -1, dst);
-                inst->type = ops[type - TB_FADD];
-                inst->dt = legalize(n->dt);
-                SUBMIT(inst);
+            if (ld != NULL) {
+                SUBMIT(isel_load_op(ctx, op, n->dt, dst, ld));
             } else {
                 int rhs = input_reg(ctx, n->inputs[2]);
-                SUBMIT(inst_op_rrr(ops[type - TB_FADD], n->dt, dst, dst, rhs));
+                SUBMIT(inst_op_rrr(op, n->dt, dst, dst, rhs));
             }
             break;
         }
@@ -948,6 +1300,7 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
         }
 
         case TB_SYSCALL:
+        case TB_TAILCALL:
         case TB_CALL: {
             bool is_sysv = (ctx->target_abi == TB_ABI_SYSTEMV);
             const struct ParamDescriptor* restrict desc = &param_descs[is_sysv ? 1 : 0];
@@ -955,7 +1308,9 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
                 desc = &param_descs[2];
             }
 
-            TB_Node* ret_node = TB_NODE_GET_EXTRA_T(n, TB_NodeCall)->projs[2];
+            // tail calls don't come back, the callee returns to our caller
+            bool is_tail = type == TB_TAILCALL;
+            TB_Node* ret_node = is_tail ? NULL : TB_NODE_GET_EXTRA_T(n, TB_NodeCall)->projs[2];
             if (!has_users(ctx, ret_node)) {
                 ret_node = NULL;
             }
@@ -968,8 +1323,9 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
             }
 
             // system calls don't count, we track this for ABI
-            // and stack allocation purposes.
-            if (ctx->caller_usage < n->input_count - 3) {
+            // and stack allocation purposes. tail calls put their
+            // arguments where ours came in.
+            if (!is_tail && ctx->caller_usage < n->input_count - 3) {
                 ctx->caller_usage = n->input_count - 3;
             }
 
@@ -984,13 +1340,24 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
             TB_FunctionPrototype* proto = TB_NODE_GET_EXTRA_T(n, TB_NodeCall)->proto;
             int vararg_cutoff = proto && proto->has_varargs ? proto->param_count : n->input_count-2;
 
+            // the tail call's stack arguments overwrite our incoming ones so
+            // everything gets read out before the first store.
+            RegIndex tail_srcs[64];
+            if (is_tail) {
+                FOREACH_N(i, 3, n->input_count) {
+                    tail_srcs[i - 3] = input_reg(ctx, n->inputs[i]);
+                }
+            }
+
             size_t xmms_used = 0, gprs_used = 0;
+            uint64_t float_args = 0;
             FOREACH_N(i, 3, n->input_count) {
                 TB_Node* param = n->inputs[i];
                 TB_DataType param_dt = param->dt;
 
                 bool use_xmm = TB_IS_FLOAT_TYPE(param_dt) || param_dt.width;
                 int reg = use_xmm ? xmms_used : gprs_used;
+                if (use_xmm && i - 3 < 64) float_args |= 1ull << (i - 3);
                 if (is_sysv) {
                     if (use_xmm) {
                         xmms_used++;
@@ -1006,8 +1373,13 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
 
                 // first few parameters are passed as inputs to the CALL instruction.
                 // the rest are written into the stack at specific places.
-                RegIndex src = input_reg(ctx, param);
-                if (reg >= desc->gpr_count) {
+                RegIndex src = is_tail ? tail_srcs[i - 3] : input_reg(ctx, param);
+                if (reg >= desc->gpr_count && is_tail) {
+                    // it's relative to our frame pointer so we need one
+                    if (ctx->stack_usage <= 16) ctx->stack_usage += 8;
+
+                    SUBMIT(inst_op_mr(use_xmm ? FP_MOV : MOV, param->dt, RBP, GPR_NONE, SCALE_X1, 16 + reg * 8, src));
+                } else if (reg >= desc->gpr_count) {
                     SUBMIT(inst_op_mr(use_xmm ? FP_MOV : MOV, param->dt, RSP, GPR_NONE, SCALE_X1, reg * 8, src));
                 } else {
                     int phys_reg = use_xmm ? reg : desc->gprs[reg];
@@ -1046,7 +1418,7 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
             // compute the target (unless it's a symbol) before the
             // registers all need to be forcibly shuffled
             TB_Node* target = n->inputs[2];
-            bool static_call = n->type == TB_CALL && target->type == TB_SYMBOL;
+            bool static_call = n->type != TB_SYSCALL && target->type == TB_SYMBOL;
 
             int target_val = RSP; // placeholder really
             if (!static_call) {
@@ -1066,6 +1438,37 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
                 }
             }
 
+            if (is_tail) {
+                // indirect targets can't stay in memory (or a callee saved reg) since
+                // the frame is gone by the time we jump, R11 isn't used for anything.
+                if (!static_call) {
+                    hint_reg(ctx, target_val, R11);
+                    SUBMIT(inst_move(target->dt, R11, target_val));
+                    target_val = R11;
+                }
+
+                // the callee saved registers get restored and the frame torn down
+                // right before the JMP.
+                Inst* epilogue = alloc_inst(INST_EPILOGUE, TB_TYPE_VOID, 0, 0, 0);
+                epilogue->flags = INST_NODE;
+                epilogue->n = n;
+                SUBMIT(epilogue);
+
+                Inst* jmp_inst = alloc_inst(JMP, TB_TYPE_PTR, 0, 1 + in_count, 0);
+                if (static_call) {
+                    jmp_inst->flags |= INST_GLOBAL;
+                    jmp_inst->mem_slot = 0;
+                    jmp_inst->s = TB_NODE_GET_EXTRA_T(target, TB_NodeSymbol)->sym;
+                    jmp_inst->abs = float_args;
+                    jmp_inst->scale = TB_MIN(n->input_count - 3, 255);
+                }
+
+                jmp_inst->operands[0] = target_val;
+                memcpy(&jmp_inst->operands[1], ins, in_count * sizeof(RegIndex));
+                SUBMIT(jmp_inst);
+                break;
+            }
+
             bool use_xmm_ret = TB_IS_FLOAT_TYPE(ret_dt) || ret_dt.width;
             if (ret_node != NULL) {
                 if (use_xmm_ret) {
@@ -1101,6 +1504,11 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
                 call_inst->flags |= INST_GLOBAL;
                 call_inst->mem_slot = 1;
                 call_inst->s = TB_NODE_GET_EXTRA_T(target, TB_NodeSymbol)->sym;
+
+                // direct calls have no use for these, they tell the JIT which
+                // arguments were floats in case it has to translate the call.
+                call_inst->abs = float_args;
+                call_inst->scale = TB_MIN(n->input_count - 3, 255);
             }
 
             *dst_ins++ = target_val;
@@ -1167,50 +1575,35 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
                     }
                 } else {
                     int key = input_reg(ctx, n->inputs[1]);
-                    SUBMIT(inst_op_ri(CMP, dt, key, br->keys[0]));
-                    SUBMIT(inst_jcc(succ[1], E));
-                    SUBMIT(inst_jmp(succ[0]));
-                }
-            } else {
-                TB_DataType dt = n->inputs[1]->dt;
-                int key = input_reg(ctx, n->inputs[1]);
-
-                // check if there's at most only one space between entries
-                uint64_t last = br->keys[1];
-                uint64_t min = last, max = last;
-
-                bool use_jump_table = true;
-                FOREACH_N(i, 2, br->succ_count) {
-                    uint64_t key = br->keys[i - 1];
-                    min = (min > key) ? key : min;
-                    max = (max > key) ? max : key;
-
-                    int64_t dist = key - last;
-                    if (dist > 2) {
-                        use_jump_table = false;
-                        break;
+                    if ((dt.type == TB_INT && dt.data <= 32) || fits_into_int32(br->keys[0])) {
+                        SUBMIT(inst_op_ri(CMP, dt, key, br->keys[0]));
+                    } else {
+                        int tmp = DEF(n, dt);
+                        SUBMIT(inst_op_abs(MOVABS, dt, tmp, br->keys[0]));
+                        SUBMIT(inst_op_rr_no_dst(CMP, dt, key, tmp));
                     }
-                    last = key;
-                }
-
-                if (use_jump_table) {
-                    // Simple range check
-                    log_debug("Should do range check (%llu .. %llu)", min, max);
-                }
 
-                FOREACH_N(i, 1, br->succ_count) {
-                    uint64_t curr_key = br->keys[i-1];
-
-                    if (fits_into_int32(curr_key)) {
-                        SUBMIT(inst_op_ri(CMP, dt, key, curr_key));
+                    // same flip as above
+                    if (ctx->fallthrough == succ[1]) {
+                        SUBMIT(inst_jcc(succ[0], NE));
                     } else {
-                        int tmp = DEF(n, dt);
-                        SUBMIT(inst_op_abs(MOVABS, dt, tmp, curr_key));
-                        SUBMIT(inst_op_rr(CMP, dt, key, tmp));
+                        SUBMIT(inst_jcc(succ[1], E));
+
+                        if (ctx->fallthrough != succ[0]) {
+                            SUBMIT(inst_jmp(succ[0]));
+                        }
                     }
-                    SUBMIT(inst_jcc(succ[i], E));
                 }
-                SUBMIT(inst_jmp(succ[0]));
+            } else {
+                // the dispatch has control flow of its own (bounds checks, binary
+                // search) so it's lowered during emission, see emit_switch.
+                Inst* inst = alloc_inst(INST_SWITCH, n->inputs[1]->dt, 0, 1, 2);
+                inst->n = n;
+                inst->imm = ctx->fallthrough == succ[0];
+                inst->operands[0] = input_reg(ctx, n->inputs[1]);
+                inst->operands[1] = DEF(n, TB_TYPE_I64);
+                inst->operands[2] = DEF(n, TB_TYPE_I64);
+                SUBMIT(inst);
             }
             break;
         }
@@ -1275,20 +1668,35 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
             // if we can couple the LOAD & STORE
             TB_Node* addr = n->inputs[2];
             TB_Node* src = n->inputs[3];
-            int store_op = can_folded_store(ctx, n->inputs[1], addr, n->inputs[3]);
+            TB_Node *ld, *rmw_src;
+            int store_op = can_folded_store(ctx, n->inputs[1], addr, src, &ld, &rmw_src);
             if (store_op >= 0) {
                 use(ctx, src);
                 use(ctx, addr);
-                use(ctx, src->inputs[1]);
-                use(ctx, src->inputs[1]->inputs[1]);
+                use(ctx, ld);
+                use(ctx, ld->inputs[1]);
 
-                src = src->inputs[2];
+                // inc & dec have their constant built in
+                if (store_op == INC || store_op == DEC) {
+                    use(ctx, rmw_src);
+                    rmw_src = NULL;
+                }
+
+                src = rmw_src;
             } else {
                 store_op = (TB_IS_FLOAT_TYPE(store_dt) || store_dt.width) ? FP_MOV : MOV;
             }
 
             int32_t imm;
-            if (try_for_imm32(ctx, src, &imm)) {
+            if (src == NULL) {
+                // op [mem]
+                Inst* st_inst = isel_addr2(ctx, addr, dst, store_op, -1);
+                st_inst->in_count -= 1;
+                st_inst->dt = legalize(store_dt);
+                assert(st_inst->flags & (INST_MEM | INST_GLOBAL));
+
+                SUBMIT(st_inst);
+            } else if (try_for_imm32(ctx, src, &imm)) {
                 use(ctx, src);
 
                 Inst* st_inst = isel_addr2(ctx, addr, dst, store_op, -1);
@@ -1444,6 +1852,9 @@ static void isel(Ctx* restrict ctx, TB_Node* n, const int dst) {
 
                 // past the first register parameters, it's all stack
                 if (index >= param_gpr_count) {
+                    // it's relative to our frame pointer so we need one
+                    if (ctx->stack_usage <= 16) ctx->stack_usage += 8;
+
                     InstType i = n->dt.type == TB_FLOAT ? FP_MOV : MOV;
                     SUBMIT(inst_op_rm(i, n->dt, dst, RBP, GPR_NONE, SCALE_X1, 16 + index*8));
                 }
@@ -1531,6 +1942,13 @@ static void inst2_print(TB_CGEmitter* restrict e, InstType type, Val* dst, Val*
         if (inst_table[type].cat == INST_BINOP_EXT3) {
             // movd/q
             EMITA(e, "%c ", dt == TB_X86_TYPE_QWORD ? 'q' : 'd');
+        } else if (type == PADD || type == PSUB) {
+            EMITA(e, "%c ", "bwdq"[dt - TB_X86_TYPE_PBYTE]);
+        } else if (type == PMULLW || type == PSHUFD) {
+            EMITA(e, " ");
+        } else if (dt >= TB_X86_TYPE_PBYTE && dt <= TB_X86_TYPE_PQWORD) {
+            // bitwise ops and moves don't care about lanes, we use the ps forms
+            EMITA(e, "ps ");
         } else if (dt >= TB_X86_TYPE_SSE_SS && dt <= TB_X86_TYPE_SSE_PD) {
             static const char suffixes[4][3] = { "ss", "sd", "ps", "pd" };
             EMITA(e, "%s ", suffixes[dt - TB_X86_TYPE_SSE_SS]);
@@ -1539,11 +1957,15 @@ static void inst2_print(TB_CGEmitter* restrict e, InstType type, Val* dst, Val*
         }
         print_operand(e, dst, dt);
         EMITA(e, ", ");
+        if (src->type == VAL_IMM && (type == SHUFP || type == PSHUFD)) {
+            print_operand(e, dst, dt);
+            EMITA(e, ", ");
+        }
         print_operand(e, src, dt);
         EMITA(e, "\n");
     }
 
-    if (dt >= TB_X86_TYPE_SSE_SS && dt <= TB_X86_TYPE_SSE_PD) {
+    if (dt >= TB_X86_TYPE_PBYTE && dt <= TB_X86_TYPE_SSE_PD) {
         inst2sse(e, type, dst, src, dt);
     } else {
         inst2(e, type, dst, src, dt);
@@ -1605,6 +2027,696 @@ static int resolve_interval(Ctx* restrict ctx, Inst* inst, int i, Val* val) {
     return 1;
 }
 
+////////////////////////////////
+// Peephole descriptions
+////////////////////////////////
+#define PEEP_ALU (PEEP_KNOWN | PEEP_WRITES_FLAGS)
+static const uint32_t peep_table[] = {
+    [MOV]       = PEEP_KNOWN | PEEP_DEF | PEEP_PURE | PEEP_MOVE,
+    [MOVABS]    = PEEP_KNOWN | PEEP_DEF | PEEP_PURE,
+    [LEA]       = PEEP_KNOWN | PEEP_DEF | PEEP_PURE | PEEP_ADDR,
+    [MOVSXB]    = PEEP_KNOWN | PEEP_DEF | PEEP_PURE,
+    [MOVSXW]    = PEEP_KNOWN | PEEP_DEF | PEEP_PURE,
+    [MOVSXD]    = PEEP_KNOWN | PEEP_DEF | PEEP_PURE,
+    [MOVZXB]    = PEEP_KNOWN | PEEP_DEF | PEEP_PURE,
+    [MOVZXW]    = PEEP_KNOWN | PEEP_DEF | PEEP_PURE,
+    [MOV_I2F]   = PEEP_KNOWN | PEEP_DEF | PEEP_PURE,
+    [MOV_F2I]   = PEEP_KNOWN | PEEP_DEF | PEEP_PURE,
+    [FP_MOV]    = PEEP_KNOWN | PEEP_PURE | PEEP_MOVE,
+
+    [ADD]       = PEEP_ALU | PEEP_FLAGS_ZS,
+    [SUB]       = PEEP_ALU | PEEP_FLAGS_ZS,
+    [NEG]       = PEEP_ALU | PEEP_FLAGS_ZS,
+    [INC]       = PEEP_ALU | PEEP_FLAGS_ZS,
+    [DEC]       = PEEP_ALU | PEEP_FLAGS_ZS,
+    [AND]       = PEEP_ALU | PEEP_FLAGS_ZS | PEEP_FLAGS_TEST,
+    [OR]        = PEEP_ALU | PEEP_FLAGS_ZS | PEEP_FLAGS_TEST,
+    [XOR]       = PEEP_ALU | PEEP_FLAGS_ZS | PEEP_FLAGS_TEST,
+    [NOT]       = PEEP_KNOWN,
+    [IMUL]      = PEEP_ALU,
+    [IMUL3]     = PEEP_ALU | PEEP_DEF,
+    [SHL]       = PEEP_ALU,
+    [SHR]       = PEEP_ALU,
+    [SAR]       = PEEP_ALU,
+    [ROL]       = PEEP_ALU,
+    [ROR]       = PEEP_ALU,
+    [CMP]       = PEEP_ALU | PEEP_COMPARE | PEEP_ZERO_TEST_I,
+    [TEST]      = PEEP_ALU | PEEP_COMPARE | PEEP_ZERO_TEST_RR,
+    [FP_UCOMI]  = PEEP_ALU | PEEP_COMPARE,
+
+    // the SSE ops don't touch EFLAGS
+    [FP_ADD]    = PEEP_KNOWN,
+    [FP_MUL]    = PEEP_KNOWN,
+    [FP_SUB]    = PEEP_KNOWN,
+    [FP_MIN]    = PEEP_KNOWN,
+    [FP_DIV]    = PEEP_KNOWN,
+    [FP_MAX]    = PEEP_KNOWN,
+    [FP_CMP]    = PEEP_KNOWN,
+    [FP_CVT32]  = PEEP_KNOWN,
+    [FP_CVT64]  = PEEP_KNOWN,
+    [FP_CVT]    = PEEP_KNOWN,
+    [FP_CVTT]   = PEEP_KNOWN | PEEP_DEF,
+    [FP_SQRT]   = PEEP_KNOWN,
+    [FP_RSQRT]  = PEEP_KNOWN,
+    [FP_AND]    = PEEP_KNOWN,
+    [FP_OR]     = PEEP_KNOWN,
+    [FP_XOR]    = PEEP_KNOWN,
+    [SHUFP]     = PEEP_KNOWN,
+    [PADD]      = PEEP_KNOWN,
+    [PSUB]      = PEEP_KNOWN,
+    [PMULLW]    = PEEP_KNOWN,
+    [PSHUFD]    = PEEP_KNOWN,
+
+    // these list their fixed registers as operands, the string ops don't
+    // (they bump RDI & co) so they stay barriers.
+    [CAST]      = PEEP_KNOWN | PEEP_FIXED | PEEP_DEF,
+    [DIV]       = PEEP_ALU | PEEP_FIXED | PEEP_DEF,
+    [IDIV]      = PEEP_ALU | PEEP_FIXED | PEEP_DEF,
+    [CALL]      = PEEP_ALU | PEEP_FIXED | PEEP_DEF,
+    [JMP]       = PEEP_KNOWN | PEEP_JUMP,
+};
+#undef PEEP_ALU
+
+static uint32_t peep_classify(int type) {
+    // condition codes which only care about ZF & SF
+    static const bool zs_only[16] = { [E] = true, [NE] = true, [S] = true, [NS] = true };
+
+    if (type >= JO && type <= JG) {
+        return PEEP_KNOWN | PEEP_BRANCH | PEEP_READS_FLAGS | (zs_only[type - JO] ? PEEP_READS_ZS : 0);
+    } else if (type >= SETO && type <= SETG) {
+        return PEEP_KNOWN | PEEP_READS_FLAGS | (zs_only[type - SETO] ? PEEP_READS_ZS : 0);
+    } else if (type >= CMOVO && type <= CMOVG) {
+        return PEEP_KNOWN | PEEP_READS_FLAGS | (zs_only[type - CMOVO] ? PEEP_READS_ZS : 0);
+    } else {
+        return type < COUNTOF(peep_table) ? peep_table[type] : 0;
+    }
+}
+
+// two operand forms (op dst, src) read the destination unless the first input gets copied
+// into it first (the ternary forms in emit_code), narrow writes and scalar SSE ops merge.
+static bool peep_reads_dst(Ctx* restrict ctx, Inst* inst, uint32_t info) {
+    bool packed = inst->dt >= TB_X86_TYPE_PBYTE && inst->dt <= TB_X86_TYPE_PQWORD;
+    packed |= inst->dt == TB_X86_TYPE_SSE_PS || inst->dt == TB_X86_TYPE_SSE_PD || inst->dt == TB_X86_TYPE_XMMWORD;
+
+    if (inst->type == INST_ZERO) {
+        return false;
+    } else if (ctx->intervals[inst->operands[0]].reg_class == REG_CLASS_XMM) {
+        // movd/movq & scalar loads clear the upper lanes, full width moves replace them
+        bool load = (inst->flags & (INST_MEM | INST_GLOBAL)) && inst->mem_slot == inst->out_count;
+        return !(inst->type == MOV_I2F || (inst->type == FP_MOV && (packed || load)));
+    } else if (inst->dt == TB_X86_TYPE_BYTE || inst->dt == TB_X86_TYPE_WORD) {
+        return true;
+    } else if (info & PEEP_DEF) {
+        return false;
+    } else if (inst->in_count == 0) {
+        return true;
+    }
+
+    int first = (inst->flags & INST_MEM) && (inst->flags & INST_INDEXED) && inst->mem_slot == inst->out_count ? 2 : 1;
+    bool ternary = inst->in_count > first || (inst->flags & (INST_IMM | INST_ABS));
+    return !ternary;
+}
+
+// what the caller gets to see once we return: the return registers, the stack and the
+// callee saved registers (their restores come after the epilogue).
+static uint64_t peep_return_live(Ctx* restrict ctx) {
+    uint64_t callee_saved[CG_REGISTER_CLASSES];
+    mark_callee_saved_constraints(ctx, callee_saved);
+
+    uint64_t gprs = (callee_saved[0] & 0xFFFF) | (1u << RAX) | (1u << RSP) | (1u << RBP);
+    uint64_t xmms = (callee_saved[1] & 0xFFFF) | (1u << XMM0);
+    return gprs | (xmms << 32);
+}
+
+////////////////////////////////
+// Switch lowering
+////////////////////////////////
+// multiway branches are expanded here since the dispatch needs labels which don't map to
+// any region. the sorted cases are grouped into clusters:
+//
+//   * dense runs become jump tables, those hold 32bit offsets relative to the table and
+//     get placed after the function body so they don't need relocations.
+//   * runs within 64 values of each other going to a few targets are bit tests.
+//   * anything else is a plain compare.
+//
+// and then we binary search over the clusters.
+enum {
+    SWITCH_TABLE_MIN_CASES = 4,
+    SWITCH_TABLE_MAX_RANGE = 4096,
+    // percentage of the table which needs to be real cases
+    SWITCH_TABLE_DENSITY   = 40,
+
+    SWITCH_BITS_MIN_CASES  = 3,
+    SWITCH_BITS_MAX_DESTS  = 3,
+
+    // clusters we just test one after another instead of splitting
+    SWITCH_LINEAR_CLUSTERS = 3,
+};
+
+typedef struct {
+    uint64_t key;
+    TB_Node* target;
+} SwitchCase;
+
+typedef enum {
+    CLUSTER_CASE, CLUSTER_BITS, CLUSTER_TABLE
+} SwitchClusterKind;
+
+typedef struct {
+    SwitchClusterKind kind;
+    // cases [first, last]
+    int first, last;
+} SwitchCluster;
+
+typedef struct JumpTable JumpTable;
+struct JumpTable {
+    JumpTable* next;
+
+    // the LEA which needs the table's address
+    uint32_t patch_pos;
+    int id, count;
+    TB_Node** targets;
+};
+
+typedef struct {
+    TB_CGEmitter* e;
+    TB_X86_DataType dt;
+
+    // idx and aux are scratch GPRs
+    Val key, idx, aux;
+
+    TB_Node* fallback;
+    bool fallthrough;
+
+    SwitchCase* cases;
+    SwitchCluster* clusters;
+
+    // shared across the whole function
+    JumpTable** tables;
+    int* label_count;
+} SwitchEmit;
+
+static int switch_case_cmp(const void* a, const void* b) {
+    uint64_t x = ((const SwitchCase*) a)->key;
+    uint64_t y = ((const SwitchCase*) b)->key;
+    return (x > y) - (x < y);
+}
+
+static int switch_clusters(SwitchCase* cases, int case_count, SwitchCluster* clusters) {
+    int cluster_count = 0;
+    for (int i = 0; i < case_count;) {
+        // widest dense run starting at i
+        int last = -1;
+        for (int j = i + SWITCH_TABLE_MIN_CASES - 1; j < case_count; j++) {
+            uint64_t span = cases[j].key - cases[i].key;
+            if (span >= SWITCH_TABLE_MAX_RANGE) break;
+
+            if ((j - i + 1) * 100 >= (span + 1) * SWITCH_TABLE_DENSITY) last = j;
+        }
+
+        if (last >= 0) {
+            clusters[cluster_count++] = (SwitchCluster){ CLUSTER_TABLE, i, last };
+            i = last + 1;
+            continue;
+        }
+
+        // a bit test needs the cases to fit in a 64bit mask
+        TB_Node* dests[SWITCH_BITS_MAX_DESTS];
+        int dest_count = 0, j = i;
+        for (; j < case_count && cases[j].key - cases[i].key < 64; j++) {
+            int k = 0;
+            while (k < dest_count && dests[k] != cases[j].target) k++;
+
+            if (k == dest_count) {
+                if (dest_count == SWITCH_BITS_MAX_DESTS) break;
+                dests[dest_count++] = cases[j].target;
+            }
+        }
+
+        if (j - i >= SWITCH_BITS_MIN_CASES) {
+            clusters[cluster_count++] = (SwitchCluster){ CLUSTER_BITS, i, j - 1 };
+            i = j;
+        } else {
+            clusters[cluster_count++] = (SwitchCluster){ CLUSTER_CASE, i, i };
+            i += 1;
+        }
+    }
+
+    return cluster_count;
+}
+
+static void switch_jmp(SwitchEmit* s, int op, TB_Node* target) {
+    Val v = val_label(target);
+    inst1_print(s->e, op, &v, TB_X86_TYPE_QWORD);
+}
+
+// forward jumps to a spot within the dispatch, returns where to patch
+static uint32_t switch_jcc_local(SwitchEmit* s, Cond cc, int id) {
+    TB_CGEmitter* e = s->e;
+    EMITA(e, "  %s .sw%d\n", inst_table[JO + cc].mnemonic, id);
+    dyn_array_put(e->branches, GET_CODE_POS(e));
+    EMIT1(e, 0x0F);
+    EMIT1(e, 0x80 + cc);
+    EMIT4(e, 0);
+    return GET_CODE_POS(e) - 4;
+}
+
+static void switch_resolve_local(SwitchEmit* s, uint32_t pos, int id) {
+    TB_CGEmitter* e = s->e;
+    EMITA(e, ".sw%d:\n", id);
+    PATCH4(e, pos, GET_CODE_POS(e) - (pos + 4));
+}
+
+// op dst, x where x is at most as wide as dt, goes through aux if it doesn't fit an imm32.
+static void switch_op_imm(SwitchEmit* s, int op, Val* dst, uint64_t x, TB_X86_DataType dt) {
+    if (dt == TB_X86_TYPE_QWORD && (int64_t) x != (int32_t) x) {
+        Val abs = val_abs(x);
+        inst2_print(s->e, MOVABS, &s->aux, &abs, TB_X86_TYPE_QWORD);
+        inst2_print(s->e, op, dst, &s->aux, dt);
+    } else {
+        Val imm = val_imm((int32_t) x);
+        inst2_print(s->e, op, dst, &imm, dt);
+    }
+}
+
+// idx = key - lo as a 64bit value, anything above hi goes to the miss label (or the
+// fallback if there's no local one).
+static void switch_index(SwitchEmit* s, SwitchCluster* c, uint32_t* miss, int miss_id) {
+    uint64_t lo = s->cases[c->first].key, hi = s->cases[c->last].key;
+
+    // 32bit ops zero extend for us
+    TB_X86_DataType dt = s->dt == TB_X86_TYPE_QWORD ? TB_X86_TYPE_QWORD : TB_X86_TYPE_DWORD;
+    if (s->dt == TB_X86_TYPE_BYTE || s->dt == TB_X86_TYPE_WORD) {
+        inst2_print(s->e, s->dt == TB_X86_TYPE_BYTE ? MOVZXB : MOVZXW, &s->idx, &s->key, dt);
+    } else {
+        inst2_print(s->e, MOV, &s->idx, &s->key, dt);
+    }
+
+    if (lo != 0) switch_op_imm(s, SUB, &s->idx, lo, dt);
+    switch_op_imm(s, CMP, &s->idx, hi - lo, dt);
+
+    if (miss) {
+        *miss = switch_jcc_local(s, A, miss_id);
+    } else {
+        switch_jmp(s, JO + A, s->fallback);
+    }
+}
+
+static void switch_bits(SwitchEmit* s, SwitchCluster* c) {
+    TB_CGEmitter* e = s->e;
+    uint64_t lo = s->cases[c->first].key;
+
+    // one mask per target, they're disjoint so the order doesn't matter
+    for (int i = c->first; i <= c->last; i++) {
+        TB_Node* target = s->cases[i].target;
+
+        bool done = false;
+        for (int j = c->first; j < i; j++) {
+            if (s->cases[j].target == target) { done = true; break; }
+        }
+        if (done) continue;
+
+        uint64_t mask = 0;
+        for (int j = i; j <= c->last; j++) {
+            if (s->cases[j].target == target) mask |= 1ull << (s->cases[j].key - lo);
+        }
+
+        if (mask <= INT32_MAX) {
+            Val imm = val_imm(mask);
+            inst2_print(e, MOV, &s->aux, &imm, TB_X86_TYPE_DWORD);
+        } else {
+            Val abs = val_abs(mask);
+            inst2_print(e, MOVABS, &s->aux, &abs, TB_X86_TYPE_QWORD);
+        }
+
+        // bt aux, idx
+        if (e->emit_asm) {
+            EMITA(e, "  bt ");
+            print_operand(e, &s->aux, TB_X86_TYPE_QWORD);
+            EMITA(e, ", ");
+            print_operand(e, &s->idx, TB_X86_TYPE_QWORD);
+            EMITA(e, "\n");
+        }
+        EMIT1(e, rex(true, s->idx.reg, s->aux.reg, 0));
+        EMIT1(e, 0x0F);
+        EMIT1(e, 0xA3);
+        EMIT1(e, mod_rx_rm(MOD_DIRECT, s->idx.reg, s->aux.reg));
+
+        switch_jmp(s, JO + B, target);
+    }
+
+    // it's in range but not one of ours
+    switch_jmp(s, JMP, s->fallback);
+}
+
+static void switch_table(SwitchEmit* s, SwitchCluster* c) {
+    TB_CGEmitter* e = s->e;
+    uint64_t lo = s->cases[c->first].key, hi = s->cases[c->last].key;
+
+    JumpTable* t = TB_ARENA_ALLOC(tmp_arena, JumpTable);
+    t->count = hi - lo + 1;
+    t->id = (*s->label_count)++;
+    t->targets = tb_arena_alloc(tmp_arena, t->count * sizeof(TB_Node*));
+    FOREACH_N(i, 0, t->count) t->targets[i] = s->fallback;
+    for (int i = c->first; i <= c->last; i++) {
+        t->targets[s->cases[i].key - lo] = s->cases[i].target;
+    }
+
+    // lea aux, [rip + table]
+    EMITA(e, "  lea ");
+    print_operand(e, &s->aux, TB_X86_TYPE_QWORD);
+    EMITA(e, ", [rip + .jt%d]\n", t->id);
+    EMIT1(e, rex(true, s->aux.reg, 0, 0));
+    EMIT1(e, 0x8D);
+    EMIT1(e, mod_rx_rm(MOD_INDIRECT, s->aux.reg, RBP));
+    EMIT4(e, 0);
+    t->patch_pos = GET_CODE_POS(e) - 4;
+
+    // movsxd idx, [aux + idx*4]
+    Val entry = { .type = VAL_MEM, .reg = s->aux.reg, .index = s->idx.reg, .scale = SCALE_X4 };
+    inst2_print(e, MOVSXD, &s->idx, &entry, TB_X86_TYPE_QWORD);
+    inst2_print(e, ADD, &s->aux, &s->idx, TB_X86_TYPE_QWORD);
+    inst1_print(e, JMP, &s->aux, TB_X86_TYPE_QWORD);
+
+    t->next = *s->tables;
+    *s->tables = t;
+}
+
+// tests clusters [a, b) one after another
+static void switch_linear(SwitchEmit* s, int a, int b, bool tail) {
+    bool needs_exit = true;
+    for (int i = a; i < b; i++) {
+        SwitchCluster* c = &s->clusters[i];
+        bool last = i + 1 == b;
+
+        if (c->kind == CLUSTER_CASE) {
+            switch_op_imm(s, CMP, &s->key, s->cases[c->first].key, s->dt);
+            switch_jmp(s, JO + E, s->cases[c->first].target);
+            needs_exit = true;
+            continue;
+        }
+
+        // misses past the range go to the next cluster
+        int id = last ? 0 : (*s->label_count)++;
+        uint32_t miss;
+        switch_index(s, c, last ? NULL : &miss, id);
+
+        if (c->kind == CLUSTER_BITS) {
+            switch_bits(s, c);
+        } else {
+            switch_table(s, c);
+        }
+
+        if (!last) switch_resolve_local(s, miss, id);
+        needs_exit = false;
+    }
+
+    if (needs_exit && !(tail && s->fallthrough)) {
+        switch_jmp(s, JMP, s->fallback);
+    }
+}
+
+static void switch_tree(SwitchEmit* s, int a, int b, bool tail) {
+    if (b - a <= SWITCH_LINEAR_CLUSTERS) {
+        switch_linear(s, a, b, tail);
+        return;
+    }
+
+    // keys below the middle cluster go left
+    int mid = a + (b - a) / 2;
+    int id = (*s->label_count)++;
+    switch_op_imm(s, CMP, &s->key, s->cases[s->clusters[mid].first].key, s->dt);
+    uint32_t left = switch_jcc_local(s, B, id);
+
+    switch_tree(s, mid, b, false);
+    switch_resolve_local(s, left, id);
+    switch_tree(s, a, mid, tail);
+}
+
+static void emit_switch(Ctx* restrict ctx, Inst* inst, JumpTable** tables, int* label_count) {
+    TB_NodeBranch* br = TB_NODE_GET_EXTRA(inst->n);
+    int case_count = br->succ_count - 1;
+
+    SwitchEmit s = {
+        .e = &ctx->emit,
+        .dt = inst->dt,
+        .fallback = br->succ[0],
+        .fallthrough = inst->imm,
+        .tables = tables,
+        .label_count = label_count,
+    };
+
+    resolve_interval(ctx, inst, 0, &s.key);
+    resolve_interval(ctx, inst, 1, &s.idx);
+    resolve_interval(ctx, inst, 2, &s.aux);
+    assert(s.idx.type == VAL_GPR && s.aux.type == VAL_GPR);
+
+    // unsigned order on the key's width
+    uint64_t mask = s.dt == TB_X86_TYPE_QWORD ? UINT64_MAX : (1ull << (8u << (s.dt - TB_X86_TYPE_BYTE))) - 1;
+
+    s.cases = tb_arena_alloc(tmp_arena, case_count * sizeof(SwitchCase));
+    FOREACH_N(i, 0, case_count) {
+        s.cases[i] = (SwitchCase){ br->keys[i] & mask, br->succ[i + 1] };
+    }
+    qsort(s.cases, case_count, sizeof(SwitchCase), switch_case_cmp);
+
+    s.clusters = tb_arena_alloc(tmp_arena, case_count * sizeof(SwitchCluster));
+    int cluster_count = switch_clusters(s.cases, case_count, s.clusters);
+    switch_tree(&s, 0, cluster_count, true);
+}
+
+static void emit_jump_tables(Ctx* restrict ctx, JumpTable* tables) {
+    TB_CGEmitter* e = &ctx->emit;
+    if (tables == NULL) return;
+
+    // keep the entries aligned, nothing ever runs through here
+    while (GET_CODE_POS(e) & 3) EMIT1(e, 0xCC);
+
+    for (JumpTable* t = tables; t; t = t->next) {
+        uint32_t pos = GET_CODE_POS(e);
+        PATCH4(e, t->patch_pos, pos - (t->patch_pos + 4));
+
+        EMITA(e, ".jt%d:\n", t->id);
+        FOREACH_N(i, 0, t->count) {
+            uint32_t target = nl_map_get_checked(e->labels, t->targets[i]);
+            assert((target & 0x80000000) && "jump table target wasn't placed");
+
+            EMITA(e, "  dd L%d - .jt%d\n", TB_NODE_GET_EXTRA_T(t->targets[i], TB_NodeRegion)->postorder_id, t->id);
+            EMIT4(e, (target & 0x7FFFFFFF) - pos);
+        }
+    }
+}
+
+// up to 15 bytes of multi-byte nops
+static void fill_nops(uint8_t* dst, size_t pad) {
+    static const uint8_t nops[8][8] = {
+        { 0x90 },
+        { 0x66, 0x90 },
+        { 0x0F, 0x1F, 0x00 },
+        { 0x0F, 0x1F, 0x40, 0x00 },
+        { 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00 },
+        { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
+    };
+
+    if (pad == 0) return;
+    if (pad > 8) {
+        size_t rem = pad - 8;
+        memset(dst, 0x66, rem);
+        pad -= rem, dst += rem;
+    }
+    memcpy(dst, nops[pad - 1], pad);
+}
+
+////////////////////////////////
+// Branch relaxation
+////////////////////////////////
+// every jump to a label goes out as rel32 since we don't know where the label lands
+// yet, once the body is done we shrink the ones which fit in a rel8 and drop the ones
+// which just go to the next instruction. removing bytes only ever pulls code closer
+// together so anything which fits stays fitting, we keep going until nothing changes.
+//
+// the alignment padding in front of loop headers is counted at full size while we do
+// that and only trimmed at the end, trimming can't push a branch out of range either.
+typedef struct {
+    // in the rel32 layout
+    uint32_t pos, target;
+    // JMP or Jcc, 0 for alignment padding
+    uint8_t op, cc;
+    // the old size and the one we're going with
+    uint8_t old_size, size;
+} Branch;
+
+// bytes removed by the branches before pos (removed[i] covers branches[0, i))
+static uint32_t relax_pos(Branch* branches, uint32_t* removed, size_t count, uint32_t pos) {
+    size_t lo = 0, hi = count;
+    while (lo < hi) {
+        size_t mid = (lo + hi) / 2;
+        if (branches[mid].pos < pos) lo = mid + 1;
+        else hi = mid;
+    }
+
+    return pos - removed[lo];
+}
+
+static void relax_compute_removed(Branch* branches, uint32_t* removed, size_t count) {
+    removed[0] = 0;
+    FOREACH_N(i, 0, count) {
+        removed[i + 1] = removed[i] + (branches[i].old_size - branches[i].size);
+    }
+}
+
+static void relax_branches(Ctx* restrict ctx, TB_FunctionOutput* restrict func_out, JumpTable* tables) {
+    TB_CGEmitter* e = &ctx->emit;
+    size_t branch_count = dyn_array_length(e->branches);
+    size_t align_count = dyn_array_length(e->aligns);
+    size_t count = branch_count + align_count;
+    if (count == 0) return;
+
+    // everything's been placed by now so the displacements are real
+    Branch* branches = tb_arena_alloc(tmp_arena, count * sizeof(Branch));
+    uint32_t* removed = tb_arena_alloc(tmp_arena, (count + 1) * sizeof(uint32_t));
+    size_t j = 0, k = 0;
+    FOREACH_N(i, 0, count) {
+        Branch* b = &branches[i];
+
+        // both lists are already sorted, merge them
+        if (k < align_count && (j == branch_count || e->aligns[k] < e->branches[j])) {
+            *b = (Branch){ .pos = e->aligns[k++], .old_size = LAYOUT_LOOP_ALIGN - 1, .size = LAYOUT_LOOP_ALIGN - 1 };
+            continue;
+        }
+
+        uint32_t pos = e->branches[j++];
+        uint8_t* code = &e->data[pos];
+        if (code[0] == 0xE9) {
+            *b = (Branch){ .pos = pos, .op = JMP, .old_size = 5 };
+        } else {
+            assert(code[0] == 0x0F && (code[1] & 0xF0) == 0x80);
+            *b = (Branch){ .pos = pos, .op = JO, .cc = code[1] & 0xF, .old_size = 6 };
+        }
+
+        int32_t disp;
+        memcpy(&disp, &code[b->old_size - 4], 4);
+        b->target = pos + b->old_size + disp;
+        b->size = b->old_size;
+    }
+
+    bool changed = true;
+    while (changed) {
+        changed = false;
+        relax_compute_removed(branches, removed, count);
+
+        FOREACH_N(i, 0, count) {
+            Branch* b = &branches[i];
+            if (b->op == 0 || b->size == 0) continue;
+
+            // for forward jumps the target moves along with us, so we only care
+            // about what's in between.
+            bool forward = b->target > b->pos;
+            int64_t src = relax_pos(branches, removed, count, b->pos);
+            int64_t dst = relax_pos(branches, removed, count, b->target);
+            int64_t disp = forward ? dst - (src + b->size) : dst - (src + 2);
+
+            uint8_t size = b->size;
+            if (forward && disp == 0) {
+                // falls into the next instruction anyways
+                size = 0;
+            } else if (disp == (int8_t) disp) {
+                size = 2;
+            }
+
+            if (b->size != size) {
+                b->size = size;
+                changed = true;
+            }
+        }
+    }
+
+    // now that we know where everything lands the padding can be trimmed, each
+    // one only depends on the ones before it.
+    removed[0] = 0;
+    FOREACH_N(i, 0, count) {
+        Branch* b = &branches[i];
+        if (b->op == 0) {
+            b->size = (LAYOUT_LOOP_ALIGN - ((b->pos - removed[i]) & (LAYOUT_LOOP_ALIGN - 1))) & (LAYOUT_LOOP_ALIGN - 1);
+        }
+        removed[i + 1] = removed[i] + (b->old_size - b->size);
+    }
+
+    // slide the code down, every branch gets rewritten since the targets moved
+
+    uint32_t read = 0, write = 0;
+    FOREACH_N(i, 0, count) {
+        Branch* b = &branches[i];
+        uint32_t len = b->pos - read;
+        memmove(&e->data[write], &e->data[read], len);
+        write += len, read = b->pos + b->old_size;
+
+        uint8_t* code = &e->data[write];
+        if (b->op == 0) {
+            fill_nops(code, b->size);
+            write += b->size;
+            continue;
+        }
+
+        int32_t disp = relax_pos(branches, removed, count, b->target) - (write + b->size);
+        if (b->size == 2) {
+            assert(disp == (int8_t) disp);
+            code[0] = b->op == JMP ? 0xEB : 0x70 + b->cc;
+            code[1] = (int8_t) disp;
+        } else if (b->size > 2) {
+            if (b->op == JMP) {
+                code[0] = 0xE9;
+            } else {
+                code[0] = 0x0F;
+                code[1] = 0x80 + b->cc;
+            }
+            memcpy(&code[b->size - 4], &disp, 4);
+        }
+        write += b->size;
+    }
+
+    memmove(&e->data[write], &e->data[read], e->count - read);
+    e->count -= read - write;
+
+    // anything which remembers a spot in the code needs to move along
+    nl_map_for(i, e->labels) {
+        uint32_t v = e->labels[i].v;
+        if (v & 0x80000000) {
+            e->labels[i].v = 0x80000000 | relax_pos(branches, removed, count, v & 0x7FFFFFFF);
+        }
+    }
+
+    if (e->return_label & 0x80000000) {
+        e->return_label = 0x80000000 | relax_pos(branches, removed, count, e->return_label & 0x7FFFFFFF);
+    }
+
+    TB_SymbolPatch* patch = func_out->last_patch;
+    FOREACH_N(i, 0, func_out->patch_count) {
+        patch->pos = relax_pos(branches, removed, count, patch->pos);
+        patch = patch->prev;
+    }
+
+    dyn_array_for(i, ctx->locations) {
+        ctx->locations[i].pos = relax_pos(branches, removed, count, ctx->locations[i].pos);
+    }
+
+    for (JumpTable* t = tables; t; t = t->next) {
+        t->patch_pos = relax_pos(branches, removed, count, t->patch_pos);
+    }
+}
+
+// the patch that was just written belongs to a direct call, keep its argument layout around
+static void note_call_patch(TB_CGEmitter* e, Inst* inst) {
+    TB_SymbolPatch* p = e->output->last_patch;
+    assert(p != NULL && p->target == inst->s);
+
+    p->is_call = true;
+    p->arg_count = inst->scale;
+    p->float_args = inst->abs;
+}
+
 static void emit_code(Ctx* restrict ctx, TB_FunctionOutput* restrict func_out) {
     TB_CGEmitter* e = &ctx->emit;
 
@@ -1625,6 +2737,9 @@ static void emit_code(Ctx* restrict ctx, TB_FunctionOutput* restrict func_out) {
     func_out->prologue_length = emit_prologue(ctx);
 
     Inst* prev_line = NULL;
+    JumpTable* tables = NULL;
+    int switch_labels = 0;
+    bool pending_epilogue = false;
     for (Inst* restrict inst = ctx->first; inst; inst = inst->next) {
         size_t in_base = inst->out_count;
         InstCategory cat = inst->type >= (sizeof inst_table / sizeof *inst_table) ? INST_BINOP : inst_table[inst->type].cat;
@@ -1644,7 +2759,22 @@ static void emit_code(Ctx* restrict ctx, TB_FunctionOutput* restrict func_out) {
         if (inst->type == INST_ENTRY || inst->type == INST_TERMINATOR) {
             // does nothing
         } else if (inst->type == INST_LABEL) {
+            if (pending_epilogue) {
+                emit_epilogue(ctx, ctx->f->stop_node);
+                pending_epilogue = false;
+            }
+
             TB_Node* bb = inst->n;
+            if (inst->imm > 0) {
+                // reserve the worst case, relax_branches trims it once it knows where we land
+                assert(inst->imm == LAYOUT_LOOP_ALIGN);
+                EMITA(e, "  .align %d\n", inst->imm);
+
+                dyn_array_put(e->aligns, GET_CODE_POS(e));
+                fill_nops(tb_cgemit_reserve(e, LAYOUT_LOOP_ALIGN - 1), LAYOUT_LOOP_ALIGN - 1);
+                tb_cgemit_commit(e, LAYOUT_LOOP_ALIGN - 1);
+            }
+
             uint32_t pos = GET_CODE_POS(&ctx->emit);
             tb_resolve_rel32(&ctx->emit, &nl_map_get_checked(ctx->emit.labels, bb), pos);
 
@@ -1661,9 +2791,15 @@ static void emit_code(Ctx* restrict ctx, TB_FunctionOutput* restrict func_out) {
             }
             EMITA(&ctx->emit, "\n");
         } else if (inst->type == INST_EPILOGUE) {
-            // return label goes here
-            EMITA(&ctx->emit, ".ret:\n");
-            tb_resolve_rel32(&ctx->emit, &ctx->emit.return_label, GET_CODE_POS(&ctx->emit));
+            // return label goes here (tail calls have their own epilogue)
+            if ((inst->flags & INST_NODE) == 0) {
+                EMITA(&ctx->emit, ".ret:\n");
+                tb_resolve_rel32(&ctx->emit, &ctx->emit.return_label, GET_CODE_POS(&ctx->emit));
+            }
+
+            // regalloc still puts the callee saved reloads after this, the epilogue
+            // goes down once those are out (at the next label, cold blocks can follow).
+            pending_epilogue = true;
         } else if (inst->type == INST_LINE) {
             TB_Function* f = ctx->f;
             TB_Attrib* loc = inst->a;
@@ -1688,6 +2824,8 @@ static void emit_code(Ctx* restrict ctx, TB_FunctionOutput* restrict func_out) {
 
             EMITA(e, "  %s\n", inst_table[inst->type].mnemonic);
             inst0(e, inst->type, inst->dt);
+        } else if (inst->type == INST_SWITCH) {
+            emit_switch(ctx, inst, &tables, &switch_labels);
         } else if (inst->type == INST_ZERO) {
             Val dst;
             resolve_interval(ctx, inst, 0, &dst);
@@ -1698,13 +2836,20 @@ static void emit_code(Ctx* restrict ctx, TB_FunctionOutput* restrict func_out) {
             Val target;
             if (inst->flags & INST_NODE) {
                 target = val_label(inst->n);
-            } else if (inst->flags & INST_GLOBAL) {
-                target = val_global(inst->s);
             } else {
-                tb_todo();
+                // tail call, the frame goes away right before we leave
+                assert(inst->type == JMP);
+                resolve_interval(ctx, inst, 0, &target);
+                if (pending_epilogue) {
+                    emit_epilogue(ctx, NULL);
+                    pending_epilogue = false;
+                }
             }
 
             inst1_print(e, inst->type, &target, inst->dt);
+            if (target.type == VAL_GLOBAL) {
+                note_call_patch(e, inst);
+            }
         } else if (inst->type == CALL) {
             Val target;
             size_t i = resolve_interval(ctx, inst, in_base, &target);
@@ -1722,6 +2867,7 @@ static void emit_code(Ctx* restrict ctx, TB_FunctionOutput* restrict func_out) {
                 }
                 EMITA(e, "\n");
                 inst1(e, CALL, &target, TB_X86_TYPE_QWORD);
+                note_call_patch(e, inst);
             } else {
                 inst1_print(e, CALL, &target, TB_X86_TYPE_QWORD);
             }
@@ -1776,7 +2922,8 @@ static void emit_code(Ctx* restrict ctx, TB_FunctionOutput* restrict func_out) {
                     inst1_print(e, inst->type, &lhs, inst->dt);
                     continue;
                 } else {
-                    if (ternary || inst->type == MOV || inst->type == FP_MOV) {
+                    // unary ops work in place, they just get their input copied over
+                    if (ternary || inst->type == MOV || inst->type == FP_MOV || cat == INST_UNARY) {
                         if (!is_value_match(&out, &lhs)) {
                             inst2_print(e, mov_op, &out, &lhs, inst->dt);
                         }
@@ -1809,31 +2956,19 @@ static void emit_code(Ctx* restrict ctx, TB_FunctionOutput* restrict func_out) {
         }
     }
 
-    emit_epilogue(ctx, ctx->f->stop_node);
+    if (pending_epilogue) {
+        emit_epilogue(ctx, ctx->f->stop_node);
+    }
 
-    // pad to 16bytes
-    static const uint8_t nops[8][8] = {
-        { 0x90 },
-        { 0x66, 0x90 },
-        { 0x0F, 0x1F, 0x00 },
-        { 0x0F, 0x1F, 0x40, 0x00 },
-        { 0x0F, 0x1F, 0x44, 0x00, 0x00 },
-        { 0x66, 0x0F, 0x1F, 0x44, 0x00, 0x00 },
-        { 0x0F, 0x1F, 0x80, 0x00, 0x00, 0x00, 0x00 },
-        { 0x0F, 0x1F, 0x84, 0x00, 0x00, 0x00, 0x00, 0x00 },
-    };
+    relax_branches(ctx, func_out, tables);
+    emit_jump_tables(ctx, tables);
 
+    // pad to 16bytes
     size_t pad = 16 - (ctx->emit.count & 15);
     if (pad < 16) {
         uint8_t* dst = tb_cgemit_reserve(&ctx->emit, pad);
         tb_cgemit_commit(&ctx->emit, pad);
-
-        if (pad > 8) {
-            size_t rem = pad - 8;
-            memset(dst, 0x66, rem);
-            pad -= rem, dst += rem;
-        }
-        memcpy(dst, nops[pad - 1], pad);
+        fill_nops(dst, pad);
     }
 }
 
@@ -1919,11 +3054,16 @@ static size_t emit_prologue(Ctx* restrict ctx) {
     return e->count;
 }
 
+// tail calls don't have a stop node, they only tear down the frame (the JMP comes after)
 static size_t emit_epilogue(Ctx* restrict ctx, TB_Node* stop) {
     uint64_t saved = ctx->regs_to_save, stack_usage = ctx->stack_usage;
     TB_CGEmitter* e = &ctx->emit;
 
     if (stack_usage <= 16) {
+        if (stop == NULL) {
+            return 0;
+        }
+
         EMITA(e, "  ret\n");
         EMIT1(e, 0xC3);
         return 1;
@@ -1954,8 +3094,8 @@ static size_t emit_epilogue(Ctx* restrict ctx, TB_Node* stop) {
     }
 
     // ret
-    TB_Node* rpc = stop->inputs[2];
-    if (rpc->type == TB_PROJ && rpc->inputs[0]->type == TB_START && TB_NODE_GET_EXTRA_T(rpc, TB_NodeProj)->index == 2) {
+    TB_Node* rpc = stop ? stop->inputs[2] : NULL;
+    if (rpc && rpc->type == TB_PROJ && rpc->inputs[0]->type == TB_START && TB_NODE_GET_EXTRA_T(rpc, TB_NodeProj)->index == 2) {
         EMITA(e, "  ret\n");
         EMIT1(&ctx->emit, 0xC3);
     }
@@ -29,7 +29,7 @@ static void emit_memory_operand(TB_CGEmitter* restrict e, uint8_t rx, const Val*
 
         EMIT1(e, mod_rx_rm(mod, rx, needs_index ? RSP : base));
         if (needs_index) {
-            EMIT1(e, mod_rx_rm(scale, (base & 7) == RSP ? RSP : index, base));
+            EMIT1(e, mod_rx_rm(scale, index != GPR_NONE ? index : RSP, base));
         }
 
         if (mod == MOD_INDIRECT_DISP8) {
@@ -71,6 +71,14 @@ static void inst1(TB_CGEmitter* restrict e, InstType type, const Val* r, TB_X86_
     bool is_rexw = dt == TB_X86_TYPE_QWORD;
 
     uint8_t op = inst->op_i, rx = inst->rx_i;
+
+    // memory operands have to be the right width, the F7 & FF groups have their
+    // byte forms one below and words get the operand size prefix.
+    if ((r->type == VAL_MEM || r->type == VAL_GLOBAL) && inst->op == 0) {
+        if (dt == TB_X86_TYPE_WORD) EMIT1(e, 0x66);
+        if (dt == TB_X86_TYPE_BYTE) op &= ~1;
+    }
+
     if (r->type == VAL_GPR) {
         if (is_rex || r->reg >= 8) {
             EMIT1(e, rex(is_rexw, 0x00, r->reg, 0x00));
@@ -100,7 +108,7 @@ static void inst1(TB_CGEmitter* restrict e, InstType type, const Val* r, TB_X86_
 
         EMIT1(e, mod_rx_rm(mod, rx, needs_index ? RSP : base));
         if (needs_index) {
-            EMIT1(e, mod_rx_rm(scale, (base & 7) == RSP ? RSP : index, base));
+            EMIT1(e, mod_rx_rm(scale, index != GPR_NONE ? index : RSP, base));
         }
 
         if (mod == MOD_INDIRECT_DISP8) EMIT1(e, (int8_t)disp);
@@ -120,6 +128,8 @@ static void inst1(TB_CGEmitter* restrict e, InstType type, const Val* r, TB_X86_
         EMIT4(e, r->imm);
         tb_emit_symbol_patch(e->output, r->symbol, e->count - 4);
     } else if (r->type == VAL_LABEL) {
+        dyn_array_put(e->branches, GET_CODE_POS(e));
+
         EXT_OP(INST_UNARY_EXT);
         EMIT1(e, inst->op);
         EMIT4(e, 0);
@@ -142,7 +152,7 @@ static void inst2(TB_CGEmitter* restrict e, InstType type, const Val* a, const V
     if (type == MOVABS) {
         assert(a->type == VAL_GPR && b->type == VAL_ABS);
 
-        EMIT1(e, rex(true, a->reg, 0, 0));
+        EMIT1(e, rex(true, 0, a->reg, 0));
         EMIT1(e, inst->op + (a->reg & 0b111));
         EMIT8(e, b->abs);
         return;
@@ -207,7 +217,7 @@ static void inst2(TB_CGEmitter* restrict e, InstType type, const Val* a, const V
 
     // if the REX stays as 0x40 then it's default and doesn't need
     // to be here.
-    if (rex_prefix != 0x40 || dt == TB_X86_TYPE_BYTE || type == MOVZXB) {
+    if (rex_prefix != 0x40 || dt == TB_X86_TYPE_BYTE || type == MOVZXB || type == MOVSXB) {
         EMIT1(e, rex_prefix);
     }
 
@@ -270,13 +280,21 @@ static void inst2sse(TB_CGEmitter* restrict e, InstType type, const Val* a, cons
     bool supports_mem_dst = (type == FP_MOV);
     bool dir = is_value_mem(a);
 
-    bool packed = (dt == TB_X86_TYPE_SSE_PS || dt == TB_X86_TYPE_SSE_PD);
+    bool packed_int = (dt >= TB_X86_TYPE_PBYTE && dt <= TB_X86_TYPE_PQWORD);
+    bool packed = packed_int || (dt == TB_X86_TYPE_SSE_PS || dt == TB_X86_TYPE_SSE_PD);
     bool is_double = (dt == TB_X86_TYPE_SSE_PD || dt == TB_X86_TYPE_SSE_SD);
 
     if (supports_mem_dst && dir) {
         SWAP(const Val*, a, b);
     }
 
+    // shuffles take an imm8, we only ever use them in the `op a, a, imm` form
+    const Val* imm = NULL;
+    if (b->type == VAL_IMM) {
+        assert(type == SHUFP || type == PSHUFD);
+        imm = b, b = a;
+    }
+
     uint8_t rx = a->reg;
     uint8_t base, index;
     if (b->type == VAL_MEM) {
@@ -292,13 +310,25 @@ static void inst2sse(TB_CGEmitter* restrict e, InstType type, const Val* a, cons
         tb_todo();
     }
 
-    if (type != FP_XOR && type != FP_AND && type != FP_OR) {
+    uint8_t op = inst->op + (supports_mem_dst ? dir : 0);
+    if (type >= PADD && type <= PSHUFD) {
+        // packed integer ops, PADDQ is the odd one out
+        if (type == PADD && dt == TB_X86_TYPE_PQWORD) {
+            op = 0xD4;
+        } else if (type == PADD || type == PSUB) {
+            op += dt - TB_X86_TYPE_PBYTE;
+        }
+
+        EMIT1(e, 0x66);
+    } else if (type != FP_XOR && type != FP_AND && type != FP_OR && type != SHUFP && !packed_int) {
         if (!packed && type != FP_UCOMI) {
             EMIT1(e, is_double ? 0xF2 : 0xF3);
         } else if (is_double) {
             // packed double
             EMIT1(e, 0x66);
         }
+    } else if (type == SHUFP && is_double) {
+        EMIT1(e, 0x66);
     }
 
     if (type == FP_CVT64 || rx >= 8 || base >= 8 || index >= 8) {
@@ -307,6 +337,10 @@ static void inst2sse(TB_CGEmitter* restrict e, InstType type, const Val* a, cons
 
     // extension prefix
     EMIT1(e, 0x0F);
-    EMIT1(e, inst->op + (supports_mem_dst ? dir : 0));
+    EMIT1(e, op);
     emit_memory_operand(e, rx, b);
+
+    if (imm) {
+        EMIT1(e, (uint8_t) imm->imm);
+    }
 }
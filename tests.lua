@@ -52,6 +52,130 @@ function test(file)
 	end
 end
 
+-- the programs in tests/run exercise the optimizer & backend, main returns 0
+-- when everything came out right. -r only speaks the Win64 ABI for now, on a
+-- SysV host the JIT thunks any calls into libc.
+function run(file, flags)
+	flags = flags and (flags.." ") or ""
+	for _, opt in ipairs({ "-O0", "-O1", "-O2" }) do
+		local cmd = "cuik -target x64_windows_msvc "..opt.." "..flags.."-r "..file
+		print(cmd)
+
+		local _0, _1, res = os.execute(cmd)
+		if res ~= 0 then
+			print("Failed to run "..file.." at "..opt.." (exit code "..tostring(res)..")")
+			os.exit(1)
+		end
+	end
+end
+
+-- same as run but with edge counters in first, then built again from the
+-- counts those runs wrote out.
+function run_profiled(file)
+	local prof = os.tmpname()
+	os.remove(prof)
+
+	run(file, "-fprofile-generate="..prof)
+	run(file, "-fprofile-use="..prof)
+	os.remove(prof)
+end
+
+-- builds object files out of the sources and makes sure they came out
+local function compile_objects(cmd, files)
+	print(cmd)
+
+	local _0, _1, res = os.execute(cmd)
+	if res ~= 0 then
+		print("Failed to compile "..files.." (exit code "..tostring(res)..")")
+		os.exit(1)
+	end
+end
+
+-- counts how many times each string made it into the object
+local function check_copies(obj, counts)
+	local f = io.open(obj, "rb")
+	if f == nil then
+		print("Missing object file "..obj)
+		os.exit(1)
+	end
+
+	local data = f:read("*a")
+	f:close()
+	os.remove(obj)
+
+	for str, expected in pairs(counts) do
+		local got, at = 0, 1
+		while true do
+			local s, e = data:find(str, at, true)
+			if s == nil then break end
+			got, at = got + 1, e + 1
+		end
+
+		if got ~= expected then
+			print("'"..str.."' shows up "..got.." times in "..obj..", expected "..expected)
+			os.exit(1)
+		end
+	end
+end
+
+-- one object out of all the sources, that's how we see what the exporter merged.
+function copies(files, counts)
+	local obj = os.tmpname()
+	os.remove(obj)
+
+	compile_objects("cuik -target x64_windows_msvc -O1 -c "..files.." -o "..obj, files)
+	check_copies(obj..".o", counts)
+end
+
+-- every TU gets its own module (-shard 1) which is exported into a separate
+-- object, each of them has to carry its own profile writer too.
+function shards(files, n, counts)
+	local obj = os.tmpname()
+	local prof = os.tmpname()
+	os.remove(obj)
+	os.remove(prof)
+
+	compile_objects("cuik -target x64_windows_msvc -O1 -shard 1 -fprofile-generate="..prof.." -c "..files.." -o "..obj, files)
+	for i = 0, n - 1 do
+		check_copies(obj.."_"..i..".o", counts)
+	end
+end
+
 test("tests/hello_world.c")
 
+run("tests/run/sccp.c")
+run("tests/run/inline.c")
+run("tests/run/loop.c")
+run("tests/run/vector.c")
+run("tests/run/ipo.c")
+run("tests/run/alias.c")
+run("tests/run/dse.c")
+run("tests/run/gvn.c")
+run("tests/run/nodes.c")
+run("tests/run/switch.c")
+run("tests/run/relax.c")
+run("tests/run/layout.c")
+run_profiled("tests/run/profile.c")
+run("tests/run/regalloc.c")
+run("tests/run/peephole.c")
+run("tests/run/liveness.c")
+run("tests/run/coderegion.c")
+run("tests/run/coderegion.c", "-fcode-reserve=16 -j 4")
+run("tests/run/tailcall.c")
+run("tests/run/sched.c")
+run("tests/run/sched.c", "-mtune=zen")
+run("tests/run/fold.c")
+run("tests/run/host.c")
+-- the second TU rides along with the flags
+run("tests/run/tu_main.c", "tests/run/tu_lib.c")
+run("tests/run/tu_lib.c", "tests/run/tu_main.c")
+copies("tests/export/rdata_a.c tests/export/rdata_b.c", {
+	["merge-these-literals"] = 1,
+	["keep-these-apart"] = 2,
+})
+shards("tests/run/tu_lib.c tests/run/tu_main.c", 2, {
+	["TBPF"] = 1,
+	["fopen"] = 1,
+})
+
 print("Hello")
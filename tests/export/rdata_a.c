@@ -0,0 +1,13 @@
+// identical read-only blobs from different TUs get merged when the object is
+// laid out, the literal below shows up in rdata_b.c too. named arrays need
+// their own addresses though, even with the same contents.
+void use(const char* p);
+
+static const char first[] = "keep-these-apart";
+static const char second[] = "keep-these-apart";
+
+void use_a(void) {
+    use("merge-these-literals");
+    use(first);
+    use(second);
+}
@@ -0,0 +1,7 @@
+// the other half of rdata_a.c, this literal should end up sharing the
+// storage of the one over there.
+void use(const char* p);
+
+void use_b(void) {
+    use("merge-these-literals");
+}
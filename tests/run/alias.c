@@ -0,0 +1,94 @@
+// memory accesses which alias (or don't) in ways the optimizer has to get
+// right: the same address through two pointers, locals whose address gets
+// out, struct fields, unions, char access and restrict params.
+typedef struct { int a, b; short c; long long d; } S;
+typedef union { int i; float f; unsigned u; } U;
+
+static int trips[4] = { 0, 1, 3, 7 };
+static int g, cnt;
+static int arr[8];
+static int* stash;
+
+static void side(void) { cnt++; }
+
+static int through(int* p, int* q) {
+    *p = 1, *q = 2;
+    return *p;
+}
+
+static int restricted(int* restrict p, int* restrict q) {
+    *p = 1, *q = 2;
+    return *p;
+}
+
+static void escape(int* x) { stash = x; }
+
+static int hoist(const int* p, int* q, int n) {
+    // the load from p can't leave the loop, q writes the same int
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s += *p;
+        *q = i;
+    }
+    return s;
+}
+
+static int global_store(void) {
+    g = 100;
+    return g != 100;
+}
+
+int main(void) {
+    if (global_store()) return 1;
+
+    // cnt gets bumped by the inlined call between the two reads
+    int s = 0;
+    cnt = 0;
+    for (int i = 0; i < trips[3]; i++) {
+        s += cnt;
+        side();
+        s += cnt;
+    }
+    if (s != 49 || cnt != 7) return 2;
+
+    int x = 0, y = 0;
+    if (through(&x, &x) != 2 || through(&x, &y) != 1) return 3;
+    if (restricted(&x, &y) != 1 || y != 2) return 4;
+
+    // x's address gets out, stores through the stash are to x
+    int z = 10;
+    escape(&z);
+    *stash = 5;
+    if (z != 5) return 5;
+    z = 6;
+    if (*stash != 6) return 6;
+
+    S st = { 1, 2, 3, 4 };
+    int* pb = &st.b;
+    *pb = 7;
+    st.a += 1;
+    if (st.a + st.b != 9 || st.c != 3 || st.d != 4) return 7;
+
+    // variable indices which happen to match
+    int i = trips[2], j = trips[1] + 2;
+    arr[i] = 3, arr[j] = 4;
+    if (arr[i] != 4) return 8;
+    arr[j + 1] = 9;
+    if (arr[i] != 4 || arr[4] != 9) return 9;
+
+    U u;
+    u.i = 0x3f800000;
+    if (u.f != 1.0f) return 10;
+    u.f = 2.0f;
+    if (u.u != 0x40000000) return 11;
+
+    unsigned w = 0x11223344;
+    unsigned char* c = (unsigned char*) &w;
+    c[0] = 0xff;
+    if (w != 0x112233ff) return 12;
+
+    int k = 3;
+    if (hoist(&k, &k, trips[3]) != 3 + 0 + 1 + 2 + 3 + 4 + 5) return 13;
+    if (k != 6) return 14;
+    return 0;
+}
@@ -0,0 +1,43 @@
+// lots of functions (run with and without a code reservation) calling each
+// other directly and through a table, so every one of them has to land where
+// the others expect it no matter which region it ended up in.
+static int trips[4] = { 0, 1, 3, 64 };
+
+#define F(i) static int f##i(int x) { return (x * (i + 3)) ^ (x >> (i & 7)) ^ i; }
+#define F8(i) F(i##0) F(i##1) F(i##2) F(i##3) F(i##4) F(i##5) F(i##6) F(i##7)
+F8(1) F8(2) F8(3) F8(4) F8(5) F8(6) F8(7) F8(8)
+
+#define R(i) f##i,
+#define R8(i) R(i##0) R(i##1) R(i##2) R(i##3) R(i##4) R(i##5) R(i##6) R(i##7)
+static int (*table[64])(int) = { R8(1) R8(2) R8(3) R8(4) R8(5) R8(6) R8(7) R8(8) };
+
+// each link calls the next one, the last calls back around to the first
+static unsigned chain(int d, unsigned x);
+static unsigned c15(int d, unsigned x) { return d <= 0 ? x : chain(d - 1, x * 3 + 15); }
+#define C(i, j) static unsigned c##i(int d, unsigned x) { return d <= 0 ? x : c##j(d - 1, x * 3 + i); }
+C(14, 15) C(13, 14) C(12, 13) C(11, 12) C(10, 11) C(9, 10) C(8, 9)
+C(7, 8) C(6, 7) C(5, 6) C(4, 5) C(3, 4) C(2, 3) C(1, 2) C(0, 1)
+static unsigned chain(int d, unsigned x) { return c0(d, x); }
+
+static unsigned big(unsigned x) {
+    // one function with a good deal more code than the others
+    #define S(k) x = (x ^ (x << 7)) + k; x = (x ^ (x >> 9)) * 0x9E3779B1u;
+    #define S8(k) S(k##0) S(k##1) S(k##2) S(k##3) S(k##4) S(k##5) S(k##6) S(k##7)
+    S8(1) S8(2) S8(3) S8(4) S8(5) S8(6) S8(7) S8(8)
+    return x;
+}
+
+int main(void) {
+    int n = trips[3];
+
+    int s = 0;
+    for (int i = 0; i < n; i++) s += table[i](i + trips[2]);
+    if (s != 142125) return 1;
+
+    int d = f11(trips[2]) + f47(trips[2]) + f87(trips[2]);
+    if (d != 563) return 2;
+
+    if (chain(n, trips[1]) != 2625900577u) return 3;
+    if (big(trips[2]) != 3865750002u) return 4;
+    return 0;
+}
@@ -0,0 +1,90 @@
+// stores which get overwritten, adjacent constant stores which get glued
+// together and small memcpy/memset which turn into plain moves (the odd
+// sizes leave a tail of smaller ones, 65 is past the lowering limit).
+typedef unsigned long long size_t;
+
+// our own copies since these don't link against libc, the optimizer still
+// goes by the name and turns the calls into its own memcpy/memset.
+void* memcpy(void* dst, const void* src, size_t n) {
+    unsigned char* d = dst;
+    const unsigned char* s = src;
+    while (n--) *d++ = *s++;
+    return dst;
+}
+
+void* memset(void* dst, int c, size_t n) {
+    unsigned char* d = dst;
+    while (n--) *d++ = c;
+    return dst;
+}
+
+typedef struct { char tag; short kind; int id; long long big; char name[9]; } Rec;
+
+static int trips[4] = { 0, 1, 3, 7 };
+static unsigned char src[80], dst[80];
+
+static int check_copy(int n) {
+    for (int i = 0; i < 80; i++) {
+        int want = i < n ? src[i] : 0xEE;
+        if (dst[i] != want) return 0;
+    }
+    return 1;
+}
+
+static int check_fill(int n, int v) {
+    for (int i = 0; i < 80; i++) {
+        int want = i < n ? v : 0xEE;
+        if (dst[i] != want) return 0;
+    }
+    return 1;
+}
+
+#define COPY(n) (memset(dst, 0xEE, 80), memcpy(dst, src, n), check_copy(n))
+#define FILL(n, v) (memset(dst, 0xEE, 80), memset(dst, v, n), check_fill(n, v & 0xFF))
+
+static Rec make(int id) {
+    Rec r = { 0 };
+    r.tag = 'r';
+    r.id = id;
+    r.name[0] = 'a', r.name[8] = 'z';
+    return r;
+}
+
+int main(void) {
+    for (int i = 0; i < 80; i++) src[i] = i * 7 + 3;
+
+    if (!COPY(1) || !COPY(3) || !COPY(7) || !COPY(8) || !COPY(13)) return 1;
+    if (!COPY(16) || !COPY(24) || !COPY(33) || !COPY(64) || !COPY(65)) return 2;
+    if (!FILL(1, 0) || !FILL(5, 0x41) || !FILL(17, 0xFF) || !FILL(31, 0x180) || !FILL(64, 9)) return 3;
+
+    // the first store to each of these is dead
+    int x[4];
+    x[0] = 1, x[1] = 2, x[2] = 3, x[3] = 4;
+    x[0] = 5, x[2] = trips[3];
+    if (x[0] + x[1] + x[2] + x[3] != 18) return 4;
+
+    // byte and short constants next to each other, read back wider
+    union { unsigned char b[8]; unsigned short h[4]; unsigned long long q; } u;
+    u.b[0] = 0x11, u.b[1] = 0x22, u.b[2] = 0x33, u.b[3] = 0x44;
+    u.h[2] = 0x6655, u.h[3] = 0x8877;
+    if (u.q != 0x8877665544332211ull) return 5;
+    u.b[3] = 0;
+    if (u.q != 0x8877665500332211ull || u.h[1] != 0x0033) return 6;
+
+    // zeroed then some fields, the zeroes under them don't need storing twice
+    Rec r = make(trips[2]);
+    if (r.tag != 'r' || r.kind != 0 || r.id != 3 || r.big != 0) return 7;
+    if (r.name[0] != 'a' || r.name[1] != 0 || r.name[7] != 0 || r.name[8] != 'z') return 8;
+
+    // a store which only partly covers the one before it
+    union { long long q; int lo; } w;
+    w.q = 0x1111111111111111ll;
+    w.lo = 0x22222222;
+    if (w.q != 0x1111111122222222ll) return 9;
+
+    Rec copy;
+    if (memcpy(&copy, &r, sizeof(Rec)) != &copy) return 11;
+    copy.id += 1;
+    if (copy.id != 4 || copy.name[8] != 'z' || r.id != 3) return 10;
+    return 0;
+}
@@ -0,0 +1,145 @@
+// operations which isel can fold memory operands into: loads on either side,
+// read-modify-write at every width, shifts and unary ops on memory, compares
+// with the memory on the left or the right and addresses it has to build up.
+static int trips[4] = { 0, 1, 3, 8 };
+
+typedef struct Node { struct Node* next; long long value; } Node;
+typedef struct { int x, y, z; } Vec3;
+
+static Node pool[8];
+static int order[8] = { 3, 1, 7, 0, 5, 2, 6, 4 };
+
+static int loads(const int* p, int a) {
+    // the load on the right, on the left and under something that doesn't commute
+    int r = a + p[0];
+    r ^= p[1] & a;
+    r = p[2] - r;
+    r *= p[3];
+    return r | p[1];
+}
+
+static void rmw(int* p, int a) {
+    p[0] += a;
+    p[1] -= a;
+    p[2] &= a;
+    p[3] |= a;
+    p[4] ^= a;
+    p[5] += 100;
+    p[6] <<= 3;
+    p[7] >>= 2;
+    p[8] = ~p[8];
+    p[9] = -p[9];
+    p[10] += 1;
+    p[11] -= 1;
+}
+
+static void rmw_narrow(unsigned char* b, short* h, long long* q, int a) {
+    b[0] += a;
+    b[1] ^= 0x5A;
+    b[2] = ~b[2];
+    b[3] *= (unsigned char) a;
+    h[0] -= a;
+    h[1] = -h[1];
+    h[2] >>= 1;
+    q[0] += a;
+    q[1] = ~q[1];
+    q[2] <<= 33;
+}
+
+static unsigned rotates(unsigned* p, int k) {
+    unsigned x = p[0], y = p[1];
+    p[0] = (x << 5) | (x >> 27);
+    p[1] = (y >> 7) | (y << 25);
+    return p[0] ^ p[1] ^ k;
+}
+
+static double floats(const double* d, const float* f, double a) {
+    double r = a + d[0];
+    r = d[1] * r;
+    r = r - d[2];
+    r = d[3] / r + r / d[0];
+    float s = f[0] + (float) a;
+    s = f[1] - s;
+    return r + s * f[2];
+}
+
+static int compares(const int* p, const unsigned* u, const double* d, int a) {
+    int mask = 0;
+    if (p[0] == a) mask |= 1;
+    if (a != p[1]) mask |= 2;
+    if (p[2] < a) mask |= 4;
+    if (a <= p[3]) mask |= 8;
+    if (u[0] < (unsigned) a) mask |= 16;
+    if ((unsigned) a < u[1]) mask |= 32;
+    if (d[0] < a) mask |= 64;
+    if (a <= d[1]) mask |= 128;
+    if (d[2] == a) mask |= 256;
+    return mask;
+}
+
+static int aliasing(int* p, int* q) {
+    // p and q are the same here, the load of p can't be folded past the store
+    int a = *p;
+    *q = 7;
+    *p += a;
+    return *p;
+}
+
+static long long scaled(const Vec3* v, const short* h, int i, int j) {
+    // 12 byte elements, 2 byte elements and a negative displacement
+    return v[i].y * 100 + v[j].z + h[i * 2 + 1] * 7 + h[j - 1];
+}
+
+int main(void) {
+    int n = trips[3];
+
+    int p[4] = { 5, 6, 7, 8 };
+    if (loads(p, trips[2]) != -18) return 1;
+
+    int r[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    rmw(r, trips[2] + 0x30);
+    unsigned rs = 0;
+    for (int i = 0; i < 12; i++) rs = rs * 31 + r[i];
+    if (rs != 4166676204u) return 2;
+
+    unsigned char b[4] = { 250, 0x0F, 0x33, 7 };
+    short h[3] = { -5, 300, -9 };
+    long long q[3] = { 1, 2, 3 };
+    rmw_narrow(b, h, q, trips[2] + 10);
+    if (b[0] != 7 || b[1] != 85 || b[2] != 204 || b[3] != 91) return 3;
+    if (h[0] != -18 || h[1] != -300 || h[2] != -5) return 4;
+    if (q[0] != 14 || q[1] != -3 || q[2] != 25769803776ll) return 5;
+
+    unsigned rot[2] = { 0x80000001u, 0x12345678u };
+    if (rotates(rot, trips[2]) != 4028917919u) return 6;
+
+    double d[4] = { 2.0, 3.0, 0.5, 9.0 };
+    float f[3] = { 1.5f, 10.0f, 0.25f };
+    if (floats(d, f, trips[2]) != 9.2456896551724128) return 7;
+
+    int cp[4] = { 3, 4, 4, 3 };
+    unsigned cu[2] = { 5, 0xFFFFFFFFu };
+    double cd[3] = { 2.5, 2.0, 3.5 };
+    if (compares(cp, cu, cd, trips[2]) != 107) return 8;
+
+    int x = trips[2];
+    if (aliasing(&x, &x) != 10) return 9;
+
+    Vec3 v[3] = { { 1, 2, 3 }, { 4, 5, 6 }, { 7, 8, 9 } };
+    short hs[8] = { 10, 11, 12, 13, 14, 15, 16, 17 };
+    if (scaled(v, hs, trips[1], trips[2] - 1) != 611) return 10;
+
+    // 16 byte elements are past what an address can scale by, the index gets shifted instead
+    for (int i = 0; i < n; i++) {
+        pool[i].value = i + 1;
+        pool[i].next = i + 1 < n ? &pool[i + 1] : 0;
+    }
+
+    long long s = 0;
+    for (Node* it = pool; it; it = it->next) s += it->value;
+
+    long long t = 0;
+    for (int i = 0; i < n; i++) t += pool[order[i]].value * (i + 1);
+    if (s != 36 || t != 173) return 11;
+    return 0;
+}
@@ -0,0 +1,73 @@
+// expressions which show up more than once (sometimes with the operands
+// swapped), loads with and without a store between them and peepholes
+// which only fire once an earlier one has gone through.
+static int trips[4] = { 0, 1, 6, 11 };
+static int g;
+
+static int commute(int a, int b) {
+    int x = a * b + (a ^ b);
+    int y = (b ^ a) + b * a;
+    return x - y;
+}
+
+static int reload(int* p) {
+    int a = *p;
+    int b = *p;
+    *p = a + 1;
+    int c = *p;
+    return a + b + c;
+}
+
+static int diamond(int a, int b, int c) {
+    int r;
+    if (c) r = (a + b) * 3;
+    else   r = (a + b) * 5;
+    return r + (a + b);
+}
+
+static unsigned chain(unsigned x) {
+    // each step only simplifies after the one before it
+    unsigned a = x + 0;
+    unsigned b = a * 1;
+    unsigned c = (b << 3) >> 3;
+    unsigned d = c & 0x1FFFFFFF;
+    return (d | 0) ^ 0;
+}
+
+static int same_addr(int* arr, int i) {
+    arr[i + 1] = 7;
+    g = 3;
+    return arr[1 + i] + g;
+}
+
+int main(void) {
+    int a = trips[2], b = trips[3];
+    if (commute(a, b) != 0) return 1;
+
+    int v = trips[2];
+    if (reload(&v) != 6 + 6 + 7 || v != 7) return 2;
+
+    if (diamond(a, b, trips[1]) != 68 || diamond(a, b, trips[0]) != 102) return 3;
+
+    if (chain(0xFFFFFFFFu - (unsigned) trips[0]) != 0x1FFFFFFFu) return 4;
+    if (chain((unsigned) b) != 11) return 5;
+
+    int arr[4] = { 0 };
+    if (same_addr(arr, trips[1]) != 10 || arr[2] != 7) return 6;
+
+    // a loop invariant computed once per iteration in the source
+    int s = 0;
+    for (int i = 0; i < b; i++) {
+        s += (a * b) + i;
+        s -= (b * a);
+    }
+    if (s != 55) return 7;
+
+    // the same compare feeding two branches
+    int k = 0;
+    if (a < b) k += 1;
+    if (a < b) k += 2;
+    if (!(a < b)) k += 4;
+    if (k != 3) return 8;
+    return 0;
+}
@@ -0,0 +1,28 @@
+// calls out to the host's C library, under -r those might not follow the
+// same calling convention as the code we generate: floats and ints mixed in
+// registers, arguments spilling onto the stack, varargs and tail calls.
+static int trips[4] = { 0, 1, 3, 8 };
+
+int sprintf(char* buf, const char* fmt, ...);
+int memcmp(const void* a, const void* b, unsigned long long n);
+double ldexp(double x, int exp);
+
+static int same(const char* a, const char* b, int n) {
+    return memcmp(a, b, n);
+}
+
+int main(void) {
+    char buf[128];
+
+    int n = sprintf(buf, "%d %d %d %d %d %d %d %d", trips[1], 2, trips[2], 4, 5, 6, 7, trips[3]);
+    if (n != 15 || same(buf, "1 2 3 4 5 6 7 8", 16) != 0) return 1;
+
+    n = sprintf(buf, "%.2f %d %.1f %s %d %.1f %d %.1f %.1f %.1f %.1f %.1f",
+        1.5, trips[1], 2.5, "x", trips[2], 6.5, 7, 8.0, 9.0, 10.0, 11.0, 12.0);
+    if (n != 43 || same(buf, "1.50 1 2.5 x 3 6.5 7 8.0 9.0 10.0 11.0 12.0", 44) != 0) return 2;
+
+    if (ldexp(3.0, trips[3]) != 768.0) return 3;
+    if (same("abc", "abd", 3) >= 0) return 4;
+
+    return 0;
+}
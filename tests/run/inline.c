@@ -0,0 +1,50 @@
+// small callees get cloned into their callers, bottom up over the call graph.
+typedef struct { int x, y; } Vec2;
+
+static int counter;
+
+static int sq(int x) { return x * x; }
+static int sum_sq(int a, int b) { return sq(a) + sq(b); }
+
+// multiple returns end up merged at the callee's stop
+static int clamp(int x, int lo, int hi) {
+    if (x < lo) return lo;
+    if (x > hi) return hi;
+    return x;
+}
+
+// the local's address gets taken so it has to stay in memory after cloning
+static void bump(int* p) { *p += 1; counter += 1; }
+static int with_local(int x) {
+    int tmp = x;
+    bump(&tmp);
+    bump(&tmp);
+    return tmp;
+}
+
+static int dot(const Vec2* a, const Vec2* b) { return a->x * b->x + a->y * b->y; }
+
+static int loop_sum(int n) {
+    int s = 0;
+    for (int i = 1; i <= n; i++) s += i;
+    return s;
+}
+
+// mutually recursive, these sit in one SCC and don't get inlined into each other
+static int is_odd(int n);
+static int is_even(int n) { return n == 0 ? 1 : is_odd(n - 1); }
+static int is_odd(int n) { return n == 0 ? 0 : is_even(n - 1); }
+
+int main(void) {
+    Vec2 a = { 2, 3 }, b = { 4, 5 };
+
+    if (sum_sq(3, 4) != 25) return 1;
+    // one inlined call feeding the next
+    if (sq(sq(2)) != 16) return 2;
+    if (clamp(-5, 0, 10) != 0 || clamp(50, 0, 10) != 10 || clamp(7, 0, 10) != 7) return 3;
+    if (with_local(40) != 42 || counter != 2) return 4;
+    if (dot(&a, &b) != 23) return 5;
+    if (loop_sum(10) + loop_sum(4) != 65) return 6;
+    if (!is_even(10) || !is_odd(7) || is_odd(4)) return 7;
+    return 0;
+}
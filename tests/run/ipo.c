@@ -0,0 +1,73 @@
+// static helpers which recurse (so the inliner leaves them alone) with every
+// call passing the same constants, helpers that only read memory, one that
+// never comes back and one whose result can't be NULL.
+static int trips[4] = { 0, 1, 5, 9 };
+static int table[16];
+static int counter, other;
+
+static int shape(int x, int mode, int depth) {
+    if (depth > 0) return shape(x + 1, mode, depth - 1) * 2;
+    switch (mode) {
+        case 0:  return x;
+        case 1:  return -x;
+        case 2:  return x * 3 + 1;
+        default: return 0;
+    }
+}
+
+static int* fill(int* dst, int n, int v) {
+    if (n == 0) return dst;
+    dst[n - 1] = v + n;
+    return fill(dst, n - 1, v);
+}
+
+// readonly, loads of other globals can go across calls to it
+static int sum(const int* a, int n) {
+    if (n == 0) return 0;
+    return a[n - 1] + sum(a, n - 1);
+}
+
+// writes memory, nothing may be forwarded across it
+static void bump(int n) {
+    if (n == 0) return;
+    counter += n;
+    bump(n - 1);
+}
+
+static void spin(int x) {
+    for (;;) {
+        x = x * 3 + 1;
+        other = x;
+    }
+}
+
+static int* pick(int k, int* a, int* b) {
+    if (k > 100) return pick(k - 100, b, a);
+    return k & 1 ? a : b;
+}
+
+int main(void) {
+    // mode is always 2 and dst is always table
+    if (shape(trips[1], 2, trips[2]) != 608) return 1;
+    if (shape(trips[3], 2, trips[0]) != 28) return 2;
+    if (fill(table, trips[3], 10) != table || table[0] != 11 || table[8] != 19) return 3;
+
+    other = 5;
+    int s = sum(table, trips[3]);
+    if (s != 135 || other != 5) return 4;
+
+    counter = 1;
+    int before = counter;
+    bump(trips[2]);
+    if (before != 1 || counter != 16) return 5;
+
+    int v = trips[2];
+    if (v == 12345) spin(v);
+    if (v != 5 || other != 5) return 6;
+
+    int a = 40, b = 50;
+    int* p = pick(trips[1] + 200, &a, &b);
+    if (p == 0) return 7;
+    if (*p != 40 || *pick(trips[2] + 1, &a, &b) != 50) return 8;
+    return 0;
+}
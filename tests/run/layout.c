@@ -0,0 +1,90 @@
+// blocks which get moved out of the way: unlikely sides of __builtin_expect,
+// paths that end in a trap and cold blocks inside loops which still have to
+// come back in (or feed a phi) once they've been pushed past the epilogue.
+#define likely(x)   __builtin_expect(!!(x), 1)
+#define unlikely(x) __builtin_expect(!!(x), 0)
+
+static int trips[4] = { 0, 1, 5, 100 };
+static int errors;
+
+static int checked_div(int a, int b) {
+    if (unlikely(b == 0)) {
+        errors++;
+        return 0;
+    }
+    return a / b;
+}
+
+static int must_be_positive(int x) {
+    if (x <= 0) __builtin_trap();
+    return x * 2;
+}
+
+static int shift(int k) {
+    if (k < 0 || k > 3) __builtin_unreachable();
+    return 1 << k;
+}
+
+static int cold_in_loop(int n) {
+    // every 37th element takes the cold path and rejoins the loop
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        int v = i;
+        if (unlikely(i % 37 == 0)) {
+            v = -i * 3;
+            errors++;
+        }
+        s += v;
+    }
+    return s;
+}
+
+static int hot_else(int x) {
+    // the then side is the cold one here
+    int r;
+    if (likely(x != 7)) r = x + 1;
+    else r = x * 100;
+    return r;
+}
+
+static int early_exit(const int* arr, int n, int key) {
+    for (int i = 0; i < n; i++) {
+        if (unlikely(arr[i] == key)) return i;
+    }
+    return -1;
+}
+
+static int nested(int a, int b) {
+    if (unlikely(a < 0)) {
+        if (b < 0) return 1;
+        if (unlikely(b == 0)) return 2;
+        return 3;
+    }
+    return likely(b > 0) ? 4 : 5;
+}
+
+int main(void) {
+    errors = 0;
+    if (checked_div(trips[3], trips[2]) != 20 || errors != 0) return 1;
+    if (checked_div(trips[3], trips[0]) != 0 || errors != 1) return 2;
+
+    if (must_be_positive(trips[2]) != 10 || shift(trips[1] + 2) != 8) return 3;
+
+    errors = 0;
+    int s = cold_in_loop(trips[3]);
+    // 0, 37 and 74 go the cold way
+    if (s != 4950 - (37 + 74) - 3 * (37 + 74) || errors != 3) return 4;
+
+    int h = 0;
+    for (int i = 0; i < 10; i++) h += hot_else(i);
+    if (h != 55 - 8 + 700) return 5;
+
+    int arr[16];
+    for (int i = 0; i < 16; i++) arr[i] = i * i;
+    if (early_exit(arr, 16, 81) != 9 || early_exit(arr, 16, 82) != -1) return 6;
+
+    int a = trips[1], b = -trips[1];
+    if (nested(-a, b) != 1 || nested(-a, 0) != 2 || nested(-a, a) != 3) return 7;
+    if (nested(a, a) != 4 || nested(a, b) != 5) return 8;
+    return 0;
+}
@@ -0,0 +1,102 @@
+// control flow that takes the dataflow a few rounds to settle: values live
+// across deep loop nests, back edges out of the middle of a switch, gotos
+// into the middle of a loop and enough values that the bitsets span words.
+static int trips[4] = { 0, 1, 6, 40 };
+
+static int nests(int n) {
+    // a..d are defined up top and only read in the innermost loop
+    int a = n + 1, b = n * 2, c = n ^ 3, d = n - 4;
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < i; j++) {
+            for (int k = 0; k < j; k++) {
+                if ((i + j + k) & 1) s += a * k;
+                else s -= b;
+            }
+            s ^= c;
+        }
+        s += d;
+    }
+    return s;
+}
+
+static int machine(const char* str) {
+    // a little state machine where every state can jump to every other
+    int state = 0, count = 0;
+    unsigned acc = 0;
+    for (int i = 0; str[i]; i++) {
+        char ch = str[i];
+        switch (state) {
+            case 0:
+            if (ch == 'a') state = 1;
+            else if (ch == 'b') state = 2;
+            else acc += ch;
+            break;
+
+            case 1:
+            count++;
+            if (ch == 'b') state = 2;
+            else if (ch == 'c') { state = 0; continue; }
+            acc ^= count;
+            break;
+
+            case 2:
+            if (ch == 'a') state = 3;
+            else state = 0;
+            acc += count * 3;
+            break;
+
+            case 3:
+            if (ch == 'c') goto done;
+            state = 1;
+            break;
+        }
+        acc = acc * 7 + state;
+    }
+
+    done:
+    return (int) (acc ^ count);
+}
+
+static int into_the_middle(int n, int skip) {
+    // the goto enters the loop past its header, so the loop has two entries
+    int s = 0, i = 0;
+    if (skip) goto middle;
+    while (i < n) {
+        s += i * 3 + 1;
+        middle:
+        s ^= i;
+        i++;
+    }
+    return s;
+}
+
+#define DECL8(p, x) int p##0 = (x) + 0, p##1 = (x) * 3, p##2 = (x) ^ 7, p##3 = (x) - 9, \
+    p##4 = (x) << 1, p##5 = (x) | 5, p##6 = (x) & 3, p##7 = (x) + 11;
+#define SUM8(p) (p##0 + p##1 + p##2 + p##3 + p##4 + p##5 + p##6 + p##7)
+#define BUMP8(p, v) p##0 += (v); p##1 ^= (v); p##2 -= (v); p##3 += (v) * 2; \
+    p##4 ^= (v) + 1; p##5 += (v) >> 1; p##6 -= (v) & 3; p##7 += 1;
+
+static int wide(int x, int n) {
+    // 80 values all live around the loop
+    DECL8(a, x) DECL8(b, x + 1) DECL8(c, x + 2) DECL8(d, x + 3) DECL8(e, x + 4)
+    DECL8(f, x + 5) DECL8(g, x + 6) DECL8(h, x + 7) DECL8(i, x + 8) DECL8(j, x + 9)
+    for (int k = 0; k < n; k++) {
+        BUMP8(a, k) BUMP8(c, k + 1) BUMP8(e, k + 2) BUMP8(g, k + 3) BUMP8(i, k + 4)
+        if (k & 1) { BUMP8(b, k) BUMP8(d, k) }
+        else { BUMP8(f, k) BUMP8(h, k) BUMP8(j, k) }
+    }
+    return SUM8(a) + SUM8(b) + SUM8(c) + SUM8(d) + SUM8(e)
+        + SUM8(f) + SUM8(g) + SUM8(h) + SUM8(i) + SUM8(j);
+}
+
+int main(void) {
+    if (nests(trips[3] / 4) != 49) return 1;
+
+    char str[] = "xaaby_abzbacqabcab";
+    if (machine(str) != 1091066334) return 2;
+
+    if (into_the_middle(trips[2], 0) != 44 || into_the_middle(trips[2], 1) != 57) return 3;
+    if (wide(trips[2], trips[3]) != 16638) return 4;
+    return 0;
+}
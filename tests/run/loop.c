@@ -0,0 +1,98 @@
+// loops which the loop pass rotates, strength reduces, hoists out of and
+// unrolls, the trip counts come from a table so they aren't known up front.
+static int trips[6] = { 0, 1, 3, 7, 16, 33 };
+static int data[64];
+
+static unsigned gcd(unsigned a, unsigned b) {
+    while (b != 0) {
+        unsigned t = a % b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+static long long sum_to(int n) {
+    long long s = 0;
+    for (int i = 0; i < n; i++) {
+        s += i;
+    }
+    return s;
+}
+
+static int strided(int n, int k) {
+    // i * k should turn into an add per iteration
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        s += i * k + (k << 2);
+    }
+    return s;
+}
+
+static int count_down(int n) {
+    int s = 0;
+    for (int i = n; i > 0; i -= 2) {
+        s += i;
+    }
+    return s;
+}
+
+static int nested(int n) {
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        for (int j = i; j < n; j++) {
+            s += data[j] - data[i];
+        }
+    }
+    return s;
+}
+
+static int find(int n, int x) {
+    for (int i = 0; i < n; i++) {
+        if (data[i] == x) return i;
+    }
+    return -1;
+}
+
+static int rotate(int k) {
+    // the loop phis feed each other, their copies on the back edge form a cycle
+    int a = 1, b = 2, c = 3;
+    for (int i = 0; i < k; i++) {
+        int t = a;
+        a = b, b = c, c = t;
+    }
+    return a * 100 + b * 10 + c;
+}
+
+static int digits(unsigned x) {
+    int d = 0;
+    do {
+        x /= 10, d++;
+    } while (x);
+    return d;
+}
+
+int main(void) {
+    for (int i = 0; i < 64; i++) data[i] = i * 3 + 1;
+
+    if (gcd(1071, 462) != 21) return 1;
+    if (gcd(trips[4] * 9, trips[3] * 6) != 6) return 2;
+    if (gcd(17, trips[0]) != 17) return 3;
+
+    long long expect[6] = { 0, 0, 3, 21, 120, 528 };
+    for (int i = 0; i < 6; i++) {
+        if (sum_to(trips[i]) != expect[i]) return 4;
+    }
+
+    if (strided(trips[3], 5) != 245) return 5;
+    if (strided(trips[0], 5) != 0) return 6;
+    if (count_down(trips[3]) != 16) return 7;
+    if (count_down(trips[4]) != 72) return 8;
+    if (nested(trips[2]) != 12) return 9;
+    if (nested(trips[3]) != 168) return 10;
+    if (find(trips[5], 40) != 13) return 11;
+    if (find(trips[5], 41) != -1) return 12;
+    if (rotate(trips[1]) != 231 || rotate(trips[2]) != 123 || rotate(trips[3]) != 231) return 14;
+    if (digits(0) != 1 || digits(9) != 1 || digits(4294967295u) != 10) return 13;
+    return 0;
+}
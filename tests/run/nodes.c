@@ -0,0 +1,65 @@
+// shapes which stretch the node layout: one value with lots of users (the
+// user arrays have to grow), a region with many predecessors, phis with as
+// many inputs and long chains that get rewritten while they're being used.
+static int trips[4] = { 0, 1, 7, 40 };
+
+static int fan_out(int x) {
+    int a0 = x + 1, a1 = x + 2, a2 = x + 3, a3 = x + 4, a4 = x + 5;
+    int a5 = x + 6, a6 = x + 7, a7 = x + 8, a8 = x + 9, a9 = x + 10;
+    int b0 = x * 2, b1 = x * 3, b2 = x * 4, b3 = x * 5, b4 = x * 6;
+    int b5 = x ^ 1, b6 = x ^ 2, b7 = x ^ 3, b8 = x ^ 4, b9 = x ^ 5;
+    return a0 + a1 + a2 + a3 + a4 + a5 + a6 + a7 + a8 + a9
+         + b0 + b1 + b2 + b3 + b4 + b5 + b6 + b7 + b8 + b9;
+}
+
+static int many_preds(int k) {
+    // every case jumps to the same join with its own value
+    int r;
+    switch (k) {
+        case 0:  r = 11; break;
+        case 1:  r = 13; break;
+        case 2:  r = 17; break;
+        case 3:  r = 19; break;
+        case 4:  r = 23; break;
+        case 5:  r = 29; break;
+        case 6:  r = 31; break;
+        case 7:  r = 37; break;
+        case 8:  r = 41; break;
+        case 9:  r = 43; break;
+        case 10: r = 47; break;
+        case 11: r = 53; break;
+        case 12: r = 59; break;
+        case 13: r = 61; break;
+        case 14: r = 67; break;
+        case 15: r = 71; break;
+        default: r = k;  break;
+    }
+    return r * 2 + k;
+}
+
+static unsigned long long chain(unsigned long long x, int n) {
+    // each iteration rewrites a value everything after it reads
+    for (int i = 0; i < n; i++) {
+        x = x * 6364136223846793005ull + 1442695040888963407ull;
+        x ^= x >> 29;
+    }
+    return x;
+}
+
+int main(void) {
+    int x = trips[2];
+    if (fan_out(x) != 10 * 7 + 55 + 7 * 20 + (6 + 5 + 4 + 3 + 2)) return 1;
+
+    int s = 0;
+    for (int k = 0; k < 20; k++) s += many_preds(k);
+    if (s != 1574) return 2;
+
+    unsigned long long a = chain(trips[1], trips[3]);
+    unsigned long long b = 1;
+    for (int i = 0; i < 40; i++) {
+        b = b * 6364136223846793005ull + 1442695040888963407ull;
+        b ^= b >> 29;
+    }
+    if (a != b) return 3;
+    return 0;
+}
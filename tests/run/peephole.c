@@ -0,0 +1,95 @@
+// code the post-RA rules get to chew on: zero tests right after the ALU op
+// that set the flags, compares which get sunk onto their jumps, copies of
+// zeroed registers and spill reloads that follow the store they came from.
+static int trips[4] = { 0, 1, 7, 64 };
+
+static int helper(int a, int b) {
+    if (a <= 0) return b;
+    return helper(a - 1, b ^ a);
+}
+
+static int flags_from_alu(int n) {
+    // every one of these branches tests what the op before it produced
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        int a = i & 5;
+        if (a == 0) s += 1;
+        int b = i - 32;
+        if (b < 0) s += 2;
+        int c = i ^ 17;
+        if (c != 0) s += 3;
+        unsigned d = (unsigned) i >> 3;
+        if (d == 0) s += 4;
+    }
+    return s;
+}
+
+static int flags_clobbered(int n) {
+    // the op between the sub and the test must not leave its flags behind
+    int s = 0;
+    for (int i = 0; i < n; i++) {
+        int a = i - 10;
+        int b = (i * 3) | 1;
+        if (a == 0) s += b;
+        if (a < 0) s -= 1;
+    }
+    return s;
+}
+
+static int zeros(int n) {
+    // a few values which start out as zero and then go their own ways
+    int x = 0, y = 0, z = 0;
+    for (int i = 0; i < n; i++) {
+        x += i;
+        y = x - y;
+        z ^= y;
+    }
+    return x + y * 3 + z * 7;
+}
+
+static int copies(int a, int b) {
+    // swaps and shuffles which leave copies around for propagation
+    for (int i = 0; i < trips[2]; i++) {
+        int t = a;
+        a = b;
+        b = t + i;
+    }
+    int c = a, d = c, e = d;
+    return e * 10 + b;
+}
+
+static int reloads(int seed) {
+    // more live values than registers across a call, so some get spilled
+    // and reloaded right away
+    int a = seed + 1, b = seed * 3, c = seed ^ 5, d = seed - 7;
+    int e = seed * seed, f = seed << 2, g = seed | 9, h = seed & 12;
+    int i = a * b, j = c * d, k = e * f, l = g * h;
+    int r = helper(seed & 3, seed);
+    int m = a + b + c + d, o = e + f + g + h;
+    return m + o + i + j + k + l + r;
+}
+
+static int dead_defs(int x) {
+    // values which are computed and then overwritten before anyone reads them
+    int r = x * 7;
+    r = x + 3;
+    int t = x << 4;
+    t = r - x;
+    return r * t;
+}
+
+int main(void) {
+    int n = trips[3];
+
+    if (flags_from_alu(n) != 301) return 1;
+    if (flags_clobbered(n) != 21) return 2;
+    if (zeros(n) != 12704) return 3;
+    if (copies(trips[1], trips[2]) != 173) return 4;
+
+    int r = 0;
+    for (int i = 0; i < 16; i++) r += reloads(i);
+    if (r != 65904) return 5;
+
+    if (dead_defs(trips[2]) != 30) return 6;
+    return 0;
+}
@@ -0,0 +1,54 @@
+// branches whose counts end up lopsided one way or the other, run once with
+// counters in and again laid out from what they recorded. the counters are
+// plain adds so they mustn't disturb anything the program computes.
+static int trips[4] = { 0, 1, 3, 1000 };
+
+static int collatz(unsigned x) {
+    int steps = 0;
+    while (x != 1) {
+        if (x & 1) x = 3 * x + 1;
+        else x >>= 1;
+        steps++;
+    }
+    return steps;
+}
+
+static int classify(int k) {
+    switch (k % 10) {
+        case 0:  return 5;
+        case 1:  return 7;
+        case 7:  return 11;
+        default: return 1;
+    }
+}
+
+static int rarely(int i) {
+    // taken 3 times out of 1000
+    if (i % 400 == 399) return i;
+    return 0;
+}
+
+static int recurse(int n) {
+    // the same counters get bumped at every depth
+    if (n <= 1) return n;
+    return recurse(n - 1) + recurse(n - 2);
+}
+
+int main(void) {
+    int n = trips[3];
+
+    int c = 0;
+    for (int i = 1; i <= 30; i++) c += collatz(i);
+    if (c != 441) return 1;
+
+    int k = 0;
+    for (int i = 0; i < n; i++) k += classify(i);
+    if (k != 100 * (5 + 7 + 11 + 7)) return 2;
+
+    int r = 0;
+    for (int i = 0; i < n; i++) r += rarely(i);
+    if (r != 399 + 799) return 3;
+
+    if (recurse(trips[2] * 6) != 2584) return 4;
+    return 0;
+}
@@ -0,0 +1,71 @@
+// values that have to survive calls (so they either sit in callee saved
+// registers or get spilled), more live values than there are registers and
+// loop carried values the coalescer wants to merge with their updates.
+static int trips[4] = { 0, 1, 10, 15 };
+
+// recursive so the inliner leaves them alone
+static int fib(int n) { return n < 2 ? n : fib(n - 1) + fib(n - 2); }
+
+static int helper(int a, int b) {
+    if (a <= 0) return b;
+    return helper(a - 1, b + a);
+}
+
+static double fhelper(double x, int n) {
+    if (n <= 0) return x;
+    return fhelper(x * 0.5 + 1.0, n - 1);
+}
+
+static int pressure(int seed) {
+    // all of these are live across the call in the middle
+    int a = seed + 1, b = seed * 3, c = seed ^ 5, d = seed - 7;
+    int e = seed * seed, f = seed << 2, g = seed | 9, h = seed & 12;
+    int i = a + b, j = c + d, k = e + f, l = g + h;
+    int m = a * d, n = b * c, o = e - h, p = f - g;
+
+    int r = helper(seed & 7, 1);
+
+    return a + b + c + d + e + f + g + h + i + j + k + l + m + n + o + p + r;
+}
+
+static double fpressure(double x) {
+    double a = x + 1.0, b = x * 2.0, c = x - 3.0, d = x * x;
+    double e = a * b, f = c * d, g = a + d, h = b - c;
+
+    double r = fhelper(x, 3);
+
+    return a + b + c + d + e + f + g + h + r;
+}
+
+static int swaps(int n) {
+    // loop carried values which trade places every iteration
+    int x = 1, y = 2, z = 3;
+    for (int i = 0; i < n; i++) {
+        int t = x;
+        x = y, y = z, z = t + helper(i & 3, 0);
+    }
+    return x * 100 + y * 10 + z;
+}
+
+int main(void) {
+    int s = 0;
+    for (int i = 0; i < trips[3]; i++) s += fib(i);
+    if (s != 986) return 1;
+
+    s = 0;
+    for (int i = 0; i < trips[2]; i++) {
+        s += helper(i, 0);
+        s += helper(i, 0);
+    }
+    if (s != 330) return 2;
+
+    int p = 0;
+    for (int i = 0; i < trips[2]; i++) p += pressure(i);
+    if (p != 2869) return 3;
+
+    double fp = fpressure(trips[2]);
+    if (fp != 1185.0) return 4;
+
+    if (swaps(trips[3]) != 1246) return 5;
+    return 0;
+}
@@ -0,0 +1,76 @@
+// branches over bodies of different sizes, some fit a rel8 and some are
+// just past it, shrinking one jump moves the targets of the others.
+static int trips[4] = { 0, 1, 3, 25 };
+static unsigned g[8];
+
+#define STEP(i)  g[(i) & 7] = g[(i) & 7] * 33u + (i)
+#define STEP4(i) STEP(i); STEP(i + 1); STEP(i + 2); STEP(i + 3)
+#define STEP16(i) STEP4(i); STEP4(i + 4); STEP4(i + 8); STEP4(i + 12)
+
+static unsigned sum(void) {
+    unsigned s = 0;
+    for (int i = 0; i < 8; i++) s = s * 31u + g[i];
+    return s;
+}
+
+static void reset(void) {
+    for (int i = 0; i < 8; i++) g[i] = i;
+}
+
+static unsigned small_loop(int n) {
+    reset();
+    for (int i = 0; i < n; i++) { STEP(1); STEP(2); }
+    return sum();
+}
+
+static unsigned mid_loop(int n) {
+    reset();
+    for (int i = 0; i < n; i++) { STEP4(0); STEP4(8); }
+    return sum();
+}
+
+static unsigned big_loop(int n) {
+    reset();
+    for (int i = 0; i < n; i++) { STEP16(0); STEP16(3); STEP16(5); }
+    return sum();
+}
+
+static unsigned nested(int n) {
+    // the inner loop's back edge is short, the outer one's isn't
+    reset();
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < n; j++) STEP(j);
+        if (i & 1) { STEP16(i); } else { STEP4(i); }
+        if (g[0] & 1) continue;
+        STEP16(7);
+    }
+    return sum();
+}
+
+static int chain(int x) {
+    // forward branches skipping over each other
+    if (x > 20) goto far;
+    if (x > 10) goto mid;
+    STEP4(x);
+    x += 1;
+    mid:
+    STEP16(x);
+    x += 2;
+    far:
+    STEP4(x);
+    return x + (int) (g[3] & 1);
+}
+
+int main(void) {
+    int n = trips[3];
+    if (small_loop(n) != 0xB3E637CBu) return 1;
+    if (mid_loop(n) != 0xCBC92728u) return 2;
+    if (big_loop(n) != 0x8C7EB1BCu) return 3;
+    if (small_loop(trips[0]) != 0x387C1804u) return 4;
+    if (nested(trips[2]) != 0x5EB87025u) return 5;
+
+    reset();
+    int x = chain(trips[1]) + chain(15) + chain(30);
+    if (x != 53 || sum() != 0x39706424u) return 6;
+    return 0;
+}
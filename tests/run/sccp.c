@@ -0,0 +1,50 @@
+// constants flowing through branches, phis and loops which SCCP should fold
+// away, along with the bits it can know about values it can't fold.
+static int table[4] = { 3, 1, 4, 1 };
+
+static int pick(int mode) {
+    int x;
+    if (mode == 2) {
+        x = 10;
+    } else if (mode > 100) {
+        x = 20;
+    } else {
+        x = 10;
+    }
+    return x;
+}
+
+static int loop_invariant(int n) {
+    // k never changes from 7 even though it's a loop phi
+    int k = 7, s = 0;
+    for (int i = 0; i < n; i++) {
+        if (k != 7) k = 99;
+        s += k;
+    }
+    return s;
+}
+
+static int known_bits(int v) {
+    // the low bit is always set and bit 1 is always clear
+    int x = (v << 2) | 1;
+    if ((x & 1) == 0) return -1;
+    if ((x & 2) != 0) return -2;
+    return (x >> 2) & 0xFF;
+}
+
+static int narrow(void) {
+    short w = 4;
+    short v = -w;
+    unsigned char b = 0x0F;
+    b = ~b;
+    return v == -4 && b == 0xF0 && (signed char) b == -16;
+}
+
+int main(void) {
+    if (pick(table[0]) != 10) return 1;
+    if (pick(200) != 20) return 2;
+    if (loop_invariant(table[2]) != 28) return 3;
+    if (known_bits(table[1] + 40) != 41) return 4;
+    if (!narrow()) return 5;
+    return 0;
+}
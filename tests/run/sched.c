@@ -0,0 +1,87 @@
+// blocks the list scheduler gets to reorder: independent chains of loads and
+// multiplies, loads which have to stay below stores through possibly aliasing
+// pointers, memory touched by calls and more loads in flight than registers.
+static int trips[4] = { 0, 1, 4, 256 };
+static int counter;
+
+static int dot4(const int* a, const int* b, int n) {
+    // four accumulators so the loads of one can cover the multiplies of another
+    int s0 = 0, s1 = 0, s2 = 0, s3 = 0;
+    for (int i = 0; i + 3 < n; i += 4) {
+        s0 += a[i + 0] * b[i + 0];
+        s1 += a[i + 1] * b[i + 1];
+        s2 += a[i + 2] * b[i + 2];
+        s3 += a[i + 3] * b[i + 3];
+    }
+    return s0 + s1 * 3 + s2 * 5 + s3 * 7;
+}
+
+static int store_then_load(int* p, int* q, int v) {
+    // p and q might be the same, the load of q can't go above the store
+    int a = *q;
+    *p = v;
+    int b = *q;
+    *p += a;
+    return a * 100 + b;
+}
+
+static void bump(int k) { counter += k; }
+
+static int across_calls(int k) {
+    // the loads of counter can't move past the calls which change it
+    int a = counter;
+    bump(k);
+    int b = counter;
+    bump(k * 2);
+    int c = counter;
+    return a + b * 10 + c * 100;
+}
+
+static int divides(int x, int y, int z) {
+    // a long latency divide next to a pile of cheap ops that don't need it
+    int q = x / y;
+    int r = z % y;
+    int t = (x ^ z) + (x << 3) - (z >> 1) + (x & z) + (x | 7);
+    return q * 1000 + r * 10 + t;
+}
+
+static int many_loads(const int* a) {
+    // 24 loads which could all be hoisted to the top of the block
+    int t = 0;
+    t += a[0] * a[1] + a[2] * a[3] + a[4] * a[5] + a[6] * a[7];
+    t ^= a[8] * a[9] + a[10] * a[11] + a[12] * a[13] + a[14] * a[15];
+    t += a[16] * a[17] - a[18] * a[19] + a[20] * a[21] - a[22] * a[23];
+    return t;
+}
+
+static int dead_loop(int a) {
+    // the loop is gone but its counter still feeds itself, that's not a dependency
+    if (0) {
+        for (int i = 0; i < a; i++) {}
+        bump(a);
+    }
+    return a;
+}
+
+int main(void) {
+    int n = trips[3];
+    int a[256], b[256];
+    for (int i = 0; i < n; i++) {
+        a[i] = i * 3 - 100;
+        b[i] = (i * 7) & 31;
+    }
+
+    if (dot4(a, b, n) != 4608896) return 1;
+
+    int x = 5, y = 9;
+    if (store_then_load(&x, &y, trips[2]) != 909 || x != 13) return 2;
+    if (store_then_load(&x, &x, trips[2]) != 1304 || x != 17) return 3;
+
+    counter = trips[1];
+    if (across_calls(trips[2]) != 1351 || counter != 13) return 4;
+
+    if (divides(n + 17, trips[2] + 3, n * 3 + 1) != 41924) return 5;
+    if (many_loads(&a[trips[2]]) != 30372) return 6;
+    if (dead_loop(trips[2]) != 4) return 7;
+    return 0;
+}
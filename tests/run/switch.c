@@ -0,0 +1,104 @@
+// multiway branches in the shapes each lowering picks up: dense keys for a
+// jump table, a few targets over a small range for bit tests, sparse keys
+// for the binary search, plus keys past either end of the table.
+static int trips[4] = { 0, 1, 9, 300 };
+
+static int dense(int k) {
+    switch (k) {
+        case 3:  return 30;
+        case 4:  return 41;
+        case 5:  return 52;
+        case 6:  return 63;
+        case 7:  return 74;
+        case 8:  return 85;
+        case 9:  return 96;
+        case 10: return 107;
+        case 12: return 129;
+        default: return -1;
+    }
+}
+
+static int classify(unsigned c) {
+    // vowels, digits and the rest, only three targets
+    switch (c) {
+        case 'a': case 'e': case 'i': case 'o': case 'u':
+        return 1;
+
+        case '0': case '1': case '2': case '3': case '4':
+        case '5': case '6': case '7': case '8': case '9':
+        return 2;
+
+        default:
+        return 0;
+    }
+}
+
+static int sparse(int k) {
+    switch (k) {
+        case -100000: return 1;
+        case -7:      return 2;
+        case 0:       return 3;
+        case 13:      return 4;
+        case 1000:    return 5;
+        case 4096:    return 6;
+        case 65537:   return 7;
+        case 1 << 30: return 8;
+        default:      return 0;
+    }
+}
+
+static int wide(long long k) {
+    switch (k) {
+        case 0x100000000ll:     return 1;
+        case 0x100000001ll:     return 2;
+        case 0x100000002ll:     return 3;
+        case 0x100000003ll:     return 4;
+        case 0x100000004ll:     return 5;
+        case -1ll:              return 6;
+        default:                return 0;
+    }
+}
+
+static unsigned char sdense(signed char k) {
+    // negative keys all the way down to the bottom of the type
+    switch (k) {
+        case -128: return 1;
+        case -127: return 2;
+        case -126: return 3;
+        case -125: return 4;
+        case -124: return 5;
+        case -123: return 6;
+        default:   return 7;
+    }
+}
+
+int main(void) {
+    int s = 0;
+    for (int k = -2; k < 16; k++) s += dense(k);
+    // 10 defaults, the rest sum up the cases
+    if (s != 30 + 41 + 52 + 63 + 74 + 85 + 96 + 107 + 129 - 9) return 1;
+    if (dense(trips[3]) != -1 || dense(-trips[3]) != -1 || dense(0x7fffffff) != -1) return 2;
+
+    const char* str = "hello 2024, quiet zoo";
+    int v = 0, d = 0;
+    for (const char* p = str; *p; p++) {
+        int c = classify((unsigned char) *p);
+        v += c == 1, d += c == 2;
+    }
+    if (v != 7 || d != 4) return 3;
+    if (classify(0xFFFFFFFFu) != 0 || classify('a' + 64) != 0) return 4;
+
+    int keys[] = { -100000, -7, 0, 13, 1000, 4096, 65537, 1 << 30, -8, 14, 999, 1 << 29, 0x7fffffff };
+    int want[] = { 1, 2, 3, 4, 5, 6, 7, 8, 0, 0, 0, 0, 0 };
+    for (int i = 0; i < 13; i++) {
+        if (sparse(keys[i]) != want[i]) return 5;
+    }
+
+    if (wide(0x100000000ll + trips[1]) != 2 || wide(trips[1]) != 0) return 6;
+    if (wide(-(long long) trips[1]) != 6 || wide(0x100000004ll) != 5 || wide(0x200000000ll) != 0) return 7;
+
+    int t = 0;
+    for (int k = -128; k < 128; k++) t += sdense((signed char) k);
+    if (t != 1 + 2 + 3 + 4 + 5 + 6 + 7 * 250) return 8;
+    return 0;
+}
@@ -0,0 +1,50 @@
+// calls in tail position: deep mutual recursion (shallow enough that -O0 gets
+// by without tail calls), sibling calls which shuffle their stack arguments
+// around and callees which need more argument space than their caller has.
+static int trips[4] = { 0, 1, 5, 100000 };
+
+static int is_odd(unsigned n);
+static int is_even(unsigned n) { return n == 0 ? 1 : is_odd(n - 1); }
+static int is_odd(unsigned n) { return n == 0 ? 0 : is_even(n - 1); }
+
+static unsigned count_down(unsigned n, unsigned acc) {
+    if (n == 0) return acc;
+    return count_down(n - 1, acc * 31 + n);
+}
+
+// the fifth and sixth arguments live on the stack, every step swaps them
+// with registers so the outgoing ones overwrite incoming ones still needed.
+static int rotate(int n, int a, int b, int c, int d, int e) {
+    if (n == 0) return a + b * 2 + c * 3 + d * 4 + e * 5;
+    return rotate(n - 1, e, a, b, c, d);
+}
+
+static int mix(int n, int a, double x, int b, double y, int c) {
+    if (n == 0) return (int) (x * 10.0 + y) + a + b + c;
+    return mix(n - 1, c + 1, y, a, x + 1.0, b);
+}
+
+static int wide(int a, int b, int c, int d, int e, int f, int g, int h) {
+    return a + b * 2 + c * 3 + d * 4 + e * 5 + f * 6 + g * 7 + h * 8;
+}
+
+// fewer incoming stack slots than wide() wants, so this can't reuse them
+static int narrow(int x) { return wide(x, x + 1, x + 2, x + 3, x + 4, x + 5, x + 6, x + 7); }
+
+static int twice(int x) { return x * 2; }
+static int thrice(int x) { return x * 3; }
+static int (*ops[2])(int) = { twice, thrice };
+
+static int apply(int which, int x) { return ops[which & 1](x + which); }
+
+int main(void) {
+    int n = trips[3];
+
+    if (!is_even(n) || is_odd(n) || !is_odd(n + 1)) return 1;
+    if (count_down(n, trips[1]) != 698615985u) return 2;
+    if (rotate(trips[2] * 3 + 1, 1, 2, 3, 4, 5) != 45) return 3;
+    if (mix(trips[2] * 2 + 1, 1, 0.5, 2, 0.25, 3) != 76) return 4;
+    if (narrow(trips[2]) != 348) return 5;
+    if (apply(trips[1], 10) + apply(trips[2] - 1, 10) != 61) return 6;
+    return 0;
+}
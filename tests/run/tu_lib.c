@@ -0,0 +1,17 @@
+// the other half of tu_main.c, everything public in here is only reachable
+// from there through extern declarations. scale() is static in both so the
+// two mustn't get mixed up.
+int counter = 5;
+const char greeting[] = "hello";
+
+static int scale(int x) { return x * 3; }
+
+int helper(int x) {
+    counter += x;
+    return scale(x);
+}
+
+int (*helper_ptr)(int) = helper;
+
+// calls back into the other TU
+int twice(int (*fn)(int), int x) { return fn(fn(x)); }
@@ -0,0 +1,23 @@
+// calls, data and function pointers which cross between two TUs in the same
+// module (this one and tu_lib.c), none of it should be looked up in the host.
+static int trips[4] = { 0, 1, 4, 10 };
+
+extern int counter;
+extern const char greeting[6];
+extern int (*helper_ptr)(int);
+
+int helper(int x);
+int twice(int (*fn)(int), int x);
+
+static int scale(int x) { return x * 7; }
+static int (*via)(int) = helper;
+
+int main(void) {
+    if (helper(trips[2]) != 12 || counter != 9) return 1;
+    if (helper_ptr(trips[1]) != 3 || counter != 10) return 2;
+    if (via(trips[3]) != 30 || counter != 20) return 3;
+    if (greeting[0] != 'h' || greeting[4] != 'o') return 4;
+    if (twice(scale, trips[2]) != 196) return 5;
+    if (twice(helper, trips[1]) != 9 || counter != 24) return 6;
+    return 0;
+}
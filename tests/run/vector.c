@@ -0,0 +1,92 @@
+// simple counted loops the vectorizer turns into 128-bit ones, the lengths
+// leave every kind of remainder for the scalar epilogue and a couple of
+// calls overlap their source and destination.
+typedef long long int64_t;
+
+static int lengths[9] = { 0, 1, 3, 4, 5, 15, 16, 17, 33 };
+
+static void fadd(float* a, const float* b, const float* c, int n) {
+    for (int i = 0; i < n; i++) a[i] = b[i] + c[i] * 2.0f;
+}
+
+static void dscale(double* a, double k, int n) {
+    for (int i = 0; i < n; i++) a[i] = a[i] * k;
+}
+
+static void iadd(int* a, const int* b, int k, int n) {
+    for (int i = 0; i < n; i++) a[i] = b[i] + k;
+}
+
+static void lxor(int64_t* a, const int64_t* b, int n) {
+    for (int i = 0; i < n; i++) a[i] = a[i] ^ b[i];
+}
+
+static void badd(unsigned char* a, const unsigned char* b, int n) {
+    for (int i = 0; i < n; i++) a[i] = a[i] + b[i] + 3;
+}
+
+static void smul(short* a, const short* b, short k, int n) {
+    for (int i = 0; i < n; i++) a[i] = b[i] * k - a[i];
+}
+
+static int run(int n) {
+    float fa[40], fb[40], fc[40];
+    double da[40];
+    int ia[41], ib[41];
+    int64_t la[40], lb[40];
+    unsigned char ba[40], bb[40];
+    short sa[40], sb[40];
+    for (int i = 0; i < 40; i++) {
+        fa[i] = -1.0f, fb[i] = i * 0.5f, fc[i] = i;
+        da[i] = i + 0.25;
+        ia[i] = -1, ib[i] = i * 7;
+        la[i] = i * 3, lb[i] = 0x1234567890ll * i;
+        ba[i] = i * 5, bb[i] = 250 - i;
+        sa[i] = i * 11, sb[i] = 100 - i * 9;
+    }
+    ia[40] = ib[40] = -1;
+
+    fadd(fa, fb, fc, n);
+    dscale(da, 1.5, n);
+    iadd(ia, ib, -3, n);
+    lxor(la, lb, n);
+    badd(ba, bb, n);
+    smul(sa, sb, 7, n);
+
+    // everything past n stays untouched
+    for (int i = 0; i < 40; i++) {
+        if (i < n) {
+            if (fa[i] != i * 2.5f) return 1;
+            if (da[i] != (i + 0.25) * 1.5) return 2;
+            if (ia[i] != i * 7 - 3) return 3;
+            if (la[i] != ((i * 3) ^ (0x1234567890ll * i))) return 4;
+            if (ba[i] != (unsigned char) (i * 4 + 253)) return 5;
+            if (sa[i] != (short) ((100 - i * 9) * 7 - i * 11)) return 6;
+        } else {
+            if (fa[i] != -1.0f || da[i] != i + 0.25 || ia[i] != -1) return 1;
+            if (la[i] != i * 3 || ba[i] != (unsigned char) (i * 5) || sa[i] != i * 11) return 4;
+        }
+    }
+
+    // the store runs one ahead of the load, this has to stay scalar
+    iadd(ib + 1, ib, 1, n);
+    for (int i = 0; i <= n; i++) {
+        if (ib[i] != i) return 7;
+    }
+
+    // one behind is fine to vectorize
+    for (int i = 0; i < 40; i++) ia[i] = i;
+    iadd(ia, ia + 1, 10, n);
+    for (int i = 0; i < n; i++) {
+        if (ia[i] != i + 11) return 8;
+    }
+    return 0;
+}
+
+int main(void) {
+    for (int i = 0; i < 9; i++) {
+        int r = run(lengths[i]);
+        if (r) return r * 10 + i;
+    }
+    return 0;
+}